@@ -82,6 +82,15 @@ const uint16_t COM_RX_AF[COMn] = {DISCOVERY_COM1_RX_AF};
 I2C_HandleTypeDef hI2cHandler;
 UART_HandleTypeDef hDiscoUart;
 
+static DMA_HandleTypeDef hI2cDmaRx;
+static DMA_HandleTypeDef hI2cDmaTx;
+
+/* Sensor bus queue: SensorIoQueue[SensorIoHead] is on the bus while SensorIoBusy */
+static SENSOR_IO_TransactionTypeDef *SensorIoQueue[SENSOR_IO_QUEUE_SIZE];
+static volatile uint32_t SensorIoHead = 0;
+static volatile uint32_t SensorIoCount = 0;
+static volatile uint32_t SensorIoBusy = 0;
+
 /**
   * @}
   */
@@ -96,6 +105,10 @@ static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8
 static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddSize, uint8_t *Buffer, uint16_t Length);
 static HAL_StatusTypeDef I2Cx_IsDeviceReady(I2C_HandleTypeDef *i2c_handler, uint16_t DevAddress, uint32_t Trials);
 static void              I2Cx_Error(I2C_HandleTypeDef *i2c_handler, uint8_t Addr);
+static HAL_StatusTypeDef I2Cx_WaitIdle(void);
+static void              I2Cx_Flush(void);
+static void              I2Cx_StartNext(void);
+static void              I2Cx_Complete(HAL_StatusTypeDef Status);
 
 /* Sensors IO functions */
 void     SENSOR_IO_Init(void);
@@ -106,6 +119,7 @@ uint16_t SENSOR_IO_ReadMultiple(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint
 void     SENSOR_IO_WriteMultiple(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
 HAL_StatusTypeDef SENSOR_IO_IsDeviceReady(uint16_t DevAddress, uint32_t Trials);
 void     SENSOR_IO_Delay(uint32_t Delay);
+void     LSM6DSL_IO_ITConfig(uint8_t Enable);
 
 void     NFC_IO_Init(uint8_t GpoIrqEnable);
 void     NFC_IO_DeInit(void);
@@ -386,6 +400,36 @@ static void I2Cx_MspInit(I2C_HandleTypeDef *i2c_handler)
   /* Enable and set I2Cx Interrupt to a lower priority */
   HAL_NVIC_SetPriority(DISCOVERY_I2Cx_ER_IRQn, 0x0F, 0);
   HAL_NVIC_EnableIRQ(DISCOVERY_I2Cx_ER_IRQn);
+
+  /*** Configure the DMA used by SENSOR_IO_Submit() ***/
+  /* Enable DMA clock */
+  DISCOVERY_DMAx_CLK_ENABLE();
+
+  hI2cDmaRx.Instance                 = DISCOVERY_I2Cx_DMA_RX_CHANNEL;
+  hI2cDmaRx.Init.Request             = DISCOVERY_I2Cx_DMA_REQUEST;
+  hI2cDmaRx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  hI2cDmaRx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hI2cDmaRx.Init.MemInc              = DMA_MINC_ENABLE;
+  hI2cDmaRx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hI2cDmaRx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hI2cDmaRx.Init.Mode                = DMA_NORMAL;
+  hI2cDmaRx.Init.Priority            = DMA_PRIORITY_LOW;
+  HAL_DMA_DeInit(&hI2cDmaRx);
+  HAL_DMA_Init(&hI2cDmaRx);
+  __HAL_LINKDMA(i2c_handler, hdmarx, hI2cDmaRx);
+
+  hI2cDmaTx.Instance                 = DISCOVERY_I2Cx_DMA_TX_CHANNEL;
+  hI2cDmaTx.Init                     = hI2cDmaRx.Init;
+  hI2cDmaTx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  HAL_DMA_DeInit(&hI2cDmaTx);
+  HAL_DMA_Init(&hI2cDmaTx);
+  __HAL_LINKDMA(i2c_handler, hdmatx, hI2cDmaTx);
+
+  /* Same priority as the I2C interrupts, so that queue handling does not nest */
+  HAL_NVIC_SetPriority(DISCOVERY_I2Cx_DMA_RX_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(DISCOVERY_I2Cx_DMA_RX_IRQn);
+  HAL_NVIC_SetPriority(DISCOVERY_I2Cx_DMA_TX_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(DISCOVERY_I2Cx_DMA_TX_IRQn);
 }
 
 /**
@@ -457,6 +501,12 @@ static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8
 {
   HAL_StatusTypeDef status = HAL_OK;
 
+  status = I2Cx_WaitIdle();
+  if(status != HAL_OK)
+  {
+    /* The queue was flushed and the bus re-initialized already */
+    return status;
+  }
   status = HAL_I2C_Mem_Read(i2c_handler, Addr, (uint16_t)Reg, MemAddress, Buffer, Length, 1000);
 
   /* Check the communication status */
@@ -483,6 +533,12 @@ static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint
 {
   HAL_StatusTypeDef status = HAL_OK;
 
+  status = I2Cx_WaitIdle();
+  if(status != HAL_OK)
+  {
+    /* The queue was flushed and the bus re-initialized already */
+    return status;
+  }
   status = HAL_I2C_Mem_Write(i2c_handler, Addr, (uint16_t)Reg, MemAddress, Buffer, Length, 1000);
 
   /* Check the communication status */
@@ -504,6 +560,10 @@ static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint
   */
 static HAL_StatusTypeDef I2Cx_IsDeviceReady(I2C_HandleTypeDef *i2c_handler, uint16_t DevAddress, uint32_t Trials)
 { 
+  if(I2Cx_WaitIdle() != HAL_OK)
+  {
+    return HAL_TIMEOUT;
+  }
   return (HAL_I2C_IsDeviceReady(i2c_handler, DevAddress, Trials, 1000));
 }
 
@@ -522,6 +582,194 @@ static void I2Cx_Error(I2C_HandleTypeDef *i2c_handler, uint8_t Addr)
   I2Cx_Init(i2c_handler);
 }
 
+/**
+  * @brief  Waits until the queued sensor bus transactions are done.
+  * @note   The blocking functions would otherwise find the bus busy. They
+  *         must not be called from a transaction callback. A queue that
+  *         does not drain in 1 s lost the completion of its transfer: it
+  *         is flushed, as a blocking transfer would only find the bus busy.
+  * @retval HAL_OK, or HAL_TIMEOUT if the queue had to be flushed
+  */
+static HAL_StatusTypeDef I2Cx_WaitIdle(void)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while((SensorIoCount != 0) && ((HAL_GetTick() - tickstart) < 1000))
+  {
+  }
+  if(SensorIoCount == 0)
+  {
+    return HAL_OK;
+  }
+  I2Cx_Flush();
+  return HAL_TIMEOUT;
+}
+
+/**
+  * @brief  Stops the transfer on the bus, empties the queue, reporting each
+  *         transaction with HAL_TIMEOUT, and re-initializes I2C2.
+  * @retval None
+  */
+static void I2Cx_Flush(void)
+{
+  SENSOR_IO_TransactionTypeDef *flushed[SENSOR_IO_QUEUE_SIZE];
+  uint32_t primask = __get_PRIMASK();
+  uint32_t count, i;
+
+  __disable_irq();
+  HAL_DMA_Abort(&hI2cDmaRx);
+  HAL_DMA_Abort(&hI2cDmaTx);
+  HAL_I2C_DeInit(&hI2cHandler);
+  HAL_NVIC_ClearPendingIRQ(DISCOVERY_I2Cx_EV_IRQn);
+  HAL_NVIC_ClearPendingIRQ(DISCOVERY_I2Cx_ER_IRQn);
+  HAL_NVIC_ClearPendingIRQ(DISCOVERY_I2Cx_DMA_RX_IRQn);
+  HAL_NVIC_ClearPendingIRQ(DISCOVERY_I2Cx_DMA_TX_IRQn);
+
+  count = SensorIoCount;
+  for(i = 0; i < count; i++)
+  {
+    flushed[i] = SensorIoQueue[(SensorIoHead + i) % SENSOR_IO_QUEUE_SIZE];
+  }
+  SensorIoHead = 0;
+  SensorIoCount = 0;
+  SensorIoBusy = 0;
+  I2Cx_Init(&hI2cHandler);
+
+  /* Reported as from the interrupts; a callback may submit again */
+  for(i = 0; i < count; i++)
+  {
+    if(flushed[i]->Callback != NULL)
+    {
+      flushed[i]->Callback(flushed[i], HAL_TIMEOUT);
+    }
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Starts the transaction at the head of the sensor bus queue.
+  * @note   Called with interrupts masked or from the I2C/DMA interrupts.
+  * @retval None
+  */
+static void I2Cx_StartNext(void)
+{
+  SENSOR_IO_TransactionTypeDef *transaction;
+  HAL_StatusTypeDef status;
+
+  while((SensorIoBusy == 0) && (SensorIoCount != 0))
+  {
+    transaction = SensorIoQueue[SensorIoHead];
+
+    if(transaction->Direction == SENSOR_IO_READ)
+    {
+      if(transaction->Length >= SENSOR_IO_DMA_THRESHOLD)
+      {
+        status = HAL_I2C_Mem_Read_DMA(&hI2cHandler, transaction->Addr, transaction->Reg, I2C_MEMADD_SIZE_8BIT, transaction->Buffer, transaction->Length);
+      }
+      else
+      {
+        status = HAL_I2C_Mem_Read_IT(&hI2cHandler, transaction->Addr, transaction->Reg, I2C_MEMADD_SIZE_8BIT, transaction->Buffer, transaction->Length);
+      }
+    }
+    else
+    {
+      if(transaction->Length >= SENSOR_IO_DMA_THRESHOLD)
+      {
+        status = HAL_I2C_Mem_Write_DMA(&hI2cHandler, transaction->Addr, transaction->Reg, I2C_MEMADD_SIZE_8BIT, transaction->Buffer, transaction->Length);
+      }
+      else
+      {
+        status = HAL_I2C_Mem_Write_IT(&hI2cHandler, transaction->Addr, transaction->Reg, I2C_MEMADD_SIZE_8BIT, transaction->Buffer, transaction->Length);
+      }
+    }
+
+    if(status == HAL_OK)
+    {
+      SensorIoBusy = 1;
+    }
+    else
+    {
+      /* Not started (bus not ready): report it and go on with the next one */
+      SensorIoBusy = 1;
+      I2Cx_Complete(status);
+    }
+  }
+}
+
+/**
+  * @brief  Ends the transaction on the bus, starts the next one and reports.
+  * @param  Status  Transfer status
+  * @retval None
+  */
+static void I2Cx_Complete(HAL_StatusTypeDef Status)
+{
+  SENSOR_IO_TransactionTypeDef *transaction;
+
+  if(SensorIoBusy == 0)
+  {
+    return;
+  }
+
+  transaction = SensorIoQueue[SensorIoHead];
+  SensorIoHead = (SensorIoHead + 1) % SENSOR_IO_QUEUE_SIZE;
+  SensorIoCount--;
+  SensorIoBusy = 0;
+
+  if(Status == HAL_ERROR)
+  {
+    /* Re-Initialize the I2C communication bus */
+    HAL_I2C_DeInit(&hI2cHandler);
+    I2Cx_Init(&hI2cHandler);
+  }
+
+  /* Keep the bus going before the callback */
+  I2Cx_StartNext();
+
+  if(transaction->Callback != NULL)
+  {
+    transaction->Callback(transaction, Status);
+  }
+}
+
+/**
+  * @brief  Memory Rx transfer completed callback.
+  * @param  hi2c  I2C handler
+  * @retval None
+  */
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  if(hi2c == &hI2cHandler)
+  {
+    I2Cx_Complete(HAL_OK);
+  }
+}
+
+/**
+  * @brief  Memory Tx transfer completed callback.
+  * @param  hi2c  I2C handler
+  * @retval None
+  */
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  if(hi2c == &hI2cHandler)
+  {
+    I2Cx_Complete(HAL_OK);
+  }
+}
+
+/**
+  * @brief  I2C error callback: NACK, bus error or arbitration loss.
+  * @param  hi2c  I2C handler
+  * @retval None
+  */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+  if(hi2c == &hI2cHandler)
+  {
+    I2Cx_Complete(HAL_ERROR);
+  }
+}
+
 /**
   * @}
   */
@@ -537,6 +785,7 @@ static void I2Cx_Error(I2C_HandleTypeDef *i2c_handler, uint8_t Addr)
   */
 void SENSOR_IO_Init(void)
 {
+  I2Cx_WaitIdle();
   I2Cx_Init(&hI2cHandler);
 }
 
@@ -546,6 +795,7 @@ void SENSOR_IO_Init(void)
   */
 void SENSOR_IO_DeInit(void)
 {
+  I2Cx_WaitIdle();
   I2Cx_DeInit(&hI2cHandler);
 }
 
@@ -616,6 +866,48 @@ HAL_StatusTypeDef SENSOR_IO_IsDeviceReady(uint16_t DevAddress, uint32_t Trials)
   return (I2Cx_IsDeviceReady(&hI2cHandler, DevAddress, Trials));
 }
 
+/**
+  * @brief  Queues a transaction on the sensor bus and returns at once.
+  * @param  Transaction  Transaction to run; it is not copied and must stay
+  *                      valid, with its buffer, until its callback
+  * @note   Transfers of SENSOR_IO_DMA_THRESHOLD bytes or more use the DMA,
+  *         shorter ones the I2C interrupts. The callback runs in interrupt
+  *         context; it may submit transactions but not use the blocking
+  *         SENSOR_IO functions, which wait for the queue to drain. They
+  *         give up after 1 s and report what is left with HAL_TIMEOUT.
+  * @retval HAL_OK, or HAL_BUSY if the queue is full
+  */
+HAL_StatusTypeDef SENSOR_IO_Submit(SENSOR_IO_TransactionTypeDef *Transaction)
+{
+  HAL_StatusTypeDef status = HAL_OK;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if(SensorIoCount == SENSOR_IO_QUEUE_SIZE)
+  {
+    status = HAL_BUSY;
+  }
+  else
+  {
+    SensorIoQueue[(SensorIoHead + SensorIoCount) % SENSOR_IO_QUEUE_SIZE] = Transaction;
+    SensorIoCount++;
+    I2Cx_StartNext();
+  }
+  __set_PRIMASK(primask);
+
+  return status;
+}
+
+/**
+  * @brief  Tells whether queued sensor bus transactions are pending.
+  * @note   I2C2 stops in Stop 2: do not enter it while the bus is busy.
+  * @retval 1 if the queue is empty, 0 otherwise
+  */
+uint32_t SENSOR_IO_IsIdle(void)
+{
+  return (SensorIoCount == 0) ? 1 : 0;
+}
+
 /**
   * @brief  Delay function used in Sensor low level driver.
   * @param  Delay  Delay in ms
@@ -626,6 +918,38 @@ void SENSOR_IO_Delay(uint32_t Delay)
   HAL_Delay(Delay);
 }
 
+/**
+  * @brief  Configures the LSM6DSL INT1 line (PD11).
+  * @param  Enable  0x0 is a plain input, otherwise a rising edge interrupt
+  * @note   EXTI15_10_IRQn is left enabled on disable: the user button uses it too.
+  * @retval None
+  */
+void LSM6DSL_IO_ITConfig(uint8_t Enable)
+{
+  GPIO_InitTypeDef GPIO_InitStruct;
+
+  LSM6DSL_INT1_EXTI11_GPIO_CLK_ENABLE();
+
+  GPIO_InitStruct.Pin = LSM6DSL_INT1_EXTI11_PIN;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  if(Enable == 0)
+  {
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    HAL_GPIO_Init(LSM6DSL_INT1_EXTI11_GPIO_PORT, &GPIO_InitStruct);
+  }
+  else
+  {
+    /* INT1 is push-pull, active high by default (CTRL3_C) */
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
+    HAL_GPIO_Init(LSM6DSL_INT1_EXTI11_GPIO_PORT, &GPIO_InitStruct);
+
+    /* Enable and set EXTI15_10_IRQn Interrupt to the lowest priority */
+    HAL_NVIC_SetPriority(LSM6DSL_INT1_EXTI11_EXTI_IRQn, 0x0F, 0x00);
+    HAL_NVIC_EnableIRQ(LSM6DSL_INT1_EXTI11_EXTI_IRQn);
+  }
+}
+
 /******************************** LINK NFC ********************************/
 
 /**
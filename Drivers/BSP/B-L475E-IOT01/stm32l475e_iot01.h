@@ -65,6 +65,20 @@ typedef enum
   COM1 = 0,
   COM2 = 0,
 }COM_TypeDef;
+
+/**
+  * @brief  Sensor bus transaction, queued with SENSOR_IO_Submit()
+  */
+typedef struct SENSOR_IO_Transaction
+{
+  uint8_t  Addr;        /*!< I2C address */
+  uint8_t  Reg;         /*!< Register address, with the auto-increment bit the device may need */
+  uint8_t  Direction;   /*!< SENSOR_IO_READ or SENSOR_IO_WRITE */
+  uint8_t *Buffer;      /*!< Data in SRAM, valid until the callback */
+  uint16_t Length;
+  void   (*Callback)(struct SENSOR_IO_Transaction *Transaction, HAL_StatusTypeDef Status); /*!< Interrupt context, may be NULL */
+  void    *Context;     /*!< Free for the caller */
+}SENSOR_IO_TransactionTypeDef;
 /**
   * @}
   */ 
@@ -105,6 +119,14 @@ typedef enum
 #define USER_BUTTON_GPIO_CLK_DISABLE()    __HAL_RCC_GPIOC_CLK_DISABLE()
 #define USER_BUTTON_EXTI_IRQn             EXTI15_10_IRQn
 
+/**
+  * @brief  LSM6DSL INT1 (FIFO threshold), shares EXTI15_10 with the user button
+  */
+#define LSM6DSL_INT1_EXTI11_PIN               GPIO_PIN_11
+#define LSM6DSL_INT1_EXTI11_GPIO_PORT         GPIOD
+#define LSM6DSL_INT1_EXTI11_GPIO_CLK_ENABLE() __HAL_RCC_GPIOD_CLK_ENABLE()
+#define LSM6DSL_INT1_EXTI11_EXTI_IRQn         EXTI15_10_IRQn
+
 /**
   * @brief  NFC Gpio PINs
   */
@@ -172,6 +194,24 @@ typedef enum
 #define DISCOVERY_I2Cx_EV_IRQn                     I2C2_EV_IRQn
 #define DISCOVERY_I2Cx_ER_IRQn                     I2C2_ER_IRQn
 
+/* Definition for I2Cx DMA: I2C2_TX on DMA1 Channel 4, I2C2_RX on DMA1 Channel 5 */
+#define DISCOVERY_I2Cx_DMA_TX_CHANNEL              DMA1_Channel4
+#define DISCOVERY_I2Cx_DMA_RX_CHANNEL              DMA1_Channel5
+#define DISCOVERY_I2Cx_DMA_REQUEST                 DMA_REQUEST_3
+#define DISCOVERY_I2Cx_DMA_TX_IRQn                 DMA1_Channel4_IRQn
+#define DISCOVERY_I2Cx_DMA_RX_IRQn                 DMA1_Channel5_IRQn
+
+/* Sensor bus transaction queue */
+#define SENSOR_IO_READ                             ((uint8_t)0)
+#define SENSOR_IO_WRITE                            ((uint8_t)1)
+#ifndef SENSOR_IO_QUEUE_SIZE
+ #define SENSOR_IO_QUEUE_SIZE                      8
+#endif
+/* Shorter transfers use the I2C interrupts only: setting up the DMA costs more */
+#ifndef SENSOR_IO_DMA_THRESHOLD
+ #define SENSOR_IO_DMA_THRESHOLD                   4
+#endif
+
 /* I2C clock speed configuration (in Hz)
   WARNING:
    Make sure that this define is not already declared in other files.
@@ -232,6 +272,8 @@ void             BSP_PB_DeInit(Button_TypeDef Button);
 uint32_t         BSP_PB_GetState(Button_TypeDef Button);
 void             BSP_COM_Init(COM_TypeDef COM, UART_HandleTypeDef *husart);
 void             BSP_COM_DeInit(COM_TypeDef COM, UART_HandleTypeDef *huart);
+HAL_StatusTypeDef SENSOR_IO_Submit(SENSOR_IO_TransactionTypeDef *Transaction);
+uint32_t         SENSOR_IO_IsIdle(void);
 /**
   * @}
   */
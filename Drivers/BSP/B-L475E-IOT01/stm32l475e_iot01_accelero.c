@@ -131,6 +131,76 @@ void BSP_ACCELERO_AccGetXYZ(int16_t *pDataXYZ)
     }
   }
 }
+
+/**
+  * @brief  Start batch acquisition of the accelerometer in the LSM6DSL FIFO.
+  * @param  Odr  Sample rate, LSM6DSL_ODR_13Hz to LSM6DSL_ODR_6660Hz
+  * @param  Watermark  Samples stored before LSM6DSL_INT1_EXTI11_PIN rises
+  * @note   Call BSP_ACCELERO_Init() first. The application handles the
+  *         EXTI15_10 interrupt and drains the FIFO with BSP_ACCELERO_FIFO_GetXYZ().
+  * @retval ACCELERO_OK or ACCELERO_ERROR
+  */
+ACCELERO_StatusTypeDef BSP_ACCELERO_FIFO_Init(uint8_t Odr, uint16_t Watermark)
+{
+  ACCELERO_StatusTypeDef ret = ACCELERO_OK;
+
+  if(AccelerometerDrv != &Lsm6dslAccDrv)
+  {
+    ret = ACCELERO_ERROR;
+  }
+  else
+  {
+    LSM6DSL_FifoInit(LSM6DSL_FIFO_ACC, Odr, Watermark);
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  Stop the accelerometer batch acquisition; the sensor keeps its ODR.
+  * @retval None
+  */
+void BSP_ACCELERO_FIFO_DeInit(void)
+{
+  if(AccelerometerDrv == &Lsm6dslAccDrv)
+  {
+    LSM6DSL_FifoDeInit();
+  }
+}
+
+/**
+  * @brief  Get the number of samples waiting in the FIFO.
+  * @param  pStatus  If not NULL, receives the LSM6DSL_FIFO_STATUS_xxx flags
+  *                  (LSM6DSL_FIFO_STATUS_OVER_RUN: samples were lost)
+  * @retval Samples ready
+  */
+uint16_t BSP_ACCELERO_FIFO_GetLevel(uint8_t *pStatus)
+{
+  uint16_t samples = 0;
+
+  if(AccelerometerDrv == &Lsm6dslAccDrv)
+  {
+    samples = LSM6DSL_FifoGetLevel(pStatus);
+  }
+  return samples;
+}
+
+/**
+  * @brief  Read the samples stored in the FIFO with one burst I2C transfer.
+  * @param  pDataXYZ  Pointer on MaxSamples acceleration triplets (X, Y, Z in mg)
+  * @param  MaxSamples  Room in pDataXYZ, in samples
+  * @retval Samples read
+  */
+uint16_t BSP_ACCELERO_FIFO_GetXYZ(int16_t *pDataXYZ, uint16_t MaxSamples)
+{
+  uint16_t samples = 0;
+
+  if(AccelerometerDrv == &Lsm6dslAccDrv)
+  {
+    samples = LSM6DSL_FifoReadXYZ(pDataXYZ, NULL, MaxSamples);
+  }
+  return samples;
+}
 /**
   * @}
   */
@@ -64,6 +64,11 @@ ACCELERO_StatusTypeDef BSP_ACCELERO_Init(void);
 void BSP_ACCELERO_DeInit(void);
 void BSP_ACCELERO_LowPower(uint16_t status); /* 0 Means Disable Low Power Mode, otherwise Low Power Mode is enabled */
 void BSP_ACCELERO_AccGetXYZ(int16_t *pDataXYZ);
+/* FIFO batch acquisition, watermark interrupt on LSM6DSL_INT1_EXTI11_PIN */
+ACCELERO_StatusTypeDef BSP_ACCELERO_FIFO_Init(uint8_t Odr, uint16_t Watermark);
+void BSP_ACCELERO_FIFO_DeInit(void);
+uint16_t BSP_ACCELERO_FIFO_GetLevel(uint8_t *pStatus);
+uint16_t BSP_ACCELERO_FIFO_GetXYZ(int16_t *pDataXYZ, uint16_t MaxSamples);
 /**
   * @}
   */
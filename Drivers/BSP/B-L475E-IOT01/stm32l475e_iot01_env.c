@@ -0,0 +1,182 @@
+/**
+  ******************************************************************************
+  * @file    stm32l475e_iot01_env.c
+  * @brief   This file provides a set of functions needed to read the
+  *          environmental sensors (HTS221, LPS22HB) in one batch
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32l475e_iot01_env.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM32L475E_IOT01
+  * @{
+  */
+
+/** @defgroup STM32L475E_IOT01_ENV ENV
+  * @{
+  */
+
+/** @defgroup STM32L475E_IOT01_ENV_Private_Variables ENV Private Variables
+  * @{
+  */
+static HTS221_CalibTypeDef EnvCalib;
+static uint8_t EnvInitialized = 0;
+
+/* HUMIDITY_OUT_L to TEMP_OUT_H, and PRESS_OUT_XL to PRESS_OUT_H */
+static uint8_t EnvHts221Raw[4];
+static uint8_t EnvLps22hbRaw[3];
+static SENSOR_IO_TransactionTypeDef EnvTransaction[2];
+
+static ENV_DataTypeDef EnvData;
+static ENV_CallbackTypeDef EnvCallback;
+static volatile uint32_t EnvPending = 0;
+static volatile ENV_StatusTypeDef EnvStatus = ENV_OK;
+/**
+  * @}
+  */
+
+/** @defgroup STM32L475E_IOT01_ENV_Private_Functions ENV Private Functions
+  * @{
+  */
+static void ENV_TransactionCallback(SENSOR_IO_TransactionTypeDef *Transaction, HAL_StatusTypeDef Status);
+
+/**
+  * @brief  Initializes the HTS221 and LPS22HB and reads the HTS221 calibration.
+  * @note   Blocking; the readings are then done with BSP_ENV_Read_IT().
+  * @retval ENV_OK or ENV_ERROR
+  */
+ENV_StatusTypeDef BSP_ENV_Init(void)
+{
+  ENV_StatusTypeDef ret = ENV_OK;
+
+  if((HTS221_H_Drv.ReadID(HTS221_I2C_ADDRESS) != HTS221_WHO_AM_I_VAL) ||
+     (LPS22HB_P_Drv.ReadID(LPS22HB_I2C_ADDRESS) != LPS22HB_WHO_AM_I_VAL))
+  {
+    ret = ENV_ERROR;
+  }
+  else
+  {
+    HTS221_H_Drv.Init(HTS221_I2C_ADDRESS);
+    LPS22HB_P_Drv.Init(LPS22HB_I2C_ADDRESS);
+
+    /* Read once here instead of with every sample, as HTS221_T_ReadTemp() does */
+    HTS221_ReadCalibration(HTS221_I2C_ADDRESS, &EnvCalib);
+
+    EnvTransaction[0].Addr = HTS221_I2C_ADDRESS;
+    EnvTransaction[0].Reg = HTS221_HR_OUT_L_REG | 0x80;
+    EnvTransaction[0].Direction = SENSOR_IO_READ;
+    EnvTransaction[0].Buffer = EnvHts221Raw;
+    EnvTransaction[0].Length = sizeof(EnvHts221Raw);
+    EnvTransaction[0].Callback = ENV_TransactionCallback;
+    EnvTransaction[0].Context = NULL;
+
+    EnvTransaction[1].Addr = LPS22HB_I2C_ADDRESS;
+    EnvTransaction[1].Reg = LPS22HB_PRESS_OUT_XL_REG;
+    EnvTransaction[1].Direction = SENSOR_IO_READ;
+    EnvTransaction[1].Buffer = EnvLps22hbRaw;
+    EnvTransaction[1].Length = sizeof(EnvLps22hbRaw);
+    EnvTransaction[1].Callback = ENV_TransactionCallback;
+    EnvTransaction[1].Context = NULL;
+
+    EnvInitialized = 1;
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  Starts a reading of temperature, humidity and pressure.
+  * @param  Callback  Called from interrupt context with the converted values
+  *                   once both sensors have been read
+  * @note   Queues one burst read per sensor on the sensor bus and returns at
+  *         once; the CPU is free while the I2C transfers run.
+  * @retval ENV_OK, ENV_BUSY if a reading is in progress or the sensor bus
+  *         queue is full, ENV_ERROR if BSP_ENV_Init() did not succeed
+  */
+ENV_StatusTypeDef BSP_ENV_Read_IT(ENV_CallbackTypeDef Callback)
+{
+  uint32_t primask;
+
+  if(EnvInitialized == 0)
+  {
+    return ENV_ERROR;
+  }
+  if(EnvPending != 0)
+  {
+    return ENV_BUSY;
+  }
+
+  EnvCallback = Callback;
+  EnvStatus = ENV_OK;
+  EnvPending = 2;
+
+  if(SENSOR_IO_Submit(&EnvTransaction[0]) != HAL_OK)
+  {
+    EnvPending = 0;
+    return ENV_BUSY;
+  }
+  if(SENSOR_IO_Submit(&EnvTransaction[1]) != HAL_OK)
+  {
+    /* The HTS221 read is already queued: it reports the failure */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    ENV_TransactionCallback(&EnvTransaction[1], HAL_BUSY);
+    __set_PRIMASK(primask);
+  }
+
+  return ENV_OK;
+}
+
+/**
+  * @brief  Sensor bus completion of one of the two reads.
+  * @param  Transaction  Completed transaction
+  * @param  Status  Transfer status
+  * @retval None
+  */
+static void ENV_TransactionCallback(SENSOR_IO_TransactionTypeDef *Transaction, HAL_StatusTypeDef Status)
+{
+  int16_t raw;
+
+  if(Status != HAL_OK)
+  {
+    EnvStatus = ENV_ERROR;
+  }
+
+  if(--EnvPending == 0)
+  {
+    if(EnvStatus == ENV_OK)
+    {
+      raw = (int16_t)((((uint16_t)EnvHts221Raw[1]) << 8) | (uint16_t)EnvHts221Raw[0]);
+      EnvData.Humidity = HTS221_H_Convert(&EnvCalib, raw);
+      raw = (int16_t)((((uint16_t)EnvHts221Raw[3]) << 8) | (uint16_t)EnvHts221Raw[2]);
+      EnvData.Temperature = HTS221_T_Convert(&EnvCalib, raw);
+      EnvData.Pressure = LPS22HB_P_Convert(EnvLps22hbRaw);
+    }
+
+    if(EnvCallback != NULL)
+    {
+      EnvCallback(&EnvData, EnvStatus);
+    }
+  }
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -0,0 +1,95 @@
+/**
+  ******************************************************************************
+  * @file    stm32l475e_iot01_env.h
+  * @brief   This file provides a set of functions needed to read the
+  *          environmental sensors (HTS221, LPS22HB) in one batch
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32L475E_IOT01_ENV_H
+#define __STM32L475E_IOT01_ENV_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32l475e_iot01.h"
+#include "../Components/hts221/hts221.h"
+#include "../Components/lps22hb/lps22hb.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM32L475E_IOT01
+  * @{
+  */
+
+/** @addtogroup STM32L475E_IOT01_ENV
+  * @{
+  */
+
+/* Exported types ------------------------------------------------------------*/
+/** @defgroup STM32L475E_IOT01_ENV_Exported_Types ENV Exported Types
+  * @{
+  */
+
+/**
+  * @brief  ENV Status
+  */
+typedef enum
+{
+  ENV_OK = 0,
+  ENV_ERROR = 1,
+  ENV_BUSY = 2
+}ENV_StatusTypeDef;
+
+/**
+  * @brief  One reading of the environmental sensors
+  */
+typedef struct
+{
+  float Temperature;    /*!< HTS221, degC */
+  float Humidity;       /*!< HTS221, %rH */
+  float Pressure;       /*!< LPS22HB, hPa */
+}ENV_DataTypeDef;
+
+/**
+  * @brief  Reading completion callback, called from interrupt context
+  */
+typedef void (*ENV_CallbackTypeDef)(const ENV_DataTypeDef *pData, ENV_StatusTypeDef Status);
+
+/**
+  * @}
+  */
+
+/* Exported functions --------------------------------------------------------*/
+/** @addtogroup STM32L475E_IOT01_ENV_Exported_Functions
+  * @{
+  */
+/* Sensor Configuration Functions */
+ENV_StatusTypeDef BSP_ENV_Init(void);
+ENV_StatusTypeDef BSP_ENV_Read_IT(ENV_CallbackTypeDef Callback);
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32L475E_IOT01_ENV_H */
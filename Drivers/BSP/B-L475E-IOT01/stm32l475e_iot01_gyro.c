@@ -135,6 +135,71 @@ void BSP_GYRO_GetXYZ(float* pfData)
   }
 }
 
+/**
+  * @brief  Start batch acquisition of the Gyroscope in the LSM6DSL FIFO.
+  * @param  Odr  Sample rate, LSM6DSL_ODR_13Hz to LSM6DSL_ODR_6660Hz
+  * @param  Watermark  Samples stored before LSM6DSL_INT1_EXTI11_PIN rises
+  * @note   Call BSP_GYRO_Init() first. The application handles the
+  *         EXTI15_10 interrupt and drains the FIFO with BSP_GYRO_FIFO_GetXYZ().
+  * @retval GYRO_OK or GYRO_ERROR
+  */
+uint8_t BSP_GYRO_FIFO_Init(uint8_t Odr, uint16_t Watermark)
+{
+  uint8_t ret = GYRO_ERROR;
+
+  if(GyroscopeDrv == &Lsm6dslGyroDrv)
+  {
+    LSM6DSL_FifoInit(LSM6DSL_FIFO_GYRO, Odr, Watermark);
+    ret = GYRO_OK;
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  Stop the Gyroscope batch acquisition; the sensor keeps its ODR.
+  */
+void BSP_GYRO_FIFO_DeInit(void)
+{
+  if(GyroscopeDrv == &Lsm6dslGyroDrv)
+  {
+    LSM6DSL_FifoDeInit();
+  }
+}
+
+/**
+  * @brief  Get the number of samples waiting in the FIFO.
+  * @param  pStatus: if not NULL, receives the LSM6DSL_FIFO_STATUS_xxx flags
+  * @retval Samples ready
+  */
+uint16_t BSP_GYRO_FIFO_GetLevel(uint8_t *pStatus)
+{
+  uint16_t samples = 0;
+
+  if(GyroscopeDrv == &Lsm6dslGyroDrv)
+  {
+    samples = LSM6DSL_FifoGetLevel(pStatus);
+  }
+  return samples;
+}
+
+/**
+  * @brief  Read the samples stored in the FIFO with one burst I2C transfer.
+  * @param  pfData: pointer on MaxSamples angular rate triplets (X, Y, Z in mdps)
+  * @param  MaxSamples: room in pfData, in samples
+  * @retval Samples read
+  */
+uint16_t BSP_GYRO_FIFO_GetXYZ(float *pfData, uint16_t MaxSamples)
+{
+  uint16_t samples = 0;
+
+  if(GyroscopeDrv == &Lsm6dslGyroDrv)
+  {
+    samples = LSM6DSL_FifoReadXYZ(NULL, pfData, MaxSamples);
+  }
+  return samples;
+}
+
 /**
   * @}
   */
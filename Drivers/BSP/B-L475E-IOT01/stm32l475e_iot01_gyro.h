@@ -63,6 +63,11 @@ uint8_t BSP_GYRO_Init(void);
 void BSP_GYRO_DeInit(void);
 void BSP_GYRO_LowPower(uint16_t status);   /* 0 Means Disable Low Power Mode, otherwise Low Power Mode is enabled */
 void BSP_GYRO_GetXYZ(float* pfData);
+/* FIFO batch acquisition, watermark interrupt on LSM6DSL_INT1_EXTI11_PIN */
+uint8_t BSP_GYRO_FIFO_Init(uint8_t Odr, uint16_t Watermark);
+void BSP_GYRO_FIFO_DeInit(void);
+uint16_t BSP_GYRO_FIFO_GetLevel(uint8_t *pStatus);
+uint16_t BSP_GYRO_FIFO_GetXYZ(float *pfData, uint16_t MaxSamples);
 /**
   * @}
   */
@@ -210,6 +210,65 @@ float HTS221_T_ReadTemp(uint16_t DeviceAddr)
   return tmp_f;
 }
 
+/**
+  * @}
+  */
+
+/** @defgroup HTS221_Calibration_Private_Functions HTS221 Calibration Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Read the HTS221 factory calibration.
+  * @param  DeviceAddr: I2C device address
+  * @param  pCalib: calibration out
+  */
+void HTS221_ReadCalibration(uint16_t DeviceAddr, HTS221_CalibTypeDef *pCalib)
+{
+  uint8_t buffer[16];
+
+  /* H0_rH_x2 (0x30) to T1_OUT_H (0x3F) */
+  SENSOR_IO_ReadMultiple(DeviceAddr, (HTS221_H0_RH_X2 | 0x80), buffer, 16);
+
+  pCalib->H0_rh = buffer[0] >> 1;
+  pCalib->H1_rh = buffer[1] >> 1;
+  pCalib->T0_degC = ((((uint16_t)(buffer[5] & 0x03)) << 8) | ((uint16_t)buffer[2])) >> 3;
+  pCalib->T1_degC = ((((uint16_t)(buffer[5] & 0x0C)) << 6) | ((uint16_t)buffer[3])) >> 3;
+  pCalib->H0_T0_out = (((uint16_t)buffer[7]) << 8) | (uint16_t)buffer[6];
+  pCalib->H1_T0_out = (((uint16_t)buffer[11]) << 8) | (uint16_t)buffer[10];
+  pCalib->T0_out = (((uint16_t)buffer[13]) << 8) | (uint16_t)buffer[12];
+  pCalib->T1_out = (((uint16_t)buffer[15]) << 8) | (uint16_t)buffer[14];
+}
+
+/**
+  * @brief  Convert a raw HUMIDITY_OUT value.
+  * @param  pCalib: calibration from HTS221_ReadCalibration()
+  * @param  H_T_out: HUMIDITY_OUT register pair
+  * @retval humidity value
+  */
+float HTS221_H_Convert(const HTS221_CalibTypeDef *pCalib, int16_t H_T_out)
+{
+  float tmp_f;
+
+  tmp_f = (float)(H_T_out - pCalib->H0_T0_out) * (float)(pCalib->H1_rh - pCalib->H0_rh) / (float)(pCalib->H1_T0_out - pCalib->H0_T0_out)  +  pCalib->H0_rh;
+  tmp_f = ( tmp_f > 100.0f ) ? 100.0f
+        : ( tmp_f <   0.0f ) ?   0.0f
+        : tmp_f;
+
+  return tmp_f;
+}
+
+/**
+  * @brief  Convert a raw TEMP_OUT value.
+  * @param  pCalib: calibration from HTS221_ReadCalibration()
+  * @param  T_out: TEMP_OUT register pair
+  * @retval temperature value
+  */
+float HTS221_T_Convert(const HTS221_CalibTypeDef *pCalib, int16_t T_out)
+{
+  return (float)(T_out - pCalib->T0_out) * (float)(pCalib->T1_degC - pCalib->T0_degC) / (float)(pCalib->T1_out - pCalib->T0_out)  +  pCalib->T0_degC;
+}
+
 /**
   * @}
   */
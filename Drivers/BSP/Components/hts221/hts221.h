@@ -41,6 +41,30 @@ extern "C" {
   * @{
   */
 
+/** @defgroup HTS221_Exported_Types HTS221 Exported Types
+  * @{
+  */
+
+/**
+  * @brief  Factory calibration, read once with HTS221_ReadCalibration()
+  *         to convert raw outputs read by other means.
+  */
+typedef struct
+{
+  int16_t H0_rh;
+  int16_t H1_rh;
+  int16_t H0_T0_out;
+  int16_t H1_T0_out;
+  int16_t T0_degC;
+  int16_t T1_degC;
+  int16_t T0_out;
+  int16_t T1_out;
+} HTS221_CalibTypeDef;
+
+/**
+  * @}
+  */
+
 /** @defgroup HTS221_Exported_Constants HTS221 Exported Constants
   * @{
   */
@@ -282,6 +306,16 @@ float HTS221_T_ReadTemp(uint16_t DeviceAddr);
 /* Temperature driver structure */
 extern TSENSOR_DrvTypeDef HTS221_T_Drv;
 
+/**
+  * @}
+  */
+
+/** @defgroup HTS221_Calibration_Exported_Functions HTS221 Calibration Exported Functions
+  * @{
+  */
+void  HTS221_ReadCalibration(uint16_t DeviceAddr, HTS221_CalibTypeDef *pCalib);
+float HTS221_H_Convert(const HTS221_CalibTypeDef *pCalib, int16_t H_T_out);
+float HTS221_T_Convert(const HTS221_CalibTypeDef *pCalib, int16_t T_out);
 /**
   * @}
   */
@@ -98,9 +98,7 @@ uint8_t LPS22HB_P_ReadID(uint16_t DeviceAddr)
   */
 float LPS22HB_P_ReadPressure(uint16_t DeviceAddr)
 {
-  int32_t raw_press;
   uint8_t buffer[3];
-  uint32_t tmp = 0;
   uint8_t i;
 
   for(i = 0; i < 3; i++)
@@ -108,9 +106,23 @@ float LPS22HB_P_ReadPressure(uint16_t DeviceAddr)
     buffer[i] = SENSOR_IO_Read(DeviceAddr, (LPS22HB_PRESS_OUT_XL_REG + i));
   }
 
+  return LPS22HB_P_Convert(buffer);
+}
+
+/**
+  * @brief  Convert the PRESS_OUT registers of LPS22HB
+  * @param  pBuffer: PRESS_OUT_XL, PRESS_OUT_L and PRESS_OUT_H
+  * @retval pressure value
+  */
+float LPS22HB_P_Convert(const uint8_t *pBuffer)
+{
+  int32_t raw_press;
+  uint32_t tmp = 0;
+  uint8_t i;
+
   /* Build the raw data */
   for(i = 0; i < 3; i++)
-    tmp |= (((uint32_t)buffer[i]) << (8 * i));
+    tmp |= (((uint32_t)pBuffer[i]) << (8 * i));
 
   /* convert the 2's complement 24 bit to 2's complement 32 bit */
   if(tmp & 0x00800000)
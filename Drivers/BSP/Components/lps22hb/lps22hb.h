@@ -449,6 +449,7 @@ extern "C" {
 void    LPS22HB_P_Init(uint16_t DeviceAddr);
 uint8_t LPS22HB_P_ReadID(uint16_t DeviceAddr);
 float   LPS22HB_P_ReadPressure(uint16_t DeviceAddr);
+float   LPS22HB_P_Convert(const uint8_t *pBuffer);
 /**
   * @}
   */
@@ -356,6 +356,254 @@ void LSM6DSL_GyroReadXYZAngRate(float *pfData)
   }
 }
 
+/**
+  * @}
+  */ 
+
+/** @defgroup LSM6DSL_FIFO_Private_Functions LSM6DSL FIFO Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Number of 16-bit words the FIFO stores per sample.
+  * @param  ctrl3: FIFO_CTRL3 register content
+  * @retval 3 words for each sensor in the FIFO
+  */
+static uint16_t LSM6DSL_FifoSampleWords(uint8_t ctrl3)
+{
+  uint16_t words = 0;
+
+  if(ctrl3 & LSM6DSL_FIFO_DEC_G_BITPOSITION)
+  {
+    words += 3;
+  }
+  if(ctrl3 & LSM6DSL_FIFO_DEC_XL_BITPOSITION)
+  {
+    words += 3;
+  }
+  return words;
+}
+
+/**
+  * @brief  Start FIFO batch acquisition with a watermark interrupt on INT1.
+  * @param  Sensors: LSM6DSL_FIFO_ACC and/or LSM6DSL_FIFO_GYRO
+  * @param  Odr: LSM6DSL_ODR_xxx, used for the sensors and the FIFO
+  * @param  Watermark: samples stored before the FIFO threshold raises INT1
+  * @note   Both sensors run at the FIFO ODR without decimation, so each FIFO
+  *         sample is the gyroscope data set followed by the accelerometer one.
+  *         The FIFO runs in continuous mode: the newest data overwrites the oldest.
+  */
+void LSM6DSL_FifoInit(uint8_t Sensors, uint8_t Odr, uint16_t Watermark)
+{
+  uint8_t ctrl3 = 0x00;
+  uint8_t tmp;
+  uint32_t threshold;
+
+  /* Bypass mode stops and empties the FIFO while it is configured */
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL5, LSM6DSL_FIFO_MODE_BYPASS);
+
+  if(Sensors & LSM6DSL_FIFO_GYRO)
+  {
+    tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_CTRL2_G);
+    tmp &= ~(LSM6DSL_ODR_BITPOSITION);
+    tmp |= Odr;
+    SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_CTRL2_G, tmp);
+    ctrl3 |= LSM6DSL_FIFO_DEC_G_NO_DECIMATION;
+  }
+  if(Sensors & LSM6DSL_FIFO_ACC)
+  {
+    tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_CTRL1_XL);
+    tmp &= ~(LSM6DSL_ODR_BITPOSITION);
+    tmp |= Odr;
+    SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_CTRL1_XL, tmp);
+    ctrl3 |= LSM6DSL_FIFO_DEC_XL_NO_DECIMATION;
+  }
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL3, ctrl3);
+
+  /* FIFO threshold, counted in 16-bit words */
+  threshold = (uint32_t)Watermark * LSM6DSL_FifoSampleWords(ctrl3);
+  if(threshold > LSM6DSL_FIFO_THRESHOLD_MAX)
+  {
+    threshold = LSM6DSL_FIFO_THRESHOLD_MAX;
+  }
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL1, (uint8_t)threshold);
+  tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL2);
+  tmp &= ~(0x07);
+  tmp |= (uint8_t)((threshold >> 8) & 0x07);
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL2, tmp);
+
+  /* Route the FIFO threshold to INT1 */
+  LSM6DSL_IO_ITConfig(1);
+  tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_INT1_CTRL);
+  tmp |= LSM6DSL_INT1_FTH;
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_INT1_CTRL, tmp);
+
+  /* Continuous mode; ODR_FIFO in bits 6:3 uses the same codes as ODR_XL and ODR_G */
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL5,
+                  (uint8_t)((Odr >> 1) | LSM6DSL_FIFO_MODE_CONTINUOUS));
+}
+
+/**
+  * @brief  Stop the FIFO and its INT1 threshold interrupt.
+  */
+void LSM6DSL_FifoDeInit(void)
+{
+  uint8_t tmp;
+
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL5, LSM6DSL_FIFO_MODE_BYPASS);
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL3, 0x00);
+
+  tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_INT1_CTRL);
+  tmp &= ~(LSM6DSL_INT1_FTH);
+  SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_INT1_CTRL, tmp);
+  LSM6DSL_IO_ITConfig(0);
+}
+
+/**
+  * @brief  Read the FIFO fill level.
+  * @param  pStatus: if not 0, receives the LSM6DSL_FIFO_STATUS_xxx flags
+  * @retval Complete samples stored in the FIFO
+  */
+uint16_t LSM6DSL_FifoGetLevel(uint8_t *pStatus)
+{
+  uint8_t buffer[2];
+  uint16_t words;
+  uint16_t sample_words;
+
+  sample_words = LSM6DSL_FifoSampleWords(SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL3));
+
+  /* FIFO_STATUS1 and FIFO_STATUS2 */
+  SENSOR_IO_ReadMultiple(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_STATUS1, buffer, 2);
+  words = ((uint16_t)(buffer[1] & LSM6DSL_FIFO_DIFF_BITPOSITION) << 8) + (uint16_t)buffer[0];
+
+  if(pStatus != 0)
+  {
+    *pStatus = buffer[1] & ~(LSM6DSL_FIFO_DIFF_BITPOSITION);
+  }
+  return (sample_words != 0) ? (words / sample_words) : 0;
+}
+
+/**
+  * @brief  Drain the FIFO in a single burst read.
+  * @param  pAccData: accelerometer samples out, 3 int16_t in mg each, if the FIFO holds them
+  * @param  pGyroData: gyroscope samples out, 3 float in mdps each, if the FIFO holds them
+  * @param  MaxSamples: room in the output buffers, in samples
+  * @note   The raw FIFO words are read straight into the output buffer (the
+  *         gyroscope one when both sensors are in the FIFO: 12 bytes per sample
+  *         hold both raw data sets) and converted in place, last sample first.
+  *         The FIFO output address wraps from FIFO_DATA_OUT_H back to
+  *         FIFO_DATA_OUT_L, so IF_INC must be set in CTRL3_C, as the BSP does.
+  * @retval Samples read
+  */
+uint16_t LSM6DSL_FifoReadXYZ(int16_t *pAccData, float *pGyroData, uint16_t MaxSamples)
+{
+  int16_t pnRawData[6];
+  uint8_t status[4];
+  uint8_t discard[10];
+  uint8_t ctrl3;
+  uint8_t *buffer;
+  uint16_t sample_words, words, pattern, samples, i, j;
+  float acc_sensitivity = 0, gyro_sensitivity = 0;
+
+  ctrl3 = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_CTRL3);
+  sample_words = LSM6DSL_FifoSampleWords(ctrl3);
+  if((sample_words == 0) || (MaxSamples == 0) ||
+     ((ctrl3 & LSM6DSL_FIFO_DEC_XL_BITPOSITION) && (pAccData == 0)) ||
+     ((ctrl3 & LSM6DSL_FIFO_DEC_G_BITPOSITION) && (pGyroData == 0)))
+  {
+    return 0;
+  }
+
+  /* Unread words, and the position of the next one in the sample pattern */
+  SENSOR_IO_ReadMultiple(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_STATUS1, status, 4);
+  words = ((uint16_t)(status[1] & LSM6DSL_FIFO_DIFF_BITPOSITION) << 8) + (uint16_t)status[0];
+  pattern = ((uint16_t)(status[3] & 0x03) << 8) + (uint16_t)status[2];
+
+  /* After an overrun the oldest sample may be partly overwritten: skip its remaining words */
+  if((pattern != 0) && (pattern < sample_words))
+  {
+    if(words < (sample_words - pattern))
+    {
+      return 0;
+    }
+    SENSOR_IO_ReadMultiple(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_DATA_OUT_L, discard, 2 * (sample_words - pattern));
+    words -= (sample_words - pattern);
+  }
+
+  samples = words / sample_words;
+  if(samples > MaxSamples)
+  {
+    samples = MaxSamples;
+  }
+  if(samples == 0)
+  {
+    return 0;
+  }
+
+  buffer = (ctrl3 & LSM6DSL_FIFO_DEC_G_BITPOSITION) ? (uint8_t *)pGyroData : (uint8_t *)pAccData;
+  SENSOR_IO_ReadMultiple(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_FIFO_DATA_OUT_L, buffer, 2 * samples * sample_words);
+
+  /* Switch the sensitivity values set in CTRL1_XL and CTRL2_G */
+  switch(SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_CTRL1_XL) & 0x0C)
+  {
+  case LSM6DSL_ACC_FULLSCALE_2G:
+    acc_sensitivity = LSM6DSL_ACC_SENSITIVITY_2G;
+    break;
+  case LSM6DSL_ACC_FULLSCALE_4G:
+    acc_sensitivity = LSM6DSL_ACC_SENSITIVITY_4G;
+    break;
+  case LSM6DSL_ACC_FULLSCALE_8G:
+    acc_sensitivity = LSM6DSL_ACC_SENSITIVITY_8G;
+    break;
+  case LSM6DSL_ACC_FULLSCALE_16G:
+    acc_sensitivity = LSM6DSL_ACC_SENSITIVITY_16G;
+    break;
+  }
+  switch(SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_CTRL2_G) & 0x0C)
+  {
+  case LSM6DSL_GYRO_FS_245:
+    gyro_sensitivity = LSM6DSL_GYRO_SENSITIVITY_245DPS;
+    break;
+  case LSM6DSL_GYRO_FS_500:
+    gyro_sensitivity = LSM6DSL_GYRO_SENSITIVITY_500DPS;
+    break;
+  case LSM6DSL_GYRO_FS_1000:
+    gyro_sensitivity = LSM6DSL_GYRO_SENSITIVITY_1000DPS;
+    break;
+  case LSM6DSL_GYRO_FS_2000:
+    gyro_sensitivity = LSM6DSL_GYRO_SENSITIVITY_2000DPS;
+    break;
+  }
+
+  /* Converted samples are at least as large as raw ones: go backwards so that
+     a sample only overwrites raw words that have already been converted */
+  i = samples;
+  while(i-- > 0)
+  {
+    for(j=0; j<sample_words; j++)
+    {
+      pnRawData[j]=((((uint16_t)buffer[2*(i*sample_words+j)+1]) << 8) + (uint16_t)buffer[2*(i*sample_words+j)]);
+    }
+
+    j = 0;
+    if(ctrl3 & LSM6DSL_FIFO_DEC_G_BITPOSITION)
+    {
+      pGyroData[3*i]   = ( float )(pnRawData[0] * gyro_sensitivity);
+      pGyroData[3*i+1] = ( float )(pnRawData[1] * gyro_sensitivity);
+      pGyroData[3*i+2] = ( float )(pnRawData[2] * gyro_sensitivity);
+      j = 3;
+    }
+    if(ctrl3 & LSM6DSL_FIFO_DEC_XL_BITPOSITION)
+    {
+      pAccData[3*i]   = ( int16_t )(pnRawData[j] * acc_sensitivity);
+      pAccData[3*i+1] = ( int16_t )(pnRawData[j+1] * acc_sensitivity);
+      pAccData[3*i+2] = ( int16_t )(pnRawData[j+2] * acc_sensitivity);
+    }
+  }
+
+  return samples;
+}
+
 /**
   * @}
   */ 
@@ -246,6 +246,34 @@ extern "C" {
 /* Auto-increment */
 #define LSM6DSL_ACC_GYRO_IF_INC_DISABLED    ((uint8_t)0x00)
 #define LSM6DSL_ACC_GYRO_IF_INC_ENABLED     ((uint8_t)0x04)
+
+/* FIFO content selection */
+#define LSM6DSL_FIFO_ACC                    ((uint8_t)0x01) /* Accelerometer data sets in FIFO */
+#define LSM6DSL_FIFO_GYRO                   ((uint8_t)0x02) /* Gyroscope data sets in FIFO */
+
+/* FIFO decimation (FIFO_CTRL3) */
+#define LSM6DSL_FIFO_DEC_XL_BITPOSITION     ((uint8_t)0x07)
+#define LSM6DSL_FIFO_DEC_XL_NO_DECIMATION   ((uint8_t)0x01)
+#define LSM6DSL_FIFO_DEC_G_BITPOSITION      ((uint8_t)0x38)
+#define LSM6DSL_FIFO_DEC_G_NO_DECIMATION    ((uint8_t)0x08)
+
+/* FIFO mode (FIFO_CTRL5) */
+#define LSM6DSL_FIFO_MODE_BYPASS            ((uint8_t)0x00) /* FIFO disabled and emptied */
+#define LSM6DSL_FIFO_MODE_FIFO              ((uint8_t)0x01) /* Stops collecting when full */
+#define LSM6DSL_FIFO_MODE_CONTINUOUS        ((uint8_t)0x06) /* Newest data overwrites oldest */
+
+/* FIFO status flags (FIFO_STATUS2) */
+#define LSM6DSL_FIFO_STATUS_WATERMARK       ((uint8_t)0x80)
+#define LSM6DSL_FIFO_STATUS_OVER_RUN        ((uint8_t)0x40)
+#define LSM6DSL_FIFO_STATUS_FULL_SMART      ((uint8_t)0x20)
+#define LSM6DSL_FIFO_STATUS_EMPTY           ((uint8_t)0x10)
+#define LSM6DSL_FIFO_DIFF_BITPOSITION       ((uint8_t)0x07) /* DIFF_FIFO[10:8] */
+
+/* FIFO threshold, in 16-bit words (FIFO_CTRL1, FIFO_CTRL2) */
+#define LSM6DSL_FIFO_THRESHOLD_MAX          ((uint16_t)0x07FF)
+
+/* FIFO threshold interrupt on INT1 (INT1_CTRL) */
+#define LSM6DSL_INT1_FTH                    ((uint8_t)0x08)
   
 /**
   * @}
@@ -290,6 +318,17 @@ void    LSM6DSL_GyroReadXYZAngRate(float *pfData);
 /* Gyroscope driver structure */
 extern GYRO_DrvTypeDef Lsm6dslGyroDrv;
 
+/**
+  * @}
+  */
+
+/** @defgroup LSM6DSL_FifoExported_Functions FIFO Exported functions
+  * @{
+  */
+void     LSM6DSL_FifoInit(uint8_t Sensors, uint8_t Odr, uint16_t Watermark);
+void     LSM6DSL_FifoDeInit(void);
+uint16_t LSM6DSL_FifoGetLevel(uint8_t *pStatus);
+uint16_t LSM6DSL_FifoReadXYZ(int16_t *pAccData, float *pGyroData, uint16_t MaxSamples);
 /**
   * @}
   */
@@ -303,6 +342,7 @@ extern void     SENSOR_IO_Write(uint8_t Addr, uint8_t Reg, uint8_t Value);
 extern uint8_t  SENSOR_IO_Read(uint8_t Addr, uint8_t Reg);
 extern uint16_t SENSOR_IO_ReadMultiple(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
 extern void     SENSOR_IO_WriteMultiple(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
+extern void     LSM6DSL_IO_ITConfig(uint8_t Enable);
 /**
   * @}
   */
@@ -0,0 +1,648 @@
+/*******************************************************************************
+ * Device fleet load generator.
+ *
+ * Simulates many B-L475E-IOT01A boards against one broker: every device is an
+ * MQTTClient replaying the pattern of the firmware's main.c - connect, then
+ * publish to one topic at a fixed interval and service the connection in
+ * between - through the non-blocking client API (MQTTConnectNB,
+ * MQTTPublishNB, MQTTClient_poll).  A few worker threads each own a share of
+ * the devices and an epoll set of their sockets, so one host can run thousands
+ * of devices.
+ *
+ * Reports connect time (TCP connect to CONNACK) and publish latency (PUBLISH
+ * to PUBACK or PUBCOMP, so QoS 1 or 2) percentiles.  --storm drops every
+ * connection at once after the given number of seconds to reproduce a
+ * reconnect storm; --ramp limits the fleet-wide connect rate.
+ *
+ *   loadgen --devices 5000 --threads 4 --rate 0.5 --size 64 --qos 1
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "MQTTClient.h"
+
+#define MAX_EVENTS 256
+#define TICK_MS 5					/* worker loop period when no socket is ready */
+#define RECONNECT_DELAY_MS 1000		/* after a failed connect or a lost connection */
+
+
+void usage(void)
+{
+	printf("MQTT device fleet load generator\n");
+	printf("Usage: loadgen <options>, where options are:\n");
+	printf("  --host <hostname> (default is localhost)\n");
+	printf("  --port <port> (default is 1883)\n");
+	printf("  --devices <count> (default is 1000)\n");
+	printf("  --threads <count> (default is 4)\n");
+	printf("  --rate <publishes per second per device> (default is 0.5, as main.c)\n");
+	printf("  --size <payload bytes> (default is 41, as main.c)\n");
+	printf("  --qos <qos> (default is 1)\n");
+	printf("  --topic <topic> (default is test/topic)\n");
+	printf("  --keepalive <seconds> (default is 60)\n");
+	printf("  --duration <seconds> (default is 30)\n");
+	printf("  --ramp <connects per second, 0 for no limit> (default is 1000)\n");
+	printf("  --storm <seconds> drop every connection once, this long after the start\n");
+	exit(-1);
+}
+
+
+struct opts_struct
+{
+	char* host;
+	int port;
+	int devices;
+	int threads;
+	double rate;
+	int size;
+	enum QoS qos;
+	char* topic;
+	int keepalive;
+	int duration;
+	int ramp;
+	int storm;
+} opts =
+{
+	(char*)"localhost", 1883, 1000, 4, 0.5, 41, QOS1, (char*)"test/topic", 60, 30, 1000, 0
+};
+
+
+void getopts(int argc, char** argv)
+{
+	int count = 1;
+
+	while (count < argc)
+	{
+		char* option = argv[count];
+
+		if (++count >= argc)
+			usage();
+		if (strcmp(option, "--host") == 0)
+			opts.host = argv[count];
+		else if (strcmp(option, "--port") == 0)
+			opts.port = atoi(argv[count]);
+		else if (strcmp(option, "--devices") == 0)
+			opts.devices = atoi(argv[count]);
+		else if (strcmp(option, "--threads") == 0)
+			opts.threads = atoi(argv[count]);
+		else if (strcmp(option, "--rate") == 0)
+			opts.rate = atof(argv[count]);
+		else if (strcmp(option, "--size") == 0)
+			opts.size = atoi(argv[count]);
+		else if (strcmp(option, "--qos") == 0)
+			opts.qos = (enum QoS)atoi(argv[count]);
+		else if (strcmp(option, "--topic") == 0)
+			opts.topic = argv[count];
+		else if (strcmp(option, "--keepalive") == 0)
+			opts.keepalive = atoi(argv[count]);
+		else if (strcmp(option, "--duration") == 0)
+			opts.duration = atoi(argv[count]);
+		else if (strcmp(option, "--ramp") == 0)
+			opts.ramp = atoi(argv[count]);
+		else if (strcmp(option, "--storm") == 0)
+			opts.storm = atoi(argv[count]);
+		else
+			usage();
+		count++;
+	}
+	if (opts.devices <= 0 || opts.threads <= 0 || opts.size < 0 || opts.qos < QOS0 || opts.qos > QOS2)
+		usage();
+	if (opts.threads > opts.devices)
+		opts.threads = opts.devices;
+}
+
+
+/* Growable array of measurements in milliseconds */
+typedef struct Samples
+{
+	double* values;
+	int count, size;
+} Samples;
+
+enum DeviceState { DOWN, TCP_CONNECTING, MQTT_CONNECTING, UP };
+
+struct Device;
+
+typedef struct Inflight
+{
+	struct Device* device;
+	double start;
+	int used;
+} Inflight;
+
+typedef struct Device
+{
+	int id;
+	enum DeviceState state;
+	int failed;						/* set by a completion handler, acted on after the poll */
+	char clientid[40];
+	Network network;
+	MQTTClient client;
+	unsigned char* sendbuf;
+	unsigned char* readbuf;
+	double connect_start;
+	double next_connect;
+	double next_publish;
+	Inflight inflight[MQTT_PENDING_MAX];
+	struct Worker* worker;
+} Device;
+
+typedef struct Worker
+{
+	pthread_t thread;
+	int epfd;
+	Device* devices;
+	int count;
+	double connect_tokens;
+	Samples connect_time, publish_latency;
+	volatile unsigned long connected, connects, connect_failures, disconnects,
+		published, completed, failed, skipped;
+} Worker;
+
+static volatile int toStop = 0;
+static volatile int storm = 0;		/* generation of the last storm requested */
+static unsigned char* payload = NULL;
+static char* hostaddr = NULL;		/* resolved once for all devices */
+
+
+void cfinish(int sig)
+{
+	signal(SIGINT, NULL);
+	toStop = 1;
+}
+
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+
+static void addSample(Samples* s, double value)
+{
+	if (s->count == s->size)
+	{
+		s->size = s->size ? s->size * 2 : 1024;
+		s->values = realloc(s->values, s->size * sizeof(double));
+	}
+	s->values[s->count++] = value;
+}
+
+
+/* Network functions for non-blocking sockets: reads return 0 when nothing is buffered */
+static int loadgen_read(Network* n, unsigned char* buffer, int len, int timeout_ms)
+{
+	int rc = recv(n->my_socket, buffer, len, 0);
+
+	if (rc > 0)
+		return rc;
+	if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return 0;
+	return -1;	/* closed by the broker, or failed */
+}
+
+
+static int loadgen_write(Network* n, unsigned char* buffer, int len, int timeout_ms)
+{
+	struct pollfd pfd = {n->my_socket, POLLOUT, 0};
+	int rc = send(n->my_socket, buffer, len, MSG_NOSIGNAL);
+
+	if (rc >= 0)
+		return rc;
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		return -1;
+	/* socket buffer full: wait for room, the caller retries until its timer expires */
+	return (poll(&pfd, 1, (timeout_ms > 10) ? 10 : timeout_ms) < 0) ? -1 : 0;
+}
+
+
+static void closeDevice(Device* d, double now)
+{
+	Worker* w = d->worker;
+
+	if (d->state == DOWN)
+		return;
+	if (d->state == UP)
+	{
+		w->connected--;
+		w->disconnects++;
+	}
+	epoll_ctl(w->epfd, EPOLL_CTL_DEL, d->network.my_socket, NULL);
+	close(d->network.my_socket);
+	d->state = DOWN;
+	d->next_connect = now + RECONNECT_DELAY_MS;
+}
+
+
+static void startConnect(Device* d, double now)
+{
+	struct sockaddr_in address;
+	struct epoll_event ev;
+	int one = 1;
+	int i;
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(opts.port);
+	inet_pton(AF_INET, hostaddr, &address.sin_addr);
+
+	d->network.mqttread = loadgen_read;
+	d->network.mqttwrite = loadgen_write;
+	d->network.my_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (d->network.my_socket < 0)
+	{
+		d->worker->connect_failures++;
+		d->next_connect = now + RECONNECT_DELAY_MS;
+		return;
+	}
+	setsockopt(d->network.my_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	MQTTClientInit(&d->client, &d->network, 3000, d->sendbuf, opts.size + 256, d->readbuf, 256);
+	for (i = 0; i < MQTT_PENDING_MAX; ++i)
+		d->inflight[i].used = 0;
+	d->failed = 0;
+	d->connect_start = now;
+	d->state = TCP_CONNECTING;
+	d->worker->connects++;
+
+	ev.events = EPOLLOUT;
+	ev.data.ptr = d;
+	epoll_ctl(d->worker->epfd, EPOLL_CTL_ADD, d->network.my_socket, &ev);
+	if (connect(d->network.my_socket, (struct sockaddr*)&address, sizeof(address)) < 0 && errno != EINPROGRESS)
+	{
+		d->worker->connect_failures++;
+		closeDevice(d, now);
+	}
+}
+
+
+static void connectComplete(void* context, int rc)
+{
+	Device* d = (Device*)context;
+	double now = now_ms();
+
+	if (rc != MQTT_SUCCESS)
+	{
+		d->worker->connect_failures++;
+		d->failed = 1;
+		return;
+	}
+	addSample(&d->worker->connect_time, now - d->connect_start);
+	d->worker->connected++;
+	d->state = UP;
+	/* spread the first publishes over one interval, as boards powered at random times would */
+	d->next_publish = now + ((opts.rate > 0) ? (rand() % 1000) / opts.rate : 0);
+}
+
+
+static void publishComplete(void* context, int rc)
+{
+	Inflight* inflight = (Inflight*)context;
+	Worker* w = inflight->device->worker;
+
+	if (rc == MQTT_SUCCESS)
+	{
+		addSample(&w->publish_latency, now_ms() - inflight->start);
+		w->completed++;
+	}
+	else
+		w->failed++;
+	inflight->used = 0;
+}
+
+
+/* TCP connect finished: send the CONNECT packet and wait for the CONNACK */
+static void tcpConnected(Device* d, double now)
+{
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	struct epoll_event ev;
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	getsockopt(d->network.my_socket, SOL_SOCKET, SO_ERROR, &err, &len);
+	ev.events = EPOLLIN;
+	ev.data.ptr = d;
+	if (err != 0 || epoll_ctl(d->worker->epfd, EPOLL_CTL_MOD, d->network.my_socket, &ev) < 0)
+	{
+		d->worker->connect_failures++;
+		closeDevice(d, now);
+		return;
+	}
+
+	data.MQTTVersion = 4;
+	data.clientID.cstring = d->clientid;
+	data.cleansession = 1;
+	data.keepAliveInterval = opts.keepalive;
+	d->state = MQTT_CONNECTING;
+	if (MQTTConnectNB(&d->client, &data, connectComplete, d) != MQTT_SUCCESS)
+	{
+		d->worker->connect_failures++;
+		closeDevice(d, now);
+	}
+}
+
+
+static void publish(Device* d, double now)
+{
+	Worker* w = d->worker;
+	MQTTMessage message;
+	Inflight* inflight = NULL;
+	int i;
+
+	message.qos = opts.qos;
+	message.retained = 0;
+	message.payload = payload;
+	message.payloadlen = opts.size;
+
+	if (opts.qos > QOS0)
+	{
+		for (i = 0; i < MQTT_PENDING_MAX && inflight == NULL; ++i)
+		{
+			if (!d->inflight[i].used)
+				inflight = &d->inflight[i];
+		}
+		if (inflight == NULL)
+		{
+			w->skipped++;	/* the broker is not keeping up with this device */
+			return;
+		}
+		inflight->device = d;
+		inflight->start = now;
+		inflight->used = 1;
+	}
+	if (MQTTPublishNB(&d->client, opts.topic, &message, inflight ? publishComplete : NULL, inflight) == MQTT_SUCCESS)
+		w->published++;
+	else
+	{
+		if (inflight)
+			inflight->used = 0;
+		d->failed = 1;
+	}
+}
+
+
+static void pollDevice(Device* d, double now)
+{
+	if (MQTTClient_poll(&d->client) != MQTT_SUCCESS && d->state == UP)
+		d->failed = 1;
+	if (d->failed)
+		closeDevice(d, now);
+}
+
+
+static void* worker(void* arg)
+{
+	Worker* w = (Worker*)arg;
+	struct epoll_event events[MAX_EVENTS];
+	double interval = (opts.rate > 0) ? 1000.0 / opts.rate : 0;
+	double last = now_ms();
+	int storm_seen = 0;
+
+	while (!toStop)
+	{
+		double now = now_ms();
+		int count, i;
+
+		/* connect budget for this tick */
+		if (opts.ramp > 0)
+		{
+			w->connect_tokens += (now - last) * opts.ramp / 1000.0 / opts.threads;
+			if (w->connect_tokens > opts.ramp)
+				w->connect_tokens = opts.ramp;
+		}
+		last = now;
+
+		if (storm != storm_seen)
+		{
+			storm_seen = storm;
+			for (i = 0; i < w->count; ++i)
+			{
+				closeDevice(&w->devices[i], now);
+				w->devices[i].next_connect = now;
+			}
+		}
+
+		for (i = 0; i < w->count; ++i)
+		{
+			Device* d = &w->devices[i];
+
+			switch (d->state)
+			{
+			case DOWN:
+				if (now >= d->next_connect && (opts.ramp == 0 || w->connect_tokens >= 1))
+				{
+					w->connect_tokens -= 1;
+					startConnect(d, now);
+				}
+				break;
+			case TCP_CONNECTING:
+				if (now - d->connect_start > 3000)
+				{
+					w->connect_failures++;
+					closeDevice(d, now);
+				}
+				break;
+			case MQTT_CONNECTING:
+				pollDevice(d, now);	/* times out the CONNACK */
+				break;
+			case UP:
+				if (interval > 0 && now >= d->next_publish)
+				{
+					d->next_publish += interval;
+					if (d->next_publish < now)
+						d->next_publish = now + interval;	/* fell behind: do not burst */
+					publish(d, now);
+					if (d->failed)
+						closeDevice(d, now);
+				}
+				break;
+			}
+		}
+
+		count = epoll_wait(w->epfd, events, MAX_EVENTS, TICK_MS);
+		now = now_ms();
+		for (i = 0; i < count; ++i)
+		{
+			Device* d = (Device*)events[i].data.ptr;
+
+			if (d->state == TCP_CONNECTING)
+				tcpConnected(d, now);
+			else if (d->state != DOWN)
+				pollDevice(d, now);
+		}
+
+		/* keepalive pings and ack timeouts of the idle devices, once a second each */
+		for (i = (int)now % 1000; i < w->count; i += 1000 / TICK_MS)
+		{
+			if (w->devices[i].state == UP)
+				pollDevice(&w->devices[i], now);
+		}
+	}
+
+	for (int i = 0; i < w->count; ++i)
+	{
+		Device* d = &w->devices[i];
+
+		if (d->state == UP)
+			MQTTDisconnect(&d->client);
+		if (d->state != DOWN)
+			close(d->network.my_socket);	/* not counted as lost */
+	}
+	return NULL;
+}
+
+
+static int compare(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+
+	return (x > y) - (x < y);
+}
+
+
+static void report(const char* name, Samples* s)
+{
+	double ps[] = {50, 90, 99, 99.9};
+	size_t i;
+
+	if (s->count == 0)
+	{
+		printf("%-16s no samples\n", name);
+		return;
+	}
+	qsort(s->values, s->count, sizeof(double), compare);
+	printf("%-16s n=%d", name, s->count);
+	for (i = 0; i < sizeof(ps) / sizeof(ps[0]); ++i)
+		printf(" p%g=%.2fms", ps[i], s->values[(int)(ps[i] / 100 * (s->count - 1))]);
+	printf(" max=%.2fms\n", s->values[s->count - 1]);
+}
+
+
+int main(int argc, char** argv)
+{
+	struct addrinfo hints = {0, AF_INET, SOCK_STREAM, IPPROTO_TCP, 0, NULL, NULL, NULL};
+	struct addrinfo* result = NULL;
+	struct rlimit limit;
+	Worker* workers;
+	Device* devices;
+	Samples connect_time = {NULL, 0, 0}, publish_latency = {NULL, 0, 0};
+	unsigned long published = 0, completed = 0, failed = 0, skipped = 0, connects = 0,
+		connect_failures = 0, disconnects = 0;
+	double start;
+	int elapsed = 0;
+	int i;
+
+	getopts(argc, argv);
+
+	signal(SIGINT, cfinish);
+	signal(SIGTERM, cfinish);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* one socket per device */
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	if (getaddrinfo(opts.host, NULL, &hints, &result) != 0)
+	{
+		printf("cannot resolve %s\n", opts.host);
+		return -1;
+	}
+	hostaddr = strdup(inet_ntoa(((struct sockaddr_in*)result->ai_addr)->sin_addr));
+	freeaddrinfo(result);
+
+	payload = malloc(opts.size + 1);
+	memset(payload, 'x', opts.size);
+
+	devices = calloc(opts.devices, sizeof(Device));
+	workers = calloc(opts.threads, sizeof(Worker));
+	for (i = 0; i < opts.devices; ++i)
+	{
+		Device* d = &devices[i];
+
+		d->id = i;
+		d->state = DOWN;
+		snprintf(d->clientid, sizeof(d->clientid), "loadgen-%d-%d", (int)getpid(), i);
+		d->sendbuf = malloc(opts.size + 256);
+		d->readbuf = malloc(256);
+	}
+	for (i = 0; i < opts.threads; ++i)
+	{
+		Worker* w = &workers[i];
+		int first = (int)((long)opts.devices * i / opts.threads);
+		int j;
+
+		w->devices = &devices[first];
+		w->count = (int)((long)opts.devices * (i + 1) / opts.threads) - first;
+		w->epfd = epoll_create1(0);
+		for (j = 0; j < w->count; ++j)
+			w->devices[j].worker = w;
+	}
+
+	printf("%d devices on %d threads to %s:%d, %.2f publishes/s each of %d bytes at QoS %d\n",
+			opts.devices, opts.threads, hostaddr, opts.port, opts.rate, opts.size, opts.qos);
+	start = now_ms();
+	for (i = 0; i < opts.threads; ++i)
+		pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+
+	while (!toStop && elapsed < opts.duration)
+	{
+		unsigned long up = 0, pub = 0, done = 0;
+
+		sleep(1);
+		elapsed = (int)((now_ms() - start) / 1000);
+		for (i = 0; i < opts.threads; ++i)
+		{
+			up += workers[i].connected;
+			pub += workers[i].published;
+			done += workers[i].completed;
+		}
+		printf("t=%ds connected %lu/%d published %lu acknowledged %lu\n", elapsed, up, opts.devices, pub, done);
+		fflush(stdout);
+		if (opts.storm > 0 && elapsed == opts.storm && storm == 0)
+		{
+			printf("reconnect storm: dropping every connection\n");
+			storm = 1;
+		}
+	}
+	toStop = 1;
+
+	for (i = 0; i < opts.threads; ++i)
+	{
+		Worker* w = &workers[i];
+		int j;
+
+		pthread_join(w->thread, NULL);
+		for (j = 0; j < w->connect_time.count; ++j)
+			addSample(&connect_time, w->connect_time.values[j]);
+		for (j = 0; j < w->publish_latency.count; ++j)
+			addSample(&publish_latency, w->publish_latency.values[j]);
+		published += w->published;
+		completed += w->completed;
+		failed += w->failed;
+		skipped += w->skipped;
+		connects += w->connects;
+		connect_failures += w->connect_failures;
+		disconnects += w->disconnects;
+	}
+
+	printf("connects %lu, failed %lu, connections lost %lu\n", connects, connect_failures, disconnects);
+	printf("publishes %lu, acknowledged %lu, failed %lu, skipped with %d in flight %lu\n",
+			published, completed, failed, MQTT_PENDING_MAX, skipped);
+	report("connect time", &connect_time);
+	if (opts.qos > QOS0)
+		report("publish latency", &publish_latency);
+	return 0;
+}
@@ -84,6 +84,15 @@ void TimerInit(Timer* timer)
 }
 
 
+uint64_t TimerGetTickMS(void)
+{
+	TimeOut_t now;
+
+	vTaskSetTimeOutState(&now); /* the tick count and the number of times it wrapped */
+	return (((uint64_t)now.xOverflowCount << (8 * sizeof(TickType_t))) | now.xTimeOnEntering) * portTICK_PERIOD_MS;
+}
+
+
 int FreeRTOS_read(Network* n, unsigned char* buffer, int len, int timeout_ms)
 {
 	TickType_t xTicksToWait = timeout_ms / portTICK_PERIOD_MS; /* convert milliseconds to ticks */
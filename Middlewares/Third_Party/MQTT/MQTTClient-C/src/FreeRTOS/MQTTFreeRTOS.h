@@ -44,6 +44,7 @@ char TimerIsExpired(Timer*);
 void TimerCountdownMS(Timer*, unsigned int);
 void TimerCountdown(Timer*, unsigned int);
 int TimerLeftMS(Timer*);
+uint64_t TimerGetTickMS(void);
 
 typedef struct Mutex
 {
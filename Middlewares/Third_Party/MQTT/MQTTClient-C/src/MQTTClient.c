@@ -15,8 +15,11 @@
  *   Ian Craggs - fix for #96 - check rem_len in readPacket
  *   Ian Craggs - add ability to set message handler separately #6
  *******************************************************************************/
+#include <string.h>
+#if !defined(MQTTCLIENT_PLATFORM_HEADER)
 #include "Timer.h"
 #include "MQTTInterface.h"
+#endif
 
 #ifdef SUCCESS
 #undef SUCCESS
@@ -24,6 +27,11 @@
 
 #include "MQTTClient.h"
 
+#if defined(MQTTCLIENT_RAM_BUDGET)
+/* fails to compile when the configured client does not fit the budget */
+typedef char MQTTClient_ram_budget_check[(MQTTCLIENT_STATIC_RAM <= MQTTCLIENT_RAM_BUDGET) ? 1 : -1];
+#endif
+
 
 static void NewMessageData(MessageData* md, MQTTString* aTopicName, MQTTMessage* aMessage) {
     md->topicName = aTopicName;
@@ -36,20 +44,40 @@ static int getNextPacketId(MQTTClient *c) {
 }
 
 
-static int sendPacket(MQTTClient* c, int length, Timer* timer)
+/* Sends the packet serialized in c->buf, then payloadlen bytes of payload when the
+ * publish was serialized without its payload (see serializePublish) */
+static int sendPacketPayload(MQTTClient* c, int length, unsigned char* payload, int payloadlen, Timer* timer)
 {
     int rc = FAILURE,
         sent = 0;
 
-    while (sent < length && !TimerIsExpired(timer))
+    while (sent < length + payloadlen && !TimerIsExpired(timer))
     {
-        rc = c->ipstack->mqttwrite(c->ipstack, &c->buf[sent], length, TimerLeftMS(timer));
+#if defined(MQTT_NETWORK_WRITEV)
+        if (payloadlen > 0)
+        {
+            struct iovec iov[2];
+            int iovcnt = 0;
+
+            if (sent < length)
+            {
+                iov[iovcnt].iov_base = &c->buf[sent];
+                iov[iovcnt++].iov_len = length - sent;
+            }
+            iov[iovcnt].iov_base = payload + ((sent > length) ? sent - length : 0);
+            iov[iovcnt].iov_len = length + payloadlen - ((sent > length) ? sent : length);
+            rc = c->ipstack->mqttwritev(c->ipstack, iov, ++iovcnt, TimerLeftMS(timer));
+        }
+        else
+#endif
+        rc = c->ipstack->mqttwrite(c->ipstack, &c->buf[sent], length - sent, TimerLeftMS(timer));
         if (rc < 0)  // there was an error writing the data
             break;
         sent += rc;
     }
-    if (sent == length)
+    if (sent == length + payloadlen)
     {
+        MQTT_PACKET_SENT(c->buf);
         TimerCountdown(&c->last_sent, c->keepAliveInterval); // record the fact that we have successfully sent the packet
         rc = SUCCESS;
     }
@@ -59,6 +87,41 @@ static int sendPacket(MQTTClient* c, int length, Timer* timer)
 }
 
 
+static int sendPacket(MQTTClient* c, int length, Timer* timer)
+{
+    return sendPacketPayload(c, length, NULL, 0, timer);
+}
+
+
+/* Serializes a publish into c->buf.  If the network gathers writes, only the header is
+ * serialized and *payloadlen is set to the payload bytes still to send, from the caller's
+ * memory; so the payload is not copied and not bounded by the send buffer. */
+static int serializePublish(MQTTClient* c, MQTTString topic, MQTTMessage* message, int* payloadlen)
+{
+    *payloadlen = 0;
+#if defined(MQTT_NETWORK_WRITEV)
+    if (c->ipstack->mqttwritev != NULL)
+    {
+        *payloadlen = message->payloadlen;
+        return MQTTSerialize_publishHeader(c->buf, c->buf_size, 0, message->qos, message->retained, message->id,
+              topic, message->payloadlen);
+    }
+#endif
+    return MQTTSerialize_publish(c->buf, c->buf_size, 0, message->qos, message->retained, message->id,
+              topic, (unsigned char*)message->payload, message->payloadlen);
+}
+
+
+/* MQTTTransport getfn of MQTTClient_poll: takes only what the network already holds */
+static int transportRead(void* sck, unsigned char* buf, int count)
+{
+    MQTTClient* c = (MQTTClient*)sck;
+    int rc = c->ipstack->mqttread(c->ipstack, buf, count, 0);
+
+    return (rc < 0) ? -1 : rc;
+}
+
+
 void MQTTClientInit(MQTTClient* c, Network* network, unsigned int command_timeout_ms,
 		unsigned char* sendbuf, size_t sendbuf_size, unsigned char* readbuf, size_t readbuf_size)
 {
@@ -79,6 +142,17 @@ void MQTTClientInit(MQTTClient* c, Network* network, unsigned int command_timeou
 	  c->next_packetid = 1;
     TimerInit(&c->last_sent);
     TimerInit(&c->last_received);
+    c->transport.getfn = transportRead;
+    c->transport.sck = c;
+    c->transport.state = 0;
+    for (i = 0; i < MQTT_PENDING_MAX; ++i)
+        c->pending[i].ack = 0;
+    for (i = 0; i < MQTT_PRIORITY_CLASSES; ++i)
+    {
+        c->outbound[i].buf = NULL;
+        c->outbound[i].buf_size = 0;
+        c->outbound[i].used = 0;
+    }
 #if defined(MQTT_TASK)
 	  MutexInit(&c->mutex);
 #endif
@@ -143,6 +217,7 @@ static int readPacket(MQTTClient* c, Timer* timer)
 
     header.byte = c->readbuf[0];
     rc = header.bits.type;
+    MQTT_PACKET_RECEIVED(c->readbuf);
     if (c->keepAliveInterval > 0)
         TimerCountdown(&c->last_received, c->keepAliveInterval); // record the fact that we have successfully received a packet
 exit:
@@ -254,18 +329,17 @@ void MQTTCloseSession(MQTTClient* c)
 {
     c->ping_outstanding = 0;
     c->isconnected = 0;
+    c->transport.state = 0; // a packet MQTTClient_poll was part way through is gone with the connection
     if (c->cleansession)
         MQTTCleanSession(c);
 }
 
 
-int cycle(MQTTClient* c, Timer* timer)
+static int handlePacket(MQTTClient* c, int packet_type, Timer* timer)
 {
     int len = 0,
         rc = SUCCESS;
 
-    int packet_type = readPacket(c, timer);     /* read the socket, see what work is due */
-
     switch (packet_type)
     {
         default:
@@ -342,6 +416,142 @@ exit:
 }
 
 
+int cycle(MQTTClient* c, Timer* timer)
+{
+    int packet_type = readPacket(c, timer);     /* read the socket, see what work is due */
+
+    return handlePacket(c, packet_type, timer);
+}
+
+
+int waitfor(MQTTClient* c, int packet_type, Timer* timer);
+
+
+static int waitforPublishAck(MQTTClient* c, int qos, Timer* timer)
+{
+    int rc = SUCCESS;
+    int ack = (qos == QOS1) ? PUBACK : PUBCOMP;
+
+    if (qos == QOS0)
+        goto exit;
+
+    if (waitfor(c, ack, timer) == ack)
+    {
+        unsigned short mypacketid;
+        unsigned char dup, type;
+        if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
+            rc = FAILURE;
+    }
+    else
+        rc = FAILURE;
+
+exit:
+    return rc;
+}
+
+
+static void refillBucket(MQTTOutboundQueue* q)
+{
+    uint64_t now = TimerGetTickMS();
+    uint64_t elapsed = now - q->refill_ms;
+    unsigned long room = (unsigned long)q->burst * 1000 - q->tokens;
+
+    // credit all the time since the last refill, however long the device slept
+    if (elapsed > room / q->rate)
+        q->tokens += room; // full, and the product below could overflow
+    else
+        q->tokens += (unsigned long)elapsed * q->rate;
+    q->refill_ms = now;
+}
+
+
+static void queuePut(MQTTOutboundQueue* q, const unsigned char* data, size_t len)
+{
+    size_t tail = (q->head + q->used) % q->buf_size;
+    size_t first = (len < q->buf_size - tail) ? len : q->buf_size - tail;
+
+    memcpy(&q->buf[tail], data, first);
+    memcpy(q->buf, data + first, len - first);
+    q->used += len;
+}
+
+
+static void queuePeek(MQTTOutboundQueue* q, size_t offset, unsigned char* data, size_t len)
+{
+    size_t start = (q->head + offset) % q->buf_size;
+    size_t first = (len < q->buf_size - start) ? len : q->buf_size - start;
+
+    memcpy(data, &q->buf[start], first);
+    memcpy(data + first, q->buf, len - first);
+}
+
+
+static void queueDrop(MQTTOutboundQueue* q, size_t len)
+{
+    q->head = (q->head + len) % q->buf_size;
+    q->used -= len;
+}
+
+
+static int dispatch(MQTTClient* c)
+{
+    int rc = SUCCESS;
+    int prio;
+
+    if (!c->isconnected)
+        goto exit;
+
+    for (prio = 0; prio < MQTT_PRIORITY_CLASSES && rc == SUCCESS; ++prio)
+    {
+        MQTTOutboundQueue* q = &c->outbound[prio];
+
+        if (q->rate > 0)
+            refillBucket(q);
+        while (q->used > 0)
+        {
+            Timer timer;
+            MQTTHeader header = {0};
+            int len = (q->buf[q->head] << 8) | q->buf[(q->head + 1) % q->buf_size];
+
+            if (q->rate > 0 && q->tokens < (unsigned long)len * 1000)
+                break; // out of tokens: lower classes may still have some
+            queuePeek(q, 2, c->buf, len);
+
+            TimerInit(&timer);
+            TimerCountdownMS(&timer, c->command_timeout_ms);
+            header.byte = c->buf[0];
+            if ((rc = sendPacket(c, len, &timer)) != SUCCESS)
+                break; // still queued, sent again once reconnected
+            queueDrop(q, 2 + len);
+            if (q->rate > 0)
+                q->tokens -= (unsigned long)len * 1000;
+            if ((rc = waitforPublishAck(c, header.bits.qos, &timer)) != SUCCESS)
+                break;
+        }
+    }
+
+    if (rc == FAILURE)
+        MQTTCloseSession(c);
+exit:
+    return rc;
+}
+
+
+int MQTTDispatch(MQTTClient* c)
+{
+    int rc;
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+    rc = dispatch(c);
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
 int MQTTYield(MQTTClient* c, int timeout_ms)
 {
     int rc = SUCCESS;
@@ -352,7 +562,7 @@ int MQTTYield(MQTTClient* c, int timeout_ms)
 
 	  do
     {
-        if (cycle(c, &timer) < 0)
+        if (dispatch(c) < 0 || cycle(c, &timer) < 0)
         {
             rc = FAILURE;
             break;
@@ -376,6 +586,7 @@ void MQTTRun(void* parm)
 		MutexLock(&c->mutex);
 #endif
 		TimerCountdownMS(&timer, 500); /* Don't wait too long if no traffic is incoming */
+		dispatch(c);
 		cycle(c, &timer);
 #if defined(MQTT_TASK)
 		MutexUnlock(&c->mutex);
@@ -432,6 +643,7 @@ int MQTTConnectWithResults(MQTTClient* c, MQTTPacket_connectData* options, MQTTC
     c->keepAliveInterval = options->keepAliveInterval;
     c->cleansession = options->cleansession;
     TimerCountdown(&c->last_received, c->keepAliveInterval);
+    c->transport.state = 0;
     if ((len = MQTTSerialize_connect(c->buf, c->buf_size, options)) <= 0)
         goto exit;
     if ((rc = sendPacket(c, len, &connect_timer)) != SUCCESS)  // send the connect packet
@@ -472,6 +684,19 @@ int MQTTConnect(MQTTClient* c, MQTTPacket_connectData* options)
 }
 
 
+/* Whether a message handler can keep this topic filter: checked before subscribing, so that
+ * the broker never holds a subscription the client has no handler for */
+static int topicFilterFits(const char* topicFilter)
+{
+#if MQTT_TOPIC_FILTER_MAX > 0
+    return strlen(topicFilter) < MQTT_TOPIC_FILTER_MAX;
+#else
+    (void)topicFilter;
+    return 1;
+#endif
+}
+
+
 int MQTTSetMessageHandler(MQTTClient* c, const char* topicFilter, messageHandler messageHandler)
 {
     int rc = FAILURE;
@@ -506,6 +731,15 @@ int MQTTSetMessageHandler(MQTTClient* c, const char* topicFilter, messageHandler
         }
         if (i < MAX_MESSAGE_HANDLERS)
         {
+#if MQTT_TOPIC_FILTER_MAX > 0
+            if (c->messageHandlers[i].topicFilter != c->messageHandlers[i].topicFilterBuf)
+            {
+                if (!topicFilterFits(topicFilter))
+                    return BUFFER_OVERFLOW; /* does not fit the topic filter pool */
+                strcpy(c->messageHandlers[i].topicFilterBuf, topicFilter);
+            }
+            topicFilter = c->messageHandlers[i].topicFilterBuf;
+#endif
             c->messageHandlers[i].topicFilter = topicFilter;
             c->messageHandlers[i].fp = messageHandler;
         }
@@ -528,6 +762,11 @@ int MQTTSubscribeWithResults(MQTTClient* c, const char* topicFilter, enum QoS qo
 #endif
 	  if (!c->isconnected)
 		    goto exit;
+    if (messageHandler != NULL && !topicFilterFits(topicFilter))
+    {
+        rc = BUFFER_OVERFLOW;
+        goto exit;
+    }
 
     TimerInit(&timer);
     TimerCountdownMS(&timer, c->command_timeout_ms);
@@ -621,6 +860,7 @@ int MQTTPublish(MQTTClient* c, const char* topicName, MQTTMessage* message)
     MQTTString topic = MQTTString_initializer;
     topic.cstring = (char *)topicName;
     int len = 0;
+    int payloadlen = 0;
 
 #if defined(MQTT_TASK)
 	  MutexLock(&c->mutex);
@@ -634,37 +874,77 @@ int MQTTPublish(MQTTClient* c, const char* topicName, MQTTMessage* message)
     if (message->qos == QOS1 || message->qos == QOS2)
         message->id = getNextPacketId(c);
 
-    len = MQTTSerialize_publish(c->buf, c->buf_size, 0, message->qos, message->retained, message->id,
-              topic, (unsigned char*)message->payload, message->payloadlen);
+    len = serializePublish(c, topic, message, &payloadlen);
     if (len <= 0)
         goto exit;
-    if ((rc = sendPacket(c, len, &timer)) != SUCCESS) // send the subscribe packet
+    if ((rc = sendPacketPayload(c, len, (unsigned char*)message->payload, payloadlen, &timer)) != SUCCESS) // send the subscribe packet
         goto exit; // there was a problem
 
-    if (message->qos == QOS1)
-    {
-        if (waitfor(c, PUBACK, &timer) == PUBACK)
-        {
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
-                rc = FAILURE;
-        }
-        else
-            rc = FAILURE;
-    }
-    else if (message->qos == QOS2)
+    rc = waitforPublishAck(c, message->qos, &timer);
+
+exit:
+    if (rc == FAILURE)
+        MQTTCloseSession(c);
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
+int MQTTPreparePublish(MQTTPublishHandle* handle, const char* topicName, enum QoS qos, unsigned char retained)
+{
+    MQTTString topic = MQTTString_initializer;
+    MQTTPublishTemplate tmpl;
+    topic.cstring = (char *)topicName;
+
+    if (MQTTSerialize_preparePublish(&tmpl, handle->topic, sizeof(handle->topic), qos, retained, topic) <= 0)
     {
-        if (waitfor(c, PUBCOMP, &timer) == PUBCOMP)
-        {
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1)
-                rc = FAILURE;
-        }
-        else
-            rc = FAILURE;
+        handle->header = 0; // MQTTPublishPrepared refuses it
+        handle->topiclen = 0;
+        return BUFFER_OVERFLOW;
     }
+    handle->header = tmpl.header;
+    handle->topiclen = tmpl.topiclen;
+    return SUCCESS;
+}
+
+
+int MQTTPublishPrepared(MQTTClient* c, const MQTTPublishHandle* handle, void* payload, size_t payloadlen)
+{
+    int rc = FAILURE;
+    Timer timer;
+    MQTTHeader header;
+    MQTTPublishTemplate tmpl;
+    unsigned short id = 0;
+    int len = 0;
+
+    if (handle->header == 0)
+        return FAILURE; // not prepared
+    tmpl.header = handle->header;
+    tmpl.topic = (unsigned char*)handle->topic;
+    tmpl.topiclen = handle->topiclen;
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+	  if (!c->isconnected)
+		    goto exit;
+
+    TimerInit(&timer);
+    TimerCountdownMS(&timer, c->command_timeout_ms);
+
+    header.byte = tmpl.header;
+    if (header.bits.qos == QOS1 || header.bits.qos == QOS2)
+        id = getNextPacketId(c);
+
+    len = MQTTSerialize_publishPrepared(c->buf, c->buf_size, &tmpl, 0, id, (unsigned char*)payload, payloadlen);
+    if (len <= 0)
+        goto exit;
+    if ((rc = sendPacket(c, len, &timer)) != SUCCESS)
+        goto exit;
+
+    rc = waitforPublishAck(c, header.bits.qos, &timer);
 
 exit:
     if (rc == FAILURE)
@@ -676,6 +956,82 @@ exit:
 }
 
 
+int MQTTSetPriorityClass(MQTTClient* c, enum MQTTPriority prio, unsigned char* queuebuf,
+       size_t queuebuf_size, unsigned int rate, unsigned int burst)
+{
+    MQTTOutboundQueue* q;
+
+    if ((int)prio < 0 || prio >= MQTT_PRIORITY_CLASSES)
+        return FAILURE;
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+    q = &c->outbound[prio];
+    q->buf = queuebuf;
+    q->buf_size = (queuebuf != NULL) ? queuebuf_size : 0;
+    q->head = q->used = 0;
+    q->rate = rate;
+    q->burst = burst;
+    q->tokens = (unsigned long)burst * 1000; // start with a full bucket
+    q->refill_ms = TimerGetTickMS();
+    q->dropped = 0;
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return SUCCESS;
+}
+
+
+int MQTTPublishWithPriority(MQTTClient* c, const char* topicName, MQTTMessage* message, enum MQTTPriority prio)
+{
+    int rc = FAILURE;
+    MQTTOutboundQueue* q;
+    MQTTString topic = MQTTString_initializer;
+    topic.cstring = (char *)topicName;
+    unsigned char lenbytes[2];
+    int len = 0;
+
+    if ((int)prio < 0 || prio >= MQTT_PRIORITY_CLASSES)
+        return FAILURE;
+    q = &c->outbound[prio];
+    if (q->buf == NULL) // no queue for this class: publish straight away
+        return MQTTPublish(c, topicName, message);
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+	  if (!c->isconnected)
+		    goto exit;
+
+    if (message->qos == QOS1 || message->qos == QOS2)
+        message->id = getNextPacketId(c);
+
+    len = MQTTSerialize_publish(c->buf, c->buf_size, 0, message->qos, message->retained, message->id,
+              topic, (unsigned char*)message->payload, message->payloadlen);
+    if (len <= 0)
+        goto exit;
+    if (len > 0xFFFF || (q->rate > 0 && (unsigned int)len > q->burst) || q->used + 2 + len > q->buf_size)
+    {
+        q->dropped++;
+        rc = BUFFER_OVERFLOW;
+        goto exit;
+    }
+    lenbytes[0] = (unsigned char)(len >> 8);
+    lenbytes[1] = (unsigned char)(len & 0xFF);
+    queuePut(q, lenbytes, 2);
+    queuePut(q, c->buf, len);
+
+    rc = dispatch(c);
+
+exit:
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
 int MQTTDisconnect(MQTTClient* c)
 {
     int rc = FAILURE;
@@ -698,3 +1054,341 @@ int MQTTDisconnect(MQTTClient* c)
 #endif
     return rc;
 }
+
+
+/* Non-blocking client: requests return once sent, MQTTClient_poll completes them */
+
+static MQTTPendingOp* newPending(MQTTClient* c, int ack, unsigned short packetid,
+       MQTTCompletionHandler fp, void* context)
+{
+    int i;
+
+    for (i = 0; i < MQTT_PENDING_MAX; ++i)
+    {
+        MQTTPendingOp* op = &c->pending[i];
+
+        if (op->ack == 0)
+        {
+            op->ack = ack;
+            op->packetid = packetid;
+            op->topicFilter = NULL;
+            op->handler = NULL;
+            op->fp = fp;
+            op->context = context;
+            TimerInit(&op->timeout);
+            TimerCountdownMS(&op->timeout, c->command_timeout_ms);
+            return op;
+        }
+    }
+    return NULL;
+}
+
+
+static MQTTPendingOp* findPending(MQTTClient* c, int ack, unsigned short packetid)
+{
+    int i;
+
+    for (i = 0; i < MQTT_PENDING_MAX; ++i)
+    {
+        if (c->pending[i].ack == ack && c->pending[i].packetid == packetid)
+            return &c->pending[i];
+    }
+    return NULL;
+}
+
+
+static void completePending(MQTTPendingOp* op, int rc)
+{
+    MQTTCompletionHandler fp = op->fp;
+    void* context = op->context;
+
+    op->ack = 0; // free the record first, so that the handler can start another request
+    if (fp != NULL)
+        fp(context, rc);
+}
+
+
+/* Matches an acknowledgement read by MQTTClient_poll with the request waiting for it */
+static void ackPending(MQTTClient* c, int packet_type)
+{
+    MQTTPendingOp* op = NULL;
+    unsigned short mypacketid = 0;
+    int rc = FAILURE;
+
+    switch (packet_type)
+    {
+        case CONNACK:
+        {
+            unsigned char connack_rc = 255, sessionPresent = 0;
+            if ((op = findPending(c, CONNACK, 0)) == NULL)
+                break;
+            if (MQTTDeserialize_connack(&sessionPresent, &connack_rc, c->readbuf, c->readbuf_size) == 1 && connack_rc == 0)
+            {
+                c->isconnected = 1;
+                c->ping_outstanding = 0;
+                rc = SUCCESS;
+            }
+            break;
+        }
+        case PUBACK:
+        case PUBCOMP:
+        {
+            unsigned char dup, type;
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) == 1 &&
+                (op = findPending(c, packet_type, mypacketid)) != NULL)
+                rc = SUCCESS;
+            break;
+        }
+        case SUBACK:
+        {
+            int count = 0, grantedQoS = QOS0;
+            if (MQTTDeserialize_suback(&mypacketid, 1, &count, &grantedQoS, c->readbuf, c->readbuf_size) != 1 ||
+                (op = findPending(c, SUBACK, mypacketid)) == NULL)
+                break;
+            if (grantedQoS != 0x80)
+                rc = MQTTSetMessageHandler(c, op->topicFilter, op->handler);
+            break;
+        }
+        case UNSUBACK:
+            if (MQTTDeserialize_unsuback(&mypacketid, c->readbuf, c->readbuf_size) != 1 ||
+                (op = findPending(c, UNSUBACK, mypacketid)) == NULL)
+                break;
+            /* remove the subscription message handler associated with this topic, if there is one */
+            MQTTSetMessageHandler(c, op->topicFilter, NULL);
+            rc = SUCCESS;
+            break;
+    }
+
+    if (op != NULL)
+        completePending(op, rc);
+}
+
+
+/* Fails the requests not acknowledged in time, or all of them when the connection is lost */
+static void expirePending(MQTTClient* c, int all)
+{
+    int i;
+
+    for (i = 0; i < MQTT_PENDING_MAX; ++i)
+    {
+        if (c->pending[i].ack != 0 && (all || TimerIsExpired(&c->pending[i].timeout)))
+            completePending(&c->pending[i], FAILURE);
+    }
+}
+
+
+int MQTTClient_poll(MQTTClient* c)
+{
+    int rc = SUCCESS;
+    int packet_type;
+    Timer timer;
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+	  if (!c->isconnected && findPending(c, CONNACK, 0) == NULL)
+    {
+        expirePending(c, 1);
+        rc = FAILURE;
+        goto exit;
+    }
+
+    TimerInit(&timer);
+    TimerCountdownMS(&timer, c->command_timeout_ms); // bounds the acks and pings sent in reply only
+
+    do  // until the network holds no complete packet
+    {
+        packet_type = MQTTPacket_readnb(c->readbuf, c->readbuf_size, &c->transport);
+        if (packet_type > 0)
+        {
+            MQTT_PACKET_RECEIVED(c->readbuf);
+            if (c->keepAliveInterval > 0)
+                TimerCountdown(&c->last_received, c->keepAliveInterval); // record the fact that we have successfully received a packet
+            ackPending(c, packet_type);
+        }
+
+        if (handlePacket(c, packet_type, &timer) < 0)
+        {
+            c->transport.state = 0;
+            expirePending(c, 1);
+            rc = FAILURE;
+            goto exit;
+        }
+    } while (packet_type > 0);
+    expirePending(c, 0);
+
+exit:
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
+/* Sends the packet serialized in c->buf, and any payload left out of it, for a request recorded in op */
+static int sendRequest(MQTTClient* c, int len, unsigned char* payload, int payloadlen, MQTTPendingOp* op)
+{
+    Timer timer;
+
+    TimerInit(&timer);
+    TimerCountdownMS(&timer, c->command_timeout_ms);
+    if (len > 0 && sendPacketPayload(c, len, payload, payloadlen, &timer) == SUCCESS)
+        return SUCCESS;
+
+    op->ack = 0;
+    if (len > 0)
+        MQTTCloseSession(c);
+    return FAILURE;
+}
+
+
+int MQTTConnectNB(MQTTClient* c, MQTTPacket_connectData* options, MQTTCompletionHandler fp, void* context)
+{
+    int rc = FAILURE;
+    MQTTPacket_connectData default_options = MQTTPacket_connectData_initializer;
+    MQTTPendingOp* op;
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+	  if (c->isconnected || findPending(c, CONNACK, 0) != NULL)
+		  goto exit;
+
+    if ((op = newPending(c, CONNACK, 0, fp, context)) == NULL)
+    {
+        rc = BUFFER_OVERFLOW;
+        goto exit;
+    }
+
+    if (options == 0)
+        options = &default_options; /* set default options if none were supplied */
+
+    c->keepAliveInterval = options->keepAliveInterval;
+    c->cleansession = options->cleansession;
+    TimerCountdown(&c->last_received, c->keepAliveInterval);
+    c->transport.state = 0;
+    rc = sendRequest(c, MQTTSerialize_connect(c->buf, c->buf_size, options), NULL, 0, op);
+
+exit:
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
+int MQTTPublishNB(MQTTClient* c, const char* topicName, MQTTMessage* message,
+       MQTTCompletionHandler fp, void* context)
+{
+    int rc = FAILURE;
+    MQTTString topic = MQTTString_initializer;
+    topic.cstring = (char *)topicName;
+    MQTTPendingOp* op = NULL;
+    Timer timer;
+    int len = 0;
+    int payloadlen = 0;
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+	  if (!c->isconnected)
+		    goto exit;
+
+    if (message->qos == QOS1 || message->qos == QOS2)
+    {
+        message->id = getNextPacketId(c);
+        if ((op = newPending(c, (message->qos == QOS1) ? PUBACK : PUBCOMP, message->id, fp, context)) == NULL)
+        {
+            rc = BUFFER_OVERFLOW;
+            goto exit;
+        }
+    }
+
+    len = serializePublish(c, topic, message, &payloadlen);
+    if (op != NULL)
+        rc = sendRequest(c, len, (unsigned char*)message->payload, payloadlen, op);
+    else if (len > 0)
+    {
+        TimerInit(&timer);
+        TimerCountdownMS(&timer, c->command_timeout_ms);
+        if ((rc = sendPacketPayload(c, len, (unsigned char*)message->payload, payloadlen, &timer)) != SUCCESS)
+            MQTTCloseSession(c);
+        else if (fp != NULL)
+            fp(context, SUCCESS); // QoS 0 is complete once sent
+    }
+
+exit:
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
+int MQTTSubscribeNB(MQTTClient* c, const char* topicFilter, enum QoS qos, messageHandler messageHandler,
+       MQTTCompletionHandler fp, void* context)
+{
+    int rc = FAILURE;
+    MQTTString topic = MQTTString_initializer;
+    topic.cstring = (char *)topicFilter;
+    MQTTPendingOp* op;
+    unsigned short id;
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+	  if (!c->isconnected)
+		    goto exit;
+    if (messageHandler != NULL && !topicFilterFits(topicFilter))
+    {
+        rc = BUFFER_OVERFLOW;
+        goto exit;
+    }
+
+    id = getNextPacketId(c);
+    if ((op = newPending(c, SUBACK, id, fp, context)) == NULL)
+    {
+        rc = BUFFER_OVERFLOW;
+        goto exit;
+    }
+    op->topicFilter = topicFilter;
+    op->handler = messageHandler;
+    rc = sendRequest(c, MQTTSerialize_subscribe(c->buf, c->buf_size, 0, id, 1, &topic, (int*)&qos), NULL, 0, op);
+
+exit:
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
+
+
+int MQTTUnsubscribeNB(MQTTClient* c, const char* topicFilter, MQTTCompletionHandler fp, void* context)
+{
+    int rc = FAILURE;
+    MQTTString topic = MQTTString_initializer;
+    topic.cstring = (char *)topicFilter;
+    MQTTPendingOp* op;
+    unsigned short id;
+
+#if defined(MQTT_TASK)
+	  MutexLock(&c->mutex);
+#endif
+	  if (!c->isconnected)
+		    goto exit;
+
+    id = getNextPacketId(c);
+    if ((op = newPending(c, UNSUBACK, id, fp, context)) == NULL)
+    {
+        rc = BUFFER_OVERFLOW;
+        goto exit;
+    }
+    op->topicFilter = topicFilter;
+    rc = sendRequest(c, MQTTSerialize_unsubscribe(c->buf, c->buf_size, 0, id, 1, &topic), NULL, 0, op);
+
+exit:
+#if defined(MQTT_TASK)
+	  MutexUnlock(&c->mutex);
+#endif
+    return rc;
+}
@@ -24,8 +24,10 @@
  #undef SUCCESS
  #endif
  
+ #if !defined(MQTTCLIENT_PLATFORM_HEADER) /* B-L475E-IOT01A port: HAL tick Timer, ES-WiFi Network */
  #include "Timer.h"
  #include "MQTTInterface.h"
+ #endif
  
  #if !defined(__MQTT_CLIENT_C_)
  #define __MQTT_CLIENT_C_
@@ -47,6 +49,7 @@
  
  #include "MQTTPacket.h"
  #include "stdio.h"
+ #include <stdint.h>
  
  #if defined(MQTTCLIENT_PLATFORM_HEADER)
    /* Convert MQTTCLIENT_PLATFORM_HEADER value into a string constant */
@@ -55,11 +58,9 @@
    #include xstr(MQTTCLIENT_PLATFORM_HEADER)
  #endif
  
- #define MAX_PACKET_ID 65535 /* according to the MQTT specification - do not change! */
+ #include "MQTTClientConfig.h" /* table and buffer sizes */
  
- #if !defined(MAX_MESSAGE_HANDLERS)
-   #define MAX_MESSAGE_HANDLERS 5 /* redefinable - how many subscriptions do you want? */
- #endif
+ #define MAX_PACKET_ID 65535 /* according to the MQTT specification - do not change! */
  
  enum QoS { QOS0, QOS1, QOS2, SUBFAIL = 0x80 };
  
@@ -68,6 +69,9 @@
  #undef SUCCESS
  #endif
  enum returnCode { BUFFER_OVERFLOW = -2, FAILURE = -1, MQTT_SUCCESS = 0 };
+ #if defined(MQTTCLIENT_PLATFORM_HEADER)
+ #define SUCCESS MQTT_SUCCESS /* the firmware build takes SUCCESS from the HAL ErrorStatus */
+ #endif
  
  /* The Platform specific header must define the Network and Timer structures and functions
   * which operate on them.
@@ -86,6 +90,7 @@
  extern void TimerCountdownMS(Timer*, unsigned int);
  extern void TimerCountdown(Timer*, unsigned int);
  extern int TimerLeftMS(Timer*);
+ extern uint64_t TimerGetTickMS(void); /* monotonic milliseconds, for the token buckets */
  
  typedef struct MQTTMessage {
      enum QoS qos;
@@ -111,6 +116,50 @@
  } MQTTSubackData;
  
  typedef void (*messageHandler)(MessageData*);
+
+/* Completion of a non-blocking request, called from MQTTClient_poll: rc is SUCCESS, or
+ * FAILURE when the request was refused, timed out or the connection was lost.
+ */
+typedef void (*MQTTCompletionHandler)(void* context, int rc);
+
+/* A non-blocking request waiting for its acknowledgement */
+typedef struct MQTTPendingOp {
+    int ack;                    /* packet type awaited, 0 for a free record */
+    unsigned short packetid;
+    Timer timeout;
+    const char* topicFilter;    /* SUBSCRIBE and UNSUBSCRIBE: the filter whose handler is set on the ack */
+    messageHandler handler;
+    MQTTCompletionHandler fp;
+    void* context;
+} MQTTPendingOp;
+
+/* A publish topic, QoS and retained flag serialized once by MQTTPreparePublish.  It holds
+ * no pointer into itself, so it may be copied: the MQTTPublishTemplate is made up on each
+ * publish.
+ */
+typedef struct MQTTPublishHandle {
+    unsigned char header;       /* fixed header byte, 0 until prepared */
+    int topiclen;               /* length of the serialized topic name */
+    unsigned char topic[2 + MQTT_PREPARED_TOPIC_MAX];
+} MQTTPublishHandle;
+ 
+ /* Outbound priority classes, dispatched in this order */
+ enum MQTTPriority { MQTT_PRIORITY_CRITICAL, MQTT_PRIORITY_NORMAL, MQTT_PRIORITY_BULK, MQTT_PRIORITY_CLASSES };
+ 
+ /* Per-class outbound queue of serialized PUBLISH packets, rate limited by a token bucket
+  * counted in bytes.  Each entry is a 2 byte length followed by the packet.
+  */
+ typedef struct MQTTOutboundQueue {
+     unsigned char *buf;
+     size_t buf_size,
+            head,               /* offset of the oldest entry */
+            used;               /* bytes queued, including the length prefixes */
+     unsigned int rate,         /* bytes per second, 0 for unlimited */
+                  burst;        /* bucket depth in bytes */
+     unsigned long tokens;      /* in 1/1000 bytes */
+     uint64_t refill_ms;        /* TimerGetTickMS() when tokens were last added */
+     unsigned int dropped;      /* publishes refused because the queue was full */
+ } MQTTOutboundQueue;
  
  typedef struct MQTTClient {
      unsigned int next_packetid,
@@ -127,12 +176,20 @@
      struct MessageHandlers {
          const char* topicFilter;
          void (*fp)(MessageData*);
+ #if MQTT_TOPIC_FILTER_MAX > 0
+         char topicFilterBuf[MQTT_TOPIC_FILTER_MAX];
+ #endif
      } messageHandlers[MAX_MESSAGE_HANDLERS];  /* Indexed by subscription topic */
  
      void (*defaultMessageHandler)(MessageData*);
  
      Network* ipstack;
      Timer last_sent, last_received;
+ 
+     MQTTOutboundQueue outbound[MQTT_PRIORITY_CLASSES];
+
+    MQTTTransport transport;                /* packet read state of MQTTClient_poll */
+    MQTTPendingOp pending[MQTT_PENDING_MAX];
  #if defined(MQTT_TASK)
      Mutex mutex;
      Thread thread;
@@ -175,6 +232,53 @@
   */
  DLLExport int MQTTPublish(MQTTClient* client, const char* topic, MQTTMessage* message);
  
+ /** MQTT PreparePublish - serialize the fixed header and topic name of publishes to a
+ *  topic once, for a topic that is published to repeatedly.
+ *  @param handle The handle to fill in, used with MQTTPublishPrepared.
+ *  @param topic The topic to publish to, at most MQTT_PREPARED_TOPIC_MAX bytes.
+ *  @param qos The QoS of the publishes.
+ *  @param retained The retained flag of the publishes.
+ *  @return success code, BUFFER_OVERFLOW if the topic is too long.
+ */
+DLLExport int MQTTPreparePublish(MQTTPublishHandle* handle, const char* topic, enum QoS qos, unsigned char retained);
+
+/** MQTT Publish prepared - send an MQTT PUBLISH packet to a prepared topic and wait for
+ *  acknowledgements.  Only the remaining length, packet id and payload are serialized.
+ *  @param handle The handle filled in by MQTTPreparePublish.
+ *  @param payload The message payload.
+ *  @param payloadlen The length of the payload.
+ *  @return success code, FAILURE without sending anything if the handle was not prepared.
+ */
+DLLExport int MQTTPublishPrepared(MQTTClient* client, const MQTTPublishHandle* handle, void* payload, size_t payloadlen);
+
+/** MQTT SetPriorityClass - attach a queue and a token bucket to an outbound priority class.
+  *  Classes without a queue publish immediately, as MQTTPublish.
+  *  @param prio The priority class.
+  *  @param queuebuf Buffer holding the queued packets, or NULL to detach.
+  *  @param queuebuf_size Size of the queue buffer.
+  *  @param rate Sustained rate in bytes per second, 0 for unlimited.
+  *  @param burst Bucket depth in bytes; the largest packet the class can send.
+  *  @return success code.
+  */
+ DLLExport int MQTTSetPriorityClass(MQTTClient* client, enum MQTTPriority prio, unsigned char* queuebuf,
+                                    size_t queuebuf_size, unsigned int rate, unsigned int burst);
+ 
+ /** MQTT Publish with priority - queue an MQTT PUBLISH packet in a priority class and dispatch
+  *  whatever the token buckets allow.  Acknowledgements of QoS 1 and 2 messages are waited
+  *  for when the packet is dispatched.
+  *  @param topic The topic to publish to.
+  *  @param message The MQTT message.
+  *  @param prio The priority class.
+  *  @return success code, BUFFER_OVERFLOW if the class queue is full.
+  */
+ DLLExport int MQTTPublishWithPriority(MQTTClient* client, const char* topic, MQTTMessage* message, enum MQTTPriority prio);
+ 
+ /** MQTT Dispatch - send queued packets, highest priority class first, while their token
+  *  buckets allow.  Called from MQTTYield and MQTTPublishWithPriority.
+  *  @return success code.
+  */
+ DLLExport int MQTTDispatch(MQTTClient* client);
+ 
  /** MQTT SetMessageHandler - set or remove a per-topic message handler.
   *  @param topicFilter The topic filter for which the message handler is set.
   *  @param messageHandler Pointer to the message handler function, or NULL to remove.
@@ -185,7 +289,8 @@
  /** MQTT Subscribe - send an MQTT SUBSCRIBE packet and wait for SUBACK.
   *  @param topicFilter The topic filter to subscribe to.
   *  @param messageHandler Pointer to the message handler.
-  *  @return success code.
+  *  @return success code, BUFFER_OVERFLOW without sending anything if the topic filter
+  *  does not fit MQTT_TOPIC_FILTER_MAX.
   */
  DLLExport int MQTTSubscribe(MQTTClient* client, const char* topicFilter, enum QoS, messageHandler);
  
@@ -193,7 +298,7 @@
   *  @param topicFilter The topic filter to subscribe to.
   *  @param messageHandler Pointer to the message handler.
   *  @param data Pointer to MQTTSubackData to receive the granted QoS.
-  *  @return success code.
+  *  @return success code, BUFFER_OVERFLOW as for MQTTSubscribe.
   */
  DLLExport int MQTTSubscribeWithResults(MQTTClient* client, const char* topicFilter, enum QoS, messageHandler, MQTTSubackData* data);
  
@@ -214,7 +319,55 @@
   */
  DLLExport int MQTTYield(MQTTClient* client, int time);
  
- /** MQTT isConnected - Macro to check if the client is connected.
+ /** MQTT Connect, non-blocking - send an MQTT CONNECT packet and return.  MQTTClient_poll
+ *  completes the request when the CONNACK arrives.
+ *  The non-blocking requests and MQTTClient_poll replace the blocking calls and MQTTYield:
+ *  do not mix the two while requests are pending.
+ *  @param options - CONNECT options.
+ *  @param fp Completion handler, may be NULL.
+ *  @param context Passed to the completion handler.
+ *  @return success code once sent, BUFFER_OVERFLOW if MQTT_PENDING_MAX requests are pending.
+ */
+DLLExport int MQTTConnectNB(MQTTClient* client, MQTTPacket_connectData* options, MQTTCompletionHandler fp, void* context);
+
+/** MQTT Publish, non-blocking - send an MQTT PUBLISH packet and return.  QoS 0 completes
+ *  once sent, QoS 1 and 2 when MQTTClient_poll reads the PUBACK or PUBCOMP.
+ *  @param topic The topic to publish to.
+ *  @param message The MQTT message.
+ *  @param fp Completion handler, may be NULL.
+ *  @param context Passed to the completion handler.
+ *  @return success code once sent, BUFFER_OVERFLOW if MQTT_PENDING_MAX requests are pending.
+ */
+DLLExport int MQTTPublishNB(MQTTClient* client, const char* topic, MQTTMessage* message,
+                            MQTTCompletionHandler fp, void* context);
+
+/** MQTT Subscribe, non-blocking - send an MQTT SUBSCRIBE packet and return.  The message
+ *  handler is set when MQTTClient_poll reads a SUBACK granting the subscription.
+ *  @param topicFilter The topic filter to subscribe to, which must stay valid until then.
+ *  @param messageHandler Pointer to the message handler.
+ *  @param fp Completion handler, may be NULL.
+ *  @param context Passed to the completion handler.
+ *  @return success code once sent, BUFFER_OVERFLOW if MQTT_PENDING_MAX requests are pending
+ *  or the topic filter does not fit MQTT_TOPIC_FILTER_MAX.
+ */
+DLLExport int MQTTSubscribeNB(MQTTClient* client, const char* topicFilter, enum QoS, messageHandler,
+                              MQTTCompletionHandler fp, void* context);
+
+/** MQTT Unsubscribe, non-blocking - send an MQTT UNSUBSCRIBE packet and return.
+ *  @param topicFilter The topic filter to unsubscribe from, which must stay valid until the UNSUBACK.
+ *  @param fp Completion handler, may be NULL.
+ *  @param context Passed to the completion handler.
+ *  @return success code once sent, BUFFER_OVERFLOW if MQTT_PENDING_MAX requests are pending.
+ */
+DLLExport int MQTTUnsubscribeNB(MQTTClient* client, const char* topicFilter, MQTTCompletionHandler fp, void* context);
+
+/** MQTT poll - read whatever bytes the network already holds without waiting, process the
+ *  packets they complete, complete or time out pending requests and send keepalive pings.
+ *  @return success code, FAILURE when the connection is lost or not connected.
+ */
+DLLExport int MQTTClient_poll(MQTTClient* client);
+
+/** MQTT isConnected - Macro to check if the client is connected.
   *  @param client The MQTT client.
   *  @return Non-zero if connected, zero otherwise.
   */
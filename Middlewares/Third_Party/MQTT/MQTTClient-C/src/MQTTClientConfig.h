@@ -0,0 +1,88 @@
+/*******************************************************************************
+ * Static memory profile of the MQTT Embedded Client.
+ *
+ * Every table and buffer used by the client is sized here at compile time; the
+ * client allocates nothing at run time and keeps no buffer on the stack larger
+ * than a Timer.  A product variant overrides any of these values by defining
+ * MQTTCLIENT_CONFIG_HEADER to the name of its own header, which is included
+ * first, or by passing the macros on the compiler command line.
+ *******************************************************************************/
+
+#ifndef MQTTCLIENTCONFIG_H
+#define MQTTCLIENTCONFIG_H
+
+#if defined(MQTTCLIENT_CONFIG_HEADER)
+  #define xstr(s) str(s)
+  #define str(s) #s
+  #include xstr(MQTTCLIENT_CONFIG_HEADER)
+#endif
+
+/* Number of subscriptions, i.e. message handler slots in MQTTClient. */
+#if !defined(MAX_MESSAGE_HANDLERS)
+  #define MAX_MESSAGE_HANDLERS 5
+#endif
+
+/* Topic filter pool: bytes reserved per handler slot for a copy of its topic
+ * filter, including the terminating NUL.  0 keeps a pointer to the caller's
+ * string instead, which must then stay valid while subscribed.
+ */
+#if !defined(MQTT_TOPIC_FILTER_MAX)
+  #define MQTT_TOPIC_FILTER_MAX 0
+#endif
+
+/* Requests of the non-blocking client (MQTTConnectNB() and friends) that can wait
+ * for their acknowledgement at the same time.
+ */
+#if !defined(MQTT_PENDING_MAX)
+  #define MQTT_PENDING_MAX 4
+#endif
+
+/* Longest topic name, in bytes, of a publish prepared with MQTTPreparePublish(). */
+#if !defined(MQTT_PREPARED_TOPIC_MAX)
+  #define MQTT_PREPARED_TOPIC_MAX 64
+#endif
+
+/* Send and read buffers passed to MQTTClientInit().  The largest packet the
+ * client can send or receive is bounded by these.
+ */
+#if !defined(MQTT_SENDBUF_SIZE)
+  #define MQTT_SENDBUF_SIZE 256
+#endif
+#if !defined(MQTT_READBUF_SIZE)
+  #define MQTT_READBUF_SIZE 256
+#endif
+
+/* Outbound queue buffers passed to MQTTSetPriorityClass(), one per class.
+ * 0 leaves the class unqueued: its publishes are sent immediately.
+ */
+#if !defined(MQTT_QUEUE_CRITICAL_SIZE)
+  #define MQTT_QUEUE_CRITICAL_SIZE 0
+#endif
+#if !defined(MQTT_QUEUE_NORMAL_SIZE)
+  #define MQTT_QUEUE_NORMAL_SIZE 0
+#endif
+#if !defined(MQTT_QUEUE_BULK_SIZE)
+  #define MQTT_QUEUE_BULK_SIZE 0
+#endif
+
+/* Packet hooks, e.g. for run-time statistics: MQTT_PACKET_SENT is called with
+ * each packet sent, from its fixed header (a publish may lack its payload, see
+ * serializePublish), and MQTT_PACKET_RECEIVED with each complete packet read.
+ * Both compile to nothing unless the variant defines them.
+ */
+#if !defined(MQTT_PACKET_SENT)
+  #define MQTT_PACKET_SENT(buf)
+#endif
+#if !defined(MQTT_PACKET_RECEIVED)
+  #define MQTT_PACKET_RECEIVED(buf)
+#endif
+
+/* Static RAM used by one client with the buffers above. */
+#define MQTTCLIENT_STATIC_RAM (sizeof(MQTTClient) + MQTT_SENDBUF_SIZE + MQTT_READBUF_SIZE + \
+        MQTT_QUEUE_CRITICAL_SIZE + MQTT_QUEUE_NORMAL_SIZE + MQTT_QUEUE_BULK_SIZE)
+
+/* Define MQTTCLIENT_RAM_BUDGET to the bytes a variant allows for the client,
+ * and the build fails when MQTTCLIENT_STATIC_RAM exceeds it.
+ */
+
+#endif /* MQTTCLIENTCONFIG_H */
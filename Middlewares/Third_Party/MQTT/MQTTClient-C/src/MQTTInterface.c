@@ -2,15 +2,20 @@
 #include <stdint.h>
 #include "es_wifi.h"  // Provides WIFI_STATUS_OK, etc.
 #include "wifi.h"     // Provides function prototypes like WIFI_SendData, WIFI_ReceiveData, etc.
+#include "trace.h"    // TRACE_RECORD, compiled out unless USE_TRACE is defined
+#include "logging.h"  // LOG_DEFER, a binary record with USE_LOG_DEFER
 
-// Optional: define a debug macro if not defined elsewhere
+// Debug level: compiled out unless LOG_LEVEL is LOG_LEVEL_DEBUG
 #ifndef LOG
-#define LOG(a) // or you can define it as printf a
+#define LOG(a) NET_LOG a
+#define NET_LOG(...) LOG_DEFER(LOG_LEVEL_DEBUG, __VA_ARGS__)
 #endif
 
 int mqtt_network_read(Network* n, unsigned char* buffer, int len, int timeout_ms) {
     uint16_t respLen;
     if(WIFI_STATUS_OK == WIFI_ReceiveData(n->socket, buffer, len, &respLen, timeout_ms)) {
+        if (respLen > 0)
+            TRACE_RECORD(TRACE_MQTT_RX, n->socket, buffer, respLen);
         return respLen;
     }
     return -1;
@@ -21,6 +26,7 @@ int mqtt_network_write(Network* n, unsigned char* buffer, int len, int timeout_m
     uint16_t sentLen = 0;
     int ret = WIFI_SendData(n->socket, buffer, len, &sentLen, timeout_ms);
     if (ret == WIFI_STATUS_OK) {
+        TRACE_RECORD(TRACE_MQTT_TX, n->socket, buffer, sentLen);
         LOG(("mqtt_network_write: Sent %d bytes\n", sentLen));
         return sentLen;
     }
@@ -3,10 +3,13 @@
 
 #include "stm32l4xx_hal.h"  // for HAL_GetTick()
 
-/* Timer structure definition */
+/* Timer structure definition.
+ * Ticks are kept on a 64-bit millisecond time base extended from HAL_GetTick(),
+ * so a deadline never wraps during the lifetime of the device.
+ */
 typedef struct Timer {
-    uint32_t start_tick;
-    uint32_t timeout_tick;
+    uint64_t start_tick;
+    uint64_t timeout_tick;
 } Timer;
 
 /* Function prototypes expected by the MQTT client */
@@ -16,4 +19,12 @@ void TimerCountdownMS(Timer* timer, unsigned int ms);
 void TimerCountdown(Timer* timer, unsigned int seconds);
 int TimerLeftMS(Timer* timer);
 
+/* Monotonic time base.
+ * TimerIncTick() must be called from the tick interrupt right after HAL_IncTick()
+ * (SysTick_Handler, or the LPTIM/TIM handler when the HAL time base is moved there).
+ */
+void TimerIncTick(void);
+uint64_t TimerGetTickMS(void);
+uint64_t TimerGetTickUS(void);
+
 #endif // __TIMER_H__
@@ -1,13 +1,72 @@
 #include "Timer.h"
 #include "stm32l4xx_hal.h"  // Ensure HAL_GetTick() is declared
 
+/* Upper 32 bits of the millisecond time base, and the last HAL tick seen by the
+ * tick interrupt. Both are only written from TimerIncTick(). */
+static volatile uint32_t tick_high = 0;
+static volatile uint32_t tick_last = 0;
+
+/**
+ * @brief Extends the 32-bit HAL tick to 64 bits. Call from the tick interrupt after HAL_IncTick().
+ * @note  The wrap is detected by comparison rather than on zero, so a tick that jumps forward
+ *        (for example when HAL_GetTick() is compensated after Stop mode) is still handled.
+ */
+void TimerIncTick(void) {
+    uint32_t now = HAL_GetTick();
+
+    if (now < tick_last)
+        tick_high++;
+    tick_last = now;
+}
+
+/**
+ * @brief Returns the monotonic 64-bit millisecond tick.
+ * @return Milliseconds since HAL_Init().
+ */
+uint64_t TimerGetTickMS(void) {
+    uint32_t high, low;
+
+    /* The tick interrupt updates both halves together; retry if it ran in between */
+    do {
+        high = tick_high;
+        low = HAL_GetTick();
+    } while (high != tick_high);
+
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief Returns the monotonic tick in microseconds, interpolated from the SysTick counter.
+ * @return Microseconds since HAL_Init().
+ * @note  Intended for latency measurement; resolution is one SysTick clock.
+ *        With interrupts masked the tick interrupt cannot run, so a reload of the
+ *        counter only shows as a pending SysTick: that millisecond is added here.
+ */
+uint64_t TimerGetTickUS(void) {
+    uint64_t ms;
+    uint32_t load, val, pending;
+
+    do {
+        ms = TimerGetTickMS();
+        load = SysTick->LOAD;
+        val = SysTick->VAL;
+        pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+    } while (ms != TimerGetTickMS());
+
+    /* A reload after VAL was read leaves VAL near 0: that one is not counted yet */
+    if (pending && (val > load / 2u))
+        ms++;
+
+    return ms * 1000u + ((uint64_t)(load - val) * 1000u) / (load + 1u);
+}
+
 /**
  * @brief Initializes the timer structure.
  * @param timer Pointer to the Timer structure.
  */
 void TimerInit(Timer* timer) {
     if (timer != NULL) {
-        timer->start_tick = HAL_GetTick();
+        timer->start_tick = TimerGetTickMS();
         timer->timeout_tick = 0; // 0 means no timeout has been set yet.
     }
 }
@@ -19,9 +78,8 @@ void TimerInit(Timer* timer) {
  */
 void TimerCountdownMS(Timer* timer, unsigned int ms) {
     if (timer != NULL) {
-        timer->start_tick = HAL_GetTick();
+        timer->start_tick = TimerGetTickMS();
         timer->timeout_tick = timer->start_tick + ms;
-        /* Note: For long durations, you might consider wrap-around handling */
     }
 }
 
@@ -31,7 +89,10 @@ void TimerCountdownMS(Timer* timer, unsigned int ms) {
  * @param seconds Countdown duration in seconds.
  */
 void TimerCountdown(Timer* timer, unsigned int seconds) {
-    TimerCountdownMS(timer, seconds * 1000);
+    if (timer != NULL) {
+        timer->start_tick = TimerGetTickMS();
+        timer->timeout_tick = timer->start_tick + (uint64_t)seconds * 1000u;
+    }
 }
 
 /**
@@ -41,7 +102,7 @@ void TimerCountdown(Timer* timer, unsigned int seconds) {
  */
 char TimerIsExpired(Timer* timer) {
     if (timer != NULL) {
-        return (HAL_GetTick() >= timer->timeout_tick) ? 1 : 0;
+        return (TimerGetTickMS() >= timer->timeout_tick) ? 1 : 0;
     }
     return 1; // If no timer provided, treat as expired.
 }
@@ -49,16 +110,17 @@ char TimerIsExpired(Timer* timer) {
 /**
  * @brief Returns the remaining time in milliseconds.
  * @param timer Pointer to the Timer structure.
- * @return Remaining milliseconds before expiration, or 0 if expired or timer is NULL.
+ * @return Remaining milliseconds before expiration (saturated to INT32_MAX), or 0 if expired or timer is NULL.
  */
 int TimerLeftMS(Timer* timer) {
     if (timer != NULL) {
-        uint32_t now = HAL_GetTick();
+        uint64_t now = TimerGetTickMS();
         if (now >= timer->timeout_tick)
             return 0;
+        else if (timer->timeout_tick - now > INT32_MAX)
+            return INT32_MAX;
         else
             return (int)(timer->timeout_tick - now);
     }
     return 0;
 }
-
@@ -13,6 +13,7 @@
  * Contributors:
  *    Allan Stockdill-Mander - initial API and implementation and/or initial documentation
  *    Ian Craggs - return codes from linux_read
+ *    Non-blocking sockets with poll timeouts, TCP_NODELAY and gathered writes
  *******************************************************************************/
 
 #include "MQTTLinux.h"
@@ -59,34 +60,104 @@ int TimerLeftMS(Timer* timer)
 }
 
 
-int linux_read(Network* n, unsigned char* buffer, int len, int timeout_ms)
+uint64_t TimerGetTickMS(void)
 {
-	struct timeval interval = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
-	if (interval.tv_sec < 0 || (interval.tv_sec == 0 && interval.tv_usec <= 0))
-	{
-		interval.tv_sec = 0;
-		interval.tv_usec = 100;
-	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+/* Waits until the socket is ready for events, or timeout_ms passes: > 0 ready, 0 timed out, < 0 error */
+static int linux_wait(int sock, short events, int timeout_ms)
+{
+	struct pollfd pfd = {sock, events, 0};
+	int rc;
+
+	while ((rc = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR)
+		;
+	return rc;
+}
 
-	setsockopt(n->my_socket, SOL_SOCKET, SO_RCVTIMEO, (char *)&interval, sizeof(struct timeval));
 
+/*
+ * The socket is non-blocking, so the timeouts are poll() waits rather than
+ * SO_RCVTIMEO/SO_SNDTIMEO set on every call.  A timeout of 0 takes only what
+ * the socket already holds, which is what MQTTClient_poll() asks for.
+ */
+int linux_read(Network* n, unsigned char* buffer, int len, int timeout_ms)
+{
+	Timer timer;
 	int bytes = 0;
+
+	TimerInit(&timer);
+	TimerCountdownMS(&timer, (timeout_ms > 0) ? timeout_ms : 0);
 	while (bytes < len)
 	{
 		int rc = recv(n->my_socket, &buffer[bytes], (size_t)(len - bytes), 0);
-		if (rc == -1)
+		if (rc > 0)
+			bytes += rc;
+		else if (rc == 0)
 		{
-			if (errno != EAGAIN && errno != EWOULDBLOCK)
-			  bytes = -1;
+			if (bytes == 0)
+				bytes = -1;	/* closed by the peer */
 			break;
 		}
-		else if (rc == 0)
+		else if (errno == EINTR)
+			continue;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
 		{
-			bytes = 0;
+			bytes = -1;
 			break;
 		}
-		else
+		else if (TimerIsExpired(&timer) || linux_wait(n->my_socket, POLLIN, TimerLeftMS(&timer)) <= 0)
+			break;
+	}
+	return bytes;
+}
+
+
+/*
+ * Gathers iovcnt buffers into as few sendmsg() calls as the socket allows, so
+ * a packet header and its payload leave in one segment.  A partial write is
+ * resumed until everything is sent or the timeout passes; iov is advanced past
+ * the bytes sent.  Returns the bytes sent, or -1 if the connection failed.
+ */
+int linux_writev(Network* n, struct iovec* iov, int iovcnt, int timeout_ms)
+{
+	struct msghdr msg;
+	Timer timer;
+	int bytes = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+	TimerInit(&timer);
+	TimerCountdownMS(&timer, (timeout_ms > 0) ? timeout_ms : 0);
+	while (msg.msg_iovlen > 0)
+	{
+		ssize_t rc = sendmsg(n->my_socket, &msg, MSG_NOSIGNAL);
+		if (rc >= 0)
+		{
 			bytes += rc;
+			while (msg.msg_iovlen > 0 && (size_t)rc >= msg.msg_iov->iov_len)
+			{
+				rc -= msg.msg_iov->iov_len;
+				msg.msg_iov++;
+				msg.msg_iovlen--;
+			}
+			if (msg.msg_iovlen > 0)
+			{
+				msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + rc;
+				msg.msg_iov->iov_len -= rc;
+			}
+		}
+		else if (errno == EINTR)
+			continue;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+		else if (TimerIsExpired(&timer) || linux_wait(n->my_socket, POLLOUT, TimerLeftMS(&timer)) <= 0)
+			break;
 	}
 	return bytes;
 }
@@ -94,28 +165,24 @@ int linux_read(Network* n, unsigned char* buffer, int len, int timeout_ms)
 
 int linux_write(Network* n, unsigned char* buffer, int len, int timeout_ms)
 {
-	struct timeval tv;
-
-	tv.tv_sec = 0;  /* 30 Secs Timeout */
-	tv.tv_usec = timeout_ms * 1000;  // Not init'ing this can cause strange errors
+	struct iovec iov = {buffer, (size_t)len};
 
-	setsockopt(n->my_socket, SOL_SOCKET, SO_SNDTIMEO, (char *)&tv,sizeof(struct timeval));
-	int	rc = write(n->my_socket, buffer, len);
-	return rc;
+	return linux_writev(n, &iov, 1, timeout_ms);
 }
 
 
 void NetworkInit(Network* n)
 {
-	n->my_socket = 0;
+	n->my_socket = -1;
 	n->mqttread = linux_read;
 	n->mqttwrite = linux_write;
+	n->mqttwritev = linux_writev;
 }
 
 
 int NetworkConnect(Network* n, char* addr, int port)
 {
-	int type = SOCK_STREAM;
+	int type = SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC;
 	struct sockaddr_in address;
 	int rc = -1;
 	sa_family_t family = AF_INET;
@@ -152,8 +219,30 @@ int NetworkConnect(Network* n, char* addr, int port)
 	if (rc == 0)
 	{
 		n->my_socket = socket(family, type, 0);
-		if (n->my_socket != -1)
+		if (n->my_socket == -1)
+			rc = -1;
+		else
+		{
+			int one = 1;
+
+			/* MQTT packets are small and each one is written whole: do not wait to coalesce them */
+			setsockopt(n->my_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 			rc = connect(n->my_socket, (struct sockaddr*)&address, sizeof(address));
+			if (rc == -1 && errno == EINPROGRESS)
+			{
+				int err = 0;
+				socklen_t len = sizeof(err);
+
+				if (linux_wait(n->my_socket, POLLOUT, NETWORK_CONNECT_TIMEOUT_MS) > 0 &&
+						getsockopt(n->my_socket, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0)
+					rc = 0;
+			}
+			if (rc != 0)
+			{
+				close(n->my_socket);
+				n->my_socket = -1;
+			}
+		}
 	}
 
 	return rc;
@@ -162,5 +251,7 @@ int NetworkConnect(Network* n, char* addr, int port)
 
 void NetworkDisconnect(Network* n)
 {
-	close(n->my_socket);
+	if (n->my_socket != -1)
+		close(n->my_socket);
+	n->my_socket = -1;
 }
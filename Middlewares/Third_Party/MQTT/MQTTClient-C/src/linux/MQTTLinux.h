@@ -41,6 +41,10 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <time.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -56,16 +60,26 @@ char TimerIsExpired(Timer*);
 void TimerCountdownMS(Timer*, unsigned int);
 void TimerCountdown(Timer*, unsigned int);
 int TimerLeftMS(Timer*);
+uint64_t TimerGetTickMS(void);
 
 typedef struct Network
 {
 	int my_socket;
 	int (*mqttread) (struct Network*, unsigned char*, int, int);
 	int (*mqttwrite) (struct Network*, unsigned char*, int, int);
+	int (*mqttwritev) (struct Network*, struct iovec*, int, int);	/* may be NULL */
 } Network;
 
+/* The client sends a publish payload from the caller's memory through mqttwritev */
+#define MQTT_NETWORK_WRITEV 1
+
+#if !defined(NETWORK_CONNECT_TIMEOUT_MS)
+  #define NETWORK_CONNECT_TIMEOUT_MS 10000
+#endif
+
 int linux_read(Network*, unsigned char*, int, int);
 int linux_write(Network*, unsigned char*, int, int);
+int linux_writev(Network*, struct iovec*, int, int);
 
 DLLExport void NetworkInit(Network*);
 DLLExport int NetworkConnect(Network*, char*, int);
@@ -0,0 +1,414 @@
+/*******************************************************************************
+ * Tests of the non-blocking client (MQTTClient_poll and the NB requests) over a
+ * fake network that hands over the bytes a test queues, as they would arrive
+ * from the socket.  No broker is needed.  In the layout of test1.c.
+ *******************************************************************************/
+
+
+#include "MQTTClient.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+struct Options
+{
+	int verbose;
+	int test_no;
+} options =
+{
+	0,
+	0,
+};
+
+void getopts(int argc, char** argv)
+{
+	int count = 1;
+
+	while (count < argc)
+	{
+		if (strcmp(argv[count], "--test_no") == 0)
+		{
+			if (++count < argc)
+				options.test_no = atoi(argv[count]);
+		}
+		else if (strcmp(argv[count], "--verbose") == 0)
+		{
+			options.verbose = 1;
+			printf("\nSetting verbose on\n");
+		}
+		count++;
+	}
+}
+
+
+#define LOGA_DEBUG 0
+#define LOGA_INFO 1
+void MyLog(int LOGA_level, char* format, ...)
+{
+	static char msg_buf[256];
+	va_list args;
+	struct timeval now;
+	struct tm *timeinfo;
+
+	if (LOGA_level == LOGA_DEBUG && options.verbose == 0)
+	  return;
+
+	gettimeofday(&now, NULL);
+	timeinfo = localtime(&now.tv_sec);
+	strftime(msg_buf, 80, "%Y%m%d %H%M%S", timeinfo);
+
+	sprintf(&msg_buf[strlen(msg_buf)], ".%.3ld ", (long)now.tv_usec / 1000);
+
+	va_start(args, format);
+	vsnprintf(&msg_buf[strlen(msg_buf)], sizeof(msg_buf) - strlen(msg_buf), format, args);
+	va_end(args);
+
+	printf("%s\n", msg_buf);
+	fflush(stdout);
+}
+
+
+struct timeval start_clock(void)
+{
+	struct timeval start_time;
+	gettimeofday(&start_time, NULL);
+	return start_time;
+}
+
+
+long elapsed(struct timeval start_time)
+{
+	struct timeval now, res;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &start_time, &res);
+	return (res.tv_sec)*1000 + (res.tv_usec)/1000;
+}
+
+
+#define assert(a, b, c, d) myassert(__FILE__, __LINE__, a, b, c, d)
+
+int tests = 0;
+int failures = 0;
+FILE* xml;
+struct timeval global_start_time;
+char output[3000];
+char* cur_output = output;
+
+
+void write_test_result()
+{
+	long duration = elapsed(global_start_time);
+
+	fprintf(xml, " time=\"%ld.%.3ld\" >\n", duration / 1000, duration % 1000);
+	if (cur_output != output)
+	{
+		fprintf(xml, "%s", output);
+		cur_output = output;
+	}
+	fprintf(xml, "</testcase>\n");
+}
+
+
+void myassert(char* filename, int lineno, char* description, int value, char* format, ...)
+{
+	++tests;
+	if (!value)
+	{
+		va_list args;
+
+		++failures;
+		printf("Assertion failed, file %s, line %d, description: %s\n", filename, lineno, description);
+
+		va_start(args, format);
+		vprintf(format, args);
+		va_end(args);
+
+		cur_output += sprintf(cur_output, "<failure type=\"%s\">file %s, line %d </failure>\n",
+                        description, filename, lineno);
+	}
+    else
+    	MyLog(LOGA_DEBUG, "Assertion succeeded, file %s, line %d, description: %s", filename, lineno, description);
+}
+
+
+/* The fake network: bytes queued by netFeed are read back in order, what the
+ * client writes is kept in net_out, and net_broken fails both ways */
+static unsigned char net_in[1000];
+static int net_in_len, net_in_pos;
+static unsigned char net_out[1000];
+static int net_out_len;
+static int net_broken;
+
+
+int netRead(Network* n, unsigned char* buf, int len, int timeout_ms)
+{
+	int count = net_in_len - net_in_pos;
+
+	if (net_broken)
+		return -1;
+	if (count > len)
+		count = len;
+	memcpy(buf, &net_in[net_in_pos], count);
+	net_in_pos += count;
+	return count;
+}
+
+
+int netWrite(Network* n, unsigned char* buf, int len, int timeout_ms)
+{
+	if (net_broken)
+		return -1;
+	memcpy(&net_out[net_out_len], buf, len);
+	net_out_len += len;
+	return len;
+}
+
+
+int netWritev(Network* n, struct iovec* iov, int iovcnt, int timeout_ms)
+{
+	int i, sent = 0;
+
+	for (i = 0; i < iovcnt; ++i)
+	{
+		int rc = netWrite(n, iov[i].iov_base, iov[i].iov_len, timeout_ms);
+
+		if (rc < 0)
+			return -1;
+		sent += rc;
+	}
+	return sent;
+}
+
+
+/* A new connection: nothing queued either way */
+void netReset(void)
+{
+	net_in_len = net_in_pos = 0;
+	net_out_len = 0;
+	net_broken = 0;
+}
+
+
+void netFeed(const unsigned char* data, int len)
+{
+	memcpy(&net_in[net_in_len], data, len);
+	net_in_len += len;
+}
+
+
+static const unsigned char connack[] = {0x20, 0x02, 0x00, 0x00};
+
+/* Queues an incoming QoS 0 PUBLISH, or its first part bytes if part > 0 */
+int feedPublish(char* topic, char* payload, int part)
+{
+	unsigned char buf[200];
+	MQTTString topicString = MQTTString_initializer;
+	int len;
+
+	topicString.cstring = topic;
+	len = MQTTSerialize_publish(buf, sizeof(buf), 0, 0, 0, 0, topicString, (unsigned char*)payload, strlen(payload));
+	netFeed(buf, (part > 0) ? part : len);
+	return len;
+}
+
+
+/* Messages delivered to messageArrived */
+static int arrived;
+static char arrived_topic[100];
+static char arrived_payload[100];
+
+void messageArrived(MessageData* md)
+{
+	++arrived;
+	snprintf(arrived_topic, sizeof(arrived_topic), "%.*s", md->topicName->lenstring.len, md->topicName->lenstring.data);
+	snprintf(arrived_payload, sizeof(arrived_payload), "%.*s", (int)md->message->payloadlen, (char*)md->message->payload);
+}
+
+
+void requestDone(void* context, int rc)
+{
+	*(int*)context = rc;
+}
+
+
+#define NOT_DONE 99
+
+int test1(struct Options options)
+{
+	MQTTClient c;
+	Network n = {0, netRead, netWrite, netWritev};
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	unsigned char sendbuf[200], readbuf[200], ack[5];
+	unsigned char dup, retained;
+	unsigned short packetid = 0;
+	int qos, payloadlen, connect_rc = NOT_DONE, sub_rc = NOT_DONE, pub_rc = NOT_DONE;
+	unsigned char* payload;
+	MQTTString topicName;
+	MQTTMessage message;
+	int rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test2\" name=\"non-blocking requests\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - non-blocking requests completed by MQTTClient_poll");
+
+	netReset();
+	arrived = 0;
+	MQTTClientInit(&c, &n, 1000, sendbuf, sizeof(sendbuf), readbuf, sizeof(readbuf));
+	data.clientID.cstring = "test2";
+	rc = MQTTConnectNB(&c, &data, requestDone, &connect_rc);
+	assert("good rc from connect", rc == SUCCESS, "rc was %d\n", rc);
+	assert("CONNECT sent", net_out_len > 0 && net_out[0] == 0x10, "first byte was %02x\n", net_out[0]);
+	rc = MQTTClient_poll(&c);
+	assert("nothing to read", rc == SUCCESS && connect_rc == NOT_DONE && !c.isconnected, "rc was %d\n", rc);
+
+	netFeed(connack, 1);
+	rc = MQTTClient_poll(&c);
+	assert("CONNACK part way", rc == SUCCESS && connect_rc == NOT_DONE && c.transport.state != 0, "rc was %d\n", rc);
+	netFeed(&connack[1], sizeof(connack) - 1);
+	rc = MQTTClient_poll(&c);
+	assert("connect completed", rc == SUCCESS && connect_rc == SUCCESS && c.isconnected, "connect_rc was %d\n", connect_rc);
+
+	net_out_len = 0;
+	rc = MQTTSubscribeNB(&c, "sensors/#", QOS1, messageArrived, requestDone, &sub_rc);
+	assert("good rc from subscribe", rc == SUCCESS && net_out[0] == 0x82, "rc was %d\n", rc);
+	ack[0] = 0x90; ack[1] = 0x03; ack[2] = net_out[2]; ack[3] = net_out[3]; ack[4] = 0x01;
+	netFeed(ack, 5);
+	feedPublish("sensors/a", "early", 0);
+	rc = MQTTClient_poll(&c);
+	assert("subscribe completed", rc == SUCCESS && sub_rc == SUCCESS, "sub_rc was %d\n", sub_rc);
+	assert("message read with the SUBACK delivered", arrived == 1 && strcmp(arrived_topic, "sensors/a") == 0 &&
+			strcmp(arrived_payload, "early") == 0, "arrived %d\n", arrived);
+
+	net_out_len = 0;
+	memset(&message, 0, sizeof(message));
+	message.qos = QOS1;
+	message.payload = "hello";
+	message.payloadlen = 5;
+	rc = MQTTPublishNB(&c, "sensors/x", &message, requestDone, &pub_rc);
+	assert("good rc from publish", rc == SUCCESS, "rc was %d\n", rc);
+	rc = MQTTDeserialize_publish(&dup, &qos, &retained, &packetid, &topicName, &payload, &payloadlen, net_out, net_out_len);
+	assert("PUBLISH sent whole", rc == 1 && qos == 1 && payloadlen == 5 && memcmp(payload, "hello", 5) == 0,
+			"rc was %d\n", rc);
+	ack[0] = 0x40; ack[1] = 0x02; ack[2] = (packetid + 1) >> 8; ack[3] = (packetid + 1) & 0xFF;
+	netFeed(ack, 4);
+	rc = MQTTClient_poll(&c);
+	assert("PUBACK of another id ignored", rc == SUCCESS && pub_rc == NOT_DONE, "pub_rc was %d\n", pub_rc);
+	ack[2] = packetid >> 8; ack[3] = packetid & 0xFF;
+	netFeed(ack, 4);
+	rc = MQTTClient_poll(&c);
+	assert("publish completed", rc == SUCCESS && pub_rc == SUCCESS, "pub_rc was %d\n", pub_rc);
+
+	pub_rc = NOT_DONE;
+	rc = MQTTPublishNB(&c, "sensors/x", &message, requestDone, &pub_rc);
+	net_broken = 1;
+	rc = MQTTClient_poll(&c);
+	assert("lost connection reported", rc == FAILURE && !c.isconnected, "rc was %d\n", rc);
+	assert("pending publish failed", pub_rc == FAILURE, "pub_rc was %d\n", pub_rc);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	MQTTClient c;
+	Network n = {0, netRead, netWrite, netWritev};
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	unsigned char sendbuf[200], readbuf[200];
+	MQTTMessage message;
+	int rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test2\" name=\"reconnect mid-packet\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - blocking reconnect after a connection lost mid-packet");
+
+	netReset();
+	arrived = 0;
+	MQTTClientInit(&c, &n, 1000, sendbuf, sizeof(sendbuf), readbuf, sizeof(readbuf));
+	data.clientID.cstring = "test2";
+	netFeed(connack, sizeof(connack));
+	rc = MQTTConnect(&c, &data);
+	assert("good rc from connect", rc == SUCCESS && c.isconnected, "rc was %d\n", rc);
+	rc = MQTTSetMessageHandler(&c, "sensors/+", messageArrived);
+	assert("good rc from set message handler", rc == SUCCESS, "rc was %d\n", rc);
+
+	/* As main.c: MQTTClient_poll on every loop, blocking calls in between */
+	feedPublish("sensors/a", "first, never finished", 6);
+	rc = MQTTClient_poll(&c);
+	assert("PUBLISH part way", rc == SUCCESS && arrived == 0 && c.transport.state != 0, "rc was %d\n", rc);
+
+	net_broken = 1;
+	memset(&message, 0, sizeof(message));
+	message.qos = QOS0;
+	message.payload = "x";
+	message.payloadlen = 1;
+	rc = MQTTPublish(&c, "sensors/out", &message);
+	assert("failed send closes the session", rc == FAILURE && !c.isconnected, "rc was %d\n", rc);
+	assert("packet read state dropped with the session", c.transport.state == 0, "state was %d\n", c.transport.state);
+
+	/* Part of the old packet left in the read state would swallow the start of these */
+	c.transport.state = 2;
+	c.transport.rem_len = 10;
+	netReset();
+	netFeed(connack, sizeof(connack));
+	feedPublish("sensors/b", "second", 0);
+	rc = MQTTConnect(&c, &data);
+	assert("good rc from reconnect", rc == SUCCESS && c.isconnected, "rc was %d\n", rc);
+	assert("CONNECT sent", net_out_len > 0 && net_out[0] == 0x10, "first byte was %02x\n", net_out[0]);
+	assert("read state reset by connect", c.transport.state == 0, "state was %d\n", c.transport.state);
+	MQTTSetMessageHandler(&c, "sensors/+", messageArrived);   /* the clean session dropped it */
+	rc = MQTTClient_poll(&c);
+	assert("good rc from poll", rc == SUCCESS && c.isconnected, "rc was %d\n", rc);
+	assert("message on the new connection delivered whole", arrived == 1 && strcmp(arrived_topic, "sensors/b") == 0 &&
+			strcmp(arrived_payload, "second") == 0, "topic was %s\n", arrived_topic);
+
+	feedPublish("sensors/c", "third", 0);
+	rc = MQTTClient_poll(&c);
+	assert("next message framed", rc == SUCCESS && arrived == 2 && strcmp(arrived_payload, "third") == 0,
+			"arrived %d\n", arrived);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+	int rc = 0;
+ 	int (*tests[])() = {NULL, test1, test2};
+
+	xml = fopen("TEST-test2.xml", "w");
+	fprintf(xml, "<testsuite name=\"test2\" tests=\"%d\">\n", (int)(ARRAY_SIZE(tests) - 1));
+
+	getopts(argc, argv);
+
+ 	if (options.test_no == 0)
+	{ /* run all the tests */
+ 	   	for (options.test_no = 1; options.test_no < ARRAY_SIZE(tests); ++options.test_no)
+			rc += tests[options.test_no](options); /* return number of failures.  0 = test succeeded */
+	}
+	else
+ 	   	rc = tests[options.test_no](options); /* run just the selected test */
+
+ 	if (rc == 0)
+		MyLog(LOGA_INFO, "verdict pass");
+	else
+		MyLog(LOGA_INFO, "verdict fail");
+
+	fprintf(xml, "</testsuite>\n");
+	fclose(xml);
+	return rc;
+}
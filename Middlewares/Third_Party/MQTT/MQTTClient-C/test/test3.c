@@ -0,0 +1,467 @@
+/*******************************************************************************
+ * Tests of the publish priority classes (MQTTSetPriorityClass and
+ * MQTTPublishWithPriority): the token buckets run on a fake clock, so this
+ * test provides the Timer functions of MQTTLinux.c, and the packets go to a
+ * fake network.  In the layout of test1.c.
+ *******************************************************************************/
+
+
+#include "MQTTClient.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+struct Options
+{
+	int verbose;
+	int test_no;
+} options =
+{
+	0,
+	0,
+};
+
+void getopts(int argc, char** argv)
+{
+	int count = 1;
+
+	while (count < argc)
+	{
+		if (strcmp(argv[count], "--test_no") == 0)
+		{
+			if (++count < argc)
+				options.test_no = atoi(argv[count]);
+		}
+		else if (strcmp(argv[count], "--verbose") == 0)
+		{
+			options.verbose = 1;
+			printf("\nSetting verbose on\n");
+		}
+		count++;
+	}
+}
+
+
+#define LOGA_DEBUG 0
+#define LOGA_INFO 1
+void MyLog(int LOGA_level, char* format, ...)
+{
+	static char msg_buf[256];
+	va_list args;
+	struct timeval now;
+	struct tm *timeinfo;
+
+	if (LOGA_level == LOGA_DEBUG && options.verbose == 0)
+	  return;
+
+	gettimeofday(&now, NULL);
+	timeinfo = localtime(&now.tv_sec);
+	strftime(msg_buf, 80, "%Y%m%d %H%M%S", timeinfo);
+
+	sprintf(&msg_buf[strlen(msg_buf)], ".%.3ld ", (long)now.tv_usec / 1000);
+
+	va_start(args, format);
+	vsnprintf(&msg_buf[strlen(msg_buf)], sizeof(msg_buf) - strlen(msg_buf), format, args);
+	va_end(args);
+
+	printf("%s\n", msg_buf);
+	fflush(stdout);
+}
+
+
+struct timeval start_clock(void)
+{
+	struct timeval start_time;
+	gettimeofday(&start_time, NULL);
+	return start_time;
+}
+
+
+long elapsed(struct timeval start_time)
+{
+	struct timeval now, res;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &start_time, &res);
+	return (res.tv_sec)*1000 + (res.tv_usec)/1000;
+}
+
+
+#define assert(a, b, c, d) myassert(__FILE__, __LINE__, a, b, c, d)
+
+int tests = 0;
+int failures = 0;
+FILE* xml;
+struct timeval global_start_time;
+char output[3000];
+char* cur_output = output;
+
+
+void write_test_result()
+{
+	long duration = elapsed(global_start_time);
+
+	fprintf(xml, " time=\"%ld.%.3ld\" >\n", duration / 1000, duration % 1000);
+	if (cur_output != output)
+	{
+		fprintf(xml, "%s", output);
+		cur_output = output;
+	}
+	fprintf(xml, "</testcase>\n");
+}
+
+
+void myassert(char* filename, int lineno, char* description, int value, char* format, ...)
+{
+	++tests;
+	if (!value)
+	{
+		va_list args;
+
+		++failures;
+		printf("Assertion failed, file %s, line %d, description: %s\n", filename, lineno, description);
+
+		va_start(args, format);
+		vprintf(format, args);
+		va_end(args);
+
+		cur_output += sprintf(cur_output, "<failure type=\"%s\">file %s, line %d </failure>\n",
+                        description, filename, lineno);
+	}
+    else
+    	MyLog(LOGA_DEBUG, "Assertion succeeded, file %s, line %d, description: %s", filename, lineno, description);
+}
+
+
+/* The fake clock: only the test moves it, or a read that waits for nothing */
+static uint64_t now_ms;
+
+uint64_t TimerGetTickMS(void)
+{
+	return now_ms;
+}
+
+
+static uint64_t timerEnd(Timer* timer)
+{
+	return (uint64_t)timer->end_time.tv_sec * 1000 + timer->end_time.tv_usec / 1000;
+}
+
+
+void TimerCountdownMS(Timer* timer, unsigned int ms)
+{
+	uint64_t end = now_ms + ms;
+
+	timer->end_time.tv_sec = end / 1000;
+	timer->end_time.tv_usec = (end % 1000) * 1000;
+}
+
+
+void TimerCountdown(Timer* timer, unsigned int seconds)
+{
+	TimerCountdownMS(timer, seconds * 1000);
+}
+
+
+void TimerInit(Timer* timer)
+{
+	timer->end_time.tv_sec = 0;
+	timer->end_time.tv_usec = 0;
+}
+
+
+char TimerIsExpired(Timer* timer)
+{
+	return timerEnd(timer) <= now_ms;
+}
+
+
+int TimerLeftMS(Timer* timer)
+{
+	return (timerEnd(timer) > now_ms) ? (int)(timerEnd(timer) - now_ms) : 0;
+}
+
+
+/* The fake network: what the client writes is split into packets in sent[] */
+static unsigned char net_in[100];
+static int net_in_len, net_in_pos;
+static unsigned char net_out[2000];
+static int net_out_len;
+static int net_broken;
+
+
+int netRead(Network* n, unsigned char* buf, int len, int timeout_ms)
+{
+	int count = net_in_len - net_in_pos;
+
+	if (net_broken)
+		return -1;
+	if (count == 0)
+		now_ms += timeout_ms;
+	if (count > len)
+		count = len;
+	memcpy(buf, &net_in[net_in_pos], count);
+	net_in_pos += count;
+	return count;
+}
+
+
+int netWrite(Network* n, unsigned char* buf, int len, int timeout_ms)
+{
+	if (net_broken)
+		return -1;
+	memcpy(&net_out[net_out_len], buf, len);
+	net_out_len += len;
+	return len;
+}
+
+
+int netWritev(Network* n, struct iovec* iov, int iovcnt, int timeout_ms)
+{
+	int i, sent = 0;
+
+	for (i = 0; i < iovcnt; ++i)
+	{
+		int rc = netWrite(n, iov[i].iov_base, iov[i].iov_len, timeout_ms);
+
+		if (rc < 0)
+			return -1;
+		sent += rc;
+	}
+	return sent;
+}
+
+
+/* Connects c on a new fake connection */
+int fakeConnect(MQTTClient* c)
+{
+	static const unsigned char connack[] = {0x20, 0x02, 0x00, 0x00};
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+
+	memcpy(net_in, connack, sizeof(connack));
+	net_in_len = sizeof(connack);
+	net_in_pos = 0;
+	net_broken = 0;
+	data.clientID.cstring = "test3";
+	data.cleansession = 0;
+	return MQTTConnect(c, &data);
+}
+
+
+/* Returns the payloads of the PUBLISH packets sent since the last call, separated by spaces */
+char* sentPayloads(void)
+{
+	static char payloads[2000];
+	int pos = 0;
+
+	payloads[0] = '\0';
+	while (pos < net_out_len)
+	{
+		MQTTHeader header = {0};
+		unsigned char dup, retained, *payload;
+		unsigned short id;
+		int qos, payloadlen, rem_len = 0, len;
+		MQTTString topicName;
+
+		header.byte = net_out[pos];
+		len = 1 + MQTTPacket_decodeBuf(&net_out[pos + 1], &rem_len);
+		if (header.bits.type == PUBLISH &&
+			MQTTDeserialize_publish(&dup, &qos, &retained, &id, &topicName, &payload, &payloadlen,
+				&net_out[pos], len + rem_len) == 1)
+			sprintf(&payloads[strlen(payloads)], "%s%.*s", (payloads[0] == '\0') ? "" : " ", payloadlen, payload);
+		pos += len + rem_len;
+	}
+	net_out_len = 0;
+	return payloads;
+}
+
+
+/* Publishes a QoS 0 message of 10 bytes, a 15 byte packet */
+int publish(MQTTClient* c, char* payload, enum MQTTPriority prio)
+{
+	MQTTMessage message;
+
+	memset(&message, 0, sizeof(message));
+	message.qos = QOS0;
+	message.payload = payload;
+	message.payloadlen = strlen(payload);
+	return MQTTPublishWithPriority(c, "t", &message, prio);
+}
+
+
+int test1(struct Options options)
+{
+	MQTTClient c;
+	Network n = {0, netRead, netWrite, netWritev};
+	unsigned char sendbuf[100], readbuf[100], bulk[64];
+	MQTTOutboundQueue* q = NULL;
+	MQTTMessage message;
+	char* payloads = NULL;
+	int rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test3\" name=\"token bucket\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - token bucket refill and burst");
+
+	now_ms = 1000;
+	MQTTClientInit(&c, &n, 1000, sendbuf, sizeof(sendbuf), readbuf, sizeof(readbuf));
+	rc = fakeConnect(&c);
+	assert("good rc from connect", rc == SUCCESS, "rc was %d\n", rc);
+	net_out_len = 0;
+
+	/* 100 bytes a second, bursts of 40: two 15 byte packets */
+	rc = MQTTSetPriorityClass(&c, MQTT_PRIORITY_BULK, bulk, sizeof(bulk), 100, 40);
+	assert("good rc from set priority class", rc == SUCCESS, "rc was %d\n", rc);
+	q = &c.outbound[MQTT_PRIORITY_BULK];
+	publish(&c, "bulk-00001", MQTT_PRIORITY_BULK);
+	publish(&c, "bulk-00002", MQTT_PRIORITY_BULK);
+	rc = publish(&c, "bulk-00003", MQTT_PRIORITY_BULK);
+	assert("good rc from publish", rc == SUCCESS, "rc was %d\n", rc);
+	payloads = sentPayloads();
+	assert("burst sent at once", strcmp(payloads, "bulk-00001 bulk-00002") == 0, "sent %s\n", payloads);
+	assert("the rest queued", q->used == 2 + 15 && q->tokens == 10000, "used %u\n", (unsigned)q->used);
+
+	now_ms += 49;
+	MQTTDispatch(&c);
+	payloads = sentPayloads();
+	assert("14.9 bytes of tokens are not enough", payloads[0] == '\0' && q->tokens == 14900, "tokens %lu\n", q->tokens);
+	now_ms += 1;
+	MQTTDispatch(&c);
+	payloads = sentPayloads();
+	assert("sent once refilled", strcmp(payloads, "bulk-00003") == 0 && q->used == 0 && q->tokens == 0,
+			"sent %s\n", payloads);
+
+	/* A long sleep refills the bucket to its depth, not beyond */
+	now_ms += 0x7FFFFFFFFFFFULL;
+	MQTTDispatch(&c);
+	assert("bucket full after a long sleep", q->tokens == 40000, "tokens %lu\n", q->tokens);
+	now_ms += 1000;
+	MQTTDispatch(&c);
+	assert("bucket no fuller", q->tokens == 40000, "tokens %lu\n", q->tokens);
+
+	/* A class without a queue is not held back by a limited one */
+	publish(&c, "bulk-00004", MQTT_PRIORITY_BULK);
+	publish(&c, "bulk-00005", MQTT_PRIORITY_BULK);
+	publish(&c, "bulk-00006", MQTT_PRIORITY_BULK);
+	publish(&c, "norm-00001", MQTT_PRIORITY_NORMAL);
+	payloads = sentPayloads();
+	assert("unqueued class sent straight away", strcmp(payloads, "bulk-00004 bulk-00005 norm-00001") == 0,
+			"sent %s\n", payloads);
+
+	/* A packet too large for the burst could never be sent */
+	memset(&message, 0, sizeof(message));
+	message.payload = "0123";
+	message.payloadlen = 4;
+	rc = MQTTPublishWithPriority(&c, "a/topic/long/enough/for/41/bytes/x", &message, MQTT_PRIORITY_BULK);
+	assert("packet larger than the burst refused", rc == BUFFER_OVERFLOW && q->dropped == 1, "rc was %d\n", rc);
+	publish(&c, "bulk-00007", MQTT_PRIORITY_BULK);
+	publish(&c, "bulk-00008", MQTT_PRIORITY_BULK);
+	rc = publish(&c, "bulk-00009", MQTT_PRIORITY_BULK);
+	assert("full queue refuses", rc == BUFFER_OVERFLOW && q->dropped == 2 && q->used == 3 * 17, "rc was %d\n", rc);
+
+	/* A failed send keeps the packet for the next connection */
+	now_ms += 1000;
+	net_broken = 1;
+	rc = MQTTDispatch(&c);
+	assert("failed send closes the session", rc == FAILURE && !c.isconnected && q->used == 3 * 17, "rc was %d\n", rc);
+	rc = fakeConnect(&c);
+	assert("good rc from reconnect", rc == SUCCESS, "rc was %d\n", rc);
+	net_out_len = 0;
+	MQTTDispatch(&c);
+	payloads = sentPayloads();
+	assert("queued packets sent once reconnected", strcmp(payloads, "bulk-00006 bulk-00007") == 0,
+			"sent %s\n", payloads);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	MQTTClient c;
+	Network n = {0, netRead, netWrite, netWritev};
+	unsigned char sendbuf[100], readbuf[100], normal[40];
+	char expected[200] = "", payload[20];
+	char* payloads = NULL;
+	MQTTOutboundQueue* q = NULL;
+	int i, rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test3\" name=\"queue wrap\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - packets wrapping round the class queue");
+
+	now_ms = 1000;
+	MQTTClientInit(&c, &n, 1000, sendbuf, sizeof(sendbuf), readbuf, sizeof(readbuf));
+	fakeConnect(&c);
+	net_out_len = 0;
+
+	/* 17 bytes an entry in 40: the third and later entries wrap at different points */
+	MQTTSetPriorityClass(&c, MQTT_PRIORITY_NORMAL, normal, sizeof(normal), 0, 0);
+	q = &c.outbound[MQTT_PRIORITY_NORMAL];
+	for (i = 0; i < 12; ++i)
+	{
+		sprintf(payload, "wrap-%05d", i);
+		sprintf(&expected[strlen(expected)], "%s%s", (i == 0) ? "" : " ", payload);
+		rc = publish(&c, payload, MQTT_PRIORITY_NORMAL);
+		assert("good rc from publish", rc == SUCCESS && q->used == 0, "rc was %d\n", rc);
+	}
+	payloads = sentPayloads();
+	assert("packets sent whole and in order", strcmp(payloads, expected) == 0, "sent %s\n", payloads);
+	assert("queue head went round", q->head == (12 * 17) % sizeof(normal), "head %u\n", (unsigned)q->head);
+
+	/* A packet whose send fails stays queued; publishes are refused until reconnected */
+	net_broken = 1;
+	publish(&c, "held-00001", MQTT_PRIORITY_NORMAL);
+	rc = publish(&c, "held-00002", MQTT_PRIORITY_NORMAL);
+	assert("held while the connection is down", rc == FAILURE && q->used == 17, "rc was %d\n", rc);
+	fakeConnect(&c);
+	net_out_len = 0;
+	rc = publish(&c, "held-00003", MQTT_PRIORITY_NORMAL);
+	payloads = sentPayloads();
+	assert("held packets sent first, across the wrap", rc == SUCCESS && strcmp(payloads, "held-00001 held-00003") == 0,
+			"sent %s\n", payloads);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+	int rc = 0;
+ 	int (*tests[])() = {NULL, test1, test2};
+
+	xml = fopen("TEST-test3.xml", "w");
+	fprintf(xml, "<testsuite name=\"test3\" tests=\"%d\">\n", (int)(ARRAY_SIZE(tests) - 1));
+
+	getopts(argc, argv);
+
+ 	if (options.test_no == 0)
+	{ /* run all the tests */
+ 	   	for (options.test_no = 1; options.test_no < ARRAY_SIZE(tests); ++options.test_no)
+			rc += tests[options.test_no](options); /* return number of failures.  0 = test succeeded */
+	}
+	else
+ 	   	rc = tests[options.test_no](options); /* run just the selected test */
+
+ 	if (rc == 0)
+		MyLog(LOGA_INFO, "verdict pass");
+	else
+		MyLog(LOGA_INFO, "verdict fail");
+
+	fprintf(xml, "</testsuite>\n");
+	fclose(xml);
+	return rc;
+}
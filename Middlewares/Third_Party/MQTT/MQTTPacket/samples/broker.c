@@ -0,0 +1,811 @@
+/*******************************************************************************
+ * Minimal MQTT 3.1/3.1.1 broker for local testing, built on the server side of
+ * the MQTTPacket codec.
+ *
+ * Single threaded, one epoll loop, non-blocking sockets.  Supports QoS 0, 1 and
+ * 2 in both directions, retained messages, wills, keepalive and the + and #
+ * wildcards.  Sessions are always clean: subscriptions and in-flight messages
+ * do not survive a disconnect, and outbound QoS 1/2 messages are not retried.
+ * Routing is a linear scan of the subscriptions, which is deterministic and
+ * fast enough for a few thousand clients on one host.
+ *
+ *   broker [port] [-v]
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "MQTTPacket.h"
+
+#define MAX_EVENTS 256
+#define MAX_PACKET (256 * 1024)		/* largest packet accepted from a client */
+#define MAX_OUTBUF (4 * 1024 * 1024)	/* a client further behind than this is disconnected */
+#define MAX_FILTERS 16				/* topic filters per SUBSCRIBE or UNSUBSCRIBE */
+#define MAX_INBOUND_QOS2 32			/* QoS 2 packet ids awaiting PUBREL, per client */
+
+typedef struct Subscription
+{
+	char* filter;
+	int qos;
+	struct Subscription* next;
+} Subscription;
+
+typedef struct Retained
+{
+	char* topic;
+	unsigned char* payload;
+	int payloadlen;
+	int qos;
+	struct Retained* next;
+} Retained;
+
+typedef struct Client
+{
+	int fd;
+	int connected;
+	char* clientID;
+	unsigned short keepalive;
+	time_t last_received;
+	unsigned short next_packetid;
+
+	unsigned char* inbuf;
+	int inbuf_size, inlen;
+	unsigned char* outbuf;
+	int outbuf_size, outlen;
+	int dirty;						/* on the flush list */
+	int overflow;					/* fell MAX_OUTBUF behind: dropped at the next flush */
+	struct Client* next_dirty;
+
+	Subscription* subs;
+	unsigned short inbound_qos2[MAX_INBOUND_QOS2];
+	int inbound_count;
+
+	int willFlag;
+	char* willTopic;
+	unsigned char* willPayload;
+	int willPayloadlen, willQos, willRetained;
+} Client;
+
+static Client** clients = NULL;		/* indexed by socket */
+static int clients_size = 0;
+static Client* dirty_list = NULL;
+static Retained* retained_list = NULL;
+static int epfd = -1;
+static int verbose = 0;
+static volatile int toStop = 0;
+
+static struct
+{
+	unsigned long connects, publishes_in, publishes_out, dropped_clients;
+} stats;
+
+
+static void cfinish(int sig)
+{
+	toStop = 1;
+}
+
+
+static char* copyMQTTString(MQTTString* s)
+{
+	int len = MQTTstrlen(*s);
+	char* copy = malloc(len + 1);
+
+	memcpy(copy, s->cstring ? s->cstring : s->lenstring.data, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+
+/**
+ * Matches a topic name against a subscription filter.  Topics starting with $
+ * are not matched by a filter starting with a wildcard.
+ */
+static int topicMatches(const char* filter, const char* topic)
+{
+	if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#'))
+		return 0;
+	while (*filter && *topic)
+	{
+		if (*filter == '#')
+			return 1;
+		if (*filter == '+')
+		{
+			while (*topic && *topic != '/')
+				++topic;
+			++filter;
+			continue;
+		}
+		if (*filter != *topic)
+			return 0;
+		++filter;
+		++topic;
+	}
+	/* "a/#" also matches "a" */
+	if (*topic == '\0' && (strcmp(filter, "/#") == 0 || strcmp(filter, "#") == 0))
+		return 1;
+	return *filter == '\0' && *topic == '\0';
+}
+
+
+/**
+ * Returns the length of the packet at the start of buf: 0 while its remaining
+ * length is incomplete, -1 if it is malformed.
+ */
+static int packetLength(unsigned char* buf, int len)
+{
+	int rem_len = 0;
+	int multiplier = 1;
+	int i;
+
+	for (i = 1; i < len; ++i)
+	{
+		if (i > 4)
+			return -1;
+		rem_len += (buf[i] & 127) * multiplier;
+		multiplier *= 128;
+		if ((buf[i] & 128) == 0)
+			return 1 + i + rem_len;
+	}
+	return (len > 5) ? -1 : 0;
+}
+
+
+static void markDirty(Client* c)
+{
+	if (!c->dirty)
+	{
+		c->dirty = 1;
+		c->next_dirty = dirty_list;
+		dirty_list = c;
+	}
+}
+
+
+/* Returns space for at least len bytes at the end of the client's output buffer, or NULL */
+static unsigned char* reserve(Client* c, int len)
+{
+	if (c->outlen + len > c->outbuf_size)
+	{
+		int size = c->outbuf_size ? c->outbuf_size : 4096;
+
+		while (size < c->outlen + len)
+			size *= 2;
+		if (size > MAX_OUTBUF)
+		{
+			c->overflow = 1;
+			markDirty(c);
+			return NULL;
+		}
+		c->outbuf = realloc(c->outbuf, size);
+		c->outbuf_size = size;
+	}
+	markDirty(c);
+	return c->outbuf + c->outlen;
+}
+
+
+static void queueAck(Client* c, int type, unsigned short packetid)
+{
+	unsigned char* ptr = reserve(c, 4);
+
+	if (ptr)
+		c->outlen += MQTTSerialize_ack(ptr, 4, type, 0, packetid);
+}
+
+
+static void queuePublish(Client* c, const char* topic, unsigned char* payload, int payloadlen, int qos, int retained)
+{
+	MQTTString topicString = MQTTString_initializer;
+	unsigned short packetid = 0;
+	unsigned char* ptr;
+	int len;
+
+	topicString.cstring = (char*)topic;
+	len = MQTTPacket_len(2 + strlen(topic) + payloadlen + ((qos > 0) ? 2 : 0));
+	if ((ptr = reserve(c, len)) == NULL)
+		return;
+	if (qos > 0)
+	{
+		if (++c->next_packetid == 0)
+			c->next_packetid = 1;
+		packetid = c->next_packetid;
+	}
+	c->outlen += MQTTSerialize_publish(ptr, len, 0, qos, retained, packetid, topicString, payload, payloadlen);
+	stats.publishes_out++;
+}
+
+
+static void route(const char* topic, unsigned char* payload, int payloadlen, int qos)
+{
+	int fd;
+
+	for (fd = 0; fd < clients_size; ++fd)
+	{
+		Client* c = clients[fd];
+		Subscription* s;
+		int granted = -1;
+
+		if (c == NULL || !c->connected)
+			continue;
+		/* overlapping subscriptions: deliver once, at the highest matching QoS */
+		for (s = c->subs; s; s = s->next)
+		{
+			if (s->qos > granted && topicMatches(s->filter, topic))
+				granted = s->qos;
+		}
+		if (granted >= 0)
+			queuePublish(c, topic, payload, payloadlen, (qos < granted) ? qos : granted, 0);
+	}
+}
+
+
+static void retain(const char* topic, unsigned char* payload, int payloadlen, int qos)
+{
+	Retained** pr = &retained_list;
+	Retained* r;
+
+	while (*pr && strcmp((*pr)->topic, topic) != 0)
+		pr = &(*pr)->next;
+	if ((r = *pr) != NULL)
+	{
+		*pr = r->next;
+		free(r->topic);
+		free(r->payload);
+		free(r);
+	}
+	if (payloadlen == 0)
+		return;	/* an empty retained message clears the topic */
+	r = malloc(sizeof(Retained));
+	r->topic = strdup(topic);
+	r->payload = malloc(payloadlen);
+	memcpy(r->payload, payload, payloadlen);
+	r->payloadlen = payloadlen;
+	r->qos = qos;
+	r->next = retained_list;
+	retained_list = r;
+}
+
+
+static void publish(const char* topic, unsigned char* payload, int payloadlen, int qos, int retained)
+{
+	stats.publishes_in++;
+	if (retained)
+		retain(topic, payload, payloadlen, qos);
+	route(topic, payload, payloadlen, qos);
+}
+
+
+static void closeClient(Client* c, int sendWill)
+{
+	Subscription* s;
+
+	if (verbose)
+		printf("close %d %s%s\n", c->fd, c->clientID ? c->clientID : "", sendWill ? " (will)" : "");
+	if (sendWill && c->connected && c->willFlag)
+		publish(c->willTopic, c->willPayload, c->willPayloadlen, c->willQos, c->willRetained);
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	clients[c->fd] = NULL;
+
+	if (c->dirty)
+	{
+		Client** pc = &dirty_list;
+
+		while (*pc != c)
+			pc = &(*pc)->next_dirty;
+		*pc = c->next_dirty;
+	}
+	while ((s = c->subs) != NULL)
+	{
+		c->subs = s->next;
+		free(s->filter);
+		free(s);
+	}
+	free(c->clientID);
+	free(c->willTopic);
+	free(c->willPayload);
+	free(c->inbuf);
+	free(c->outbuf);
+	free(c);
+}
+
+
+static int handleConnect(Client* c, unsigned char* buf, int len)
+{
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	unsigned char* ptr;
+	int fd;
+
+	if (c->connected)
+		return -1;	/* a second CONNECT is a protocol violation */
+	if ((ptr = reserve(c, 4)) == NULL)
+		return -1;
+	if (MQTTDeserialize_connect(&data, buf, len) != 1)
+	{
+		c->outlen += MQTTSerialize_connack(ptr, 4, 1, 0);	/* unacceptable protocol version */
+		return 0;
+	}
+	c->clientID = copyMQTTString(&data.clientID);
+	c->keepalive = data.keepAliveInterval;
+	if ((c->willFlag = data.willFlag) != 0)
+	{
+		c->willTopic = copyMQTTString(&data.will.topicName);
+		c->willPayloadlen = MQTTstrlen(data.will.message);
+		c->willPayload = (unsigned char*)copyMQTTString(&data.will.message);
+		c->willQos = data.will.qos;
+		c->willRetained = data.will.retained;
+	}
+
+	/* a client connecting with the ID of a connected one takes it over */
+	for (fd = 0; fd < clients_size; ++fd)
+	{
+		Client* other = clients[fd];
+
+		if (other && other != c && other->connected && strcmp(other->clientID, c->clientID) == 0)
+			closeClient(other, 1);
+	}
+
+	c->connected = 1;
+	c->outlen += MQTTSerialize_connack(ptr, 4, 0, 0);
+	stats.connects++;
+	if (verbose)
+		printf("connect %d %s keepalive %d\n", c->fd, c->clientID, c->keepalive);
+	return 1;
+}
+
+
+static int handlePublish(Client* c, unsigned char* buf, int len)
+{
+	unsigned char dup, retained;
+	unsigned short packetid;
+	int qos, payloadlen;
+	unsigned char* payload;
+	MQTTString topicName;
+	char* topic;
+	int i;
+
+	if (MQTTDeserialize_publish(&dup, &qos, &retained, &packetid, &topicName, &payload, &payloadlen, buf, len) != 1 ||
+		qos > 2)
+		return -1;
+
+	if (qos == 2)
+	{
+		/* exactly once: a resent PUBLISH still awaiting its PUBREL is not routed again */
+		for (i = 0; i < c->inbound_count; ++i)
+		{
+			if (c->inbound_qos2[i] == packetid)
+				break;
+		}
+		queueAck(c, PUBREC, packetid);
+		if (i < c->inbound_count)
+			return 1;
+		if (c->inbound_count == MAX_INBOUND_QOS2)
+			return -1;
+		c->inbound_qos2[c->inbound_count++] = packetid;
+	}
+	else if (qos == 1)
+		queueAck(c, PUBACK, packetid);
+
+	topic = copyMQTTString(&topicName);
+	publish(topic, payload, payloadlen, qos, retained);
+	free(topic);
+	return 1;
+}
+
+
+static int handleSubscribe(Client* c, unsigned char* buf, int len)
+{
+	MQTTString filters[MAX_FILTERS];
+	int qoss[MAX_FILTERS];
+	const char* subscribed[MAX_FILTERS];
+	Retained* r;
+	unsigned char dup;
+	unsigned short packetid;
+	unsigned char* ptr;
+	int count = 0;
+	int i;
+
+	if (MQTTDeserialize_subscribe(&dup, &packetid, MAX_FILTERS, &count, filters, qoss, buf, len) != 1)
+		return -1;
+
+	for (i = 0; i < count; ++i)
+	{
+		char* filter = copyMQTTString(&filters[i]);
+		Subscription* s;
+
+		if (qoss[i] > 2)
+			qoss[i] = 2;
+		for (s = c->subs; s && strcmp(s->filter, filter) != 0; s = s->next)
+			;
+		if (s)
+			free(filter);	/* an identical filter replaces the old subscription */
+		else
+		{
+			s = malloc(sizeof(Subscription));
+			s->filter = filter;
+			s->next = c->subs;
+			c->subs = s;
+		}
+		s->qos = qoss[i];
+		subscribed[i] = s->filter;
+		if (verbose)
+			printf("subscribe %d %s qos %d\n", c->fd, s->filter, s->qos);
+	}
+
+	/* the SUBACK goes first, then the retained messages matching the filters */
+	if ((ptr = reserve(c, 5 + count)) != NULL)
+		c->outlen += MQTTSerialize_suback(ptr, 5 + count, packetid, count, qoss);
+	for (r = retained_list; r; r = r->next)
+	{
+		int granted = -1;
+
+		for (i = 0; i < count; ++i)
+		{
+			if (qoss[i] > granted && topicMatches(subscribed[i], r->topic))
+				granted = qoss[i];
+		}
+		if (granted >= 0)
+			queuePublish(c, r->topic, r->payload, r->payloadlen, (r->qos < granted) ? r->qos : granted, 1);
+	}
+	return 1;
+}
+
+
+static int handleUnsubscribe(Client* c, unsigned char* buf, int len)
+{
+	MQTTString filters[MAX_FILTERS];
+	unsigned char dup;
+	unsigned short packetid;
+	unsigned char* ptr;
+	int count = 0;
+	int i;
+
+	if (MQTTDeserialize_unsubscribe(&dup, &packetid, MAX_FILTERS, &count, filters, buf, len) != 1)
+		return -1;
+
+	for (i = 0; i < count; ++i)
+	{
+		char* filter = copyMQTTString(&filters[i]);
+		Subscription** ps = &c->subs;
+
+		while (*ps && strcmp((*ps)->filter, filter) != 0)
+			ps = &(*ps)->next;
+		if (*ps)
+		{
+			Subscription* s = *ps;
+
+			*ps = s->next;
+			free(s->filter);
+			free(s);
+		}
+		free(filter);
+	}
+	if ((ptr = reserve(c, 4)) != NULL)
+		c->outlen += MQTTSerialize_unsuback(ptr, 4, packetid);
+	return 1;
+}
+
+
+/**
+ * Handles one complete packet.
+ * @return 1 to carry on, 0 to close the connection cleanly, -1 to drop it (with its will)
+ */
+static int handlePacket(Client* c, unsigned char* buf, int len)
+{
+	MQTTHeader header = {0};
+	unsigned char type, dup;
+	unsigned short packetid;
+	int i;
+
+	header.byte = buf[0];
+	if (!c->connected && header.bits.type != CONNECT)
+		return -1;
+
+	switch (header.bits.type)
+	{
+	case CONNECT:
+		return handleConnect(c, buf, len);
+	case PUBLISH:
+		return handlePublish(c, buf, len);
+	case PUBREC:	/* subscriber received our QoS 2 publish */
+		if (MQTTDeserialize_ack(&type, &dup, &packetid, buf, len) != 1)
+			return -1;
+		queueAck(c, PUBREL, packetid);
+		return 1;
+	case PUBREL:	/* publisher releases its QoS 2 publish */
+		if (MQTTDeserialize_ack(&type, &dup, &packetid, buf, len) != 1)
+			return -1;
+		for (i = 0; i < c->inbound_count; ++i)
+		{
+			if (c->inbound_qos2[i] == packetid)
+			{
+				c->inbound_qos2[i] = c->inbound_qos2[--c->inbound_count];
+				break;
+			}
+		}
+		queueAck(c, PUBCOMP, packetid);
+		return 1;
+	case PUBACK:
+	case PUBCOMP:
+		return 1;	/* nothing is retried, so nothing to release */
+	case SUBSCRIBE:
+		return handleSubscribe(c, buf, len);
+	case UNSUBSCRIBE:
+		return handleUnsubscribe(c, buf, len);
+	case PINGREQ:
+	{
+		unsigned char* ptr = reserve(c, 2);
+
+		if (ptr)
+		{
+			header.byte = 0;
+			header.bits.type = PINGRESP;
+			ptr[0] = header.byte;
+			ptr[1] = 0;
+			c->outlen += 2;
+		}
+		return 1;
+	}
+	case DISCONNECT:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+
+/* Writes as much of the output buffer as the socket takes, and waits for EPOLLOUT for the rest */
+static int flush(Client* c)
+{
+	struct epoll_event ev;
+	int sent = 0;
+
+	while (sent < c->outlen)
+	{
+		int rc = write(c->fd, c->outbuf + sent, c->outlen - sent);
+
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+		sent += rc;
+	}
+	if (sent > 0)
+	{
+		memmove(c->outbuf, c->outbuf + sent, c->outlen - sent);
+		c->outlen -= sent;
+	}
+
+	ev.events = EPOLLIN | ((c->outlen > 0) ? EPOLLOUT : 0);
+	ev.data.fd = c->fd;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	return 0;
+}
+
+
+static void flushAll(void)
+{
+	while (dirty_list)
+	{
+		Client* c = dirty_list;
+
+		dirty_list = c->next_dirty;
+		c->dirty = 0;
+		if (c->overflow || flush(c) < 0)
+		{
+			stats.dropped_clients++;
+			closeClient(c, 1);
+		}
+	}
+}
+
+
+static void readClient(Client* c)
+{
+	int pos = 0;
+	int rc = 1;
+
+	for (;;)
+	{
+		int n;
+
+		if (c->inlen == c->inbuf_size)
+		{
+			if (c->inbuf_size >= MAX_PACKET)
+				break;
+			c->inbuf_size = c->inbuf_size ? c->inbuf_size * 2 : 4096;
+			c->inbuf = realloc(c->inbuf, c->inbuf_size);
+		}
+		n = read(c->fd, c->inbuf + c->inlen, c->inbuf_size - c->inlen);
+		if (n == 0)
+		{
+			closeClient(c, 1);	/* closed without DISCONNECT */
+			return;
+		}
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			closeClient(c, 1);
+			return;
+		}
+		c->inlen += n;
+		if (c->inlen < c->inbuf_size)
+			break;
+	}
+	c->last_received = time(NULL);
+
+	while (rc > 0)
+	{
+		int len = packetLength(c->inbuf + pos, c->inlen - pos);
+
+		if (len < 0 || len > MAX_PACKET)
+			rc = -1;
+		else if (len == 0 || len > c->inlen - pos)
+			break;	/* wait for the rest of the packet */
+		else
+		{
+			rc = handlePacket(c, c->inbuf + pos, len);
+			pos += len;
+		}
+	}
+	if (rc <= 0)
+	{
+		closeClient(c, rc < 0);
+		return;
+	}
+	memmove(c->inbuf, c->inbuf + pos, c->inlen - pos);
+	c->inlen -= pos;
+}
+
+
+static void acceptClients(int listenfd)
+{
+	for (;;)
+	{
+		struct epoll_event ev;
+		Client* c;
+		int one = 1;
+		int fd = accept(listenfd, NULL, NULL);
+
+		if (fd < 0)
+			break;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (fd >= clients_size)
+		{
+			int size = clients_size ? clients_size : 1024;
+
+			while (size <= fd)
+				size *= 2;
+			clients = realloc(clients, size * sizeof(Client*));
+			memset(clients + clients_size, 0, (size - clients_size) * sizeof(Client*));
+			clients_size = size;
+		}
+		c = calloc(1, sizeof(Client));
+		c->fd = fd;
+		c->last_received = time(NULL);
+		clients[fd] = c;
+
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+	}
+}
+
+
+/* Drops clients silent for one and a half keepalive intervals, or not connecting within 10 s */
+static void checkKeepalives(void)
+{
+	time_t now = time(NULL);
+	int fd;
+
+	for (fd = 0; fd < clients_size; ++fd)
+	{
+		Client* c = clients[fd];
+
+		if (c == NULL)
+			continue;
+		if ((!c->connected && now - c->last_received > 10) ||
+			(c->connected && c->keepalive > 0 && now - c->last_received > c->keepalive * 3 / 2))
+			closeClient(c, 1);
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	struct epoll_event events[MAX_EVENTS];
+	struct sockaddr_in addr;
+	struct epoll_event ev;
+	time_t last_check = time(NULL);
+	int port = 1883;
+	int listenfd;
+	int one = 1;
+	int i;
+
+	for (i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-v") == 0)
+			verbose = 1;
+		else
+			port = atoi(argv[i]);
+	}
+
+	signal(SIGINT, cfinish);
+	signal(SIGTERM, cfinish);
+	signal(SIGPIPE, SIG_IGN);
+
+	listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenfd, SOMAXCONN) < 0)
+	{
+		perror("broker");
+		return 1;
+	}
+	fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
+
+	epfd = epoll_create1(0);
+	ev.events = EPOLLIN;
+	ev.data.fd = listenfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev);
+	printf("listening on port %d\n", port);
+	fflush(stdout);
+
+	while (!toStop)
+	{
+		int count = epoll_wait(epfd, events, MAX_EVENTS, 1000);
+
+		for (i = 0; i < count; ++i)
+		{
+			int fd = events[i].data.fd;
+			Client* c;
+
+			if (fd == listenfd)
+			{
+				acceptClients(listenfd);
+				continue;
+			}
+			if ((c = clients[fd]) == NULL)
+				continue;	/* closed by an earlier event of this batch */
+			if (events[i].events & EPOLLOUT)
+				markDirty(c);
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				readClient(c);
+		}
+		flushAll();
+
+		if (time(NULL) != last_check)
+		{
+			last_check = time(NULL);
+			checkKeepalives();
+			flushAll();
+		}
+	}
+
+	printf("connects %lu, publishes in %lu, out %lu, slow clients dropped %lu\n",
+			stats.connects, stats.publishes_in, stats.publishes_out, stats.dropped_clients);
+	return 0;
+}
@@ -143,7 +143,8 @@ int MQTTDeserialize_connack(unsigned char* sessionPresent, unsigned char* connac
 	if (header.bits.type != CONNACK)
 		goto exit;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	if (!MQTTPacket_decodeLen(&mylen, &curdata, buf + buflen)) /* read remaining length */
+		goto exit;
 	enddata = curdata + mylen;
 	if (enddata - curdata < 2)
 		goto exit;
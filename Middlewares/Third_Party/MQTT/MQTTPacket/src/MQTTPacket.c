@@ -28,18 +28,17 @@
  */
 int MQTTPacket_encode(unsigned char* buf, int length)
 {
+	unsigned int remaining = (unsigned int)length;
 	int rc = 0;
 
 	FUNC_ENTRY;
 	do
 	{
-		char d = length % 128;
-		length /= 128;
+		unsigned char d = remaining & 0x7F;
+		remaining >>= 7;
 		/* if there are more digits to encode, set the top bit of this digit */
-		if (length > 0)
-			d |= 0x80;
-		buf[rc++] = d;
-	} while (length > 0);
+		buf[rc++] = d | (remaining ? 0x80 : 0);
+	} while (remaining > 0);
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
@@ -98,22 +97,74 @@ int MQTTPacket_len(int rem_len)
 }
 
 
-static unsigned char* bufptr;
+/**
+ * Decodes a remaining length held in memory.  All state is in the arguments, so this
+ * may be called from several tasks at once.
+ * @param ptr pointer to the first byte of the encoded length
+ * @param enddata pointer to the end of the data: do not read beyond
+ * @param value the decoded length returned
+ * @return the number of bytes used, or 0 if the encoding is invalid or runs past enddata
+ */
+static int decodeLen(const unsigned char* ptr, const unsigned char* enddata, int* value)
+{
+	int avail = enddata - ptr;
+	int len = 0;
+	int result = 0;
+
+	if (avail > MAX_NO_OF_REMAINING_LENGTH_BYTES)
+		avail = MAX_NO_OF_REMAINING_LENGTH_BYTES;
+	if (avail > 0 && ptr[0] < 128) /* single byte lengths are the common case */
+	{
+		*value = ptr[0];
+		return 1;
+	}
+	while (len < avail)
+	{
+		unsigned char c = ptr[len];
+		result |= (c & 127) << (7 * len);
+		++len;
+		if ((c & 128) == 0)
+		{
+			*value = result;
+			return len;
+		}
+	}
+	return 0;
+}
+
 
-int bufchar(unsigned char* c, int count)
+/**
+ * Decodes the remaining length from a buffer.  Reentrant replacement for MQTTPacket_decodeBuf.
+ * @param value the decoded length returned
+ * @param pptr pointer to the input buffer - incremented by the number of bytes used & returned
+ * @param enddata pointer to the end of the data: do not read beyond
+ * @return 1 if successful and the packet body fits before enddata, 0 if not
+ */
+int MQTTPacket_decodeLen(int* value, unsigned char** pptr, unsigned char* enddata)
 {
-	int i;
+	int rc = 0;
+	int len;
 
-	for (i = 0; i < count; ++i)
-		*c = *bufptr++;
-	return count;
+	FUNC_ENTRY;
+	if ((len = decodeLen(*pptr, enddata, value)) > 0 && *value <= enddata - (*pptr + len))
+	{
+		*pptr += len;
+		rc = 1;
+	}
+	FUNC_EXIT_RC(rc);
+	return rc;
 }
 
 
+/**
+ * Decodes the remaining length from a buffer, whose size is not known.
+ * @param buf the input buffer
+ * @param value the decoded length returned
+ * @return the number of bytes used, or 0 if the encoding is invalid
+ */
 int MQTTPacket_decodeBuf(unsigned char* buf, int* value)
 {
-	bufptr = buf;
-	return MQTTPacket_decode(bufchar, value);
+	return decodeLen(buf, buf + MAX_NO_OF_REMAINING_LENGTH_BYTES, value);
 }
 
 
@@ -27,6 +27,24 @@
 
 DLLExport int MQTTSerialize_publish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained, unsigned short packetid,
 		MQTTString topicName, unsigned char* payload, int payloadlen);
+DLLExport int MQTTSerialize_publishHeader(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained,
+		unsigned short packetid, MQTTString topicName, int payloadlen);
+
+/**
+ * The fixed header byte and topic name of a publish, serialized once by
+ * MQTTSerialize_preparePublish for a topic that is published to repeatedly.
+ */
+typedef struct
+{
+	unsigned char header;	/**< fixed header byte: type, qos and retained */
+	unsigned char* topic;	/**< serialized topic name, 2 byte length then the string */
+	int topiclen;			/**< length of the serialized topic name */
+} MQTTPublishTemplate;
+
+DLLExport int MQTTSerialize_preparePublish(MQTTPublishTemplate* tmpl, unsigned char* topicbuf, int topicbuflen, int qos,
+		unsigned char retained, MQTTString topicName);
+DLLExport int MQTTSerialize_publishPrepared(unsigned char* buf, int buflen, const MQTTPublishTemplate* tmpl, unsigned char dup,
+		unsigned short packetid, unsigned char* payload, int payloadlen);
 
 DLLExport int MQTTDeserialize_publish(unsigned char* dup, int* qos, unsigned char* retained, unsigned short* packetid, MQTTString* topicName,
 		unsigned char** payload, int* payloadlen, unsigned char* buf, int len);
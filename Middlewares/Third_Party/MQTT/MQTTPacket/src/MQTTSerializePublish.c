@@ -91,6 +91,150 @@ exit:
 }
 
 
+/**
+  * Serializes everything of a publish except its payload into the supplied buffer, for a
+  * transport that sends the payload from the caller's memory (scatter-gather write)
+  * @param buf the buffer into which the packet header will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param dup integer - the MQTT dup flag
+  * @param qos integer - the MQTT QoS value
+  * @param retained integer - the MQTT retained flag
+  * @param packetid integer - the MQTT packet identifier
+  * @param topicName MQTTString - the MQTT topic in the publish
+  * @param payloadlen integer - the length of the MQTT payload which will follow
+  * @return the length of the serialized data, without the payload.  <= 0 indicates error
+  */
+int MQTTSerialize_publishHeader(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained,
+		unsigned short packetid, MQTTString topicName, int payloadlen)
+{
+	unsigned char *ptr = buf;
+	MQTTHeader header = {0};
+	int rem_len = 0;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	rem_len = MQTTSerialize_publishLength(qos, topicName, payloadlen);
+	if (MQTTPacket_len(rem_len) - payloadlen > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+
+	header.bits.type = PUBLISH;
+	header.bits.dup = dup;
+	header.bits.qos = qos;
+	header.bits.retain = retained;
+	writeChar(&ptr, header.byte); /* write header */
+
+	ptr += MQTTPacket_encode(ptr, rem_len); /* write remaining length */
+
+	writeMQTTString(&ptr, topicName);
+
+	if (qos > 0)
+		writeInt(&ptr, packetid);
+
+	rc = ptr - buf;
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Serializes the fixed header byte and topic name of a publish once, for a topic that is
+  * published to repeatedly with MQTTSerialize_publishPrepared
+  * @param tmpl the template to fill in
+  * @param topicbuf the buffer into which the topic name is serialized, kept by the template
+  * @param topicbuflen the length in bytes of the supplied topic buffer
+  * @param qos integer - the MQTT QoS value
+  * @param retained integer - the MQTT retained flag
+  * @param topicName MQTTString - the MQTT topic in the publish
+  * @return the length of the serialized topic.  <= 0 indicates error
+  */
+int MQTTSerialize_preparePublish(MQTTPublishTemplate* tmpl, unsigned char* topicbuf, int topicbuflen, int qos,
+		unsigned char retained, MQTTString topicName)
+{
+	unsigned char *ptr = topicbuf;
+	MQTTHeader header = {0};
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (2 + MQTTstrlen(topicName) > topicbuflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+
+	header.bits.type = PUBLISH;
+	header.bits.qos = qos;
+	header.bits.retain = retained;
+	tmpl->header = header.byte;
+
+	writeMQTTString(&ptr, topicName);
+	tmpl->topic = topicbuf;
+	tmpl->topiclen = rc = ptr - topicbuf;
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Serializes a publish to a prepared topic into the supplied buffer, ready for sending.
+  * Only the remaining length, packet identifier and payload are encoded; the header byte
+  * and topic name are copied from the template.
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param tmpl the template filled in by MQTTSerialize_preparePublish
+  * @param dup integer - the MQTT dup flag
+  * @param packetid integer - the MQTT packet identifier, ignored for QoS 0
+  * @param payload byte buffer - the MQTT publish payload
+  * @param payloadlen integer - the length of the MQTT payload
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+int MQTTSerialize_publishPrepared(unsigned char* buf, int buflen, const MQTTPublishTemplate* tmpl, unsigned char dup,
+		unsigned short packetid, unsigned char* payload, int payloadlen)
+{
+	unsigned char *ptr = buf;
+	MQTTHeader header = {0};
+	int rem_len = 0;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	header.byte = tmpl->header;
+	rem_len = tmpl->topiclen + payloadlen;
+	if (header.bits.qos > 0)
+		rem_len += 2; /* packetid */
+	if (MQTTPacket_len(rem_len) > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+
+	header.bits.dup = dup;
+	writeChar(&ptr, header.byte); /* write header */
+
+	ptr += MQTTPacket_encode(ptr, rem_len); /* write remaining length */
+
+	memcpy(ptr, tmpl->topic, tmpl->topiclen);
+	ptr += tmpl->topiclen;
+
+	if (header.bits.qos > 0)
+		writeInt(&ptr, packetid);
+
+	memcpy(ptr, payload, payloadlen);
+	ptr += payloadlen;
+
+	rc = ptr - buf;
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
 
 /**
   * Serializes the ack packet into the supplied buffer.
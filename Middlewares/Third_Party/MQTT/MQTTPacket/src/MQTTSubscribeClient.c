@@ -110,7 +110,8 @@ int MQTTDeserialize_suback(unsigned short* packetid, int maxcount, int* count, i
 	if (header.bits.type != SUBACK)
 		goto exit;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	if (!MQTTPacket_decodeLen(&mylen, &curdata, buf + buflen)) /* read remaining length */
+		goto exit;
 	enddata = curdata + mylen;
 	if (enddata - curdata < 2)
 		goto exit;
@@ -47,7 +47,8 @@ int MQTTDeserialize_subscribe(unsigned char* dup, unsigned short* packetid, int
 		goto exit;
 	*dup = header.bits.dup;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	if (!MQTTPacket_decodeLen(&mylen, &curdata, buf + buflen)) /* read remaining length */
+		goto exit;
 	enddata = curdata + mylen;
 
 	*packetid = readInt(&curdata);
@@ -0,0 +1,188 @@
+/*******************************************************************************
+ * Profiling backend for the FUNC_ENTRY / FUNC_EXIT hooks of StackTrace.h.
+ *
+ * Built when STACKTRACE_PROFILE is defined.  Each instrumented function owns a
+ * static StackTrace_profileRecord, registered in a fixed table on its first
+ * call, holding its call count, inclusive cycle count and stack high-water
+ * mark.  Cycles come from the DWT cycle counter on Cortex-M3/M4 and from
+ * CLOCK_MONOTONIC (in ns) on Linux; define STACKTRACE_CYCLES() to supply
+ * another counter.  The table is not locked: profile from one thread only.
+ *******************************************************************************/
+
+#include "StackTrace.h"
+
+#if defined(STACKTRACE_PROFILE)
+
+#if defined(STACKTRACE_CYCLES)
+  #define STACKTRACE_CYCLE_UNIT "cycles"
+#elif defined(__linux__)
+  #include <time.h>
+  #define STACKTRACE_CYCLE_UNIT "ns"
+#elif defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_7M__) || defined(__TARGET_ARCH_7E_M) || defined(__TARGET_ARCH_7_M)
+  #define STACKTRACE_DWT 1
+  #define STACKTRACE_CYCLE_UNIT "cycles"
+  #define DEMCR      (*(volatile unsigned long*)0xE000EDFCUL)
+  #define DWT_CTRL   (*(volatile unsigned long*)0xE0001000UL)
+  #define DWT_CYCCNT (*(volatile unsigned long*)0xE0001004UL)
+#else
+  #define STACKTRACE_CYCLE_UNIT "-"
+#endif
+
+static StackTrace_profileRecord* profile[STACKTRACE_PROFILE_MAX];
+static int profile_count = 0;
+static unsigned int profile_overflow = 0;	/* functions not registered because the table was full */
+static char* stack_low = NULL;				/* deepest stack address seen in the current outermost call */
+
+
+static unsigned long cycles(void)
+{
+#if defined(STACKTRACE_CYCLES)
+	return STACKTRACE_CYCLES();
+#elif defined(__linux__)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+#elif defined(STACKTRACE_DWT)
+	if ((DWT_CTRL & 1UL) == 0)
+	{
+		DEMCR |= 1UL << 24;	/* TRCENA */
+		DWT_CYCCNT = 0;
+		DWT_CTRL |= 1UL;	/* CYCCNTENA */
+	}
+	return DWT_CYCCNT;
+#else
+	return 0;
+#endif
+}
+
+
+/**
+  * Called by FUNC_ENTRY: registers the record on first use and starts timing.
+  * @param rec the static record of the calling function
+  * @param frame per-call state, on the caller's stack
+  * @param name the calling function's name
+  */
+void StackTrace_profileEntry(StackTrace_profileRecord* rec, StackTrace_profileFrame* frame, const char* name)
+{
+	char here;
+
+	if (!rec->registered)
+	{
+		rec->name = name;
+		rec->registered = 1;
+		if (profile_count < STACKTRACE_PROFILE_MAX)
+			profile[profile_count++] = rec;
+		else
+			profile_overflow++;
+	}
+	frame->outer_low = stack_low;
+	stack_low = &here;
+	frame->start = cycles();
+}
+
+
+/**
+  * Called by FUNC_EXIT: accumulates the cycles and stack depth of this call.
+  * @param rec the static record of the calling function
+  * @param frame the state saved by StackTrace_profileEntry
+  */
+void StackTrace_profileExit(StackTrace_profileRecord* rec, StackTrace_profileFrame* frame)
+{
+	unsigned long elapsed = cycles() - frame->start;
+	unsigned int depth;
+	char here;
+
+	if (&here < stack_low)
+		stack_low = &here;
+	depth = (unsigned int)((char*)frame - stack_low);
+
+	rec->calls++;
+	rec->cycles += elapsed;
+	if (elapsed > rec->max_cycles)
+		rec->max_cycles = elapsed;
+	if (depth > rec->max_stack)
+		rec->max_stack = depth;
+
+	/* the caller's activation reaches at least as deep as this one */
+	if (frame->outer_low != NULL && frame->outer_low < stack_low)
+		stack_low = frame->outer_low;
+	else if (frame->outer_low == NULL)
+		stack_low = NULL;
+}
+
+
+static int formatRecord(char* buf, int buflen, StackTrace_profileRecord* rec)
+{
+	return snprintf(buf, buflen, "%s calls=%lu %s=%llu max=%lu stack=%u\n", rec->name, rec->calls,
+		STACKTRACE_CYCLE_UNIT, rec->cycles, rec->max_cycles, rec->max_stack);
+}
+
+
+/**
+  * Prints the profile table, one function per line.
+  * @param dest the stream to print to, e.g. stdout retargeted to a UART
+  */
+void StackTrace_printProfile(FILE* dest)
+{
+	char line[96];
+	int i;
+
+	for (i = 0; i < profile_count; ++i)
+	{
+		formatRecord(line, sizeof(line), profile[i]);
+		fputs(line, dest);
+	}
+	if (profile_overflow > 0)
+		fprintf(dest, "%u functions not profiled, raise STACKTRACE_PROFILE_MAX\n", profile_overflow);
+}
+
+
+/**
+  * Formats the profile table as text, one function per line, for example as the
+  * payload of a $SYS-style status publish.  Lines that do not fit are left out.
+  * @param buf the buffer into which the text is written
+  * @param buflen the length in bytes of the supplied buffer
+  * @return the length of the text written, without terminating NUL
+  */
+int StackTrace_formatProfile(char* buf, int buflen)
+{
+	int len = 0;
+	int i;
+
+	if (buflen <= 0)
+		return 0;
+	buf[0] = '\0';
+	for (i = 0; i < profile_count; ++i)
+	{
+		int rc = formatRecord(&buf[len], buflen - len, profile[i]);
+
+		if (rc < 0 || rc >= buflen - len)
+		{
+			buf[len] = '\0';	/* drop the truncated line */
+			break;
+		}
+		len += rc;
+	}
+	return len;
+}
+
+
+/**
+  * Clears the counters of all registered functions.
+  */
+void StackTrace_resetProfile(void)
+{
+	int i;
+
+	for (i = 0; i < profile_count; ++i)
+	{
+		profile[i]->calls = 0;
+		profile[i]->cycles = 0;
+		profile[i]->max_cycles = 0;
+		profile[i]->max_stack = 0;
+	}
+	profile_overflow = 0;
+}
+
+#endif /* STACKTRACE_PROFILE */
@@ -19,9 +19,57 @@
 #define STACKTRACE_H_
 
 #include <stdio.h>
+#if !defined(STACKTRACE_PROFILE)
 #define NOSTACKTRACE 1
+#endif
+
+#if defined(STACKTRACE_PROFILE)
+/* Profiling backend, see StackTrace.c: every instrumented function keeps a static
+ * record of its call count, cycles and stack high-water mark. */
+#if !defined(STACKTRACE_PROFILE_MAX)
+#define STACKTRACE_PROFILE_MAX 48 /* number of functions the profile table can hold */
+#endif
+
+typedef struct
+{
+	const char* name;
+	unsigned long calls;
+	unsigned long long cycles;	/* inclusive of instrumented callees */
+	unsigned long max_cycles;
+	unsigned int max_stack;		/* bytes from the function's frame to the deepest instrumented call below it */
+	int registered;
+} StackTrace_profileRecord;
+
+typedef struct
+{
+	unsigned long start;
+	char* outer_low;
+} StackTrace_profileFrame;
+
+#define STACKTRACE_PROFILE_ENTRY static StackTrace_profileRecord stacktrace_rec; StackTrace_profileFrame stacktrace_frame; \
+		StackTrace_profileEntry(&stacktrace_rec, &stacktrace_frame, __func__)
+#define STACKTRACE_PROFILE_EXIT StackTrace_profileExit(&stacktrace_rec, &stacktrace_frame)
+
+#define FUNC_ENTRY STACKTRACE_PROFILE_ENTRY
+#define FUNC_ENTRY_NOLOG STACKTRACE_PROFILE_ENTRY
+#define FUNC_ENTRY_MED STACKTRACE_PROFILE_ENTRY
+#define FUNC_ENTRY_MAX STACKTRACE_PROFILE_ENTRY
+#define FUNC_EXIT STACKTRACE_PROFILE_EXIT
+#define FUNC_EXIT_NOLOG STACKTRACE_PROFILE_EXIT
+#define FUNC_EXIT_MED STACKTRACE_PROFILE_EXIT
+#define FUNC_EXIT_MAX STACKTRACE_PROFILE_EXIT
+#define FUNC_EXIT_RC(x) STACKTRACE_PROFILE_EXIT
+#define FUNC_EXIT_MED_RC(x) STACKTRACE_PROFILE_EXIT
+#define FUNC_EXIT_MAX_RC(x) STACKTRACE_PROFILE_EXIT
+
+void StackTrace_profileEntry(StackTrace_profileRecord* rec, StackTrace_profileFrame* frame, const char* name);
+void StackTrace_profileExit(StackTrace_profileRecord* rec, StackTrace_profileFrame* frame);
+
+void StackTrace_printProfile(FILE* dest);
+int StackTrace_formatProfile(char* buf, int buflen);
+void StackTrace_resetProfile(void);
 
-#if defined(NOSTACKTRACE)
+#elif defined(NOSTACKTRACE)
 #define FUNC_ENTRY
 #define FUNC_ENTRY_NOLOG
 #define FUNC_ENTRY_MED
@@ -0,0 +1,89 @@
+/*******************************************************************************
+ * Micro-benchmark of the remaining length decode.
+ *
+ * Compares the bounded pointer decode used by the deserializers,
+ * MQTTPacket_decodeLen(), with the byte-at-a-time path it replaced: a static
+ * cursor read through a function pointer, reproduced here as old_decodeBuf().
+ * Not a unit test, so it is built but not registered with ctest.
+ *
+ *   bench1 [iterations]
+ *******************************************************************************/
+
+#include "MQTTPacket.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+
+static unsigned char* bufptr;
+
+static int bufchar(unsigned char* c, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i)
+		*c = *bufptr++;
+	return count;
+}
+
+static int old_decodeBuf(unsigned char* buf, int* value)
+{
+	bufptr = buf;
+	return MQTTPacket_decode(bufchar, value);
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char** argv)
+{
+	int lengths[] = {5, 100, 127, 200, 1000, 16383, 70000, 2097152};
+	long iterations = (argc > 1) ? atol(argv[1]) : 20000000L;
+	unsigned char* buf = malloc(4 + 2097152);
+	int i;
+
+	if (buf == NULL)
+		return 1;
+	printf("%-9s %12s %12s\n", "length", "old ns/op", "new ns/op");
+	for (i = 0; i < ARRAY_SIZE(lengths); ++i)
+	{
+		unsigned char* end = buf + MQTTPacket_encode(buf, lengths[i]) + lengths[i];
+		volatile int sink = 0;
+		double start, old_ns, new_ns;
+		long n;
+
+		start = now();
+		for (n = 0; n < iterations; ++n)
+		{
+			int value;
+
+			old_decodeBuf(buf, &value);
+			sink += value;
+		}
+		old_ns = (now() - start) * 1e9 / iterations;
+
+		start = now();
+		for (n = 0; n < iterations; ++n)
+		{
+			unsigned char* ptr = buf;
+			int value;
+
+			if (MQTTPacket_decodeLen(&value, &ptr, end))
+				sink += value;
+		}
+		new_ns = (now() - start) * 1e9 / iterations;
+
+		printf("%-9d %12.2f %12.2f\n", lengths[i], old_ns, new_ns);
+	}
+	free(buf);
+	return 0;
+}
@@ -606,10 +606,167 @@ int test6(struct Options options)
 }
 
 
+int test7(struct Options options)
+{
+	int lengths[] = {0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 268435455};
+	int encoded[] = {1, 1, 1, 2, 2, 3, 3, 4, 4};
+	int i = 0;
+	int rc = 0;
+	unsigned char buf[8];
+	unsigned char* ptr = NULL;
+	int value = 0;
+
+	unsigned char invalid[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+	unsigned char publish[] = {0x30, 0x05, 0x00, 0x01, 'a', 'b', 'c'};
+	unsigned char other[] = {0x80, 0x01};
+	unsigned char dup = 0, retained = 0;
+	unsigned short packetid = 0;
+	int qos = 0, payloadlen = 0;
+	unsigned char* payload = NULL;
+	MQTTString topicName = MQTTString_initializer;
+
+	fprintf(xml, "<testcase classname=\"test1\" name=\"remaining length\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 7 - remaining length encode and decode");
+
+	for (i = 0; i < ARRAY_SIZE(lengths); ++i)
+	{
+		int len = MQTTPacket_encode(buf, lengths[i]);
+		assert("encoded length uses the fewest bytes", len == encoded[i], "len was %d\n", len);
+
+		rc = MQTTPacket_decodeBuf(buf, &value);
+		assert("decodeBuf uses all encoded bytes", rc == len, "rc was %d\n", rc);
+		assert("decodeBuf gives back the length", value == lengths[i], "value was %d\n", value);
+
+		/* decodeLen also checks that the packet body fits, so give it none and expect a refusal */
+		ptr = buf;
+		rc = MQTTPacket_decodeLen(&value, &ptr, buf + len);
+		assert("decodeLen refuses a body past the end", rc == (lengths[i] == 0), "rc was %d\n", rc);
+	}
+
+	/* a length split over the end of the buffer is not read beyond it */
+	MQTTPacket_encode(buf, 16384);
+	ptr = buf;
+	rc = MQTTPacket_decodeLen(&value, &ptr, buf + 2);
+	assert("truncated length refused", rc == 0 && ptr == buf, "rc was %d\n", rc);
+
+	ptr = invalid;
+	rc = MQTTPacket_decodeLen(&value, &ptr, invalid + sizeof(invalid));
+	assert("five byte length refused", rc == 0 && ptr == invalid, "rc was %d\n", rc);
+
+	/* decodes of two buffers interleaved do not share state */
+	ptr = &publish[1];
+	rc = MQTTPacket_decodeBuf(&other[0], &value);
+	assert("two byte length decoded", rc == 2 && value == 128, "value was %d\n", value);
+	rc = MQTTPacket_decodeLen(&value, &ptr, publish + sizeof(publish));
+	assert("publish length decoded", rc == 1 && value == 5 && ptr == &publish[2], "value was %d\n", value);
+
+	rc = MQTTDeserialize_publish(&dup, &qos, &retained, &packetid, &topicName,
+			&payload, &payloadlen, publish, sizeof(publish));
+	assert("good rc from deserialize publish", rc == 1, "rc was %d\n", rc);
+	assert("payload length", payloadlen == 2, "payloadlen was %d\n", payloadlen);
+
+	rc = MQTTDeserialize_publish(&dup, &qos, &retained, &packetid, &topicName,
+			&payload, &payloadlen, publish, sizeof(publish) - 1);
+	assert("publish longer than the buffer refused", rc == 0, "rc was %d\n", rc);
+
+/* exit: */
+	MyLog(LOGA_INFO, "TEST7: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test8(struct Options options)
+{
+	int rc = 0;
+	unsigned char buf[100];
+	unsigned char prepared[100];
+	unsigned char topicbuf[16];
+	MQTTPublishTemplate tmpl;
+	MQTTString topicString = MQTTString_initializer;
+	unsigned char *payload = (unsigned char*)"kkhkhkjkj jkjjk jk jk ";
+	int payloadlen = strlen((char*)payload);
+	int qos = 0;
+	int len = 0;
+
+	fprintf(xml, "<testcase classname=\"test1\" name=\"prepared publish\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 8 - publish to a prepared topic");
+
+	topicString.cstring = "mytopic";
+	for (qos = 0; qos <= 2; ++qos)
+	{
+		rc = MQTTSerialize_preparePublish(&tmpl, topicbuf, sizeof(topicbuf), qos, 1, topicString);
+		assert("good rc from prepare publish", rc == 2 + 7, "rc was %d\n", rc);
+
+		len = MQTTSerialize_publish(buf, sizeof(buf), 1, qos, 1, 23, topicString, payload, payloadlen);
+		rc = MQTTSerialize_publishPrepared(prepared, sizeof(prepared), &tmpl, 1, 23, payload, payloadlen);
+		assert("prepared publish has the same length", rc == len, "rc was %d\n", rc);
+		assert("prepared publish has the same bytes", memcmp(buf, prepared, len) == 0, "qos was %d\n", qos);
+	}
+
+	rc = MQTTSerialize_publishPrepared(prepared, len - 1, &tmpl, 0, 23, payload, payloadlen);
+	assert("publish longer than the buffer refused", rc == MQTTPACKET_BUFFER_TOO_SHORT, "rc was %d\n", rc);
+
+	topicString.cstring = "a/topic/longer/than/the/buffer";
+	rc = MQTTSerialize_preparePublish(&tmpl, topicbuf, sizeof(topicbuf), 0, 0, topicString);
+	assert("topic longer than the buffer refused", rc == MQTTPACKET_BUFFER_TOO_SHORT, "rc was %d\n", rc);
+
+/* exit: */
+	MyLog(LOGA_INFO, "TEST8: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test9(struct Options options)
+{
+	int rc = 0;
+	unsigned char buf[100];
+	unsigned char header[100];
+	MQTTString topicString = MQTTString_initializer;
+	unsigned char *payload = (unsigned char*)"kkhkhkjkj jkjjk jk jk ";
+	int payloadlen = strlen((char*)payload);
+	int qos = 0;
+	int len = 0;
+
+	fprintf(xml, "<testcase classname=\"test1\" name=\"publish header\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 9 - serialization of a publish without its payload");
+
+	topicString.cstring = "mytopic";
+	for (qos = 0; qos <= 2; ++qos)
+	{
+		len = MQTTSerialize_publish(buf, sizeof(buf), 0, qos, 1, 23, topicString, payload, payloadlen);
+		rc = MQTTSerialize_publishHeader(header, sizeof(header), 0, qos, 1, 23, topicString, payloadlen);
+		assert("header is the publish without its payload", rc == len - payloadlen, "rc was %d\n", rc);
+		assert("header has the same bytes", memcmp(buf, header, rc) == 0, "qos was %d\n", qos);
+	}
+
+	rc = MQTTSerialize_publishHeader(header, len - payloadlen - 1, 0, 2, 1, 23, topicString, 100000);
+	assert("header longer than the buffer refused", rc == MQTTPACKET_BUFFER_TOO_SHORT, "rc was %d\n", rc);
+
+	rc = MQTTSerialize_publishHeader(header, 1 + 3 + 2 + 7, 0, 0, 0, 0, topicString, 100000);
+	assert("payload larger than the buffer accepted", rc == 1 + 3 + 2 + 7, "rc was %d\n", rc);
+
+/* exit: */
+	MyLog(LOGA_INFO, "TEST9: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
 int main(int argc, char** argv)
 {
 	int rc = 0;
- 	int (*tests[])() = {NULL, test1, test2, test3, test4, test5, test6};
+ 	int (*tests[])() = {NULL, test1, test2, test3, test4, test5, test6, test7, test8, test9};
 
 	xml = fopen("TEST-test1.xml", "w");
 	fprintf(xml, "<testsuite name=\"test1\" tests=\"%d\">\n", (int)(ARRAY_SIZE(tests) - 1));
@@ -0,0 +1,4 @@
+P=../../../MQTTPacket/src
+C=../../../MQTTClient-C/src
+gcc gateway.c -I $C -I $C/linux -I ../../src -I $P $C/MQTTClient.c $C/linux/MQTTLinux.c ../../src/MQTTSNPacket.c $P/MQTTPacket.c $P/MQTTConnectClient.c $P/MQTTSubscribeClient.c $P/MQTTUnsubscribeClient.c $P/MQTTSerializePublish.c $P/MQTTDeserializePublish.c -o gateway -DMQTTCLIENT_PLATFORM_HEADER=MQTTLinux.h
+gcc snpub.c -I ../../src -I ../../src/linux -I $C/linux -I $P ../../src/MQTTSNClient.c ../../src/MQTTSNPacket.c ../../src/linux/MQTTSNLinux.c $C/linux/MQTTLinux.c $P/MQTTPacket.c -o snpub -DMQTTSNCLIENT_PLATFORM_HEADER=MQTTSNLinux.h
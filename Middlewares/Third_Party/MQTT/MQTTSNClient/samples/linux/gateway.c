@@ -0,0 +1,642 @@
+/*******************************************************************************
+ * Transparent MQTT-SN gateway, for testing the MQTT-SN client on a host.
+ *
+ * Listens for MQTT-SN datagrams on a UDP port and gives every MQTT-SN client
+ * an MQTT connection of its own to the broker, through MQTTClient and its
+ * non-blocking MQTTClient_poll().  Topic ids are allocated per client.  While
+ * a client sleeps the gateway keeps its broker session and buffers the
+ * messages that arrive for it, up to MAX_BUFFERED, until it pings with its
+ * client id.  QoS -1 publishes, which come without a connection, go out on a
+ * connection of the gateway's own.  Predefined topic ids are given on the
+ * command line; gateway discovery (ADVERTISE, SEARCHGW) is not supported.
+ *
+ *   gateway --port 10000 --broker-port 1883 --predefined 1=sensors/temp
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "MQTTClient.h"
+#include "MQTTSNPacket.h"
+
+#define MAX_CLIENTS 16
+#define MAX_TOPICS 32			/* per client */
+#define MAX_PREDEFINED 16
+#define MAX_BUFFERED 16			/* messages per sleeping client */
+#define TOPIC_MAX 64
+#define DATAGRAM_MAX 1024
+#define POLL_MS 20
+
+
+void usage(void)
+{
+	printf("Transparent MQTT-SN gateway\n");
+	printf("Usage: gateway <options>, where options are:\n");
+	printf("  --port <udp port> (default is 10000)\n");
+	printf("  --broker <hostname> (default is localhost)\n");
+	printf("  --broker-port <port> (default is 1883)\n");
+	printf("  --predefined <id>=<topic> a predefined topic id, may be repeated\n");
+	printf("  --verbose\n");
+	exit(-1);
+}
+
+
+struct Predefined
+{
+	unsigned short id;
+	char* name;
+};
+
+struct opts_struct
+{
+	int port;
+	char* broker;
+	int broker_port;
+	struct Predefined predefined[MAX_PREDEFINED];
+	int predefined_count;
+	int verbose;
+} opts =
+{
+	10000, "localhost", 1883, {{0, NULL}}, 0, 0
+};
+
+
+void getopts(int argc, char** argv)
+{
+	int count = 1;
+
+	while (count < argc)
+	{
+		char* option = argv[count];
+
+		if (strcmp(option, "--verbose") == 0)
+		{
+			opts.verbose = 1;
+			count++;
+			continue;
+		}
+		if (++count >= argc)
+			usage();
+		if (strcmp(option, "--port") == 0)
+			opts.port = atoi(argv[count]);
+		else if (strcmp(option, "--broker") == 0)
+			opts.broker = argv[count];
+		else if (strcmp(option, "--broker-port") == 0)
+			opts.broker_port = atoi(argv[count]);
+		else if (strcmp(option, "--predefined") == 0 && opts.predefined_count < MAX_PREDEFINED)
+		{
+			char* eq = strchr(argv[count], '=');
+
+			if (eq == NULL)
+				usage();
+			opts.predefined[opts.predefined_count].id = atoi(argv[count]);
+			opts.predefined[opts.predefined_count++].name = eq + 1;
+		}
+		else
+			usage();
+		count++;
+	}
+}
+
+
+typedef struct
+{
+	unsigned short topicid;
+	int qos;
+	unsigned char retained;
+	int payloadlen;
+	unsigned char payload[DATAGRAM_MAX / 2];
+} Buffered;
+
+typedef struct
+{
+	int used;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	char clientid[24];
+	int asleep;
+	unsigned short duration;
+	Timer deadline;				/* 1.5 times the keepalive or sleep duration */
+
+	Network net;
+	MQTTClient mqtt;
+	unsigned char sendbuf[DATAGRAM_MAX], readbuf[DATAGRAM_MAX];
+	char filters[MAX_MESSAGE_HANDLERS][TOPIC_MAX];	/* MQTTClient keeps the pointers */
+
+	struct
+	{
+		unsigned short id;
+		char announced;			/* the client has seen the REGISTER */
+		char name[TOPIC_MAX];
+	} topics[MAX_TOPICS];
+	unsigned short next_topicid;
+	unsigned short next_msgid;
+
+	Buffered buffered[MAX_BUFFERED];
+	int buffered_count;
+} SNClient;
+
+SNClient clients[MAX_CLIENTS];
+SNClient* current = NULL;		/* the client whose broker connection is being polled */
+
+int udp = -1;
+Network anon_net;				/* for QoS -1 publishes */
+MQTTClient anon;
+unsigned char anon_sendbuf[DATAGRAM_MAX], anon_readbuf[DATAGRAM_MAX];
+
+volatile int toStop = 0;
+
+
+void cfinish(int sig)
+{
+	signal(SIGINT, NULL);
+	toStop = 1;
+}
+
+
+static void sendto_client(SNClient* c, unsigned char* buf, int len)
+{
+	if (len > 0)
+		sendto(udp, buf, len, 0, (struct sockaddr*)&c->addr, c->addrlen);
+}
+
+
+static void refresh(SNClient* c)
+{
+	TimerCountdownMS(&c->deadline, c->duration * 1500);
+}
+
+
+static const char* predefinedName(unsigned short id)
+{
+	int i;
+
+	for (i = 0; i < opts.predefined_count; ++i)
+	{
+		if (opts.predefined[i].id == id)
+			return opts.predefined[i].name;
+	}
+	return NULL;
+}
+
+
+/* The topic name for a topic id or short name of a PUBLISH, into name */
+static int topicName(SNClient* c, MQTTSN_topicid* topic, char* name)
+{
+	const char* found = NULL;
+	int i;
+
+	if (topic->type == MQTTSN_TOPIC_TYPE_SHORT)
+	{
+		name[0] = topic->data.short_name[0];
+		name[1] = topic->data.short_name[1];
+		name[2] = '\0';
+		return 1;
+	}
+	if (topic->type == MQTTSN_TOPIC_TYPE_PREDEFINED)
+		found = predefinedName(topic->data.id);
+	else if (c != NULL)
+	{
+		for (i = 0; i < MAX_TOPICS && found == NULL; ++i)
+		{
+			if (c->topics[i].id == topic->data.id && c->topics[i].id != 0)
+				found = c->topics[i].name;
+		}
+	}
+	if (found == NULL)
+		return 0;
+	strcpy(name, found);
+	return 1;
+}
+
+
+/* The topic id of a name, allocated if new; 0 if the table is full */
+static int topicId(SNClient* c, const char* name, int namelen, char** slot)
+{
+	int i, freeslot = -1;
+
+	if (namelen >= TOPIC_MAX)
+		return 0;
+	for (i = 0; i < MAX_TOPICS; ++i)
+	{
+		if (c->topics[i].id == 0)
+		{
+			if (freeslot < 0)
+				freeslot = i;
+		}
+		else if ((int)strlen(c->topics[i].name) == namelen && memcmp(c->topics[i].name, name, namelen) == 0)
+		{
+			if (slot)
+				*slot = &c->topics[i].announced;
+			return c->topics[i].id;
+		}
+	}
+	if (freeslot < 0)
+		return 0;
+	c->topics[freeslot].id = ++c->next_topicid;
+	c->topics[freeslot].announced = 0;
+	memcpy(c->topics[freeslot].name, name, namelen);
+	c->topics[freeslot].name[namelen] = '\0';
+	if (slot)
+		*slot = &c->topics[freeslot].announced;
+	return c->topics[freeslot].id;
+}
+
+
+static void forward(SNClient* c, unsigned short topicid, int qos, unsigned char retained,
+		unsigned char* payload, int payloadlen)
+{
+	unsigned char buf[DATAGRAM_MAX];
+	MQTTSN_topicid topic;
+	int i;
+
+	for (i = 0; i < MAX_TOPICS; ++i)
+	{
+		if (c->topics[i].id == topicid && !c->topics[i].announced)
+		{
+			MQTTString name = MQTTString_initializer;
+
+			name.cstring = c->topics[i].name;
+			c->next_msgid = (c->next_msgid == 65535) ? 1 : c->next_msgid + 1;
+			sendto_client(c, buf, MQTTSNSerialize_register(buf, sizeof(buf), topicid, c->next_msgid, &name));
+			c->topics[i].announced = 1;
+		}
+	}
+	topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+	topic.data.id = topicid;
+	if (qos > 0)
+		c->next_msgid = (c->next_msgid == 65535) ? 1 : c->next_msgid + 1;
+	sendto_client(c, buf, MQTTSNSerialize_publish(buf, sizeof(buf), 0, (qos > 0) ? 1 : 0, retained,
+			(qos > 0) ? c->next_msgid : 0, topic, payload, payloadlen));
+}
+
+
+/* MQTTClient message handler: a message from the broker for the current client */
+void messageArrived(MessageData* md)
+{
+	SNClient* c = current;
+	MQTTMessage* m = md->message;
+	int topicid;
+
+	if (c == NULL)
+		return;
+	topicid = topicId(c, md->topicName->lenstring.data, md->topicName->lenstring.len, NULL);
+	if (topicid == 0 || m->payloadlen > sizeof(c->buffered[0].payload))
+	{
+		printf("%s: dropped a message on %.*s\n", c->clientid, md->topicName->lenstring.len,
+				md->topicName->lenstring.data);
+		return;
+	}
+	if (!c->asleep)
+		forward(c, topicid, m->qos, m->retained, m->payload, m->payloadlen);
+	else if (c->buffered_count < MAX_BUFFERED)
+	{
+		Buffered* b = &c->buffered[c->buffered_count++];
+
+		b->topicid = topicid;
+		b->qos = m->qos;
+		b->retained = m->retained;
+		b->payloadlen = m->payloadlen;
+		memcpy(b->payload, m->payload, m->payloadlen);
+	}
+	else if (opts.verbose)
+		printf("%s: buffer full, dropped a message\n", c->clientid);
+}
+
+
+static SNClient* findClient(struct sockaddr_storage* addr, socklen_t addrlen)
+{
+	int i;
+
+	for (i = 0; i < MAX_CLIENTS; ++i)
+	{
+		if (clients[i].used && clients[i].addrlen == addrlen && memcmp(&clients[i].addr, addr, addrlen) == 0)
+			return &clients[i];
+	}
+	return NULL;
+}
+
+
+static void dropClient(SNClient* c, const char* why)
+{
+	printf("%s: %s\n", c->clientid, why);
+	if (c->mqtt.isconnected)
+		MQTTDisconnect(&c->mqtt);
+	NetworkDisconnect(&c->net);
+	c->used = 0;
+}
+
+
+static int anonPublish(const char* name, int retained, unsigned char* payload, int payloadlen)
+{
+	MQTTMessage m;
+
+	if (!anon.isconnected)
+	{
+		MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+		char clientid[32];
+
+		snprintf(clientid, sizeof(clientid), "mqttsn-gw-%d", (int)getpid());
+		data.clientID.cstring = clientid;
+		NetworkDisconnect(&anon_net);
+		NetworkInit(&anon_net);
+		MQTTClientInit(&anon, &anon_net, 1000, anon_sendbuf, sizeof(anon_sendbuf), anon_readbuf, sizeof(anon_readbuf));
+		if (NetworkConnect(&anon_net, opts.broker, opts.broker_port) != 0 || MQTTConnect(&anon, &data) != SUCCESS)
+			return FAILURE;
+	}
+	memset(&m, 0, sizeof(m));
+	m.qos = QOS0;
+	m.retained = retained;
+	m.payload = payload;
+	m.payloadlen = payloadlen;
+	return MQTTPublish(&anon, name, &m);
+}
+
+
+static void handleConnect(SNClient* c, struct sockaddr_storage* addr, socklen_t addrlen, unsigned char* buf, int len)
+{
+	MQTTSNPacket_connectData data;
+	MQTTPacket_connectData mqttdata = MQTTPacket_connectData_initializer;
+	unsigned char out[16];
+	int i, rc = MQTTSN_RC_ACCEPTED;
+
+	if (MQTTSNDeserialize_connect(&data, buf, len) != 1)
+		return;
+	if (c == NULL) /* a sleeping client may wake from a new address */
+	{
+		for (i = 0; i < MAX_CLIENTS && c == NULL; ++i)
+		{
+			if (clients[i].used && (int)strlen(clients[i].clientid) == data.clientID.lenstring.len &&
+					memcmp(clients[i].clientid, data.clientID.lenstring.data, data.clientID.lenstring.len) == 0)
+				c = &clients[i];
+		}
+	}
+	if (c != NULL && (data.cleansession || !c->mqtt.isconnected))
+		dropClient(c, "reconnecting");
+	if (c == NULL || !c->used)
+	{
+		for (i = 0, c = NULL; i < MAX_CLIENTS && c == NULL; ++i)
+		{
+			if (!clients[i].used)
+				c = &clients[i];
+		}
+		if (c == NULL || data.clientID.lenstring.len >= (int)sizeof(c->clientid) || data.willFlag)
+		{
+			rc = (c == NULL) ? MQTTSN_RC_REJECTED_CONGESTED : MQTTSN_RC_REJECTED_NOT_SUPPORTED;
+			goto exit;
+		}
+		memset(c, 0, sizeof(*c));
+		memcpy(c->clientid, data.clientID.lenstring.data, data.clientID.lenstring.len);
+		NetworkInit(&c->net);
+		MQTTClientInit(&c->mqtt, &c->net, 1000, c->sendbuf, sizeof(c->sendbuf), c->readbuf, sizeof(c->readbuf));
+		mqttdata.clientID.cstring = c->clientid;
+		mqttdata.keepAliveInterval = data.duration;
+		mqttdata.cleansession = data.cleansession;
+		if (NetworkConnect(&c->net, opts.broker, opts.broker_port) != 0 || MQTTConnect(&c->mqtt, &mqttdata) != SUCCESS)
+		{
+			NetworkDisconnect(&c->net);
+			rc = MQTTSN_RC_REJECTED_CONGESTED;
+			goto exit;
+		}
+		c->used = 1;
+		current = c;
+		printf("%s: connected\n", c->clientid);
+	}
+	memcpy(&c->addr, addr, addrlen);
+	c->addrlen = addrlen;
+	c->asleep = 0;
+	c->duration = data.duration;
+	refresh(c);
+	for (i = 0; i < c->buffered_count; ++i)
+		forward(c, c->buffered[i].topicid, c->buffered[i].qos, c->buffered[i].retained,
+				c->buffered[i].payload, c->buffered[i].payloadlen);
+	c->buffered_count = 0;
+
+exit:
+	len = MQTTSNSerialize_connack(out, sizeof(out), rc);
+	sendto(udp, out, len, 0, (struct sockaddr*)addr, addrlen);
+}
+
+
+static void handlePacket(struct sockaddr_storage* addr, socklen_t addrlen, unsigned char* buf, int len)
+{
+	SNClient* c = findClient(addr, addrlen);
+	unsigned char out[32];
+	int type = MQTTSNPacket_type(buf, len);
+
+	current = c; /* MQTTPublish and MQTTSubscribe may deliver messages too */
+
+	if (opts.verbose)
+		printf("%s: packet type %d, %d bytes\n", c ? c->clientid : "-", type, len);
+	if (type == MQTTSN_CONNECT)
+	{
+		handleConnect(c, addr, addrlen, buf, len);
+		return;
+	}
+	if (type == MQTTSN_PUBLISH)
+	{
+		MQTTSN_topicid topic;
+		MQTTMessage m;
+		unsigned char* payload;
+		unsigned short msgid; /* MQTTPublish sets m.id to its own */
+		int qos, payloadlen, rc = MQTTSN_RC_ACCEPTED;
+		char name[TOPIC_MAX];
+
+		if (MQTTSNDeserialize_publish(&m.dup, &qos, &m.retained, &msgid, &topic, &payload, &payloadlen, buf, len) != 1)
+			return;
+		if (!topicName(c, &topic, name))
+			rc = MQTTSN_RC_REJECTED_INVALID_TOPIC_ID;
+		else if (qos == -1 || c == NULL)
+		{
+			if (qos == -1)
+				anonPublish(name, m.retained, payload, payloadlen);
+			return;
+		}
+		else
+		{
+			m.qos = (qos > 0) ? QOS1 : QOS0;
+			m.payload = payload;
+			m.payloadlen = payloadlen;
+			if (MQTTPublish(&c->mqtt, name, &m) != SUCCESS)
+				rc = MQTTSN_RC_REJECTED_CONGESTED;
+		}
+		if (c != NULL && (qos == 1 || rc != MQTTSN_RC_ACCEPTED))
+			sendto_client(c, out, MQTTSNSerialize_puback(out, sizeof(out),
+					(topic.type == MQTTSN_TOPIC_TYPE_SHORT) ? 0 : topic.data.id, msgid, rc));
+		return;
+	}
+	if (c == NULL)
+	{
+		if (type == MQTTSN_PINGREQ || type == MQTTSN_DISCONNECT)
+		{
+			len = MQTTSNSerialize_disconnect(out, sizeof(out), -1); /* not connected */
+			sendto(udp, out, len, 0, (struct sockaddr*)addr, addrlen);
+		}
+		return;
+	}
+
+	refresh(c);
+	switch (type)
+	{
+		case MQTTSN_REGISTER:
+		{
+			MQTTString name;
+			unsigned short topicid, msgid;
+			char* announced = NULL;
+
+			if (MQTTSNDeserialize_register(&topicid, &msgid, &name, buf, len) != 1)
+				break;
+			topicid = topicId(c, name.lenstring.data, name.lenstring.len, &announced);
+			if (announced)
+				*announced = 1;
+			sendto_client(c, out, MQTTSNSerialize_regack(out, sizeof(out), topicid, msgid,
+					topicid ? MQTTSN_RC_ACCEPTED : MQTTSN_RC_REJECTED_CONGESTED));
+			break;
+		}
+		case MQTTSN_SUBSCRIBE:
+		{
+			MQTTSN_topicid filter;
+			unsigned short msgid, topicid = 0;
+			unsigned char dup;
+			int qos, i, rc = MQTTSN_RC_REJECTED_CONGESTED;
+			char* filterbuf = NULL;
+			char* announced = NULL;
+
+			if (MQTTSNDeserialize_subscribe(&dup, &qos, &msgid, &filter, buf, len) != 1)
+				break;
+			if (filter.type != MQTTSN_TOPIC_TYPE_NORMAL || filter.data.long_.len >= TOPIC_MAX)
+				rc = MQTTSN_RC_REJECTED_NOT_SUPPORTED;
+			for (i = 0; i < MAX_MESSAGE_HANDLERS && filterbuf == NULL && rc != MQTTSN_RC_REJECTED_NOT_SUPPORTED; ++i)
+			{
+				if (c->filters[i][0] == '\0' || ((int)strlen(c->filters[i]) == filter.data.long_.len &&
+						memcmp(c->filters[i], filter.data.long_.name, filter.data.long_.len) == 0))
+					filterbuf = c->filters[i];
+			}
+			if (filterbuf != NULL)
+			{
+				memcpy(filterbuf, filter.data.long_.name, filter.data.long_.len);
+				filterbuf[filter.data.long_.len] = '\0';
+				if (MQTTSubscribe(&c->mqtt, filterbuf, (qos > 0) ? QOS1 : QOS0, messageArrived) == SUCCESS)
+				{
+					rc = MQTTSN_RC_ACCEPTED;
+					if (strpbrk(filterbuf, "+#") == NULL)
+						topicid = topicId(c, filterbuf, filter.data.long_.len, &announced);
+					if (announced)
+						*announced = 1;
+				}
+				else
+					filterbuf[0] = '\0';
+			}
+			sendto_client(c, out, MQTTSNSerialize_suback(out, sizeof(out), (qos > 0) ? 1 : 0, topicid, msgid, rc));
+			break;
+		}
+		case MQTTSN_PINGREQ:
+		{
+			MQTTString clientid;
+			int i;
+
+			if (MQTTSNDeserialize_pingreq(&clientid, buf, len) == 1 && clientid.lenstring.len > 0 && c->asleep)
+			{
+				for (i = 0; i < c->buffered_count; ++i)
+					forward(c, c->buffered[i].topicid, c->buffered[i].qos, c->buffered[i].retained,
+							c->buffered[i].payload, c->buffered[i].payloadlen);
+				c->buffered_count = 0;
+			}
+			sendto_client(c, out, MQTTSNSerialize_pingresp(out, sizeof(out)));
+			break;
+		}
+		case MQTTSN_DISCONNECT:
+		{
+			int duration = -1;
+
+			if (MQTTSNDeserialize_disconnect(&duration, buf, len) != 1)
+				break;
+			sendto_client(c, out, MQTTSNSerialize_disconnect(out, sizeof(out), -1));
+			if (duration < 0)
+				dropClient(c, "disconnected");
+			else
+			{
+				c->asleep = 1;
+				c->duration = duration;
+				refresh(c);
+				printf("%s: asleep for %d seconds\n", c->clientid, duration);
+			}
+			break;
+		}
+		default: /* PUBACK, REGACK from the client */
+			break;
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	struct sockaddr_in6 local;
+	int i, off = 0;
+
+	getopts(argc, argv);
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	signal(SIGINT, cfinish);
+	signal(SIGTERM, cfinish);
+	signal(SIGPIPE, SIG_IGN);
+
+	udp = socket(AF_INET6, SOCK_DGRAM, 0);
+	setsockopt(udp, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+	memset(&local, 0, sizeof(local));
+	local.sin6_family = AF_INET6;
+	local.sin6_addr = in6addr_any;
+	local.sin6_port = htons(opts.port);
+	if (udp < 0 || bind(udp, (struct sockaddr*)&local, sizeof(local)) != 0)
+	{
+		printf("cannot bind UDP port %d\n", opts.port);
+		return -1;
+	}
+	NetworkInit(&anon_net);
+	MQTTClientInit(&anon, &anon_net, 1000, anon_sendbuf, sizeof(anon_sendbuf), anon_readbuf, sizeof(anon_readbuf));
+	printf("MQTT-SN gateway on UDP port %d for %s:%d\n", opts.port, opts.broker, opts.broker_port);
+
+	while (!toStop)
+	{
+		struct pollfd pfd = {udp, POLLIN, 0};
+
+		if (poll(&pfd, 1, POLL_MS) > 0)
+		{
+			unsigned char buf[DATAGRAM_MAX];
+			struct sockaddr_storage from;
+			socklen_t fromlen = sizeof(from);
+			int len = recvfrom(udp, buf, sizeof(buf), 0, (struct sockaddr*)&from, &fromlen);
+
+			if (len > 0)
+				handlePacket(&from, fromlen, buf, len);
+		}
+
+		for (i = 0; i < MAX_CLIENTS; ++i)
+		{
+			SNClient* c = &clients[i];
+
+			if (!c->used)
+				continue;
+			current = c;
+			if (MQTTClient_poll(&c->mqtt) != SUCCESS)
+				dropClient(c, "broker connection lost");
+			else if (c->duration > 0 && TimerIsExpired(&c->deadline))
+				dropClient(c, c->asleep ? "did not wake up" : "keepalive timeout");
+			current = NULL;
+		}
+		if (anon.isconnected)
+			MQTTClient_poll(&anon);
+	}
+
+	for (i = 0; i < MAX_CLIENTS; ++i)
+	{
+		if (clients[i].used)
+			dropClient(&clients[i], "gateway stopping");
+	}
+	if (anon.isconnected)
+		MQTTDisconnect(&anon);
+	NetworkDisconnect(&anon_net);
+	close(udp);
+	return 0;
+}
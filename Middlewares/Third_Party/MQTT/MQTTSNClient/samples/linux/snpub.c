@@ -0,0 +1,177 @@
+/*******************************************************************************
+ * MQTT-SN test client.
+ *
+ * Runs the MQTT-SN client through what a sleeping sensor node does, against
+ * the sample gateway: a QoS -1 publish without a connection, connect,
+ * subscribe, register, QoS 0 and 1 publishes, and - with a predefined topic
+ * id for the same topic - sleeping while a message arrives and collecting it
+ * on waking.  Exits non-zero if a message does not come back.
+ *
+ *   gateway --predefined 1=sn/test &
+ *   snpub --topic sn/test --predefined 1
+ *******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MQTTSNClient.h"
+
+
+void usage(void)
+{
+	printf("MQTT-SN test client\n");
+	printf("Usage: snpub <options>, where options are:\n");
+	printf("  --host <gateway hostname> (default is localhost)\n");
+	printf("  --port <gateway udp port> (default is 10000)\n");
+	printf("  --clientid <clientid> (default is snpub)\n");
+	printf("  --topic <topic> (default is sn/test)\n");
+	printf("  --predefined <id> a predefined topic id of the gateway for the same topic\n");
+	printf("  --count <publishes per QoS> (default is 3)\n");
+	exit(-1);
+}
+
+
+struct opts_struct
+{
+	char* host;
+	int port;
+	char* clientid;
+	char* topic;
+	int predefined;
+	int count;
+} opts =
+{
+	"localhost", 10000, "snpub", "sn/test", 0, 3
+};
+
+
+void getopts(int argc, char** argv)
+{
+	int count = 1;
+
+	while (count < argc)
+	{
+		char* option = argv[count];
+
+		if (++count >= argc)
+			usage();
+		if (strcmp(option, "--host") == 0)
+			opts.host = argv[count];
+		else if (strcmp(option, "--port") == 0)
+			opts.port = atoi(argv[count]);
+		else if (strcmp(option, "--clientid") == 0)
+			opts.clientid = argv[count];
+		else if (strcmp(option, "--topic") == 0)
+			opts.topic = argv[count];
+		else if (strcmp(option, "--predefined") == 0)
+			opts.predefined = atoi(argv[count]);
+		else if (strcmp(option, "--count") == 0)
+			opts.count = atoi(argv[count]);
+		else
+			usage();
+		count++;
+	}
+}
+
+
+int arrived = 0;
+
+void messageArrived(MQTTSNMessageData* md)
+{
+	MQTTSNMessage* m = md->message;
+
+	printf("message on %s, qos %d: %.*s\n", md->topicName ? md->topicName : "?", m->qos,
+			(int)m->payloadlen, (char*)m->payload);
+	++arrived;
+}
+
+
+int main(int argc, char** argv)
+{
+	MQTTSNNetwork n;
+	MQTTSNClient c;
+	MQTTSNPacket_connectData data = MQTTSNPacket_connectData_initializer;
+	MQTTSNMessage m;
+	MQTTSN_topicid topic;
+	unsigned char buf[256], readbuf[256];
+	unsigned short topicid = 0, subid = 0;
+	char payload[64];
+	int expected = 0, i, rc;
+
+	getopts(argc, argv);
+
+	MQTTSNNetworkInit(&n);
+	if (MQTTSNNetworkConnect(&n, opts.host, opts.port) != 0)
+	{
+		printf("cannot reach %s:%d\n", opts.host, opts.port);
+		return -1;
+	}
+	MQTTSNClientInit(&c, &n, 1000, buf, sizeof(buf), readbuf, sizeof(readbuf));
+
+	memset(&m, 0, sizeof(m));
+	m.payload = payload;
+	if (opts.predefined)
+	{
+		topic.type = MQTTSN_TOPIC_TYPE_PREDEFINED;
+		topic.data.id = opts.predefined;
+		m.qos = -1;
+		m.payloadlen = sprintf(payload, "qos -1 before connecting");
+		rc = MQTTSNPublish(&c, topic, &m);
+		printf("QoS -1 publish, rc %d\n", rc);
+	}
+
+	data.clientID.cstring = opts.clientid;
+	data.duration = 30;
+	if ((rc = MQTTSNConnect(&c, &data)) != MQTTSN_SUCCESS)
+	{
+		printf("connect failed, rc %d\n", rc);
+		return -1;
+	}
+	if ((rc = MQTTSNSubscribe(&c, opts.topic, 1, messageArrived, &subid)) != MQTTSN_SUCCESS)
+		printf("subscribe failed, rc %d\n", rc);
+	if ((rc = MQTTSNRegister(&c, opts.topic, &topicid)) != MQTTSN_SUCCESS)
+		printf("register failed, rc %d\n", rc);
+	printf("subscribed as topic id %d, registered as topic id %d\n", subid, topicid);
+	MQTTSNYield(&c, 200); /* the QoS -1 message, if the broker was quicker than our subscribe */
+	arrived = 0;
+
+	topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+	topic.data.id = topicid;
+	for (m.qos = 0; m.qos <= 1; ++m.qos)
+	{
+		for (i = 0; i < opts.count; ++i)
+		{
+			m.payloadlen = sprintf(payload, "qos %d message %d", m.qos, i);
+			if ((rc = MQTTSNPublish(&c, topic, &m)) != MQTTSN_SUCCESS)
+				printf("publish failed, rc %d\n", rc);
+			else
+				++expected;
+			MQTTSNYield(&c, 100);
+		}
+	}
+	MQTTSNYield(&c, 500);
+
+	if (opts.predefined)
+	{
+		if ((rc = MQTTSNSleep(&c, 10)) != MQTTSN_SUCCESS)
+			printf("sleep failed, rc %d\n", rc);
+		topic.type = MQTTSN_TOPIC_TYPE_PREDEFINED;
+		topic.data.id = opts.predefined;
+		m.qos = -1;
+		m.payloadlen = sprintf(payload, "sent while asleep");
+		MQTTSNPublish(&c, topic, &m);
+		++expected;
+		usleep(500 * 1000);
+		if ((rc = MQTTSNWake(&c)) != MQTTSN_SUCCESS)
+			printf("wake failed, rc %d\n", rc);
+		data.cleansession = 0; /* back to active, keeping the session */
+		if ((rc = MQTTSNConnect(&c, &data)) != MQTTSN_SUCCESS)
+			printf("reconnect failed, rc %d\n", rc);
+	}
+
+	rc = MQTTSNDisconnect(&c);
+	MQTTSNNetworkDisconnect(&n);
+	printf("disconnect rc %d, %d of %d messages arrived\n", rc, arrived, expected);
+	return (arrived == expected) ? 0 : 1;
+}
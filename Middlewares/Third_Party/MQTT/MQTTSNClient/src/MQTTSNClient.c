@@ -0,0 +1,540 @@
+/*******************************************************************************
+ * MQTT-SN client over UDP, see MQTTSNClient.h.
+ *******************************************************************************/
+#include <string.h>
+
+#include "MQTTSNClient.h"
+
+/* PUBACK and REGACK, the longest packets the client sends while handling others */
+#define MQTTSN_ACK_LEN 7
+
+#define MQTTSN_MAX_MSG_ID 65535
+
+
+static unsigned short getNextMsgId(MQTTSNClient* c) {
+    return c->next_msgid = (c->next_msgid == MQTTSN_MAX_MSG_ID) ? 1 : c->next_msgid + 1;
+}
+
+
+/* Sends one datagram.  Replies to the gateway are sent from a buffer of their own,
+ * so that a request in c->buf survives to be resent. */
+static int sendPacket(MQTTSNClient* c, unsigned char* buf, int length)
+{
+    if (c->ipstack->mqttsnwrite(c->ipstack, buf, length, c->command_timeout_ms) != length)
+        return MQTTSN_FAILURE;
+    if (c->state == MQTTSN_STATE_ACTIVE && c->duration > 0)
+        TimerCountdown(&c->last_sent, c->duration); // record the fact that we have successfully sent the packet
+    return MQTTSN_SUCCESS;
+}
+
+
+/* Receives one datagram into c->readbuf.  Returns its packet type, 0 if nothing arrived
+ * or it is not for us (malformed, or gateway discovery, which is not supported), or -1
+ * if the network failed. */
+static int readPacket(MQTTSNClient* c, Timer* timer)
+{
+    int len = c->ipstack->mqttsnread(c->ipstack, c->readbuf, c->readbuf_size, TimerLeftMS(timer));
+    int type;
+
+    if (len <= 0)
+        return (len < 0) ? MQTTSN_FAILURE : 0;
+    type = MQTTSNPacket_type(c->readbuf, len);
+    if (type <= MQTTSN_GWINFO)
+        return 0;
+    if (c->state == MQTTSN_STATE_ACTIVE && c->duration > 0)
+        TimerCountdown(&c->last_received, c->duration); // record the fact that we have successfully received a packet
+    return type;
+}
+
+
+static struct MQTTSNTopic* findTopic(MQTTSNClient* c, unsigned short topicid)
+{
+    int i;
+
+    for (i = 0; i < MQTTSN_MAX_TOPICS; ++i)
+    {
+        if (c->topics[i].id == topicid)
+            return &c->topics[i];
+    }
+    return NULL;
+}
+
+
+/* Remembers the name of a topic id; returns the return code for a REGACK */
+static unsigned char storeTopic(MQTTSNClient* c, unsigned short topicid, const char* name, int namelen)
+{
+    struct MQTTSNTopic* topic = findTopic(c, topicid);
+
+    if (namelen >= MQTTSN_TOPIC_NAME_MAX)
+        return MQTTSN_RC_REJECTED_NOT_SUPPORTED;
+    if (topic == NULL && (topic = findTopic(c, 0)) == NULL)
+        return MQTTSN_RC_REJECTED_CONGESTED;
+    topic->id = topicid;
+    memcpy(topic->name, name, namelen);
+    topic->name[namelen] = '\0';
+    return MQTTSN_RC_ACCEPTED;
+}
+
+
+static char isTopicEqual(MQTTSN_topicid* a, MQTTSN_topicid* b)
+{
+    if (a->type != b->type)
+        return 0;
+    if (a->type == MQTTSN_TOPIC_TYPE_SHORT)
+        return memcmp(a->data.short_name, b->data.short_name, 2) == 0;
+    return a->data.id == b->data.id;
+}
+
+
+/* Returns the return code for a PUBACK: a message nobody handles is for a topic id we do not know */
+static unsigned char deliverMessage(MQTTSNClient* c, MQTTSN_topicid* topic, MQTTSNMessage* message)
+{
+    MQTTSNMessageData md;
+    MQTTSNMessageHandler fp = c->defaultMessageHandler;
+    struct MQTTSNTopic* registered = NULL;
+    int i;
+
+    for (i = 0; i < MQTTSN_MAX_MESSAGE_HANDLERS; ++i)
+    {
+        if (c->messageHandlers[i].fp != NULL && isTopicEqual(&c->messageHandlers[i].topic, topic))
+        {
+            fp = c->messageHandlers[i].fp;
+            break;
+        }
+    }
+    if (fp == NULL)
+        return MQTTSN_RC_REJECTED_INVALID_TOPIC_ID;
+
+    if (topic->type == MQTTSN_TOPIC_TYPE_NORMAL && topic->data.id != 0)
+        registered = findTopic(c, topic->data.id);
+    md.message = message;
+    md.topic = topic;
+    md.topicName = (registered != NULL) ? registered->name : NULL;
+    fp(&md);
+    return MQTTSN_RC_ACCEPTED;
+}
+
+
+/* Pings the gateway when nothing was exchanged for a keepalive duration; a ping
+ * unanswered for command_timeout_ms is resent, up to MQTTSN_RETRY_COUNT times */
+static int keepalive(MQTTSNClient* c)
+{
+    unsigned char buf[MQTTSN_ACK_LEN];
+    MQTTString self = MQTTString_initializer; /* an active client pings anonymously */
+    int len,
+        rc = MQTTSN_SUCCESS;
+
+    if (c->state != MQTTSN_STATE_ACTIVE || c->duration == 0)
+        goto exit;
+
+    if (c->ping_outstanding ? TimerIsExpired(&c->last_received)
+            : (TimerIsExpired(&c->last_sent) || TimerIsExpired(&c->last_received)))
+    {
+        if (c->ping_outstanding >= MQTTSN_RETRY_COUNT)
+        {
+            c->state = MQTTSN_STATE_DISCONNECTED; /* the gateway is gone */
+            rc = MQTTSN_FAILURE;
+            goto exit;
+        }
+        len = MQTTSNSerialize_pingreq(buf, sizeof(buf), self);
+        if (len > 0 && (rc = sendPacket(c, buf, len)) == MQTTSN_SUCCESS)
+        {
+            c->ping_outstanding++;
+            TimerCountdownMS(&c->last_received, c->command_timeout_ms);
+        }
+    }
+
+exit:
+    return rc;
+}
+
+
+static int cycle(MQTTSNClient* c, Timer* timer)
+{
+    unsigned char buf[MQTTSN_ACK_LEN];
+    int packet_type = readPacket(c, timer);     /* read the socket, see what work is due */
+    int len = 0,
+        rc = MQTTSN_SUCCESS;
+
+    switch (packet_type)
+    {
+        case MQTTSN_FAILURE:
+            rc = MQTTSN_FAILURE;
+            goto exit;
+        case MQTTSN_PUBLISH:
+        {
+            MQTTSN_topicid topic;
+            MQTTSNMessage msg;
+            int qos, payloadlen;
+            unsigned char return_code;
+
+            if (MQTTSNDeserialize_publish(&msg.dup, &qos, &msg.retained, &msg.id, &topic,
+                    (unsigned char**)&msg.payload, &payloadlen, c->readbuf, c->readbuf_size) != 1)
+                break;
+            msg.qos = qos;
+            msg.payloadlen = payloadlen;
+            return_code = deliverMessage(c, &topic, &msg);
+            if (msg.qos == 1)
+            {
+                len = MQTTSNSerialize_puback(buf, sizeof(buf),
+                        (topic.type == MQTTSN_TOPIC_TYPE_SHORT) ? 0 : topic.data.id, msg.id, return_code);
+                rc = sendPacket(c, buf, len);
+            }
+            break;
+        }
+        case MQTTSN_REGISTER:
+        {
+            MQTTString name;
+            unsigned short topicid, msgid;
+
+            if (MQTTSNDeserialize_register(&topicid, &msgid, &name, c->readbuf, c->readbuf_size) != 1)
+                break;
+            len = MQTTSNSerialize_regack(buf, sizeof(buf), topicid, msgid,
+                    storeTopic(c, topicid, name.lenstring.data, name.lenstring.len));
+            rc = sendPacket(c, buf, len);
+            break;
+        }
+        case MQTTSN_PINGRESP:
+            c->ping_outstanding = 0;
+            break;
+        case MQTTSN_DISCONNECT:
+            c->state = MQTTSN_STATE_DISCONNECTED;
+            c->ping_outstanding = 0;
+            break;
+    }
+
+    if (keepalive(c) != MQTTSN_SUCCESS)
+        rc = MQTTSN_FAILURE;
+
+exit:
+    return (rc == MQTTSN_SUCCESS) ? packet_type : rc;
+}
+
+
+/* Cycles until a packet of packet_type arrives.  A DISCONNECT from the gateway ends the wait too. */
+static int waitfor(MQTTSNClient* c, int packet_type, Timer* timer)
+{
+    int rc = 0;
+
+    do
+    {
+        if (TimerIsExpired(timer))
+            break; // we timed out
+        rc = cycle(c, timer);
+    }
+    while (rc != packet_type && rc >= 0 && rc != MQTTSN_DISCONNECT);
+
+    return rc;
+}
+
+
+static unsigned short getAckMsgId(MQTTSNClient* c, int packet_type)
+{
+    unsigned short topicid = 0,
+        msgid = 0;
+    unsigned char return_code;
+    int qos;
+
+    if (packet_type == MQTTSN_SUBACK)
+        MQTTSNDeserialize_suback(&qos, &topicid, &msgid, &return_code, c->readbuf, c->readbuf_size);
+    else if (packet_type == MQTTSN_REGACK)
+        MQTTSNDeserialize_regack(&topicid, &msgid, &return_code, c->readbuf, c->readbuf_size);
+    else if (packet_type == MQTTSN_PUBACK)
+        MQTTSNDeserialize_puback(&topicid, &msgid, &return_code, c->readbuf, c->readbuf_size);
+    return msgid;
+}
+
+
+/* Sends the request serialized in c->buf and waits command_timeout_ms for its reply, which
+ * must carry msgid unless that is 0.  A request without a reply is sent again, PUBLISH and
+ * SUBSCRIBE with the DUP flag set.  On success the reply is left in c->readbuf. */
+static int sendAndWait(MQTTSNClient* c, int len, int acktype, unsigned short msgid)
+{
+    int attempt,
+        rc = MQTTSN_FAILURE;
+
+    for (attempt = 0; attempt < MQTTSN_RETRY_COUNT; ++attempt)
+    {
+        Timer timer;
+
+        TimerInit(&timer);
+        TimerCountdownMS(&timer, c->command_timeout_ms);
+        if (attempt > 0)
+        {
+            int packetlen = 0;
+            int lenlen = MQTTSNPacket_decode(c->buf, len, &packetlen);
+
+            if (c->buf[lenlen] == MQTTSN_PUBLISH || c->buf[lenlen] == MQTTSN_SUBSCRIBE)
+                c->buf[lenlen + 1] |= 0x80; /* DUP */
+        }
+        if (sendPacket(c, c->buf, len) != MQTTSN_SUCCESS)
+            return MQTTSN_FAILURE;
+        while ((rc = waitfor(c, acktype, &timer)) == acktype)
+        {
+            if (msgid == 0 || getAckMsgId(c, acktype) == msgid)
+                return MQTTSN_SUCCESS;
+        }
+        if (rc < 0 || rc == MQTTSN_DISCONNECT)
+            return MQTTSN_FAILURE;
+    }
+    return MQTTSN_FAILURE;
+}
+
+
+void MQTTSNClientInit(MQTTSNClient* c, MQTTSNNetwork* network, unsigned int command_timeout_ms,
+        unsigned char* sendbuf, size_t sendbuf_size, unsigned char* readbuf, size_t readbuf_size)
+{
+    memset(c, 0, sizeof(*c));
+    c->ipstack = network;
+    c->command_timeout_ms = command_timeout_ms;
+    c->buf = sendbuf;
+    c->buf_size = sendbuf_size;
+    c->readbuf = readbuf;
+    c->readbuf_size = readbuf_size;
+    c->state = MQTTSN_STATE_DISCONNECTED;
+    c->next_msgid = 1;
+    TimerInit(&c->last_sent);
+    TimerInit(&c->last_received);
+}
+
+
+int MQTTSNConnect(MQTTSNClient* c, MQTTSNPacket_connectData* options)
+{
+    int len = 0,
+        connack_rc = 0,
+        rc = MQTTSN_FAILURE;
+
+    if (options->willFlag)
+        goto exit;
+    if ((len = MQTTSNSerialize_connect(c->buf, c->buf_size, options)) <= 0)
+    {
+        rc = MQTTSN_BUFFER_OVERFLOW;
+        goto exit;
+    }
+    if ((rc = sendAndWait(c, len, MQTTSN_CONNACK, 0)) != MQTTSN_SUCCESS)
+        goto exit;
+    if (MQTTSNDeserialize_connack(&connack_rc, c->readbuf, c->readbuf_size) != 1)
+        rc = MQTTSN_FAILURE;
+    else if (connack_rc != MQTTSN_RC_ACCEPTED)
+        rc = -connack_rc;
+    if (rc != MQTTSN_SUCCESS)
+        goto exit;
+
+    if (options->cleansession)
+    {
+        memset(c->topics, 0, sizeof(c->topics));
+        memset(c->messageHandlers, 0, sizeof(c->messageHandlers));
+    }
+    c->clientID = options->clientID;
+    c->duration = options->duration;
+    c->state = MQTTSN_STATE_ACTIVE;
+    c->ping_outstanding = 0;
+    if (c->duration > 0)
+    {
+        TimerCountdown(&c->last_sent, c->duration);
+        TimerCountdown(&c->last_received, c->duration);
+    }
+
+exit:
+    return rc;
+}
+
+
+int MQTTSNRegister(MQTTSNClient* c, const char* topicName, unsigned short* topicid)
+{
+    MQTTString name = MQTTString_initializer;
+    unsigned short msgid = getNextMsgId(c),
+        ackid = 0;
+    unsigned char return_code = 0;
+    int len = 0,
+        rc = MQTTSN_FAILURE;
+
+    if (c->state != MQTTSN_STATE_ACTIVE)
+        goto exit;
+    name.cstring = (char*)topicName;
+    if ((len = MQTTSNSerialize_register(c->buf, c->buf_size, 0, msgid, &name)) <= 0)
+    {
+        rc = MQTTSN_BUFFER_OVERFLOW;
+        goto exit;
+    }
+    if ((rc = sendAndWait(c, len, MQTTSN_REGACK, msgid)) != MQTTSN_SUCCESS)
+        goto exit;
+    if (MQTTSNDeserialize_regack(topicid, &ackid, &return_code, c->readbuf, c->readbuf_size) != 1 ||
+            return_code != MQTTSN_RC_ACCEPTED)
+        rc = MQTTSN_FAILURE;
+    else
+        storeTopic(c, *topicid, topicName, strlen(topicName)); /* only for naming delivered messages */
+
+exit:
+    return rc;
+}
+
+
+int MQTTSNPublish(MQTTSNClient* c, MQTTSN_topicid topic, MQTTSNMessage* message)
+{
+    unsigned short topicid = 0,
+        ackid = 0;
+    unsigned char return_code = 0;
+    int len = 0,
+        rc = MQTTSN_FAILURE;
+
+    if (message->qos == -1)
+    {
+        if (topic.type == MQTTSN_TOPIC_TYPE_NORMAL) /* a registered id needs a connection */
+            goto exit;
+    }
+    else if (c->state != MQTTSN_STATE_ACTIVE || message->qos > 1)
+        goto exit;
+
+    message->id = (message->qos == 1) ? getNextMsgId(c) : 0;
+    len = MQTTSNSerialize_publish(c->buf, c->buf_size, 0, message->qos, message->retained, message->id,
+            topic, (unsigned char*)message->payload, message->payloadlen);
+    if (len <= 0)
+    {
+        rc = MQTTSN_BUFFER_OVERFLOW;
+        goto exit;
+    }
+
+    if (message->qos != 1)
+        rc = sendPacket(c, c->buf, len);
+    else if ((rc = sendAndWait(c, len, MQTTSN_PUBACK, message->id)) == MQTTSN_SUCCESS)
+    {
+        if (MQTTSNDeserialize_puback(&topicid, &ackid, &return_code, c->readbuf, c->readbuf_size) != 1 ||
+                return_code != MQTTSN_RC_ACCEPTED)
+            rc = MQTTSN_FAILURE;
+    }
+
+exit:
+    return rc;
+}
+
+
+int MQTTSNSubscribe(MQTTSNClient* c, const char* topicFilter, int qos, MQTTSNMessageHandler messageHandler,
+        unsigned short* topicid)
+{
+    MQTTSN_topicid filter;
+    unsigned short msgid = getNextMsgId(c),
+        ackid = 0;
+    unsigned char return_code = 0;
+    int grantedQoS = 0,
+        len = 0,
+        i,
+        rc = MQTTSN_FAILURE;
+
+    if (c->state != MQTTSN_STATE_ACTIVE || qos < 0 || qos > 1)
+        goto exit;
+    filter.type = MQTTSN_TOPIC_TYPE_NORMAL;
+    filter.data.long_.name = (char*)topicFilter;
+    filter.data.long_.len = strlen(topicFilter);
+    if ((len = MQTTSNSerialize_subscribe(c->buf, c->buf_size, 0, qos, msgid, &filter)) <= 0)
+    {
+        rc = MQTTSN_BUFFER_OVERFLOW;
+        goto exit;
+    }
+    if ((rc = sendAndWait(c, len, MQTTSN_SUBACK, msgid)) != MQTTSN_SUCCESS)
+        goto exit;
+    if (MQTTSNDeserialize_suback(&grantedQoS, topicid, &ackid, &return_code, c->readbuf, c->readbuf_size) != 1 ||
+            return_code != MQTTSN_RC_ACCEPTED)
+    {
+        rc = MQTTSN_FAILURE;
+        goto exit;
+    }
+
+    if (*topicid == 0) /* wildcard filter: the gateway registers each topic as it arrives */
+    {
+        if (c->defaultMessageHandler == NULL)
+            c->defaultMessageHandler = messageHandler;
+        goto exit;
+    }
+    storeTopic(c, *topicid, topicFilter, filter.data.long_.len);
+    filter.data.id = *topicid; /* from here on, the topic is its id */
+    rc = MQTTSN_FAILURE;
+    for (i = 0; i < MQTTSN_MAX_MESSAGE_HANDLERS; ++i)
+    {
+        if (c->messageHandlers[i].fp == NULL || isTopicEqual(&c->messageHandlers[i].topic, &filter))
+            break;
+    }
+    if (i < MQTTSN_MAX_MESSAGE_HANDLERS)
+    {
+        c->messageHandlers[i].topic = filter;
+        c->messageHandlers[i].fp = messageHandler;
+        rc = MQTTSN_SUCCESS;
+    }
+
+exit:
+    return rc;
+}
+
+
+int MQTTSNYield(MQTTSNClient* c, int timeout_ms)
+{
+    int rc = MQTTSN_SUCCESS;
+    Timer timer;
+
+    TimerInit(&timer);
+    TimerCountdownMS(&timer, timeout_ms);
+
+    do
+    {
+        int packet_type = cycle(c, &timer);
+
+        if (packet_type < 0 || packet_type == MQTTSN_DISCONNECT)
+        {
+            rc = MQTTSN_FAILURE;
+            break;
+        }
+    } while (!TimerIsExpired(&timer));
+
+    return rc;
+}
+
+
+int MQTTSNSleep(MQTTSNClient* c, unsigned short duration)
+{
+    int len = 0,
+        rc = MQTTSN_FAILURE;
+
+    if (c->state == MQTTSN_STATE_DISCONNECTED)
+        goto exit;
+    if ((len = MQTTSNSerialize_disconnect(c->buf, c->buf_size, duration)) <= 0)
+        goto exit;
+    if ((rc = sendAndWait(c, len, MQTTSN_DISCONNECT, 0)) == MQTTSN_SUCCESS)
+    {
+        c->state = MQTTSN_STATE_ASLEEP;
+        c->duration = duration;
+        c->ping_outstanding = 0;
+    }
+
+exit:
+    return rc;
+}
+
+
+int MQTTSNWake(MQTTSNClient* c)
+{
+    int len = 0,
+        rc = MQTTSN_FAILURE;
+
+    if (c->state != MQTTSN_STATE_ASLEEP)
+        goto exit;
+    /* the gateway sends what it buffered, then the PINGRESP; cycle() delivers the messages */
+    if ((len = MQTTSNSerialize_pingreq(c->buf, c->buf_size, c->clientID)) <= 0)
+        goto exit;
+    rc = sendAndWait(c, len, MQTTSN_PINGRESP, 0);
+
+exit:
+    return rc;
+}
+
+
+int MQTTSNDisconnect(MQTTSNClient* c)
+{
+    int len = 0,
+        rc = MQTTSN_FAILURE;
+
+    if ((len = MQTTSNSerialize_disconnect(c->buf, c->buf_size, -1)) > 0)
+        rc = sendAndWait(c, len, MQTTSN_DISCONNECT, 0);
+    c->state = MQTTSN_STATE_DISCONNECTED;
+    c->ping_outstanding = 0;
+    return rc;
+}
@@ -0,0 +1,189 @@
+/*******************************************************************************
+ * MQTT-SN client over UDP.
+ *
+ * For nodes that publish a few bytes at a time and should not keep a TCP
+ * session alive: every packet is one datagram to an MQTT-SN gateway, which
+ * holds the MQTT session with the broker.  Supports topic registration,
+ * QoS -1 (no connection at all, predefined or short topics), QoS 0 and 1,
+ * subscriptions, and the sleeping client: MQTTSNSleep() tells the gateway to
+ * buffer messages, MQTTSNWake() collects them.  Wills and QoS 2 are not
+ * supported.  Lost datagrams are handled by resending requests up to
+ * MQTTSN_RETRY_COUNT times, each waiting command_timeout_ms for the reply.
+ *
+ * Like MQTTClient, the client allocates nothing and is not thread safe.
+ *******************************************************************************/
+
+#if !defined(MQTTSNCLIENT_H)
+#define MQTTSNCLIENT_H
+
+#if defined(__cplusplus)
+ extern "C" {
+#endif
+
+#include "MQTTSNPacket.h"
+
+#if defined(MQTTSNCLIENT_PLATFORM_HEADER)
+  /* Convert MQTTSNCLIENT_PLATFORM_HEADER value into a string constant */
+  #define xstr(s) str(s)
+  #define str(s) #s
+  #include xstr(MQTTSNCLIENT_PLATFORM_HEADER)
+#else /* B-L475E-IOT01A port: HAL tick Timer, ES-WiFi UDP socket */
+  #include "Timer.h"
+  #include "MQTTSNInterface.h"
+#endif
+
+/* Topic names the client keeps for its registered topic ids. */
+#if !defined(MQTTSN_MAX_TOPICS)
+  #define MQTTSN_MAX_TOPICS 4
+#endif
+
+/* Longest topic name, in bytes, kept for a registered topic id. */
+#if !defined(MQTTSN_TOPIC_NAME_MAX)
+  #define MQTTSN_TOPIC_NAME_MAX 32
+#endif
+
+#if !defined(MQTTSN_MAX_MESSAGE_HANDLERS)
+  #define MQTTSN_MAX_MESSAGE_HANDLERS 4
+#endif
+
+/* Times a request is sent before giving up (the spec's Nretry). */
+#if !defined(MQTTSN_RETRY_COUNT)
+  #define MQTTSN_RETRY_COUNT 3
+#endif
+
+/* all failure return codes must be negative */
+enum MQTTSNReturnCode { MQTTSN_BUFFER_OVERFLOW = -2, MQTTSN_FAILURE = -1, MQTTSN_SUCCESS = 0 };
+
+enum MQTTSNClientState { MQTTSN_STATE_DISCONNECTED, MQTTSN_STATE_ACTIVE, MQTTSN_STATE_ASLEEP };
+
+typedef struct MQTTSNMessage
+{
+    int qos;                    /* -1, 0 or 1 */
+    unsigned char retained;
+    unsigned char dup;
+    unsigned short id;
+    void *payload;
+    size_t payloadlen;
+} MQTTSNMessage;
+
+typedef struct MQTTSNMessageData
+{
+    MQTTSNMessage* message;
+    MQTTSN_topicid* topic;
+    const char* topicName;      /* the registered name of topic->data.id, or NULL */
+} MQTTSNMessageData;
+
+typedef void (*MQTTSNMessageHandler)(MQTTSNMessageData*);
+
+typedef struct MQTTSNClient
+{
+    unsigned short next_msgid;
+    unsigned int command_timeout_ms;
+    size_t buf_size,
+      readbuf_size;
+    unsigned char *buf,
+      *readbuf;
+    unsigned short duration;    /* keepalive while active, sleep duration while asleep, in seconds */
+    int state;
+    char ping_outstanding;
+    MQTTString clientID;        /* named again in the PINGREQ of a sleeping client */
+
+    struct MQTTSNTopic
+    {
+        unsigned short id;
+        char name[MQTTSN_TOPIC_NAME_MAX];
+    } topics[MQTTSN_MAX_TOPICS];
+
+    struct MQTTSNMessageHandlers
+    {
+        MQTTSN_topicid topic;
+        MQTTSNMessageHandler fp;
+    } messageHandlers[MQTTSN_MAX_MESSAGE_HANDLERS];
+
+    MQTTSNMessageHandler defaultMessageHandler;
+
+    MQTTSNNetwork* ipstack;
+    Timer last_sent, last_received;
+} MQTTSNClient;
+
+
+/**
+ * Create an MQTT-SN client object
+ * @param client
+ * @param network a datagram network, already bound to the gateway's address
+ * @param command_timeout_ms time to wait for each reply before the request is resent
+ * @param sendbuf, sendbuf_size the largest packet the client sends
+ * @param readbuf, readbuf_size the largest datagram the client accepts
+ */
+void MQTTSNClientInit(MQTTSNClient* client, MQTTSNNetwork* network, unsigned int command_timeout_ms,
+        unsigned char* sendbuf, size_t sendbuf_size, unsigned char* readbuf, size_t readbuf_size);
+
+/** Connect to the gateway, or wake up from sleep into the active state.
+ *  options->clientID must stay valid while connected; the will is not supported.
+ *  @param client - the client object to use
+ *  @param options - connect options
+ *  @return success code, or the negated CONNACK return code when refused
+ */
+int MQTTSNConnect(MQTTSNClient* client, MQTTSNPacket_connectData* options);
+
+/** Register a topic name with the gateway
+ *  @param client - the client object to use
+ *  @param topicName - the topic name
+ *  @param topicid - returned id, to publish to with a MQTTSN_TOPIC_TYPE_NORMAL topic
+ *  @return success code
+ */
+int MQTTSNRegister(MQTTSNClient* client, const char* topicName, unsigned short* topicid);
+
+/** Publish a message.  QoS -1 needs no connection, but only a predefined or short topic.
+ *  @param client - the client object to use
+ *  @param topic - a registered or predefined topic id, or a short topic name
+ *  @param message - the message to send; message->id is set for QoS 1
+ *  @return success code
+ */
+int MQTTSNPublish(MQTTSNClient* client, MQTTSN_topicid topic, MQTTSNMessage* message);
+
+/** Subscribe to a topic name or filter.  For a filter with wildcards the gateway
+ *  returns topic id 0 and registers each matching topic as it is published; those
+ *  messages go to the default message handler, which this sets if it has none.
+ *  @param client - the client object to use
+ *  @param topicFilter - the topic name or filter
+ *  @param qos - the maximum QoS, 0 or 1
+ *  @param messageHandler - the handler for its messages
+ *  @param topicid - returned topic id, 0 for a filter with wildcards
+ *  @return success code
+ */
+int MQTTSNSubscribe(MQTTSNClient* client, const char* topicFilter, int qos, MQTTSNMessageHandler messageHandler,
+        unsigned short* topicid);
+
+/** Receive and handle datagrams for timeout_ms, and send keepalive pings while active.
+ *  @param client - the client object to use
+ *  @param timeout_ms - the time to wait, in milliseconds
+ *  @return success code, or failure if the gateway or the network went away
+ */
+int MQTTSNYield(MQTTSNClient* client, int timeout_ms);
+
+/** Go to sleep: the gateway keeps the session and buffers messages for duration seconds.
+ *  Call MQTTSNWake() or MQTTSNConnect() before the duration runs out.
+ *  @param client - the client object to use
+ *  @param duration - sleep duration, in seconds
+ *  @return success code
+ */
+int MQTTSNSleep(MQTTSNClient* client, unsigned short duration);
+
+/** While asleep, collect the messages buffered by the gateway and stay asleep for another duration.
+ *  @param client - the client object to use
+ *  @return success code
+ */
+int MQTTSNWake(MQTTSNClient* client);
+
+/** End the session with the gateway
+ *  @param client - the client object to use
+ *  @return success code
+ */
+int MQTTSNDisconnect(MQTTSNClient* client);
+
+#if defined(__cplusplus)
+     }
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#include "MQTTSNInterface.h"
+#include <stdint.h>
+#include <string.h>
+#include "es_wifi.h"  // Provides WIFI_STATUS_OK, etc.
+#include "wifi.h"     // Provides WIFI_SendDataTo, WIFI_ReceiveDataFrom, etc.
+
+#ifndef LOG
+#define LOG(a) // or you can define it as printf a
+#endif
+
+int mqttsn_network_read(MQTTSNNetwork* n, unsigned char* buffer, int len, int timeout_ms) {
+    uint8_t from[4];
+    uint16_t fromPort = 0;
+    uint16_t respLen = 0;
+
+    if (WIFI_STATUS_OK != WIFI_ReceiveDataFrom(n->socket, buffer, len, &respLen, timeout_ms,
+                                               from, sizeof(from), &fromPort)) {
+        return -1;
+    }
+    if (respLen > 0 && (memcmp(from, n->gateway, sizeof(from)) != 0 || fromPort != n->port)) {
+        LOG(("mqttsn_network_read: dropped %d bytes from %d.%d.%d.%d:%d\n", respLen,
+             from[0], from[1], from[2], from[3], fromPort));
+        return 0;
+    }
+    return respLen;
+}
+
+
+int mqttsn_network_write(MQTTSNNetwork* n, unsigned char* buffer, int len, int timeout_ms) {
+    uint16_t sentLen = 0;
+    /* the driver caches the destination: only the first datagram to the gateway sets P3/P4 */
+    int ret = WIFI_SendDataTo(n->socket, buffer, len, &sentLen, timeout_ms, n->gateway, n->port);
+    if (ret == WIFI_STATUS_OK) {
+        return sentLen;
+    }
+    LOG(("mqttsn_network_write: Error sending datagram (ret = %d)\n", ret));
+    return -1;
+}
+
+void mqttsn_network_disconnect(MQTTSNNetwork* n) {
+    WIFI_CloseClientConnection(n->socket);
+}
@@ -0,0 +1,59 @@
+#ifndef MQTTSN_INTERFACE_H
+#define MQTTSN_INTERFACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief Datagram network interface structure for the MQTT-SN client.
+ *
+ * The socket is a Wi-Fi UDP socket (WIFI_OpenClientConnection with
+ * WIFI_UDP_PROTOCOL).  The gateway address and port are both the destination
+ * of every datagram sent (WIFI_SendDataTo) and the filter on the datagrams
+ * received: those from any other address or port are dropped.
+ */
+typedef struct MQTTSNNetwork {
+    uint32_t socket;     /**< Socket identifier; use uint32_t to match the Wi-Fi driver */
+    uint8_t gateway[4];  /**< Gateway IPv4 address: send destination and receive filter */
+    uint16_t port;       /**< Gateway UDP port: send destination and receive filter */
+    int (*mqttsnread)(struct MQTTSNNetwork* n, unsigned char* buffer, int len, int timeout_ms);
+    int (*mqttsnwrite)(struct MQTTSNNetwork* n, unsigned char* buffer, int len, int timeout_ms);
+} MQTTSNNetwork;
+
+/**
+ * @brief Read one datagram from the gateway.
+ *
+ * @param n          Pointer to the MQTTSNNetwork structure.
+ * @param buffer     Buffer in which to store the datagram.
+ * @param len        Maximum number of bytes to read.
+ * @param timeout_ms Timeout in milliseconds.
+ * @return Length of the datagram, 0 if none arrived from the gateway, or -1 on error.
+ */
+int mqttsn_network_read(MQTTSNNetwork* n, unsigned char* buffer, int len, int timeout_ms);
+
+/**
+ * @brief Send one datagram to the gateway.
+ *
+ * @param n          Pointer to the MQTTSNNetwork structure.
+ * @param buffer     The datagram.
+ * @param len        Length of the datagram.
+ * @param timeout_ms Timeout in milliseconds.
+ * @return Number of bytes sent on success, or -1 on error.
+ */
+int mqttsn_network_write(MQTTSNNetwork* n, unsigned char* buffer, int len, int timeout_ms);
+
+/**
+ * @brief Close the UDP socket.
+ *
+ * @param n Pointer to the MQTTSNNetwork structure.
+ */
+void mqttsn_network_disconnect(MQTTSNNetwork* n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MQTTSN_INTERFACE_H */
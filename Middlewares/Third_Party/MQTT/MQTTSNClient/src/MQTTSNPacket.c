@@ -0,0 +1,702 @@
+/*******************************************************************************
+ * MQTT-SN 1.2 packet serialization, see MQTTSNPacket.h.
+ *******************************************************************************/
+
+#include "MQTTSNPacket.h"
+#include "StackTrace.h"
+
+#include <string.h>
+
+#define MQTTSN_FLAG_DUP		0x80
+#define MQTTSN_FLAG_RETAIN	0x10
+#define MQTTSN_FLAG_WILL	0x08
+#define MQTTSN_FLAG_CLEAN	0x04
+
+
+/**
+  * Determines the length of a packet from the length of its fields
+  * @param length the length of the fields that follow the message type
+  * @return the length of the whole packet, including the length field and message type
+  */
+int MQTTSNPacket_len(int length)
+{
+	/* a 1 byte length field counts up to 255, beyond that 0x01 and 2 more bytes */
+	return (length + 2 <= 255) ? length + 2 : length + 4;
+}
+
+
+/**
+  * Encodes the length field of an MQTT-SN packet
+  * @param buf the buffer into which the encoded data is written
+  * @param length the length of the whole packet
+  * @return the number of bytes written to the buffer, 1 or 3
+  */
+int MQTTSNPacket_encode(unsigned char* buf, int length)
+{
+	if (length <= 255)
+	{
+		buf[0] = (unsigned char)length;
+		return 1;
+	}
+	buf[0] = 0x01;
+	buf[1] = (unsigned char)(length >> 8);
+	buf[2] = (unsigned char)(length & 0xFF);
+	return 3;
+}
+
+
+/**
+  * Decodes the length field of an MQTT-SN packet
+  * @param buf the buffer holding the packet
+  * @param buflen the length in bytes of the data in the buffer
+  * @param value the decoded length of the whole packet
+  * @return the number of bytes read, 1 or 3, or 0 if the field is incomplete
+  */
+int MQTTSNPacket_decode(unsigned char* buf, int buflen, int* value)
+{
+	if (buflen < 1)
+		return 0;
+	if (buf[0] != 0x01)
+	{
+		*value = buf[0];
+		return 1;
+	}
+	if (buflen < 3)
+		return 0;
+	*value = (buf[1] << 8) + buf[2];
+	return 3;
+}
+
+
+/**
+  * Checks that a datagram holds exactly one packet and returns its type
+  * @param buf the buffer holding the datagram
+  * @param buflen the length in bytes of the datagram
+  * @return the MQTT-SN message type, or MQTTPACKET_READ_ERROR
+  */
+int MQTTSNPacket_type(unsigned char* buf, int buflen)
+{
+	int len = 0;
+	int lenlen = MQTTSNPacket_decode(buf, buflen, &len);
+
+	if (lenlen == 0 || len != buflen || len < lenlen + 1)
+		return MQTTPACKET_READ_ERROR;
+	return buf[lenlen];
+}
+
+
+unsigned char MQTTSNFlags_encode(const MQTTSNFlags* flags)
+{
+	unsigned char byte = (unsigned char)(flags->topicIdType & 0x03);
+
+	if (flags->dup)
+		byte |= MQTTSN_FLAG_DUP;
+	byte |= (unsigned char)(((flags->qos == -1) ? 3 : flags->qos) << 5);
+	if (flags->retain)
+		byte |= MQTTSN_FLAG_RETAIN;
+	if (flags->will)
+		byte |= MQTTSN_FLAG_WILL;
+	if (flags->cleanSession)
+		byte |= MQTTSN_FLAG_CLEAN;
+	return byte;
+}
+
+
+void MQTTSNFlags_decode(unsigned char byte, MQTTSNFlags* flags)
+{
+	flags->dup = (byte & MQTTSN_FLAG_DUP) != 0;
+	flags->qos = (byte >> 5) & 0x03;
+	if (flags->qos == 3)
+		flags->qos = -1;
+	flags->retain = (byte & MQTTSN_FLAG_RETAIN) != 0;
+	flags->will = (byte & MQTTSN_FLAG_WILL) != 0;
+	flags->cleanSession = (byte & MQTTSN_FLAG_CLEAN) != 0;
+	flags->topicIdType = byte & 0x03;
+}
+
+
+/* Writes the length field and message type of a packet with length bytes of fields */
+static unsigned char* writeHeader(unsigned char* buf, int length, unsigned char type)
+{
+	unsigned char* ptr = buf;
+
+	ptr += MQTTSNPacket_encode(ptr, MQTTSNPacket_len(length));
+	writeChar(&ptr, type);
+	return ptr;
+}
+
+
+/* Checks the type of the packet in buf; returns a pointer to its first field, or NULL */
+static unsigned char* readHeader(unsigned char* buf, int buflen, unsigned char type, unsigned char** enddata)
+{
+	int len = 0;
+	int lenlen = MQTTSNPacket_decode(buf, buflen, &len);
+
+	if (lenlen == 0 || len > buflen || len < lenlen + 1 || buf[lenlen] != type)
+		return NULL;
+	*enddata = buf + len;
+	return buf + lenlen + 1;
+}
+
+
+/**
+  * Serializes the connect options into the buffer.
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param options the options to be used to build the connect packet
+  * @return serialized length, or error if 0
+  */
+int MQTTSNSerialize_connect(unsigned char* buf, int buflen, MQTTSNPacket_connectData* options)
+{
+	unsigned char *ptr = buf;
+	MQTTSNFlags flags = {0};
+	int idlen = MQTTstrlen(options->clientID);
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (MQTTSNPacket_len(4 + idlen) > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+	ptr = writeHeader(buf, 4 + idlen, MQTTSN_CONNECT);
+
+	flags.will = options->willFlag;
+	flags.cleanSession = options->cleansession;
+	writeChar(&ptr, MQTTSNFlags_encode(&flags));
+	writeChar(&ptr, MQTTSN_PROTOCOL_ID);
+	writeInt(&ptr, options->duration);
+	memcpy(ptr, options->clientID.cstring ? options->clientID.cstring : options->clientID.lenstring.data, idlen);
+	ptr += idlen;
+
+	rc = ptr - buf;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into connect data structure
+  * @param data the connect data structure to be filled out; the client id points into buf
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param len the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTSNDeserialize_connect(MQTTSNPacket_connectData* data, unsigned char* buf, int len)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, len, MQTTSN_CONNECT, &enddata);
+	MQTTSNFlags flags;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (curdata == NULL || enddata - curdata < 4)
+		goto exit;
+	MQTTSNFlags_decode(readChar(&curdata), &flags);
+	if (readChar(&curdata) != MQTTSN_PROTOCOL_ID)
+		goto exit;
+	data->willFlag = flags.will;
+	data->cleansession = flags.cleanSession;
+	data->duration = readInt(&curdata);
+	data->clientID.cstring = NULL;
+	data->clientID.lenstring.data = (char*)curdata;
+	data->clientID.lenstring.len = enddata - curdata;
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Serializes the connack packet into the supplied buffer.
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param connack_rc the integer connack return code to be used
+  * @return serialized length, or error if 0
+  */
+int MQTTSNSerialize_connack(unsigned char* buf, int buflen, int connack_rc)
+{
+	unsigned char *ptr = buf;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (buflen < 3)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+	ptr = writeHeader(buf, 1, MQTTSN_CONNACK);
+	writeChar(&ptr, connack_rc);
+	rc = ptr - buf;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into connack data - return code
+  * @param connack_rc returned integer value of the connack return code
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTSNDeserialize_connack(int* connack_rc, unsigned char* buf, int buflen)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, buflen, MQTTSN_CONNACK, &enddata);
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (curdata == NULL || enddata - curdata < 1)
+		goto exit;
+	*connack_rc = readChar(&curdata);
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Serializes a register packet, which binds a topic name to a topic id
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param topicid the topic id, 0 when sent by a client
+  * @param packetid integer - the MQTT-SN message id
+  * @param topicname the topic name to register
+  * @return serialized length, or error if 0
+  */
+int MQTTSNSerialize_register(unsigned char* buf, int buflen, unsigned short topicid, unsigned short packetid,
+		MQTTString* topicname)
+{
+	unsigned char *ptr = buf;
+	int namelen = MQTTstrlen(*topicname);
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (MQTTSNPacket_len(4 + namelen) > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+	ptr = writeHeader(buf, 4 + namelen, MQTTSN_REGISTER);
+	writeInt(&ptr, topicid);
+	writeInt(&ptr, packetid);
+	memcpy(ptr, topicname->cstring ? topicname->cstring : topicname->lenstring.data, namelen);
+	ptr += namelen;
+	rc = ptr - buf;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Deserializes a register packet
+  * @param topicid returned topic id
+  * @param packetid returned MQTT-SN message id
+  * @param topicname returned topic name, pointing into buf
+  * @param buf the raw buffer data
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTSNDeserialize_register(unsigned short* topicid, unsigned short* packetid, MQTTString* topicname,
+		unsigned char* buf, int buflen)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, buflen, MQTTSN_REGISTER, &enddata);
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (curdata == NULL || enddata - curdata < 4)
+		goto exit;
+	*topicid = readInt(&curdata);
+	*packetid = readInt(&curdata);
+	topicname->cstring = NULL;
+	topicname->lenstring.data = (char*)curdata;
+	topicname->lenstring.len = enddata - curdata;
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/* REGACK and PUBACK share a layout: topic id, message id, return code */
+static int serializeTopicAck(unsigned char* buf, int buflen, unsigned char type, unsigned short topicid,
+		unsigned short packetid, unsigned char return_code)
+{
+	unsigned char *ptr = buf;
+
+	if (buflen < 7)
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	ptr = writeHeader(buf, 5, type);
+	writeInt(&ptr, topicid);
+	writeInt(&ptr, packetid);
+	writeChar(&ptr, return_code);
+	return ptr - buf;
+}
+
+
+static int deserializeTopicAck(unsigned char type, unsigned short* topicid, unsigned short* packetid,
+		unsigned char* return_code, unsigned char* buf, int buflen)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, buflen, type, &enddata);
+
+	if (curdata == NULL || enddata - curdata < 5)
+		return 0;
+	*topicid = readInt(&curdata);
+	*packetid = readInt(&curdata);
+	*return_code = readChar(&curdata);
+	return 1;
+}
+
+
+int MQTTSNSerialize_regack(unsigned char* buf, int buflen, unsigned short topicid, unsigned short packetid,
+		unsigned char return_code)
+{
+	return serializeTopicAck(buf, buflen, MQTTSN_REGACK, topicid, packetid, return_code);
+}
+
+
+int MQTTSNDeserialize_regack(unsigned short* topicid, unsigned short* packetid, unsigned char* return_code,
+		unsigned char* buf, int buflen)
+{
+	return deserializeTopicAck(MQTTSN_REGACK, topicid, packetid, return_code, buf, buflen);
+}
+
+
+int MQTTSNSerialize_puback(unsigned char* buf, int buflen, unsigned short topicid, unsigned short packetid,
+		unsigned char return_code)
+{
+	return serializeTopicAck(buf, buflen, MQTTSN_PUBACK, topicid, packetid, return_code);
+}
+
+
+int MQTTSNDeserialize_puback(unsigned short* topicid, unsigned short* packetid, unsigned char* return_code,
+		unsigned char* buf, int buflen)
+{
+	return deserializeTopicAck(MQTTSN_PUBACK, topicid, packetid, return_code, buf, buflen);
+}
+
+
+/* The 2 byte topic field of PUBLISH: an id, or the two characters of a short name */
+static void writeTopic(unsigned char** pptr, MQTTSN_topicid* topic)
+{
+	if (topic->type == MQTTSN_TOPIC_TYPE_SHORT)
+	{
+		writeChar(pptr, topic->data.short_name[0]);
+		writeChar(pptr, topic->data.short_name[1]);
+	}
+	else
+		writeInt(pptr, topic->data.id);
+}
+
+
+static void readTopic(unsigned char** pptr, int type, MQTTSN_topicid* topic)
+{
+	topic->type = type;
+	if (type == MQTTSN_TOPIC_TYPE_SHORT)
+	{
+		topic->data.short_name[0] = readChar(pptr);
+		topic->data.short_name[1] = readChar(pptr);
+	}
+	else
+		topic->data.id = readInt(pptr);
+}
+
+
+/**
+  * Serializes the supplied publish data into the supplied buffer, ready for sending
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param dup integer - the MQTT-SN dup flag
+  * @param qos integer - the MQTT-SN QoS value, -1 to 2
+  * @param retained integer - the MQTT-SN retained flag
+  * @param packetid integer - the MQTT-SN message id, 0 for QoS 0 and -1
+  * @param topic the topic id or short name
+  * @param payload byte buffer - the MQTT-SN publish payload
+  * @param payloadlen integer - the length of the MQTT-SN payload
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+int MQTTSNSerialize_publish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained,
+		unsigned short packetid, MQTTSN_topicid topic, unsigned char* payload, int payloadlen)
+{
+	unsigned char *ptr = buf;
+	MQTTSNFlags flags = {0};
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (MQTTSNPacket_len(5 + payloadlen) > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+	ptr = writeHeader(buf, 5 + payloadlen, MQTTSN_PUBLISH);
+
+	flags.dup = dup;
+	flags.qos = qos;
+	flags.retain = retained;
+	flags.topicIdType = topic.type;
+	writeChar(&ptr, MQTTSNFlags_encode(&flags));
+	writeTopic(&ptr, &topic);
+	writeInt(&ptr, packetid);
+	memcpy(ptr, payload, payloadlen);
+	ptr += payloadlen;
+
+	rc = ptr - buf;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into publish data
+  * @param dup returned integer - the MQTT-SN dup flag
+  * @param qos returned integer - the MQTT-SN QoS value, -1 to 2
+  * @param retained returned integer - the MQTT-SN retained flag
+  * @param packetid returned integer - the MQTT-SN message id
+  * @param topic returned topic id or short name
+  * @param payload returned byte buffer - the MQTT-SN publish payload, pointing into buf
+  * @param payloadlen returned integer - the length of the MQTT-SN payload
+  * @param buf the raw buffer data
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success
+  */
+int MQTTSNDeserialize_publish(unsigned char* dup, int* qos, unsigned char* retained, unsigned short* packetid,
+		MQTTSN_topicid* topic, unsigned char** payload, int* payloadlen, unsigned char* buf, int buflen)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, buflen, MQTTSN_PUBLISH, &enddata);
+	MQTTSNFlags flags;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (curdata == NULL || enddata - curdata < 5)
+		goto exit;
+	MQTTSNFlags_decode(readChar(&curdata), &flags);
+	*dup = flags.dup;
+	*qos = flags.qos;
+	*retained = flags.retain;
+	readTopic(&curdata, flags.topicIdType, topic);
+	*packetid = readInt(&curdata);
+	*payload = curdata;
+	*payloadlen = enddata - curdata;
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Serializes a subscribe packet for one topic filter: a name, a predefined id or a short name
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param dup integer - the MQTT-SN dup flag
+  * @param qos integer - the requested QoS
+  * @param packetid integer - the MQTT-SN message id
+  * @param topicFilter the topic filter
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+int MQTTSNSerialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned short packetid,
+		MQTTSN_topicid* topicFilter)
+{
+	unsigned char *ptr = buf;
+	MQTTSNFlags flags = {0};
+	int topiclen = (topicFilter->type == MQTTSN_TOPIC_TYPE_NORMAL) ? topicFilter->data.long_.len : 2;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (MQTTSNPacket_len(3 + topiclen) > buflen)
+	{
+		rc = MQTTPACKET_BUFFER_TOO_SHORT;
+		goto exit;
+	}
+	ptr = writeHeader(buf, 3 + topiclen, MQTTSN_SUBSCRIBE);
+
+	flags.dup = dup;
+	flags.qos = qos;
+	flags.topicIdType = topicFilter->type;
+	writeChar(&ptr, MQTTSNFlags_encode(&flags));
+	writeInt(&ptr, packetid);
+	if (topicFilter->type == MQTTSN_TOPIC_TYPE_NORMAL)
+	{
+		memcpy(ptr, topicFilter->data.long_.name, topiclen);
+		ptr += topiclen;
+	}
+	else
+		writeTopic(&ptr, topicFilter);
+
+	rc = ptr - buf;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+  * Deserializes a subscribe packet
+  * @param dup returned integer - the MQTT-SN dup flag
+  * @param qos returned integer - the requested QoS
+  * @param packetid returned integer - the MQTT-SN message id
+  * @param topicFilter returned topic filter; a name points into buf
+  * @param buf the raw buffer data
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success
+  */
+int MQTTSNDeserialize_subscribe(unsigned char* dup, int* qos, unsigned short* packetid,
+		MQTTSN_topicid* topicFilter, unsigned char* buf, int buflen)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, buflen, MQTTSN_SUBSCRIBE, &enddata);
+	MQTTSNFlags flags;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (curdata == NULL || enddata - curdata < 3)
+		goto exit;
+	MQTTSNFlags_decode(readChar(&curdata), &flags);
+	*dup = flags.dup;
+	*qos = flags.qos;
+	*packetid = readInt(&curdata);
+	if (flags.topicIdType == MQTTSN_TOPIC_TYPE_NORMAL)
+	{
+		topicFilter->type = MQTTSN_TOPIC_TYPE_NORMAL;
+		topicFilter->data.long_.name = (char*)curdata;
+		topicFilter->data.long_.len = enddata - curdata;
+	}
+	else if (enddata - curdata == 2)
+		readTopic(&curdata, flags.topicIdType, topicFilter);
+	else
+		goto exit;
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int MQTTSNSerialize_suback(unsigned char* buf, int buflen, int qos, unsigned short topicid, unsigned short packetid,
+		unsigned char return_code)
+{
+	unsigned char *ptr = buf;
+	MQTTSNFlags flags = {0};
+
+	if (buflen < 8)
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	ptr = writeHeader(buf, 6, MQTTSN_SUBACK);
+	flags.qos = qos;
+	writeChar(&ptr, MQTTSNFlags_encode(&flags));
+	writeInt(&ptr, topicid);
+	writeInt(&ptr, packetid);
+	writeChar(&ptr, return_code);
+	return ptr - buf;
+}
+
+
+int MQTTSNDeserialize_suback(int* qos, unsigned short* topicid, unsigned short* packetid,
+		unsigned char* return_code, unsigned char* buf, int buflen)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, buflen, MQTTSN_SUBACK, &enddata);
+	MQTTSNFlags flags;
+
+	if (curdata == NULL || enddata - curdata < 6)
+		return 0;
+	MQTTSNFlags_decode(readChar(&curdata), &flags);
+	*qos = flags.qos;
+	*topicid = readInt(&curdata);
+	*packetid = readInt(&curdata);
+	*return_code = readChar(&curdata);
+	return 1;
+}
+
+
+/**
+  * Serializes a pingreq packet.  A sleeping client names itself, so that the gateway
+  * sends the messages it buffered before the pingresp.
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param clientid the client id, or an empty string for an active client
+  * @return serialized length, or error if 0
+  */
+int MQTTSNSerialize_pingreq(unsigned char* buf, int buflen, MQTTString clientid)
+{
+	unsigned char *ptr = buf;
+	int idlen = MQTTstrlen(clientid);
+
+	if (MQTTSNPacket_len(idlen) > buflen)
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	ptr = writeHeader(buf, idlen, MQTTSN_PINGREQ);
+	memcpy(ptr, clientid.cstring ? clientid.cstring : clientid.lenstring.data, idlen);
+	ptr += idlen;
+	return ptr - buf;
+}
+
+
+int MQTTSNDeserialize_pingreq(MQTTString* clientID, unsigned char* buf, int len)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, len, MQTTSN_PINGREQ, &enddata);
+
+	if (curdata == NULL)
+		return 0;
+	clientID->cstring = NULL;
+	clientID->lenstring.data = (char*)curdata;
+	clientID->lenstring.len = enddata - curdata;
+	return 1;
+}
+
+
+int MQTTSNSerialize_pingresp(unsigned char* buf, int buflen)
+{
+	if (buflen < 2)
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	return writeHeader(buf, 0, MQTTSN_PINGRESP) - buf;
+}
+
+
+/**
+  * Serializes a disconnect packet
+  * @param buf the buffer into which the packet will be serialized
+  * @param buflen the length in bytes of the supplied buffer
+  * @param duration the sleep duration in seconds, or -1 for a plain disconnect
+  * @return serialized length, or error if 0
+  */
+int MQTTSNSerialize_disconnect(unsigned char* buf, int buflen, int duration)
+{
+	unsigned char *ptr = buf;
+	int len = (duration >= 0) ? 2 : 0;
+
+	if (MQTTSNPacket_len(len) > buflen)
+		return MQTTPACKET_BUFFER_TOO_SHORT;
+	ptr = writeHeader(buf, len, MQTTSN_DISCONNECT);
+	if (duration >= 0)
+		writeInt(&ptr, duration);
+	return ptr - buf;
+}
+
+
+/**
+  * Deserializes a disconnect packet
+  * @param duration returned sleep duration in seconds, or -1 if none was given
+  * @param buf the raw buffer data
+  * @param buflen the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success
+  */
+int MQTTSNDeserialize_disconnect(int* duration, unsigned char* buf, int buflen)
+{
+	unsigned char* enddata = NULL;
+	unsigned char* curdata = readHeader(buf, buflen, MQTTSN_DISCONNECT, &enddata);
+
+	if (curdata == NULL)
+		return 0;
+	*duration = (enddata - curdata >= 2) ? readInt(&curdata) : -1;
+	return 1;
+}
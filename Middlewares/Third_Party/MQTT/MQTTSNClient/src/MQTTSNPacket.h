@@ -0,0 +1,138 @@
+/*******************************************************************************
+ * MQTT-SN 1.2 packet serialization.
+ *
+ * The subset used by a sensor node and by the Linux gateway stand-in: connect,
+ * topic registration, publish at QoS -1, 0 and 1, subscribe, ping (with the
+ * client id, to poll for messages buffered while asleep) and disconnect (with
+ * a sleep duration).  Same conventions as MQTTPacket: serializers return the
+ * packet length, deserializers 1, and <= 0 is an error.  A packet is one
+ * datagram, so there is no stream framing to undo.
+ *******************************************************************************/
+
+#ifndef MQTTSNPACKET_H_
+#define MQTTSNPACKET_H_
+
+#if defined(__cplusplus) /* If this is a C++ compiler, use C linkage */
+extern "C" {
+#endif
+
+#include "MQTTPacket.h"
+
+enum MQTTSN_msgTypes
+{
+	MQTTSN_ADVERTISE = 0x00, MQTTSN_SEARCHGW, MQTTSN_GWINFO,
+	MQTTSN_CONNECT = 0x04, MQTTSN_CONNACK, MQTTSN_WILLTOPICREQ, MQTTSN_WILLTOPIC,
+	MQTTSN_WILLMSGREQ, MQTTSN_WILLMSG, MQTTSN_REGISTER, MQTTSN_REGACK,
+	MQTTSN_PUBLISH, MQTTSN_PUBACK, MQTTSN_PUBCOMP, MQTTSN_PUBREC, MQTTSN_PUBREL,
+	MQTTSN_SUBSCRIBE = 0x12, MQTTSN_SUBACK, MQTTSN_UNSUBSCRIBE, MQTTSN_UNSUBACK,
+	MQTTSN_PINGREQ, MQTTSN_PINGRESP, MQTTSN_DISCONNECT
+};
+
+enum MQTTSN_returnCodes
+{
+	MQTTSN_RC_ACCEPTED, MQTTSN_RC_REJECTED_CONGESTED,
+	MQTTSN_RC_REJECTED_INVALID_TOPIC_ID, MQTTSN_RC_REJECTED_NOT_SUPPORTED
+};
+
+enum MQTTSN_topicTypes
+{
+	MQTTSN_TOPIC_TYPE_NORMAL,		/**< topic id registered with REGISTER or SUBACK */
+	MQTTSN_TOPIC_TYPE_PREDEFINED,	/**< topic id configured in both client and gateway */
+	MQTTSN_TOPIC_TYPE_SHORT			/**< two character topic name sent in place of an id */
+};
+
+#define MQTTSN_PROTOCOL_ID 0x01
+
+/**
+ * A topic as carried in PUBLISH and SUBSCRIBE: an id, or a name where the
+ * packet allows one (the short name in PUBLISH, a full name in SUBSCRIBE).
+ */
+typedef struct
+{
+	int type;	/**< MQTTSN_TOPIC_TYPE_* */
+	union
+	{
+		unsigned short id;
+		char short_name[2];
+		struct
+		{
+			char* name;
+			int len;
+		} long_;	/**< only in SUBSCRIBE, with type MQTTSN_TOPIC_TYPE_NORMAL */
+	} data;
+} MQTTSN_topicid;
+
+/**
+ * The flags byte of CONNECT, PUBLISH, SUBSCRIBE and SUBACK.
+ */
+typedef struct
+{
+	unsigned char dup;
+	int qos;					/**< -1, 0, 1 or 2 */
+	unsigned char retain;
+	unsigned char will;
+	unsigned char cleanSession;
+	int topicIdType;			/**< MQTTSN_TOPIC_TYPE_* */
+} MQTTSNFlags;
+
+typedef struct
+{
+	MQTTString clientID;
+	unsigned short duration;	/**< keepalive, in seconds */
+	unsigned char cleansession;
+	unsigned char willFlag;
+} MQTTSNPacket_connectData;
+
+#define MQTTSNPacket_connectData_initializer { MQTTString_initializer, 60, 1, 0 }
+
+DLLExport int MQTTSNPacket_encode(unsigned char* buf, int length);
+DLLExport int MQTTSNPacket_decode(unsigned char* buf, int buflen, int* value);
+DLLExport int MQTTSNPacket_len(int length);
+DLLExport int MQTTSNPacket_type(unsigned char* buf, int buflen);
+
+DLLExport unsigned char MQTTSNFlags_encode(const MQTTSNFlags* flags);
+DLLExport void MQTTSNFlags_decode(unsigned char byte, MQTTSNFlags* flags);
+
+DLLExport int MQTTSNSerialize_connect(unsigned char* buf, int buflen, MQTTSNPacket_connectData* options);
+DLLExport int MQTTSNDeserialize_connect(MQTTSNPacket_connectData* data, unsigned char* buf, int len);
+DLLExport int MQTTSNSerialize_connack(unsigned char* buf, int buflen, int connack_rc);
+DLLExport int MQTTSNDeserialize_connack(int* connack_rc, unsigned char* buf, int buflen);
+
+DLLExport int MQTTSNSerialize_register(unsigned char* buf, int buflen, unsigned short topicid, unsigned short packetid,
+		MQTTString* topicname);
+DLLExport int MQTTSNDeserialize_register(unsigned short* topicid, unsigned short* packetid, MQTTString* topicname,
+		unsigned char* buf, int buflen);
+DLLExport int MQTTSNSerialize_regack(unsigned char* buf, int buflen, unsigned short topicid, unsigned short packetid,
+		unsigned char return_code);
+DLLExport int MQTTSNDeserialize_regack(unsigned short* topicid, unsigned short* packetid, unsigned char* return_code,
+		unsigned char* buf, int buflen);
+
+DLLExport int MQTTSNSerialize_publish(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned char retained,
+		unsigned short packetid, MQTTSN_topicid topic, unsigned char* payload, int payloadlen);
+DLLExport int MQTTSNDeserialize_publish(unsigned char* dup, int* qos, unsigned char* retained, unsigned short* packetid,
+		MQTTSN_topicid* topic, unsigned char** payload, int* payloadlen, unsigned char* buf, int buflen);
+DLLExport int MQTTSNSerialize_puback(unsigned char* buf, int buflen, unsigned short topicid, unsigned short packetid,
+		unsigned char return_code);
+DLLExport int MQTTSNDeserialize_puback(unsigned short* topicid, unsigned short* packetid, unsigned char* return_code,
+		unsigned char* buf, int buflen);
+
+DLLExport int MQTTSNSerialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, int qos, unsigned short packetid,
+		MQTTSN_topicid* topicFilter);
+DLLExport int MQTTSNDeserialize_subscribe(unsigned char* dup, int* qos, unsigned short* packetid,
+		MQTTSN_topicid* topicFilter, unsigned char* buf, int buflen);
+DLLExport int MQTTSNSerialize_suback(unsigned char* buf, int buflen, int qos, unsigned short topicid, unsigned short packetid,
+		unsigned char return_code);
+DLLExport int MQTTSNDeserialize_suback(int* qos, unsigned short* topicid, unsigned short* packetid,
+		unsigned char* return_code, unsigned char* buf, int buflen);
+
+DLLExport int MQTTSNSerialize_pingreq(unsigned char* buf, int buflen, MQTTString clientid);
+DLLExport int MQTTSNDeserialize_pingreq(MQTTString* clientID, unsigned char* buf, int len);
+DLLExport int MQTTSNSerialize_pingresp(unsigned char* buf, int buflen);
+DLLExport int MQTTSNSerialize_disconnect(unsigned char* buf, int buflen, int duration);
+DLLExport int MQTTSNDeserialize_disconnect(int* duration, unsigned char* buf, int buflen);
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+}
+#endif
+
+#endif /* MQTTSNPACKET_H_ */
@@ -0,0 +1,79 @@
+/*******************************************************************************
+ * Linux port of the MQTT-SN client, see MQTTSNLinux.h.
+ *******************************************************************************/
+
+#include "MQTTSNLinux.h"
+
+
+/*
+ * Reads one datagram: its length, 0 if none arrived within timeout_ms, or -1.
+ * A datagram longer than len is truncated, and then fails to parse.
+ */
+int linux_udp_read(MQTTSNNetwork* n, unsigned char* buffer, int len, int timeout_ms)
+{
+	struct pollfd pfd = {n->my_socket, POLLIN, 0};
+	int rc;
+
+	while ((rc = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR)
+		;
+	if (rc <= 0)
+		return rc;
+	rc = recv(n->my_socket, buffer, len, MSG_DONTWAIT);
+	if (rc >= 0)
+		return rc;
+	/* ECONNREFUSED: an earlier datagram met a closed port, the gateway may yet start */
+	return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNREFUSED) ? 0 : -1;
+}
+
+
+int linux_udp_write(MQTTSNNetwork* n, unsigned char* buffer, int len, int timeout_ms)
+{
+	int rc = send(n->my_socket, buffer, len, MSG_NOSIGNAL);
+
+	if (rc < 0 && errno == ECONNREFUSED) /* reported for an earlier datagram; this one is lost like any other */
+		return len;
+	return rc;
+}
+
+
+void MQTTSNNetworkInit(MQTTSNNetwork* n)
+{
+	n->my_socket = -1;
+	n->mqttsnread = linux_udp_read;
+	n->mqttsnwrite = linux_udp_write;
+}
+
+
+/* Binds the socket to the gateway's address, so that only its datagrams are received */
+int MQTTSNNetworkConnect(MQTTSNNetwork* n, char* addr, int port)
+{
+	struct addrinfo hints = {0, AF_UNSPEC, SOCK_DGRAM, IPPROTO_UDP, 0, NULL, NULL, NULL};
+	struct addrinfo *result = NULL, *res;
+	char service[8];
+	int rc = -1;
+
+	snprintf(service, sizeof(service), "%d", port);
+	if (getaddrinfo(addr, service, &hints, &result) != 0)
+		return -1;
+	for (res = result; res != NULL && rc != 0; res = res->ai_next)
+	{
+		n->my_socket = socket(res->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+		if (n->my_socket == -1)
+			continue;
+		if ((rc = connect(n->my_socket, res->ai_addr, res->ai_addrlen)) != 0)
+		{
+			close(n->my_socket);
+			n->my_socket = -1;
+		}
+	}
+	freeaddrinfo(result);
+	return rc;
+}
+
+
+void MQTTSNNetworkDisconnect(MQTTSNNetwork* n)
+{
+	if (n->my_socket != -1)
+		close(n->my_socket);
+	n->my_socket = -1;
+}
@@ -0,0 +1,25 @@
+/*******************************************************************************
+ * Linux port of the MQTT-SN client: a connected UDP socket, and the Timer of
+ * the MQTTClient Linux port.
+ *******************************************************************************/
+
+#if !defined(__MQTTSN_LINUX_)
+#define __MQTTSN_LINUX_
+
+#include "MQTTLinux.h"
+
+typedef struct MQTTSNNetwork
+{
+	int my_socket;
+	int (*mqttsnread) (struct MQTTSNNetwork*, unsigned char*, int, int);
+	int (*mqttsnwrite) (struct MQTTSNNetwork*, unsigned char*, int, int);
+} MQTTSNNetwork;
+
+int linux_udp_read(MQTTSNNetwork*, unsigned char*, int, int);
+int linux_udp_write(MQTTSNNetwork*, unsigned char*, int, int);
+
+DLLExport void MQTTSNNetworkInit(MQTTSNNetwork*);
+DLLExport int MQTTSNNetworkConnect(MQTTSNNetwork*, char*, int);
+DLLExport void MQTTSNNetworkDisconnect(MQTTSNNetwork*);
+
+#endif
@@ -0,0 +1,326 @@
+/*******************************************************************************
+ * MQTT-SN packet serialization tests, in the layout of MQTTPacket/test/test1.c.
+ *******************************************************************************/
+
+
+#include "MQTTSNPacket.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+struct Options
+{
+	int verbose;
+	int test_no;
+} options =
+{
+	0,
+	0,
+};
+
+void getopts(int argc, char** argv)
+{
+	int count = 1;
+
+	while (count < argc)
+	{
+		if (strcmp(argv[count], "--test_no") == 0)
+		{
+			if (++count < argc)
+				options.test_no = atoi(argv[count]);
+		}
+		else if (strcmp(argv[count], "--verbose") == 0)
+		{
+			options.verbose = 1;
+			printf("\nSetting verbose on\n");
+		}
+		count++;
+	}
+}
+
+
+#define LOGA_DEBUG 0
+#define LOGA_INFO 1
+void MyLog(int LOGA_level, char* format, ...)
+{
+	static char msg_buf[256];
+	va_list args;
+	struct timeval now;
+	struct tm *timeinfo;
+
+	if (LOGA_level == LOGA_DEBUG && options.verbose == 0)
+	  return;
+
+	gettimeofday(&now, NULL);
+	timeinfo = localtime(&now.tv_sec);
+	strftime(msg_buf, 80, "%Y%m%d %H%M%S", timeinfo);
+
+	sprintf(&msg_buf[strlen(msg_buf)], ".%.3ld ", (long)now.tv_usec / 1000);
+
+	va_start(args, format);
+	vsnprintf(&msg_buf[strlen(msg_buf)], sizeof(msg_buf) - strlen(msg_buf), format, args);
+	va_end(args);
+
+	printf("%s\n", msg_buf);
+	fflush(stdout);
+}
+
+
+struct timeval start_clock(void)
+{
+	struct timeval start_time;
+	gettimeofday(&start_time, NULL);
+	return start_time;
+}
+
+
+long elapsed(struct timeval start_time)
+{
+	struct timeval now, res;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &start_time, &res);
+	return (res.tv_sec)*1000 + (res.tv_usec)/1000;
+}
+
+
+#define assert(a, b, c, d) myassert(__FILE__, __LINE__, a, b, c, d)
+
+int tests = 0;
+int failures = 0;
+FILE* xml;
+struct timeval global_start_time;
+char output[3000];
+char* cur_output = output;
+
+
+void write_test_result()
+{
+	long duration = elapsed(global_start_time);
+
+	fprintf(xml, " time=\"%ld.%.3ld\" >\n", duration / 1000, duration % 1000);
+	if (cur_output != output)
+	{
+		fprintf(xml, "%s", output);
+		cur_output = output;
+	}
+	fprintf(xml, "</testcase>\n");
+}
+
+
+void myassert(char* filename, int lineno, char* description, int value, char* format, ...)
+{
+	++tests;
+	if (!value)
+	{
+		va_list args;
+
+		++failures;
+		printf("Assertion failed, file %s, line %d, description: %s\n", filename, lineno, description);
+
+		va_start(args, format);
+		vprintf(format, args);
+		va_end(args);
+
+		cur_output += sprintf(cur_output, "<failure type=\"%s\">file %s, line %d </failure>\n",
+                        description, filename, lineno);
+	}
+    else
+    	MyLog(LOGA_DEBUG, "Assertion succeeded, file %s, line %d, description: %s", filename, lineno, description);
+}
+
+
+int test1(struct Options options)
+{
+	MQTTSNPacket_connectData data = MQTTSNPacket_connectData_initializer;
+	MQTTSNPacket_connectData data_after = MQTTSNPacket_connectData_initializer;
+	unsigned char buf[100];
+	int connack_rc = 0;
+	int rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test1\" name=\"connect\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - serialization of connect and connack");
+
+	data.clientID.cstring = "sensor-1";
+	data.duration = 300;
+	rc = MQTTSNSerialize_connect(buf, sizeof(buf), &data);
+	assert("good rc from serialize connect", rc == 6 + 8, "rc was %d\n", rc);
+	assert("packet type is CONNECT", MQTTSNPacket_type(buf, rc) == MQTTSN_CONNECT, "type was %d\n", buf[1]);
+
+	rc = MQTTSNDeserialize_connect(&data_after, buf, rc);
+	assert("good rc from deserialize connect", rc == 1, "rc was %d\n", rc);
+	assert("durations should be the same", data_after.duration == 300, "duration was %d\n", data_after.duration);
+	assert("cleansessions should be the same", data_after.cleansession == 1, "cleansession was %d\n", data_after.cleansession);
+	assert("ClientIDs should be the same", data_after.clientID.lenstring.len == 8 &&
+			memcmp(data_after.clientID.lenstring.data, "sensor-1", 8) == 0, "length was %d\n", data_after.clientID.lenstring.len);
+
+	rc = MQTTSNSerialize_connect(buf, 13, &data);
+	assert("short buffer refused", rc == MQTTPACKET_BUFFER_TOO_SHORT, "rc was %d\n", rc);
+
+	rc = MQTTSNSerialize_connack(buf, sizeof(buf), MQTTSN_RC_REJECTED_CONGESTED);
+	assert("good rc from serialize connack", rc == 3, "rc was %d\n", rc);
+	rc = MQTTSNDeserialize_connack(&connack_rc, buf, rc);
+	assert("good rc from deserialize connack", rc == 1, "rc was %d\n", rc);
+	assert("connack rcs should be the same", connack_rc == MQTTSN_RC_REJECTED_CONGESTED, "connack_rc was %d\n", connack_rc);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	unsigned char buf[400];
+	unsigned char payload[300];
+	unsigned char *payload_after = NULL;
+	MQTTString name = MQTTString_initializer;
+	MQTTString name_after = MQTTString_initializer;
+	MQTTSN_topicid topic, topic_after;
+	unsigned short topicid = 0, packetid = 0;
+	unsigned char dup = 0, retained = 0, return_code = 0;
+	int qos = 0, payloadlen = 0;
+	int rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test1\" name=\"register and publish\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - serialization of register, publish and their acks");
+
+	name.cstring = "sensors/1/temp";
+	rc = MQTTSNSerialize_register(buf, sizeof(buf), 0, 7, &name);
+	assert("good rc from serialize register", rc == 6 + 14, "rc was %d\n", rc);
+	rc = MQTTSNDeserialize_register(&topicid, &packetid, &name_after, buf, rc);
+	assert("good rc from deserialize register", rc == 1, "rc was %d\n", rc);
+	assert("packetids should be the same", packetid == 7, "packetid was %d\n", packetid);
+	assert("topic names should be the same", name_after.lenstring.len == 14 &&
+			memcmp(name_after.lenstring.data, "sensors/1/temp", 14) == 0, "length was %d\n", name_after.lenstring.len);
+
+	rc = MQTTSNSerialize_regack(buf, sizeof(buf), 0x1234, 7, MQTTSN_RC_ACCEPTED);
+	assert("good rc from serialize regack", rc == 7, "rc was %d\n", rc);
+	rc = MQTTSNDeserialize_regack(&topicid, &packetid, &return_code, buf, rc);
+	assert("topic ids should be the same", rc == 1 && topicid == 0x1234, "topicid was %d\n", topicid);
+
+	memset(payload, 'x', sizeof(payload));
+	topic.type = MQTTSN_TOPIC_TYPE_SHORT;
+	memcpy(topic.data.short_name, "tp", 2);
+	rc = MQTTSNSerialize_publish(buf, sizeof(buf), 0, -1, 1, 0, topic, payload, 4);
+	assert("good rc from serialize short publish", rc == 7 + 4, "rc was %d\n", rc);
+	assert("QoS -1 and short topic in the flags", buf[2] == (0x60 | 0x10 | MQTTSN_TOPIC_TYPE_SHORT), "flags were %x\n", buf[2]);
+	rc = MQTTSNDeserialize_publish(&dup, &qos, &retained, &packetid, &topic_after, &payload_after, &payloadlen, buf, rc);
+	assert("good rc from deserialize publish", rc == 1, "rc was %d\n", rc);
+	assert("qos should be -1", qos == -1, "qos was %d\n", qos);
+	assert("short names should be the same", topic_after.type == MQTTSN_TOPIC_TYPE_SHORT &&
+			memcmp(topic_after.data.short_name, "tp", 2) == 0, "type was %d\n", topic_after.type);
+
+	topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+	topic.data.id = 0x1234;
+	rc = MQTTSNSerialize_publish(buf, sizeof(buf), 1, 1, 0, 99, topic, payload, sizeof(payload));
+	assert("long publish has the 3 byte length", rc == 9 + (int)sizeof(payload) && buf[0] == 0x01, "rc was %d\n", rc);
+	assert("packet type after the 3 byte length", MQTTSNPacket_type(buf, rc) == MQTTSN_PUBLISH, "type was %d\n", buf[3]);
+	assert("truncated datagram refused", MQTTSNPacket_type(buf, rc - 1) == MQTTPACKET_READ_ERROR, "rc was %d\n", rc);
+	rc = MQTTSNDeserialize_publish(&dup, &qos, &retained, &packetid, &topic_after, &payload_after, &payloadlen, buf, rc);
+	assert("good rc from deserialize long publish", rc == 1, "rc was %d\n", rc);
+	assert("dup, qos and packetid should be the same", dup == 1 && qos == 1 && packetid == 99, "packetid was %d\n", packetid);
+	assert("payloads should be the same", payloadlen == sizeof(payload) &&
+			memcmp(payload_after, payload, payloadlen) == 0, "payloadlen was %d\n", payloadlen);
+
+	rc = MQTTSNSerialize_puback(buf, sizeof(buf), 0x1234, 99, MQTTSN_RC_REJECTED_INVALID_TOPIC_ID);
+	rc = MQTTSNDeserialize_puback(&topicid, &packetid, &return_code, buf, rc);
+	assert("good rc from deserialize puback", rc == 1 && packetid == 99, "packetid was %d\n", packetid);
+	assert("return codes should be the same", return_code == MQTTSN_RC_REJECTED_INVALID_TOPIC_ID, "return_code was %d\n", return_code);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test3(struct Options options)
+{
+	unsigned char buf[100];
+	MQTTSN_topicid filter, filter_after;
+	MQTTString clientid = MQTTString_initializer;
+	MQTTString clientid_after = MQTTString_initializer;
+	unsigned short topicid = 0, packetid = 0;
+	unsigned char dup = 0, return_code = 0;
+	int qos = 0, duration = 0;
+	int rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test1\" name=\"subscribe, ping and sleep\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 3 - serialization of subscribe, pingreq and disconnect");
+
+	filter.type = MQTTSN_TOPIC_TYPE_NORMAL;
+	filter.data.long_.name = "cmd/+";
+	filter.data.long_.len = 5;
+	rc = MQTTSNSerialize_subscribe(buf, sizeof(buf), 0, 1, 12, &filter);
+	assert("good rc from serialize subscribe", rc == 5 + 5, "rc was %d\n", rc);
+	rc = MQTTSNDeserialize_subscribe(&dup, &qos, &packetid, &filter_after, buf, rc);
+	assert("good rc from deserialize subscribe", rc == 1 && qos == 1 && packetid == 12, "rc was %d\n", rc);
+	assert("filters should be the same", filter_after.data.long_.len == 5 &&
+			memcmp(filter_after.data.long_.name, "cmd/+", 5) == 0, "length was %d\n", filter_after.data.long_.len);
+
+	rc = MQTTSNSerialize_suback(buf, sizeof(buf), 1, 0, 12, MQTTSN_RC_ACCEPTED);
+	rc = MQTTSNDeserialize_suback(&qos, &topicid, &packetid, &return_code, buf, rc);
+	assert("good rc from deserialize suback", rc == 1 && qos == 1 && topicid == 0 && packetid == 12, "rc was %d\n", rc);
+
+	rc = MQTTSNSerialize_pingreq(buf, sizeof(buf), clientid);
+	assert("anonymous pingreq is 2 bytes", rc == 2, "rc was %d\n", rc);
+	clientid.cstring = "sensor-1";
+	rc = MQTTSNSerialize_pingreq(buf, sizeof(buf), clientid);
+	rc = MQTTSNDeserialize_pingreq(&clientid_after, buf, rc);
+	assert("client ids should be the same", rc == 1 && clientid_after.lenstring.len == 8, "rc was %d\n", rc);
+
+	rc = MQTTSNSerialize_disconnect(buf, sizeof(buf), 600);
+	assert("sleeping disconnect is 4 bytes", rc == 4, "rc was %d\n", rc);
+	rc = MQTTSNDeserialize_disconnect(&duration, buf, rc);
+	assert("durations should be the same", rc == 1 && duration == 600, "duration was %d\n", duration);
+	rc = MQTTSNSerialize_disconnect(buf, sizeof(buf), -1);
+	rc = MQTTSNDeserialize_disconnect(&duration, buf, rc);
+	assert("plain disconnect has no duration", rc == 1 && duration == -1, "duration was %d\n", duration);
+
+	MyLog(LOGA_INFO, "TEST3: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+	int rc = 0;
+ 	int (*tests[])() = {NULL, test1, test2, test3};
+
+	xml = fopen("TEST-test1.xml", "w");
+	fprintf(xml, "<testsuite name=\"test1\" tests=\"%d\">\n", (int)(ARRAY_SIZE(tests) - 1));
+
+	getopts(argc, argv);
+
+ 	if (options.test_no == 0)
+	{ /* run all the tests */
+ 	   	for (options.test_no = 1; options.test_no < ARRAY_SIZE(tests); ++options.test_no)
+			rc += tests[options.test_no](options); /* return number of failures.  0 = test succeeded */
+	}
+	else
+ 	   	rc = tests[options.test_no](options); /* run just the selected test */
+
+ 	if (rc == 0)
+		MyLog(LOGA_INFO, "verdict pass");
+	else
+		MyLog(LOGA_INFO, "verdict fail");
+
+	fprintf(xml, "</testsuite>\n");
+	fclose(xml);
+	return rc;
+}
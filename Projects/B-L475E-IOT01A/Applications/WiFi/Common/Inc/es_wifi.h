@@ -33,6 +33,13 @@
 /* Exported Constants --------------------------------------------------------*/
 #define ES_WIFI_PAYLOAD_SIZE     1200
 
+/* Sockets (P0 values) the module provides. */
+#ifndef ES_WIFI_MAX_SOCKETS
+#define ES_WIFI_MAX_SOCKETS      4
+#endif
+
+#define ES_WIFI_NO_SOCKET        0xFF
+
 typedef int8_t (*IO_Init_Func)(uint16_t);
 typedef int8_t (*IO_DeInit_Func)(void);
 typedef void (*IO_Delay_Func)(uint32_t);
@@ -219,6 +226,15 @@ typedef struct {
   uint8_t            Backlog;
 } ES_WIFI_Conn_t;
 
+/* Transport settings last programmed on a socket, so that consecutive datagrams
+   to the same peer only cost the S3 command. */
+typedef struct {
+  uint8_t            Valid;
+  uint8_t            RemoteIP[4];
+  uint16_t           RemotePort;
+  uint32_t           WriteTimeout;
+} ES_WIFI_SocketCache_t;
+
 typedef struct {
   IO_Init_Func       IO_Init;
   IO_DeInit_Func     IO_DeInit;
@@ -242,6 +258,9 @@ typedef struct {
   uint8_t            CmdData[ES_WIFI_DATA_SIZE];
   uint32_t           Timeout;
   uint32_t           BufferSize;
+  uint8_t            ActiveSocket;      /* socket selected by the last P0, or ES_WIFI_NO_SOCKET */
+  uint32_t           WriteTimeout;      /* last S2 value sent, 0 when unknown */
+  ES_WIFI_SocketCache_t SocketCache[ES_WIFI_MAX_SOCKETS];
 } ES_WIFIObject_t;
 
 
@@ -292,6 +311,9 @@ ES_WIFI_Status_t  ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket, const u
                                    uint16_t *SentLen, uint32_t Timeout);
 ES_WIFI_Status_t  ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, const uint8_t *pdata, uint16_t Reqlen,
                                      uint16_t *SentLen, uint32_t Timeout, const uint8_t *IPaddr, uint16_t Port);
+ES_WIFI_Status_t  ES_WIFI_SendDataToMany(ES_WIFIObject_t *Obj, uint8_t Socket, const uint8_t *const pdata[],
+                                         const uint16_t Reqlen[], uint16_t Count, uint16_t *SentCount,
+                                         uint32_t Timeout, const uint8_t *IPaddr, uint16_t Port);
 ES_WIFI_Status_t  ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t *pdata, uint16_t Reqlen,
                                       uint16_t *Receivedlen, uint32_t Timeout);
 ES_WIFI_Status_t  ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket, uint8_t *pdata, uint16_t Reqlen,
@@ -318,6 +340,10 @@ ES_WIFI_Status_t  ES_WIFI_RegisterBusIO(ES_WIFIObject_t *Obj, IO_Init_Func    IO
                                                               IO_Send_Func    IO_Send,
                                                               IO_Receive_Func IO_Receive);
 
+ES_WIFI_Status_t  ES_WIFI_SelectCreds( ES_WIFIObject_t *Obj,
+                                       ES_WIFI_CredsFunction_t credsFunction,
+                                       uint8_t credSet );
+
 ES_WIFI_Status_t  ES_WIFI_StoreCreds( ES_WIFIObject_t *Obj,
                                       ES_WIFI_CredsFunction_t credsFunction, uint8_t credSet,
                                       uint8_t* ca, uint16_t caLength,
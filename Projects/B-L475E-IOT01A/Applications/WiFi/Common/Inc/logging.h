@@ -0,0 +1,138 @@
+/**
+  ******************************************************************************
+  * @file    logging.h
+  * @brief   Console output through a RAM ring drained by UART DMA.
+  * @attention
+  * Writers copy their text into the ring and return; the UART sends it in
+  * the background with HAL_UART_Transmit_DMA(), one contiguous chunk per
+  * transfer, so a printf() costs its formatting and a memcpy instead of
+  * about 87 us per byte at 115200 baud. When the ring is full the text is
+  * dropped and counted, unless Log_SetBlocking() asked to wait for room. A
+  * message is dropped whole, and so is a printf() line: Log_Putc() collects
+  * it and queues it at its end.
+  *
+  * The ring has a single writer, the thread-mode code, and a single reader,
+  * the DMA completion interrupt, and needs no lock. Output from interrupt
+  * handlers is dropped and counted separately.
+  *
+  * With USE_LOG_DEFER defined, LOG_DEFER() does not format on the device:
+  * it queues a binary record with the address of the format string and the
+  * arguments as 32-bit words, and Tools/logdecode.c formats it on the host
+  * with the strings read from the firmware ELF. A record is
+  *   0xFF, level << 4 | argument count, string mask,
+  *   tick (4 bytes), format address (4 bytes), arguments (4 bytes each),
+  * all little-endian, followed for each bit set in the mask by a length
+  * byte and a copy of the string the argument points to in RAM, since
+  * buffers such as the AT response are gone by the time the host reads
+  * them. Strings in flash are found in the ELF. Arguments are int, unsigned
+  * or pointers; there is no 64-bit or floating-point conversion. Without
+  * USE_LOG_DEFER, LOG_DEFER() is a Log_Printf() line.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LOGGING_H
+#define __LOGGING_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32l4xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Bytes of text held; a power of two. */
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE          2048
+#endif
+
+/* Longest line formatted by Log_Printf(), prefix included. */
+#ifndef LOG_LINE_SIZE
+#define LOG_LINE_SIZE            128
+#endif
+
+/* Levels: messages above LOG_LEVEL are compiled out, and messages above
+   the level set with Log_SetLevel() are skipped at run time. */
+#define LOG_LEVEL_NONE           0
+#define LOG_LEVEL_ERROR          1
+#define LOG_LEVEL_WARN           2
+#define LOG_LEVEL_INFO           3
+#define LOG_LEVEL_DEBUG          4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL                LOG_LEVEL_INFO
+#endif
+
+/* Deferred records: arguments at most, and bytes kept of a string in RAM. */
+#define LOG_DEFER_MAX_ARGS       6
+#ifndef LOG_DEFER_STRING_SIZE
+#define LOG_DEFER_STRING_SIZE    32
+#endif
+#define LOG_DEFER_MARKER         0xFFU   /* never part of the ASCII text */
+#define LOG_DEFER_HEADER_SIZE    11
+
+/* DMA channel sending USART1 (COM1); DMA1 channel 4 is taken by I2C2. */
+#define LOG_DMA_CHANNEL          DMA2_Channel6
+#define LOG_DMA_REQUEST          DMA_REQUEST_2
+#define LOG_DMA_IRQn             DMA2_Channel6_IRQn
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint32_t Written;              /* bytes queued */
+  uint32_t Dropped;              /* bytes dropped because the ring was full */
+  uint32_t DroppedIsr;           /* bytes dropped because written from an interrupt */
+  uint32_t Skipped;              /* messages below the run-time level */
+  uint32_t HighWater;            /* most bytes waiting in the ring */
+} Log_Stats_t;
+
+/* Exported macro ------------------------------------------------------------*/
+#if (LOG_LEVEL >= LOG_LEVEL_ERROR)
+#define LOG_ERROR(...)           Log_Printf(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...)           ((void)0)
+#endif
+#if (LOG_LEVEL >= LOG_LEVEL_WARN)
+#define LOG_WARN(...)            Log_Printf(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...)            ((void)0)
+#endif
+#if (LOG_LEVEL >= LOG_LEVEL_INFO)
+#define LOG_INFO(...)            Log_Printf(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...)            ((void)0)
+#endif
+#if (LOG_LEVEL >= LOG_LEVEL_DEBUG)
+#define LOG_DEBUG(...)           Log_Printf(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...)           ((void)0)
+#endif
+
+/* Number of arguments after the format, up to LOG_DEFER_MAX_ARGS. */
+#define LOG_DEFER_NARGS(...)     LOG_DEFER_NARGS_(__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0, 0)
+#define LOG_DEFER_NARGS_(f, a1, a2, a3, a4, a5, a6, n, ...)  n
+
+#if defined(USE_LOG_DEFER)
+#define LOG_DEFER(level, ...)    (((level) <= LOG_LEVEL) ? \
+                                  Log_Defer((level), LOG_DEFER_NARGS(__VA_ARGS__), __VA_ARGS__) : (void)0)
+#else
+#define LOG_DEFER(level, ...)    (((level) <= LOG_LEVEL) ? Log_Printf((level), __VA_ARGS__) : (void)0)
+#endif
+
+/* Exported functions ------------------------------------------------------- */
+void     Log_Init(UART_HandleTypeDef *huart);
+uint32_t Log_Write(const char *pdata, uint32_t Length);
+int      Log_Putc(int ch);
+void     Log_Flush(void);
+void     Log_Printf(uint8_t Level, const char *format, ...);
+void     Log_Defer(uint8_t Level, uint32_t Count, const char *format, ...);
+void     Log_SetLevel(uint8_t Level);
+void     Log_SetBlocking(uint8_t Enable);
+uint32_t Log_IsIdle(void);
+void     Log_GetStats(Log_Stats_t *pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOGGING_H */
@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file    report.h
+  * @brief   Report by exception: deadband filtering of telemetry channels.
+  * @attention
+  * Each channel remembers the last value it reported. A new reading is only
+  * reported once it moved out of the deadband around that value, no sooner
+  * than MinInterval after the last report, and at the latest MaxInterval
+  * after it even if unchanged. The decision is made on the scaled integer
+  * (Telemetry_Scale()) before anything is encoded or sent, so unchanged
+  * readings cost a sensor read and a compare: the payload only carries the
+  * channels that are due, and nothing is published when none is.
+  *
+  * Reporting is two-step: Report_IsDue() decides, and Report_Commit() is
+  * called once the value was actually published, so that a failed publish
+  * is retried with the next reading.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __REPORT_H
+#define __REPORT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint8_t   Key;                 /* telemetry key, TELEMETRY_TEMPERATURE ... */
+  int32_t   Deadband;            /* absolute change reported, scaled units; 0: none */
+  uint16_t  DeadbandPct;         /* relative change reported, 0.01 % of the last
+                                    reported value; 0: none */
+  uint32_t  MinInterval;         /* ms between reports, however large the change */
+  uint32_t  MaxInterval;         /* ms until an unchanged value is reported again;
+                                    0: only on change */
+  int32_t   Last;                /* last reported value */
+  uint32_t  LastTime;            /* when it was reported, ms */
+  uint8_t   Valid;               /* a value was reported */
+} Report_Channel_t;
+
+/* Exported functions ------------------------------------------------------- */
+void     Report_Init(Report_Channel_t *pChannel, uint8_t Key, int32_t Deadband,
+                     uint16_t DeadbandPct, uint32_t MinInterval, uint32_t MaxInterval);
+uint32_t Report_IsDue(const Report_Channel_t *pChannel, uint32_t Now, int32_t Value);
+void     Report_Commit(Report_Channel_t *pChannel, uint32_t Now, int32_t Value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __REPORT_H */
@@ -0,0 +1,63 @@
+/**
+  ******************************************************************************
+  * @file    settings.h
+  * @brief   Run-time configuration kept in the last flash pages.
+  * @attention
+  * The Wi-Fi credentials, broker address and tunables are built in as
+  * defaults and can be overridden by a copy saved in flash, so that a board
+  * in the field is reconfigured from the console instead of reflashed.
+  * The copy lives at SETTINGS_FLASH_ADDRESS, the wifi_config_region of the
+  * EWARM layout, which the MDK-ARM IROM1 size keeps out of the image. It is
+  * only used if its magic, layout version, size and CRC-32 match: a copy
+  * written by a firmware with another Settings_t is ignored, not misread.
+  *
+  * The page is in bank 2 while the code runs from bank 1, so erasing and
+  * programming it does not stall the CPU.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SETTINGS_H
+#define __SETTINGS_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32l4xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SETTINGS_FLASH_ADDRESS   0x080FF000UL
+#define SETTINGS_MAGIC           0x53455431UL   /* "SET1" */
+#define SETTINGS_VERSION         1              /* bump when Settings_t changes */
+
+#define SETTINGS_SSID_SIZE       33             /* 32 characters and the NUL */
+#define SETTINGS_PASSWORD_SIZE   65
+#define SETTINGS_HOST_SIZE       64
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint32_t Magic;                /* SETTINGS_MAGIC, set by Settings_Save() */
+  uint16_t Version;              /* SETTINGS_VERSION, set by Settings_Save() */
+  uint16_t Size;                 /* sizeof(Settings_t), set by Settings_Save() */
+  char     Ssid[SETTINGS_SSID_SIZE];
+  char     Password[SETTINGS_PASSWORD_SIZE];
+  char     BrokerHost[SETTINGS_HOST_SIZE];
+  uint16_t BrokerPort;
+  uint8_t  LogLevel;             /* LOG_LEVEL_NONE ... LOG_LEVEL_DEBUG */
+  uint32_t PublishIntervalMs;
+  uint32_t Crc;                  /* CRC-32 of the bytes above */
+} Settings_t;
+
+/* Exported functions ------------------------------------------------------- */
+int32_t  Settings_Load(Settings_t *pSettings);
+int32_t  Settings_Save(Settings_t *pSettings);
+int32_t  Settings_Erase(void);
+uint32_t Settings_IsStored(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SETTINGS_H */
@@ -0,0 +1,71 @@
+/**
+  ******************************************************************************
+  * @file    shell.h
+  * @brief   Command shell on the console UART, received by circular DMA.
+  * @attention
+  * HAL_UARTEx_ReceiveToIdle_DMA() runs once, in circular mode, for good: the
+  * DMA writes what is typed into ShellRx and the CPU is only interrupted at
+  * a pause in the input (IDLE line) or when half the buffer was filled, not
+  * per character. Shell_Poll(), from the main loop, reads the DMA position,
+  * takes the new characters straight from the buffer into the line being
+  * edited and runs the command when Enter is pressed.
+  *
+  * Commands come from a table given to Shell_Init(). A line is split at
+  * spaces into at most SHELL_MAX_ARGS words, the last one taking the rest
+  * of the line, so that "set ssid My Network" passes "My Network" whole.
+  * "help" lists the table.
+  *
+  * The USART and its DMA are off in Stop 2. While the shell was used in
+  * the last SHELL_AWAKE_MS, Shell_IsIdle() keeps the MCU in Sleep mode;
+  * afterwards a falling edge on RX (EXTI line 7) wakes it, and the first
+  * character typed is lost to that wake-up.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SHELL_H
+#define __SHELL_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32l4xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef SHELL_RX_SIZE
+#define SHELL_RX_SIZE            256
+#endif
+#define SHELL_LINE_SIZE          128
+#define SHELL_MAX_ARGS           3
+#define SHELL_AWAKE_MS           60000
+
+/* DMA channel receiving USART1 (COM1); channel 6 sends it (logging.h). */
+#define SHELL_DMA_CHANNEL        DMA2_Channel7
+#define SHELL_DMA_REQUEST        DMA_REQUEST_2
+#define SHELL_DMA_IRQn           DMA2_Channel7_IRQn
+
+/* USART1 RX, PB7, as the Stop 2 wake-up. */
+#define SHELL_WAKE_PIN           GPIO_PIN_7
+#define SHELL_WAKE_IRQn          EXTI9_5_IRQn
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  const char *Name;
+  const char *Help;              /* arguments and description, for "help" */
+  void (*Run)(int argc, char *argv[]);
+} Shell_Command_t;
+
+/* Exported functions ------------------------------------------------------- */
+void     Shell_Init(UART_HandleTypeDef *huart, const Shell_Command_t *pCommands, uint32_t Count);
+void     Shell_Poll(void);
+uint32_t Shell_HasInput(void);
+uint32_t Shell_IsIdle(void);
+void     Shell_Wake(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SHELL_H */
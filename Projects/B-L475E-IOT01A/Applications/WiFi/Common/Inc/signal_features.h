@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file    signal_features.h
+  * @brief   Signal features of 3-axis sensor windows, computed with CMSIS-DSP.
+  * @attention
+  * Samples (e.g. accelerometer mg from BSP_ACCELERO_FIFO_GetXYZ(), or
+  * magnetometer mgauss) are collected into windows of FEATURES_WINDOW
+  * samples per axis. Each full window is reduced to per-axis RMS, peak and
+  * crest factor of the signal with its mean removed, and to the RMS in
+  * FEATURES_BANDS equal-width frequency bands over all three axes, so that
+  * a window of several kilobytes is published as a few dozen bytes.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIGNAL_FEATURES_H
+#define __SIGNAL_FEATURES_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "arm_math.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Samples per axis in a window: a length arm_rfft_fast_f32 supports, 32 to
+   4096. The window state takes 5 * FEATURES_WINDOW floats. */
+#ifndef FEATURES_WINDOW
+#define FEATURES_WINDOW          512
+#endif
+
+/* Frequency bands between DC and half the sample rate. */
+#define FEATURES_BANDS           8
+
+#define FEATURES_AXES            3
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  float32_t Rms[FEATURES_AXES];      /* input units, mean removed */
+  float32_t Peak[FEATURES_AXES];     /* largest deviation from the mean */
+  float32_t Crest[FEATURES_AXES];    /* Peak / Rms */
+  float32_t Band[FEATURES_BANDS];    /* RMS in each band, all axes together */
+  float32_t BandWidth;               /* Hz */
+} Features_t;
+
+typedef struct {
+  arm_rfft_fast_instance_f32 Fft;
+  float32_t SampleRate;              /* Hz */
+  uint32_t  Fill;                    /* samples per axis collected */
+  float32_t Samples[FEATURES_AXES][FEATURES_WINDOW];
+  float32_t Hann[FEATURES_WINDOW];
+  float32_t Spectrum[FEATURES_WINDOW];
+} Features_Window_t;
+
+/* Exported functions ------------------------------------------------------- */
+int32_t  Features_Init(Features_Window_t *pWin, float32_t SampleRate);
+uint32_t Features_Add(Features_Window_t *pWin, const int16_t *pXYZ, uint32_t Samples);
+int32_t  Features_Compute(Features_Window_t *pWin, Features_t *pFeatures);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIGNAL_FEATURES_H */
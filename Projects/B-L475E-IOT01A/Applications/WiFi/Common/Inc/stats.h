@@ -0,0 +1,121 @@
+/**
+  ******************************************************************************
+  * @file    stats.h
+  * @brief   Run-time statistics of the Wi-Fi and MQTT layers.
+  * @attention
+  * Each layer counts what it does in the Stats variable: AT commands with
+  * their round-trip time per command, SPI bytes and interrupts, MQTT packets
+  * per type, the time from a QoS 1 or 2 PUBLISH to its acknowledgement,
+  * broker connects and the high-water marks of the buffers. Counting is an
+  * increment or a compare, and the hooks below compile out unless USE_STATS
+  * is defined. Stats_Encode() writes it all as one CBOR map (telemetry.h),
+  * published periodically, so that a slowdown in the fleet can be put down
+  * to the radio (acknowledgement times), the module (AT round trips) or the
+  * MCU (interrupts, buffer high-water marks).
+  *
+  * Latencies go to histograms of STATS_BUCKETS power-of-two buckets: bucket
+  * 0 counts the zero values and bucket k the values from 2^(k-1) to
+  * 2^k - 1, the last one being open-ended; Max keeps the largest value.
+  *
+  * The MQTT client reaches Stats_MqttPacket() through the MQTT_PACKET_SENT
+  * and MQTT_PACKET_RECEIVED hooks of MQTTClientConfig.h, defined here.
+  *
+  * This header is shared with the host decoder (Tools/statsdecode.c): it
+  * describes the payload and only depends on stdint.h.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STATS_H
+#define __STATS_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define STATS_BUCKETS            16
+#define STATS_AT_UNIT_US         64   /* AT round trips: 1 ms is bucket 5 */
+
+/* AT commands are told apart by their first two characters, e.g. "S3"; the
+   commands seen after the first STATS_AT_TYPES - 1 share the last slot. */
+#define STATS_AT_TYPES           12
+
+/* Map keys of the payload. Arrays are cut after their last non-zero item. */
+#define STATS_UPTIME             0   /* s */
+#define STATS_CONNECTS           1   /* broker connections opened */
+#define STATS_SPI                2   /* [tx bytes, rx bytes, SPI3 IRQs, data-ready IRQs] */
+#define STATS_MQTT_TX            3   /* packets sent, indexed by MQTT packet type */
+#define STATS_MQTT_RX            4   /* packets read, indexed by MQTT packet type */
+#define STATS_PUBLISH_ACK        5   /* [max, buckets...] PUBLISH to PUBACK/PUBCOMP, ms */
+#define STATS_HIGH_WATER         6   /* [log ring, MQTT tx, MQTT rx, AT response] bytes */
+#define STATS_ERRORS             7   /* [socket selections failed, unmatched acks] */
+#define STATS_AT                 8   /* [code, IO errors, max, buckets...] per command,
+                                        STATS_AT_UNIT_US; keys up to STATS_AT + STATS_AT_TYPES - 1 */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint32_t Count[STATS_BUCKETS];
+  uint32_t Max;
+} Stats_Histogram_t;
+
+typedef struct {
+  uint16_t Code;                 /* first two characters, e.g. 'S' << 8 | '3' */
+  uint32_t Errors;               /* sent but no response, or an IO error */
+  Stats_Histogram_t Latency;     /* STATS_AT_UNIT_US */
+} Stats_AtCommand_t;
+
+typedef struct {
+  uint32_t Connects;
+  uint32_t SpiTxBytes;
+  uint32_t SpiRxBytes;
+  uint32_t SpiIrqs;              /* SPI3 transfer interrupts */
+  uint32_t DataReadyIrqs;        /* module CMD/DATA ready edges */
+  uint32_t MqttTx[16];           /* by packet type, CONNECT = 1 ... DISCONNECT = 14 */
+  uint32_t MqttRx[16];
+  uint32_t MqttTxMax;            /* longest packet sent, bytes */
+  uint32_t MqttRxMax;            /* longest packet read, bytes */
+  uint32_t AtResponseMax;        /* longest AT response, bytes */
+  uint32_t SocketErrors;         /* ES_WIFI_ReceiveData() could not select the socket */
+  uint32_t UnmatchedAcks;        /* acks matching no PUBLISH being timed */
+  Stats_Histogram_t PublishAck;  /* ms */
+  Stats_AtCommand_t At[STATS_AT_TYPES];
+  uint32_t AtTypes;              /* slots of At in use */
+} Stats_t;
+
+/* Exported macro ------------------------------------------------------------*/
+/* Compiled out unless USE_STATS is defined. */
+#if defined(USE_STATS)
+#define STATS_INC(field)         (Stats.field++)
+#define STATS_ADD(field, n)      (Stats.field += (n))
+#define STATS_AT_BEGIN(cmd)      Stats_AtBegin((const uint8_t *)(cmd))
+#define STATS_AT_END(len)        Stats_AtEnd(len)
+#define MQTT_PACKET_SENT(buf)    Stats_MqttPacket(0, (buf))
+#define MQTT_PACKET_RECEIVED(buf) Stats_MqttPacket(1, (buf))
+#else
+#define STATS_INC(field)         ((void)0)
+#define STATS_ADD(field, n)      ((void)0)
+#define STATS_AT_BEGIN(cmd)      ((void)0)
+#define STATS_AT_END(len)        ((void)0)
+#endif
+
+/* Exported variables --------------------------------------------------------*/
+extern Stats_t Stats;
+
+/* Exported functions ------------------------------------------------------- */
+void    Stats_Init(void);
+void    Stats_Record(Stats_Histogram_t *pHistogram, uint32_t Value);
+void    Stats_AtBegin(const uint8_t *pCmd);
+void    Stats_AtEnd(int32_t Length);
+void    Stats_MqttPacket(uint8_t Received, const uint8_t *pPacket);
+int32_t Stats_Encode(uint8_t *pBuffer, uint32_t Size);
+void    Stats_Print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STATS_H */
@@ -0,0 +1,116 @@
+/**
+  ******************************************************************************
+  * @file    telemetry.h
+  * @brief   Compact CBOR encoding of sensor readings for MQTT publishes.
+  * @attention
+  * A payload is one CBOR map (RFC 8949) from small integer keys to integers.
+  * Each reading is scaled to a fixed-point integer by the schema below, so
+  * no float formatting is needed and a value takes 1 to 5 bytes: a typical
+  * temperature, humidity and pressure publish is 13 bytes instead of about
+  * 50 as JSON.
+  *
+  * A batch payload carries several samples in the same map, column by
+  * column: each key maps to an array holding its first value followed by
+  * the difference of each sample from the previous one, and TELEMETRY_TIME
+  * holds the sample times the same way. Slowly changing readings then cost
+  * about one byte per sample, and one PUBLISH carries them all.
+  *
+  * This header and telemetry.c are shared with the host decoder
+  * (Tools/teledecode.c): they only depend on stdint.h and string.h.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Map keys. New keys are appended: the backend decodes old payloads too. */
+#define TELEMETRY_UPTIME         0   /* s */
+#define TELEMETRY_TEMPERATURE    1   /* degC, 0.01 */
+#define TELEMETRY_HUMIDITY       2   /* %rH, 0.1 */
+#define TELEMETRY_PRESSURE       3   /* hPa, 0.1 */
+#define TELEMETRY_ACC_X          4   /* mg */
+#define TELEMETRY_ACC_Y          5
+#define TELEMETRY_ACC_Z          6
+#define TELEMETRY_MAG_X          7   /* mgauss */
+#define TELEMETRY_MAG_Y          8
+#define TELEMETRY_MAG_Z          9
+#define TELEMETRY_TIME           10  /* ms, HAL_GetTick(); batch sample times */
+#define TELEMETRY_RMS_X          11  /* signal features (signal_features.h), */
+#define TELEMETRY_RMS_Y          12  /* in the units of the input, 0.1 */
+#define TELEMETRY_RMS_Z          13
+#define TELEMETRY_PEAK_X         14  /* input units */
+#define TELEMETRY_PEAK_Y         15
+#define TELEMETRY_PEAK_Z         16
+#define TELEMETRY_CREST_X        17  /* 0.01 */
+#define TELEMETRY_CREST_Y        18
+#define TELEMETRY_CREST_Z        19
+#define TELEMETRY_BAND_0         20  /* band RMS, input units, 0.1; */
+#define TELEMETRY_BAND_7         27  /* FEATURES_BANDS keys from BAND_0 */
+
+/* Fields per payload: the map header is a single byte up to 23 entries. */
+#define TELEMETRY_MAX_FIELDS     23
+
+/* Worst-case growth of a batch payload by one sample of n columns: the time
+   and each value take up to 5 bytes, and an array head may grow by 2. */
+#define TELEMETRY_BATCH_ROW_MAX(n)   (7U * ((n) + 1U))
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+  uint8_t     Key;               /* TELEMETRY_UPTIME ... */
+  uint16_t    Scale;             /* encoded value = reading * Scale */
+  const char *Name;              /* backend field name */
+} Telemetry_Field_t;
+
+typedef struct {
+  uint8_t  *Buffer;
+  uint32_t  Size;
+  uint32_t  Length;              /* bytes encoded so far */
+  uint8_t   Count;               /* fields encoded so far */
+  uint8_t   Overflow;            /* a field did not fit */
+} Telemetry_Encoder_t;
+
+/* Samples of one sensor group, kept raw until the batch is encoded. The
+   storage is the caller's, so each group sizes it for its own rate. */
+typedef struct {
+  const uint8_t *Keys;           /* column keys, in payload order */
+  uint8_t   Columns;             /* at most TELEMETRY_MAX_FIELDS - 1 */
+  uint16_t  MaxRows;
+  int32_t  *Values;              /* MaxRows * Columns, row by row, scaled */
+  uint32_t *Times;               /* MaxRows sample times, ms */
+  uint32_t  MaxBytes;            /* payload size bound */
+  uint32_t  MaxAge;              /* flush once the oldest sample is this old, ms */
+  uint16_t  Rows;                /* samples held */
+  uint32_t  ItemBytes;           /* encoded size of the samples held */
+} Telemetry_Batch_t;
+
+/* Exported functions ------------------------------------------------------- */
+const Telemetry_Field_t *Telemetry_FindField(uint8_t Key);
+int32_t Telemetry_Scale(uint8_t Key, float Reading);
+void    Telemetry_Begin(Telemetry_Encoder_t *pEnc, uint8_t *pBuffer, uint32_t Size);
+void    Telemetry_AddInt(Telemetry_Encoder_t *pEnc, uint8_t Key, int32_t Value);
+void    Telemetry_AddReading(Telemetry_Encoder_t *pEnc, uint8_t Key, float Reading);
+void    Telemetry_AddArray(Telemetry_Encoder_t *pEnc, uint8_t Key, const uint32_t *pValues, uint32_t Count);
+int32_t Telemetry_End(Telemetry_Encoder_t *pEnc);
+
+void     Telemetry_BatchInit(Telemetry_Batch_t *pBatch, const uint8_t *pKeys, uint8_t Columns,
+                             int32_t *pValues, uint32_t *pTimes, uint16_t MaxRows,
+                             uint32_t MaxBytes, uint32_t MaxAge);
+int32_t  Telemetry_BatchAdd(Telemetry_Batch_t *pBatch, uint32_t Time, const int32_t *pValues);
+uint32_t Telemetry_BatchSize(const Telemetry_Batch_t *pBatch);
+uint32_t Telemetry_BatchTimeLeft(const Telemetry_Batch_t *pBatch, uint32_t Now);
+int32_t  Telemetry_BatchEncode(Telemetry_Batch_t *pBatch, uint8_t *pBuffer, uint32_t Size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELEMETRY_H */
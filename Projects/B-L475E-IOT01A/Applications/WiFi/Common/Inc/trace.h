@@ -0,0 +1,93 @@
+/**
+  ******************************************************************************
+  * @file    trace.h
+  * @brief   Binary trace of MQTT packets and ES-WiFi AT commands in a RAM ring.
+  * @attention
+  * Recording a packet costs a header and a memcpy into the ring, instead of
+  * formatting it and sending it byte by byte over the UART, so tracing can
+  * stay on while chasing timing-dependent bugs. The ring keeps the newest
+  * records: the oldest are overwritten when it is full. Trace_Dump() prints
+  * it as hex, or the debugger can save the Trace_Ring variable as a binary
+  * file; Tools/trace2pcap converts either to a pcap file for Wireshark.
+  *
+  * This header is shared with the host tool: it describes the ring layout
+  * and only depends on stdint.h.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Bytes of records kept; a multiple of 4. */
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE        8192
+#endif
+
+/* Bytes kept of each MQTT packet and AT exchange; the rest is only counted. */
+#ifndef TRACE_MQTT_SNAPLEN
+#define TRACE_MQTT_SNAPLEN       256
+#endif
+#ifndef TRACE_AT_SNAPLEN
+#define TRACE_AT_SNAPLEN         64
+#endif
+
+#define TRACE_MAGIC              0x31435254UL   /* "TRC1" */
+
+/* Record types */
+#define TRACE_MQTT_TX            0   /* bytes written to the broker socket */
+#define TRACE_MQTT_RX            1   /* bytes read from the broker socket */
+#define TRACE_AT_CMD             2   /* AT command sent to the module */
+#define TRACE_AT_RESP            3   /* module response */
+
+/* Exported types ------------------------------------------------------------*/
+/* Each record is this header followed by Captured bytes, padded to 4 bytes.
+   Records wrap around the end of Data. All fields are little endian. */
+typedef struct {
+  uint32_t Timestamp;            /* HAL_GetTick(), ms */
+  uint16_t Length;               /* length of the packet or AT exchange */
+  uint16_t Captured;             /* bytes kept, at most the snaplen */
+  uint8_t  Type;                 /* TRACE_MQTT_TX ... */
+  uint8_t  Channel;              /* socket number */
+  uint16_t Reserved;
+} Trace_RecordHeader_t;
+
+typedef struct {
+  uint32_t Magic;                /* TRACE_MAGIC */
+  uint32_t Size;                 /* sizeof(Data) */
+  uint32_t Head;                 /* offset the next record is written at */
+  uint32_t Tail;                 /* offset of the oldest record */
+  uint32_t Used;                 /* bytes of records from Tail to Head */
+  uint32_t Dropped;              /* records overwritten since Trace_Init() */
+  uint8_t  Data[TRACE_BUFFER_SIZE];
+} Trace_Ring_t;
+
+/* Exported macro ------------------------------------------------------------*/
+/* Compiled out unless USE_TRACE is defined. */
+#if defined(USE_TRACE)
+#define TRACE_RECORD(type, channel, data, len)  Trace_Record((type), (channel), (const uint8_t *)(data), (len))
+#else
+#define TRACE_RECORD(type, channel, data, len)  ((void)0)
+#endif
+
+/* Exported variables --------------------------------------------------------*/
+extern Trace_Ring_t Trace_Ring;
+
+/* Exported functions ------------------------------------------------------- */
+void Trace_Init(void);
+void Trace_Record(uint8_t Type, uint8_t Channel, const uint8_t *pdata, uint32_t Length);
+void Trace_Dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_H */
@@ -49,6 +49,7 @@ typedef enum {
 typedef enum {
   WIFI_TCP_PROTOCOL = 0,
   WIFI_UDP_PROTOCOL = 1,
+  WIFI_TCP_SSL_PROTOCOL = 2,
 }WIFI_Protocol_t;
 
 typedef enum {
@@ -147,6 +148,9 @@ WIFI_Status_t WIFI_SendData(uint32_t socket, const uint8_t *pdata, uint16_t Reql
 WIFI_Status_t WIFI_SendDataTo(uint32_t socket, const uint8_t *pdata, uint16_t Reqlen, uint16_t *SentDatalen,
                               uint32_t Timeout,
                               const uint8_t *ipaddr, uint16_t port);
+WIFI_Status_t WIFI_SendDataToMany(uint32_t socket, const uint8_t *const pdata[], const uint16_t Reqlen[],
+                                  uint16_t Count, uint16_t *SentCount, uint32_t Timeout,
+                                  const uint8_t *ipaddr, uint16_t port);
 WIFI_Status_t WIFI_ReceiveData(uint32_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen,
                                uint32_t Timeout);
 WIFI_Status_t WIFI_ReceiveDataFrom(uint32_t socket, uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen,
@@ -161,6 +165,10 @@ WIFI_Status_t WIFI_ModuleFirmwareUpdate(const char *url);
 WIFI_Status_t WIFI_GetModuleID(char *Id, uint8_t IdLength);
 WIFI_Status_t WIFI_GetModuleFwRevision(char *rev, uint8_t RevLength);
 WIFI_Status_t WIFI_GetModuleName(char *ModuleName, uint8_t ModuleNameLength);
+WIFI_Status_t WIFI_StoreTLSCredentials(uint8_t credset, const uint8_t *ca, uint16_t ca_len,
+                                       const uint8_t *cert, uint16_t cert_len,
+                                       const uint8_t *key, uint16_t key_len);
+WIFI_Status_t WIFI_SelectTLSCredentials(uint8_t credset);
 #ifdef __cplusplus
 }
 #endif
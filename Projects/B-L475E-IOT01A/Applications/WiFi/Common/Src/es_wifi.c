@@ -17,6 +17,9 @@
   */
 /* Includes ------------------------------------------------------------------*/
 #include "es_wifi.h"
+#include "trace.h"
+#include "logging.h"
+#include "stats.h"
 
 /* Private defines -----------------------------------------------------------*/
 /* The socket timeout of the non-blocking sockets is supposed to be 0.
@@ -27,7 +30,8 @@
 #define NET_DEFAULT_NOBLOCKING_WRITE_TIMEOUT  1
 #define NET_DEFAULT_NOBLOCKING_READ_TIMEOUT   1
 
-#define DEBUG  printf("%s:%d :",__FILE__,__LINE__);printf
+/* Deferred: a binary record with USE_LOG_DEFER, formatted by logdecode */
+#define DEBUG(...)  LOG_DEFER(LOG_LEVEL_WARN, "es_wifi: " __VA_ARGS__)
 
 #define AT_OK_STRING "\r\nOK\r\n> "
 #define AT_OK_STRING_LEN (sizeof(AT_OK_STRING) - 1)
@@ -78,6 +82,12 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd,
                                            const uint8_t *pcmd_data, uint16_t len, uint8_t *pdata);
 static ES_WIFI_Status_t AT_RequestReceiveData(ES_WIFIObject_t *Obj, uint8_t *cmd,
                                               char *pdata, uint16_t Reqlen, uint16_t *ReadData);
+static void AT_InvalidateCache(ES_WIFIObject_t *Obj);
+static void AT_InvalidateSocket(ES_WIFIObject_t *Obj, uint8_t Socket);
+static ES_WIFI_Status_t AT_SelectSocket(ES_WIFIObject_t *Obj, uint8_t Socket);
+static ES_WIFI_Status_t AT_SetWriteTimeout(ES_WIFIObject_t *Obj, uint8_t Socket, uint32_t Timeout);
+static ES_WIFI_Status_t AT_SetDestination(ES_WIFIObject_t *Obj, uint8_t Socket, const uint8_t *IPaddr, uint16_t Port);
+static ES_WIFI_Status_t AT_SendDatagram(ES_WIFIObject_t *Obj, const uint8_t *pdata, uint16_t Reqlen);
 
 uint32_t HAL_GetTick(void);
 
@@ -722,11 +732,14 @@ static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, const uint8_t *c
 
   if ((Obj->fops.IO_Send != NULL) && (Obj->fops.IO_Receive != NULL)) {
 
+  STATS_AT_BEGIN(cmd);
   ret = Obj->fops.IO_Send(cmd, strlen((const char *)cmd), Obj->Timeout);
 
   if( ret > 0)
   {
+    TRACE_RECORD(TRACE_AT_CMD, Obj->ActiveSocket, cmd, ret);
     recv_len = Obj->fops.IO_Receive(pdata, ES_WIFI_DATA_SIZE, Obj->Timeout);
+    STATS_AT_END(recv_len);
     if ((recv_len > 0) && (recv_len <= ES_WIFI_DATA_SIZE))
     {
       if (recv_len == ES_WIFI_DATA_SIZE)
@@ -735,6 +748,7 @@ static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, const uint8_t *c
         recv_len--;
       }
       *(pdata + recv_len) = 0;
+      TRACE_RECORD(TRACE_AT_RESP, Obj->ActiveSocket, pdata, recv_len);
 
       if (strstr((char *)pdata, AT_OK_STRING))
       {
@@ -784,16 +798,21 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd,
 
   if ((Obj->fops.IO_Send != NULL) && (Obj->fops.IO_Receive != NULL)) {
 
+  STATS_AT_BEGIN(cmd);
   n = Obj->fops.IO_Send(cmd, cmd_len, Obj->Timeout);
   if (n == cmd_len)
   {
+    /* The command only: the payload is traced by the layer above */
+    TRACE_RECORD(TRACE_AT_CMD, Obj->ActiveSocket, cmd, cmd_len);
     send_len = Obj->fops.IO_Send(pcmd_data, len, Obj->Timeout);
     if (send_len == len)
     {
       recv_len = Obj->fops.IO_Receive(pdata, 0, Obj->Timeout);
+      STATS_AT_END(recv_len);
       if (recv_len > 0)
       {
         *(pdata + recv_len) = 0;
+        TRACE_RECORD(TRACE_AT_RESP, Obj->ActiveSocket, pdata, recv_len);
         if(strstr((char *)pdata, AT_OK_STRING))
         {
           UNLOCK_WIFI();
@@ -846,9 +865,16 @@ static ES_WIFI_Status_t AT_RequestReceiveData(ES_WIFIObject_t *Obj, uint8_t *cmd
 
   if ((Obj->fops.IO_Send != NULL) && (Obj->fops.IO_Receive != NULL)) {
 
+  STATS_AT_BEGIN(cmd);
   if (Obj->fops.IO_Send(cmd, (uint16_t)strlen((char *)cmd), Obj->Timeout) > 0)
   {
+    TRACE_RECORD(TRACE_AT_CMD, Obj->ActiveSocket, cmd, strlen((char *)cmd));
     len = Obj->fops.IO_Receive(p, 0, Obj->Timeout);
+    STATS_AT_END(len);
+    if (len > 0)
+    {
+      TRACE_RECORD(TRACE_AT_RESP, Obj->ActiveSocket, p, len);
+    }
 
     /* Check if start at "\r\n". */
     if ((p[0] != '\r') || (p[1] != '\n'))
@@ -898,6 +924,169 @@ static ES_WIFI_Status_t AT_RequestReceiveData(ES_WIFIObject_t *Obj, uint8_t *cmd
 }
 
 
+/**
+  * @brief  Forget the socket selection and the transport settings cached for all sockets.
+  *         Called whenever the module state is unknown: init, reset, failed command.
+  * @param  Obj: pointer to the module handle
+  * @retval None.
+  */
+static void AT_InvalidateCache(ES_WIFIObject_t *Obj)
+{
+  Obj->ActiveSocket = ES_WIFI_NO_SOCKET;
+  Obj->WriteTimeout = 0;
+  memset(Obj->SocketCache, 0, sizeof(Obj->SocketCache));
+}
+
+/**
+  * @brief  Forget the transport settings cached for one socket, when it is (re)configured.
+  * @param  Obj: pointer to the module handle
+  * @param  Socket: number of the socket
+  * @retval None.
+  */
+static void AT_InvalidateSocket(ES_WIFIObject_t *Obj, uint8_t Socket)
+{
+  if (Socket < ES_WIFI_MAX_SOCKETS)
+  {
+    memset(&Obj->SocketCache[Socket], 0, sizeof(Obj->SocketCache[Socket]));
+  }
+}
+
+/**
+  * @brief  Select the socket the next commands apply to (P0), unless it already is.
+  * @param  Obj: pointer to the module handle
+  * @param  Socket: number of the socket
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_SelectSocket(ES_WIFIObject_t *Obj, uint8_t Socket)
+{
+  ES_WIFI_Status_t ret;
+
+  if (Obj->ActiveSocket == Socket)
+  {
+    return ES_WIFI_STATUS_OK;
+  }
+
+  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  Obj->ActiveSocket = (ret == ES_WIFI_STATUS_OK) ? Socket : ES_WIFI_NO_SOCKET;
+
+  return ret;
+}
+
+/**
+  * @brief  Set the write timeout (S2) of the selected socket, unless it already is.
+  *         The value is skipped only when both the socket and the module saw it last,
+  *         which is right whether the firmware keeps S2 per socket or globally.
+  * @param  Obj: pointer to the module handle
+  * @param  Socket: number of the selected socket
+  * @param  Timeout: write timeout in ms
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_SetWriteTimeout(ES_WIFIObject_t *Obj, uint8_t Socket, uint32_t Timeout)
+{
+  ES_WIFI_Status_t ret;
+
+  if ((Socket < ES_WIFI_MAX_SOCKETS) && (Obj->WriteTimeout == Timeout) &&
+      (Obj->SocketCache[Socket].WriteTimeout == Timeout))
+  {
+    return ES_WIFI_STATUS_OK;
+  }
+
+  sprintf((char*)Obj->CmdData, "S2=%lu\r", Timeout);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+
+  Obj->WriteTimeout = (ret == ES_WIFI_STATUS_OK) ? Timeout : 0;
+  if (Socket < ES_WIFI_MAX_SOCKETS)
+  {
+    Obj->SocketCache[Socket].WriteTimeout = Obj->WriteTimeout;
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  Program the remote port (P4) and address (P3) of the selected socket,
+  *         unless they already are.
+  * @param  Obj: pointer to the module handle
+  * @param  Socket: number of the selected socket
+  * @param  IPaddr: remote IP address
+  * @param  Port: remote port
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_SetDestination(ES_WIFIObject_t *Obj, uint8_t Socket, const uint8_t *IPaddr, uint16_t Port)
+{
+  ES_WIFI_Status_t ret = ES_WIFI_STATUS_OK;
+  ES_WIFI_SocketCache_t *cache = NULL;
+  uint8_t same_port = 0;
+
+  if (Socket < ES_WIFI_MAX_SOCKETS)
+  {
+    cache = &Obj->SocketCache[Socket];
+    same_port = cache->Valid && (cache->RemotePort == Port);
+    if (same_port && (memcmp(cache->RemoteIP, IPaddr, 4) == 0))
+    {
+      return ES_WIFI_STATUS_OK;
+    }
+    cache->Valid = 0;
+  }
+
+  // ? Are we sure that the Firmware can change the packet destination without stopping the socket?
+  if (!same_port)
+  {
+    sprintf((char*)Obj->CmdData,"P4=%d\r", Port);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  }
+
+  if (ret == ES_WIFI_STATUS_OK)
+  {
+    sprintf((char*)Obj->CmdData,"P3=%d.%d.%d.%d\r", IPaddr[0], IPaddr[1], IPaddr[2], IPaddr[3]);
+    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  }
+
+  if ((ret == ES_WIFI_STATUS_OK) && (cache != NULL))
+  {
+    memcpy(cache->RemoteIP, IPaddr, 4);
+    cache->RemotePort = Port;
+    cache->Valid = 1;
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  Send one datagram (S3) on the selected socket.
+  * @param  Obj: pointer to the module handle
+  * @param  pdata: pointer to data
+  * @param  Reqlen: length of the data, at most ES_WIFI_PAYLOAD_SIZE
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_SendDatagram(ES_WIFIObject_t *Obj, const uint8_t *pdata, uint16_t Reqlen)
+{
+  ES_WIFI_Status_t ret;
+
+  sprintf((char *)Obj->CmdData, "S3=%04d\r", Reqlen);
+  ret = AT_RequestSendData(Obj, Obj->CmdData, pdata, Reqlen, Obj->CmdData);
+
+  if (ret == ES_WIFI_STATUS_OK)
+  {
+    char *ptr = strstr((char *)Obj->CmdData,"-1\r\n");
+    if (ptr != NULL)
+    {
+      if (ptr < (char *)&Obj->CmdData[sizeof(Obj->CmdData)])
+      {
+        ret = ES_WIFI_STATUS_ERROR;
+      }
+      else
+      {
+        ret = ES_WIFI_STATUS_IO_ERROR;
+      }
+    }
+  }
+
+  return ret;
+}
+
+
 /**
   * @brief  Initialize the WIFI module.
   * @param  Obj: pointer to the module handle
@@ -910,6 +1099,7 @@ ES_WIFI_Status_t ES_WIFI_Init(ES_WIFIObject_t *Obj)
   LOCK_WIFI();
 
   Obj->Timeout = ES_WIFI_TIMEOUT;
+  AT_InvalidateCache(Obj);
 
   if (Obj->fops.IO_Init != NULL) {
 
@@ -1478,6 +1668,7 @@ ES_WIFI_Status_t ES_WIFI_ResetToFactoryDefault(ES_WIFIObject_t *Obj)
 
   sprintf((char*)Obj->CmdData,"Z0\r");
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  AT_InvalidateCache(Obj);
 
   UNLOCK_WIFI();
 
@@ -1497,6 +1688,7 @@ ES_WIFI_Status_t ES_WIFI_ResetModule(ES_WIFIObject_t *Obj)
 
   sprintf((char*)Obj->CmdData,"ZR\r");
   ret = Obj->fops.IO_Send(Obj->CmdData, strlen((char*)Obj->CmdData), Obj->Timeout);
+  AT_InvalidateCache(Obj);
 
 #if (ES_WIFI_USE_UART == 0)
  if (ret == 3)
@@ -1525,6 +1717,7 @@ ES_WIFI_Status_t ES_WIFI_HardResetModule(ES_WIFIObject_t *Obj)
   {
     ret = Obj->fops.IO_Init(ES_WIFI_RESET);
   }
+  AT_InvalidateCache(Obj);
   UNLOCK_WIFI();
 
   return (ret > 0) ? ES_WIFI_STATUS_OK : ES_WIFI_STATUS_ERROR;
@@ -1746,8 +1939,8 @@ ES_WIFI_Status_t ES_WIFI_StartClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_Con
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  AT_InvalidateSocket(Obj, conn->Number);
+  ret = AT_SelectSocket(Obj, conn->Number);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
@@ -1802,8 +1995,8 @@ ES_WIFI_Status_t ES_WIFI_StopClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_Conn
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  AT_InvalidateSocket(Obj, conn->Number);
+  ret = AT_SelectSocket(Obj, conn->Number);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
@@ -1828,8 +2021,8 @@ ES_WIFI_Status_t ES_WIFI_StartAWSClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  AT_InvalidateSocket(Obj, conn->Number);
+  ret = AT_SelectSocket(Obj, conn->Number);
 
   if(ret == ES_WIFI_STATUS_OK)
   {
@@ -1896,8 +2089,8 @@ ES_WIFI_Status_t ES_WIFI_StartServerSingleConn(ES_WIFIObject_t *Obj, ES_WIFI_Con
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  AT_InvalidateSocket(Obj, conn->Number);
+  ret = AT_SelectSocket(Obj, conn->Number);
   if (ret != ES_WIFI_STATUS_OK)
   {
     UNLOCK_WIFI();
@@ -1968,6 +2161,9 @@ ES_WIFI_Status_t ES_WIFI_WaitServerConnection(ES_WIFIObject_t *Obj, uint32_t tim
   uint32_t      tstart;
   char          *ptr;
 
+  /* The module switches sockets to report an accepted connection. */
+  AT_InvalidateCache(Obj);
+
   tstart = HAL_GetTick();
   tlast = tstart + timeout;
   if (tlast < tstart)
@@ -2064,8 +2260,8 @@ ES_WIFI_Status_t ES_WIFI_CloseServerConnection(ES_WIFIObject_t *Obj, uint8_t soc
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData, "P0=%d\r", socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  AT_InvalidateSocket(Obj, socket);
+  ret = AT_SelectSocket(Obj, socket);
   if (ret != ES_WIFI_STATUS_OK)
   {
     DEBUG(" Can not select socket %s\n", Obj->CmdData);
@@ -2096,8 +2292,8 @@ ES_WIFI_Status_t ES_WIFI_StopServerSingleConn(ES_WIFIObject_t *Obj, uint8_t sock
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  AT_InvalidateSocket(Obj, socket);
+  ret = AT_SelectSocket(Obj, socket);
   if (ret != ES_WIFI_STATUS_OK)
   {
     DEBUG("Selecting socket failed: %s\n", Obj->CmdData);
@@ -2135,8 +2331,8 @@ ES_WIFI_Status_t ES_WIFI_StartServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    AT_InvalidateSocket(Obj, conn->Number);
+    ret = AT_SelectSocket(Obj, conn->Number);
     if (ret == ES_WIFI_STATUS_OK)
     {
       sprintf((char*)Obj->CmdData,"P1=%d\r", conn->Type);
@@ -2194,8 +2390,8 @@ ES_WIFI_Status_t ES_WIFI_StopServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_
 
  LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  AT_InvalidateSocket(Obj, conn->Number);
+  ret = AT_SelectSocket(Obj, conn->Number);
   if (ret != ES_WIFI_STATUS_OK)
   {
     UNLOCK_WIFI();
@@ -2286,12 +2482,10 @@ ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket,
   }
 
   *SentLen = Reqlen;
-  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, Socket);
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"S2=%lu\r",wkgTimeOut);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetWriteTimeout(Obj, Socket, wkgTimeOut);
 
     if (ret == ES_WIFI_STATUS_OK)
     {
@@ -2321,6 +2515,11 @@ ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket,
    DEBUG("P0 command failed\n");
   }
 
+  if (ret != ES_WIFI_STATUS_OK)
+  {
+    AT_InvalidateCache(Obj);
+  }
+
   if (ret == ES_WIFI_STATUS_ERROR)
   {
     *SentLen = 0;
@@ -2332,13 +2531,66 @@ ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket,
 }
 
 
+/**
+  * @brief  Send a datagram to a remote host over WIFI.
+  *         The socket selection, destination and write timeout are only programmed
+  *         when they differ from the previous datagram on this socket.
+  * @param  Obj: pointer to the module handle
+  * @param  Socket: number of the socket
+  * @param  pdata: pointer to data
+  * @param  Reqlen : length of the data given as parameter
+  * @param  SentLen : length of the data actually sent
+  * @param  Timeout : write timeout in ms
+  * @param  IPaddr : remote IP address
+  * @param  Port : remote port
+  * @retval Operation Status.
+  */
 ES_WIFI_Status_t ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, const uint8_t *pdata, uint16_t Reqlen,
                                     uint16_t *SentLen, uint32_t Timeout, const uint8_t *IPaddr, uint16_t Port)
+{
+  uint16_t sent = 0;
+  ES_WIFI_Status_t ret;
+
+  ret = ES_WIFI_SendDataToMany(Obj, Socket, &pdata, &Reqlen, 1, &sent, Timeout, IPaddr, Port);
+
+  if (ret == ES_WIFI_STATUS_OK)
+  {
+    *SentLen = (Reqlen >= ES_WIFI_PAYLOAD_SIZE) ? ES_WIFI_PAYLOAD_SIZE : Reqlen;
+  }
+  else
+  {
+    *SentLen = 0;
+  }
+
+  return ret;
+}
+
+
+/**
+  * @brief  Send a burst of datagrams to one remote host over WIFI, with a single
+  *         socket and destination setup for the whole burst.
+  * @param  Obj: pointer to the module handle
+  * @param  Socket: number of the socket
+  * @param  pdata: array of Count pointers to the datagrams
+  * @param  Reqlen : array of Count datagram lengths, each clamped to ES_WIFI_PAYLOAD_SIZE
+  * @param  Count : number of datagrams
+  * @param  SentCount : number of datagrams actually sent
+  * @param  Timeout : write timeout in ms
+  * @param  IPaddr : remote IP address
+  * @param  Port : remote port
+  * @retval Operation Status, of the first datagram that failed.
+  */
+ES_WIFI_Status_t ES_WIFI_SendDataToMany(ES_WIFIObject_t *Obj, uint8_t Socket, const uint8_t *const pdata[],
+                                        const uint16_t Reqlen[], uint16_t Count, uint16_t *SentCount,
+                                        uint32_t Timeout, const uint8_t *IPaddr, uint16_t Port)
 {
   uint32_t wkgTimeOut;
+  uint16_t i;
 
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_ERROR;
 
+  *SentCount = 0;
+
   if (Timeout == 0)
   {
     wkgTimeOut = NET_DEFAULT_NOBLOCKING_WRITE_TIMEOUT;
@@ -2350,72 +2602,31 @@ ES_WIFI_Status_t ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, const
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
-
-  if (ret == ES_WIFI_STATUS_OK)
-  {
-    sprintf((char*)Obj->CmdData,"P2=%d\r", /*LocalPort*/ 56830 ); // WARN: Does not work!
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
-  }
-
-  // ? Are we sure that the Firmware can change the packet destination without stopping the socket?
-  if (ret == ES_WIFI_STATUS_OK)
-  {
-    sprintf((char*)Obj->CmdData,"P4=%d\r", Port);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
-  }
+  ret = AT_SelectSocket(Obj, Socket);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"P3=%d.%d.%d.%d\r", IPaddr[0], IPaddr[1], IPaddr[2], IPaddr[3]);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetDestination(Obj, Socket, IPaddr, Port);
   }
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    if(Reqlen >= ES_WIFI_PAYLOAD_SIZE )
-    {
-      Reqlen= ES_WIFI_PAYLOAD_SIZE;
-    }
-  }
-
-  if(ret == ES_WIFI_STATUS_OK)
-  {
-    sprintf((char*)Obj->CmdData, "S2=%lu\r", wkgTimeOut);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
-  }
-
-  if(ret == ES_WIFI_STATUS_OK)
-  {
-    sprintf((char *)Obj->CmdData, "S3=%04d\r", Reqlen);
-    ret = AT_RequestSendData(Obj, Obj->CmdData, pdata, Reqlen, Obj->CmdData);
+    ret = AT_SetWriteTimeout(Obj, Socket, wkgTimeOut);
   }
 
-  if (ret == ES_WIFI_STATUS_OK)
+  for (i = 0; (ret == ES_WIFI_STATUS_OK) && (i < Count); i++)
   {
-    char *ptr = strstr((char *)Obj->CmdData,"-1\r\n");
-    if (ptr != NULL)
+    ret = AT_SendDatagram(Obj, pdata[i], (Reqlen[i] >= ES_WIFI_PAYLOAD_SIZE) ? ES_WIFI_PAYLOAD_SIZE : Reqlen[i]);
+    if (ret == ES_WIFI_STATUS_OK)
     {
-      if (ptr < (char *)&Obj->CmdData[sizeof(Obj->CmdData)])
-      {
-        ret = ES_WIFI_STATUS_ERROR;
-      }
-      else
-      {
-        ret = ES_WIFI_STATUS_IO_ERROR;
-      }
+      (*SentCount)++;
     }
   }
 
-  if (ret == ES_WIFI_STATUS_OK)
-  {
-    *SentLen = Reqlen;
-  }
-  else
+  if (ret != ES_WIFI_STATUS_OK)
   {
     DEBUG("Send error:\n%s\n", Obj->CmdData);
-    *SentLen = 0;
+    AT_InvalidateCache(Obj);
   }
 
   UNLOCK_WIFI();
@@ -2423,8 +2634,6 @@ ES_WIFI_Status_t ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, const
   return ret;
 }
 
-int issue15=0;
-
 /**
   * @brief  Receive an amount data over WIFI.
   * @param  Obj: pointer to module handle
@@ -2453,8 +2662,7 @@ ES_WIFI_Status_t ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
 
   if (Reqlen <= ES_WIFI_PAYLOAD_SIZE)
   {
-    sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SelectSocket(Obj, Socket);
 
     if (ret == ES_WIFI_STATUS_OK)
     {
@@ -2487,7 +2695,7 @@ ES_WIFI_Status_t ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
     else
     {
       DEBUG("Setting socket for read failed\n");
-      issue15++;
+      STATS_INC(SocketErrors);
     }
   }
 
@@ -2520,8 +2728,7 @@ ES_WIFI_Status_t ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket, u
 
   if (Reqlen <= ES_WIFI_PAYLOAD_SIZE)
   {
-    sprintf((char*)Obj->CmdData, "P0=%d\r", Socket);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SelectSocket(Obj, Socket);
   }
 
   if (ret == ES_WIFI_STATUS_OK)
@@ -2593,6 +2800,29 @@ ES_WIFI_Status_t ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket, u
 }
 
 
+/**
+  * @brief  Select a credential set already stored in the module, without writing it again.
+  * @param  Obj: pointer to the module handle
+  * @param  credsFunction: function the set is used for
+  * @param  credSet: credential set number
+  * @retval Operation Status.
+  */
+ES_WIFI_Status_t ES_WIFI_SelectCreds(ES_WIFIObject_t *Obj,
+                                     ES_WIFI_CredsFunction_t credsFunction, uint8_t credSet)
+{
+  ES_WIFI_Status_t ret;
+
+  LOCK_WIFI();
+
+  sprintf((char *)Obj->CmdData, "PF=%d,%d\r", credsFunction, credSet);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+
+  UNLOCK_WIFI();
+
+  return ret;
+}
+
+
 ES_WIFI_Status_t ES_WIFI_StoreCreds(ES_WIFIObject_t *Obj,
                                     ES_WIFI_CredsFunction_t credsFunction, uint8_t credSet,
                                     uint8_t* ca, uint16_t caLength,
@@ -23,6 +23,7 @@
 #include "es_wifi_io.h"
 #include <string.h>
 #include "es_wifi_conf.h"
+#include "stats.h"
 #include <core_cm4.h>
 
 /* Private define ------------------------------------------------------------*/
@@ -373,6 +374,7 @@ int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
   }
   WIFI_DISABLE_NSS();
   UNLOCK_SPI();
+  STATS_ADD(SpiRxBytes, length);
   return length;
 }
 
@@ -424,6 +426,7 @@ int16_t SPI_WIFI_SendData(const uint8_t *pdata, uint16_t len, uint32_t timeout)
     }
     wait_spi_tx_event(timeout);
   }
+  STATS_ADD(SpiTxBytes, len);
   return len;
 }
 
@@ -506,6 +509,7 @@ void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
   */
 void    SPI_WIFI_ISR(void)
 {
+   STATS_INC(DataReadyIrqs);
    if (cmddata_rdy_rising_event == 1)
    {
      SEM_SIGNAL(cmddata_rdy_rising_sem);
@@ -0,0 +1,411 @@
+/**
+  ******************************************************************************
+  * @file    logging.c
+  * @brief   Console output through a RAM ring drained by UART DMA.
+  * @attention
+  * Head and Tail run freely and are masked on use. The writer only moves
+  * Head, once the text is in place; the TX completion interrupt only moves
+  * Tail, by the length of the transfer that finished. A transfer is started
+  * by the writer when none is running, and by the completion interrupt for
+  * what was queued meanwhile, so at most one is in flight.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "logging.h"
+
+/* Private define ------------------------------------------------------------*/
+#define LOG_MASK                 (LOG_BUFFER_SIZE - 1U)
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t LogBuffer[LOG_BUFFER_SIZE];
+static volatile uint32_t LogHead;
+static volatile uint32_t LogTail;
+static volatile uint32_t LogSending;     /* bytes in the running transfer, 0 if idle */
+static UART_HandleTypeDef *LogUart;
+static DMA_HandleTypeDef hLogDmaTx;
+static uint8_t LogRunLevel = LOG_LEVEL;
+static uint8_t LogBlocking;
+static Log_Stats_t LogStats;
+static char LogLine[LOG_LINE_SIZE];     /* Log_Putc() text not queued yet */
+static uint32_t LogLineLen;
+
+static const char LogLevelTag[] = "-EWID";
+
+/* Private function prototypes -----------------------------------------------*/
+static void Log_Kick(void);
+static uint32_t Log_Queue(const char *pdata, uint32_t Length);
+static void Log_PutLine(void);
+static uint32_t Log_RamSpan(uint32_t Address);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Start sending the oldest queued text if the UART is idle.
+  * @note   Called by the writer and by the TX completion interrupt.
+  * @retval None
+  */
+static void Log_Kick(void)
+{
+  uint32_t tail = LogTail;
+  uint32_t len = LogHead - tail;
+  uint32_t offset = tail & LOG_MASK;
+
+  if ((LogSending != 0) || (LogUart == NULL) || (len == 0))
+  {
+    return;
+  }
+  if (offset + len > LOG_BUFFER_SIZE)
+  {
+    len = LOG_BUFFER_SIZE - offset;   /* the rest follows from the start */
+  }
+  if (len > 0xFFFF)
+  {
+    len = 0xFFFF;
+  }
+
+  LogSending = len;
+  if (HAL_UART_Transmit_DMA(LogUart, &LogBuffer[offset], (uint16_t)len) != HAL_OK)
+  {
+    LogSending = 0;
+  }
+}
+
+/**
+  * @brief  Copy text into the ring, whole or not at all.
+  * @param  pdata: text
+  * @param  Length: number of bytes
+  * @retval Bytes queued: Length, or 0 if the text was dropped
+  */
+static uint32_t Log_Queue(const char *pdata, uint32_t Length)
+{
+  uint32_t head = LogHead;
+  uint32_t offset = head & LOG_MASK;
+  uint32_t first, used;
+
+  if (__get_IPSR() != 0)
+  {
+    LogStats.DroppedIsr += Length;
+    return 0;
+  }
+  if (Length > LOG_BUFFER_SIZE)
+  {
+    LogStats.Dropped += Length;
+    return 0;
+  }
+  while (LOG_BUFFER_SIZE - (head - LogTail) < Length)
+  {
+    if (!LogBlocking || (LogUart == NULL) || (__get_PRIMASK() != 0))
+    {
+      LogStats.Dropped += Length;
+      return 0;
+    }
+    Log_Kick();
+  }
+
+  first = LOG_BUFFER_SIZE - offset;
+  if (first > Length)
+  {
+    first = Length;
+  }
+  memcpy(&LogBuffer[offset], pdata, first);
+  memcpy(&LogBuffer[0], pdata + first, Length - first);
+  __DMB();                        /* text in place before the reader sees it */
+  LogHead = head + Length;
+  LogStats.Written += Length;
+  used = head + Length - LogTail;
+  if (used > LogStats.HighWater)
+  {
+    LogStats.HighWater = used;    /* the running transfer included */
+  }
+  return Length;
+}
+
+/**
+  * @brief  Queue the text collected by Log_Putc() in one piece, so that a
+  *         full ring drops the whole line rather than some of its characters.
+  * @retval None
+  */
+static void Log_PutLine(void)
+{
+  if (LogLineLen != 0)
+  {
+    Log_Queue(LogLine, LogLineLen);
+    LogLineLen = 0;
+  }
+}
+
+/**
+  * @brief  Tell whether a deferred argument points into SRAM1 or SRAM2.
+  * @param  Address: argument value
+  * @retval Bytes from Address to the end of its SRAM, 0 if not in SRAM
+  */
+static uint32_t Log_RamSpan(uint32_t Address)
+{
+  if (Address - SRAM1_BASE < SRAM1_SIZE_MAX)
+  {
+    return SRAM1_BASE + SRAM1_SIZE_MAX - Address;
+  }
+  if (Address - SRAM2_BASE < SRAM2_SIZE)
+  {
+    return SRAM2_BASE + SRAM2_SIZE - Address;
+  }
+  return 0;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Send the console through the ring, on a UART already set up by
+  *         BSP_COM_Init(). Before this call the text is queued only.
+  * @param  huart: COM1 handle
+  * @retval None
+  */
+void Log_Init(UART_HandleTypeDef *huart)
+{
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  hLogDmaTx.Instance                 = LOG_DMA_CHANNEL;
+  hLogDmaTx.Init.Request             = LOG_DMA_REQUEST;
+  hLogDmaTx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  hLogDmaTx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hLogDmaTx.Init.MemInc              = DMA_MINC_ENABLE;
+  hLogDmaTx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hLogDmaTx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hLogDmaTx.Init.Mode                = DMA_NORMAL;
+  hLogDmaTx.Init.Priority            = DMA_PRIORITY_LOW;
+  HAL_DMA_Init(&hLogDmaTx);
+  __HAL_LINKDMA(huart, hdmatx, hLogDmaTx);
+
+  /* The transfer ends on the USART transmission complete interrupt */
+  HAL_NVIC_SetPriority(LOG_DMA_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(LOG_DMA_IRQn);
+  HAL_NVIC_SetPriority(USART1_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(USART1_IRQn);
+
+  LogUart = huart;
+  Log_Kick();
+}
+
+/**
+  * @brief  Queue text for the UART, after the part of a line Log_Putc()
+  *         holds so that the order is kept.
+  * @param  pdata: text
+  * @param  Length: number of bytes
+  * @retval Bytes queued: Length, or 0 if the text was dropped
+  */
+uint32_t Log_Write(const char *pdata, uint32_t Length)
+{
+  if (__get_IPSR() == 0)
+  {
+    Log_PutLine();
+  }
+  return Log_Queue(pdata, Length);
+}
+
+/**
+  * @brief  Add one character to the current line, for the printf()
+  *         retargeting. The line is queued and the UART started at its end;
+  *         a line longer than LOG_LINE_SIZE is queued in pieces.
+  * @param  ch: character
+  * @retval ch
+  */
+int Log_Putc(int ch)
+{
+  if (__get_IPSR() != 0)
+  {
+    LogStats.DroppedIsr++;
+    return ch;
+  }
+
+  LogLine[LogLineLen++] = (char)ch;
+  if ((ch == '\n') || (LogLineLen == sizeof(LogLine)))
+  {
+    Log_PutLine();
+  }
+  if (ch == '\n')
+  {
+    Log_Kick();
+  }
+  return ch;
+}
+
+/**
+  * @brief  Start sending what is queued without waiting for the end of the
+  *         line, e.g. a prompt or an echoed character.
+  * @retval None
+  */
+void Log_Flush(void)
+{
+  Log_PutLine();
+  Log_Kick();
+}
+
+/**
+  * @brief  Format a line with a "<tick> <level> " prefix and queue it.
+  * @param  Level: LOG_LEVEL_ERROR ... LOG_LEVEL_DEBUG
+  * @param  format: printf() format; lines longer than LOG_LINE_SIZE are cut
+  * @retval None
+  */
+void Log_Printf(uint8_t Level, const char *format, ...)
+{
+  char line[LOG_LINE_SIZE];
+  va_list args;
+  int len;
+
+  if (Level > LogRunLevel)
+  {
+    LogStats.Skipped++;
+    return;
+  }
+
+  len = snprintf(line, sizeof(line), "%lu %c ", (unsigned long)HAL_GetTick(),
+                 LogLevelTag[(Level < sizeof(LogLevelTag) - 1) ? Level : 0]);
+  va_start(args, format);
+  len += vsnprintf(line + len, sizeof(line) - len, format, args);
+  va_end(args);
+  if (len > (int)sizeof(line) - 1)
+  {
+    len = sizeof(line) - 1;
+    line[len - 1] = '\n';
+  }
+
+  Log_Write(line, len);
+  Log_Kick();
+}
+
+/**
+  * @brief  Queue a deferred record, formatted on the host by logdecode.
+  * @note   Use LOG_DEFER(), which counts the arguments.
+  * @param  Level: LOG_LEVEL_ERROR ... LOG_LEVEL_DEBUG
+  * @param  Count: number of arguments, up to LOG_DEFER_MAX_ARGS
+  * @param  format: printf() format, in flash
+  * @retval None
+  */
+void Log_Defer(uint8_t Level, uint32_t Count, const char *format, ...)
+{
+  uint8_t record[LOG_DEFER_HEADER_SIZE + LOG_DEFER_MAX_ARGS * (4 + 1 + LOG_DEFER_STRING_SIZE)];
+  uint8_t *arg = &record[LOG_DEFER_HEADER_SIZE];
+  uint8_t *end = arg + 4 * Count;
+  uint32_t tick = HAL_GetTick();
+  uint32_t address = (uint32_t)format;
+  uint8_t mask = 0;
+  va_list args;
+  uint32_t i;
+
+  if ((Level > LogRunLevel) || (Count > LOG_DEFER_MAX_ARGS))
+  {
+    LogStats.Skipped++;
+    return;
+  }
+
+  va_start(args, format);
+  for (i = 0; i < Count; i++, arg += 4)
+  {
+    uint32_t value = va_arg(args, uint32_t);
+    uint32_t span = Log_RamSpan(value);
+
+    memcpy(arg, &value, 4);
+    if (span != 0)
+    {
+      /* A buffer in RAM may have changed by the time the host reads it */
+      const char *s = (const char *)value;
+      uint32_t len = 0;
+
+      span = (span < LOG_DEFER_STRING_SIZE) ? span : LOG_DEFER_STRING_SIZE;
+      while ((len < span) && (s[len] != '\0'))
+      {
+        len++;
+      }
+      end[0] = (uint8_t)len;
+      memcpy(&end[1], s, len);
+      end += 1 + len;
+      mask |= 1U << i;
+    }
+  }
+  va_end(args);
+
+  record[0] = LOG_DEFER_MARKER;
+  record[1] = (uint8_t)((Level << 4) | Count);
+  record[2] = mask;
+  memcpy(&record[3], &tick, 4);
+  memcpy(&record[7], &address, 4);
+
+  Log_Write((const char *)record, end - record);
+  Log_Kick();
+}
+
+/**
+  * @brief  Set the run-time level; LOG_LEVEL still bounds it.
+  * @param  Level: LOG_LEVEL_NONE ... LOG_LEVEL_DEBUG
+  * @retval None
+  */
+void Log_SetLevel(uint8_t Level)
+{
+  LogRunLevel = Level;
+}
+
+/**
+  * @brief  Wait for room instead of dropping text, e.g. for a long dump.
+  * @param  Enable: 1 to wait, 0 to drop
+  * @retval None
+  */
+void Log_SetBlocking(uint8_t Enable)
+{
+  LogBlocking = Enable;
+}
+
+/**
+  * @brief  Tell whether everything queued was sent, and start sending a
+  *         line still waiting for its end. The DMA does not run in Stop 2,
+  *         so the MCU only enters it once the ring is empty.
+  * @retval 1 if idle, 0 while text is queued or being sent
+  */
+uint32_t Log_IsIdle(void)
+{
+  Log_PutLine();
+  Log_Kick();
+  return (LogUart == NULL) || (LogHead == LogTail);
+}
+
+/**
+  * @brief  Read the counters.
+  * @param  pStats: counters since start-up
+  * @retval None
+  */
+void Log_GetStats(Log_Stats_t *pStats)
+{
+  *pStats = LogStats;
+}
+
+/**
+  * @brief  UART transmission complete: release the chunk and send the next.
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  if (huart == LogUart)
+  {
+    LogTail += LogSending;
+    LogSending = 0;
+    Log_Kick();
+  }
+}
+
+/**
+  * @brief  UART error: the chunk being sent is given up.
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+  if ((huart == LogUart) && (LogSending != 0) && (huart->gState == HAL_UART_STATE_READY))
+  {
+    LogStats.Dropped += LogSending;
+    LogTail += LogSending;
+    LogSending = 0;
+    Log_Kick();
+  }
+}
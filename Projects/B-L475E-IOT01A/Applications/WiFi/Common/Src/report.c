@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    report.c
+  * @brief   Report by exception: deadband filtering of telemetry channels.
+  * @attention
+  * With both an absolute and a relative deadband set, a change is reported
+  * as soon as it exceeds either. With neither set, any change is reported.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "report.h"
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Set up a channel that has not reported yet.
+  * @param  pChannel: channel
+  * @param  Key: telemetry key of the channel
+  * @param  Deadband: absolute change reported, in scaled units; 0 for none
+  * @param  DeadbandPct: relative change reported, in 0.01 %; 0 for none
+  * @param  MinInterval: ms between reports
+  * @param  MaxInterval: ms until an unchanged value is reported again; 0 never
+  * @retval None
+  */
+void Report_Init(Report_Channel_t *pChannel, uint8_t Key, int32_t Deadband,
+                 uint16_t DeadbandPct, uint32_t MinInterval, uint32_t MaxInterval)
+{
+  pChannel->Key = Key;
+  pChannel->Deadband = Deadband;
+  pChannel->DeadbandPct = DeadbandPct;
+  pChannel->MinInterval = MinInterval;
+  pChannel->MaxInterval = MaxInterval;
+  pChannel->Last = 0;
+  pChannel->LastTime = 0;
+  pChannel->Valid = 0;
+}
+
+/**
+  * @brief  Decide whether a reading is reported.
+  * @param  pChannel: channel
+  * @param  Now: current time, ms
+  * @param  Value: scaled reading
+  * @retval 1 for the first reading, a change out of the deadband once
+  *         MinInterval has passed, or any reading after MaxInterval; else 0
+  */
+uint32_t Report_IsDue(const Report_Channel_t *pChannel, uint32_t Now, int32_t Value)
+{
+  uint32_t elapsed = Now - pChannel->LastTime;
+  int64_t change = (int64_t)Value - pChannel->Last;
+  int64_t last = pChannel->Last;
+
+  if (!pChannel->Valid)
+  {
+    return 1;
+  }
+  if (elapsed < pChannel->MinInterval)
+  {
+    return 0;
+  }
+  if ((pChannel->MaxInterval != 0) && (elapsed >= pChannel->MaxInterval))
+  {
+    return 1;
+  }
+
+  change = (change < 0) ? -change : change;
+  last = (last < 0) ? -last : last;
+  if ((pChannel->Deadband == 0) && (pChannel->DeadbandPct == 0))
+  {
+    return (change != 0);
+  }
+  return ((pChannel->Deadband != 0) && (change >= pChannel->Deadband)) ||
+         ((pChannel->DeadbandPct != 0) && (change != 0) && (change * 10000 >= last * pChannel->DeadbandPct));
+}
+
+/**
+  * @brief  Record a reading as reported.
+  * @param  pChannel: channel
+  * @param  Now: time of the report, ms
+  * @param  Value: scaled reading that was published
+  * @retval None
+  */
+void Report_Commit(Report_Channel_t *pChannel, uint32_t Now, int32_t Value)
+{
+  pChannel->Last = Value;
+  pChannel->LastTime = Now;
+  pChannel->Valid = 1;
+}
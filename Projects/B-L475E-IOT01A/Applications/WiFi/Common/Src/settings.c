@@ -0,0 +1,132 @@
+/**
+  ******************************************************************************
+  * @file    settings.c
+  * @brief   Run-time configuration kept in the last flash pages.
+  * @attention
+  * Flash is programmed by double words, so the structure is copied into a
+  * zero-padded buffer of whole double words first.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stddef.h>
+#include <string.h>
+#include "settings.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SETTINGS_WORDS           ((sizeof(Settings_t) + 7) / 8)
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Settings_Crc(const Settings_t *pSettings);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  CRC-32 (IEEE 802.3, reflected) of the fields before Crc.
+  * @param  pSettings: settings
+  * @retval CRC
+  */
+static uint32_t Settings_Crc(const Settings_t *pSettings)
+{
+  const uint8_t *p = (const uint8_t *)pSettings;
+  uint32_t crc = 0xFFFFFFFFU;
+  uint32_t i, bit;
+
+  for (i = 0; i < offsetof(Settings_t, Crc); i++)
+  {
+    crc ^= p[i];
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+    }
+  }
+  return ~crc;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Tell whether flash holds settings of this layout.
+  * @retval 1 if Settings_Load() would succeed, else 0
+  */
+uint32_t Settings_IsStored(void)
+{
+  const Settings_t *stored = (const Settings_t *)SETTINGS_FLASH_ADDRESS;
+
+  return (stored->Magic == SETTINGS_MAGIC) && (stored->Version == SETTINGS_VERSION) &&
+         (stored->Size == sizeof(Settings_t)) && (stored->Crc == Settings_Crc(stored));
+}
+
+/**
+  * @brief  Replace the settings by the copy saved in flash, if any.
+  * @param  pSettings: settings, left as they are if nothing valid is stored
+  * @retval 0 if loaded, -1 if flash holds no valid copy
+  */
+int32_t Settings_Load(Settings_t *pSettings)
+{
+  if (!Settings_IsStored())
+  {
+    return -1;
+  }
+  memcpy(pSettings, (const void *)SETTINGS_FLASH_ADDRESS, sizeof(Settings_t));
+  return 0;
+}
+
+/**
+  * @brief  Save the settings to flash.
+  * @param  pSettings: settings; Magic, Version, Size and Crc are filled in
+  * @retval 0 on success, -1 if erasing or programming failed
+  */
+int32_t Settings_Save(Settings_t *pSettings)
+{
+  uint64_t words[SETTINGS_WORDS];
+  uint32_t i;
+  int32_t ret = 0;
+
+  pSettings->Magic = SETTINGS_MAGIC;
+  pSettings->Version = SETTINGS_VERSION;
+  pSettings->Size = sizeof(Settings_t);
+  pSettings->Crc = Settings_Crc(pSettings);
+
+  memset(words, 0, sizeof(words));
+  memcpy(words, pSettings, sizeof(Settings_t));
+
+  if (Settings_Erase() != 0)
+  {
+    return -1;
+  }
+  HAL_FLASH_Unlock();
+  for (i = 0; (i < SETTINGS_WORDS) && (ret == 0); i++)
+  {
+    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, SETTINGS_FLASH_ADDRESS + 8 * i, words[i]) != HAL_OK)
+    {
+      ret = -1;
+    }
+  }
+  HAL_FLASH_Lock();
+
+  return (ret == 0) && Settings_IsStored() ? 0 : -1;
+}
+
+/**
+  * @brief  Erase the saved copy; the built-in defaults apply from the next
+  *         start.
+  * @retval 0 on success, -1 on error
+  */
+int32_t Settings_Erase(void)
+{
+  FLASH_EraseInitTypeDef erase;
+  uint32_t offset = SETTINGS_FLASH_ADDRESS - FLASH_BASE;
+  uint32_t page_error;
+  HAL_StatusTypeDef status;
+
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.Banks = (offset < FLASH_BANK_SIZE) ? FLASH_BANK_1 : FLASH_BANK_2;
+  erase.Page = (offset % FLASH_BANK_SIZE) / FLASH_PAGE_SIZE;
+  erase.NbPages = (sizeof(Settings_t) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+  status = HAL_FLASHEx_Erase(&erase, &page_error);
+  HAL_FLASH_Lock();
+
+  return (status == HAL_OK) ? 0 : -1;
+}
@@ -0,0 +1,289 @@
+/**
+  ******************************************************************************
+  * @file    shell.c
+  * @brief   Command shell on the console UART, received by circular DMA.
+  * @attention
+  * The DMA counter gives the write position in ShellRx; ShellRxTail is the
+  * read position of Shell_Poll(). Both only move forward around the ring,
+  * so more than SHELL_RX_SIZE bytes typed between two polls are lost,
+  * which a terminal at typing speed never does. The reception event only
+  * flags new input and keeps the shell awake.
+  * Echo, prompt and command output go through the log ring (logging.h),
+  * which waits for room while a command runs instead of dropping its text.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "shell.h"
+#include "logging.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SHELL_PROMPT             "> "
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t ShellRx[SHELL_RX_SIZE];
+static uint32_t ShellRxTail;
+static char ShellLine[SHELL_LINE_SIZE];
+static uint32_t ShellLineLen;
+static uint8_t ShellLastCr;
+static volatile uint8_t ShellInput;
+static volatile uint32_t ShellLastRx;
+static UART_HandleTypeDef *ShellUart;
+static DMA_HandleTypeDef hShellDmaRx;
+static const Shell_Command_t *ShellCommands;
+static uint32_t ShellCount;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Shell_Start(void);
+static void Shell_Char(char c);
+static void Shell_Execute(char *line);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Start the circular reception from the start of ShellRx.
+  * @retval None
+  */
+static void Shell_Start(void)
+{
+  ShellRxTail = 0;
+  HAL_UARTEx_ReceiveToIdle_DMA(ShellUart, ShellRx, SHELL_RX_SIZE);
+}
+
+/**
+  * @brief  Edit the line with one received character.
+  * @param  c: character
+  * @retval None
+  */
+static void Shell_Char(char c)
+{
+  if ((c == '\r') || (c == '\n'))
+  {
+    /* CR LF is one end of line */
+    if ((c == '\r') || !ShellLastCr)
+    {
+      Log_Write("\r\n", 2);
+      ShellLine[ShellLineLen] = '\0';
+      Shell_Execute(ShellLine);
+      ShellLineLen = 0;
+      Log_Write(SHELL_PROMPT, sizeof(SHELL_PROMPT) - 1);
+    }
+  }
+  else if ((c == '\b') || (c == 0x7F))
+  {
+    if (ShellLineLen > 0)
+    {
+      ShellLineLen--;
+      Log_Write("\b \b", 3);
+    }
+  }
+  else if ((c >= ' ') && (c < 0x7F) && (ShellLineLen < SHELL_LINE_SIZE - 1))
+  {
+    ShellLine[ShellLineLen++] = c;
+    Log_Write(&c, 1);
+  }
+  ShellLastCr = (c == '\r');
+}
+
+/**
+  * @brief  Split a line into words and run its command.
+  * @param  line: NUL-terminated line, modified
+  * @retval None
+  */
+static void Shell_Execute(char *line)
+{
+  char *argv[SHELL_MAX_ARGS];
+  int argc = 0;
+  uint32_t i;
+
+  while (argc < SHELL_MAX_ARGS)
+  {
+    while (*line == ' ')
+    {
+      line++;
+    }
+    if (*line == '\0')
+    {
+      break;
+    }
+    argv[argc++] = line;
+    if (argc < SHELL_MAX_ARGS)
+    {
+      line += strcspn(line, " ");
+      if (*line != '\0')
+      {
+        *line++ = '\0';
+      }
+    }
+  }
+  if (argc == 0)
+  {
+    return;
+  }
+  /* The last word is the rest of the line, without trailing spaces */
+  i = strlen(argv[argc - 1]);
+  while ((i > 0) && (argv[argc - 1][i - 1] == ' '))
+  {
+    argv[argc - 1][--i] = '\0';
+  }
+
+  Log_SetBlocking(1);
+  if (strcmp(argv[0], "help") == 0)
+  {
+    for (i = 0; i < ShellCount; i++)
+    {
+      printf("%-8s %s\n", ShellCommands[i].Name, ShellCommands[i].Help);
+    }
+  }
+  else
+  {
+    for (i = 0; (i < ShellCount) && (strcmp(argv[0], ShellCommands[i].Name) != 0); i++)
+    {
+    }
+    if (i < ShellCount)
+    {
+      ShellCommands[i].Run(argc, argv);
+    }
+    else
+    {
+      printf("Unknown command \"%s\", type help\n", argv[0]);
+    }
+  }
+  Log_SetBlocking(0);
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Start receiving commands on a UART already set up by
+  *         BSP_COM_Init() and Log_Init().
+  * @param  huart: COM1 handle
+  * @param  pCommands: command table, kept
+  * @param  Count: number of commands
+  * @retval None
+  */
+void Shell_Init(UART_HandleTypeDef *huart, const Shell_Command_t *pCommands, uint32_t Count)
+{
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  __HAL_RCC_SYSCFG_CLK_ENABLE();
+
+  hShellDmaRx.Instance                 = SHELL_DMA_CHANNEL;
+  hShellDmaRx.Init.Request             = SHELL_DMA_REQUEST;
+  hShellDmaRx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  hShellDmaRx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hShellDmaRx.Init.MemInc              = DMA_MINC_ENABLE;
+  hShellDmaRx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hShellDmaRx.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+  hShellDmaRx.Init.Mode                = DMA_CIRCULAR;
+  hShellDmaRx.Init.Priority            = DMA_PRIORITY_LOW;
+  HAL_DMA_Init(&hShellDmaRx);
+  __HAL_LINKDMA(huart, hdmarx, hShellDmaRx);
+
+  HAL_NVIC_SetPriority(SHELL_DMA_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(SHELL_DMA_IRQn);
+  HAL_NVIC_SetPriority(USART1_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(USART1_IRQn);
+
+  /* RX pin on EXTI line 7, falling edge (start bit); unmasked in Shell_IsIdle() */
+  SYSCFG->EXTICR[1] = (SYSCFG->EXTICR[1] & ~SYSCFG_EXTICR2_EXTI7) | SYSCFG_EXTICR2_EXTI7_PB;
+  EXTI->IMR1 &= ~SHELL_WAKE_PIN;
+  EXTI->FTSR1 |= SHELL_WAKE_PIN;
+  HAL_NVIC_SetPriority(SHELL_WAKE_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(SHELL_WAKE_IRQn);
+
+  ShellCommands = pCommands;
+  ShellCount = Count;
+  ShellUart = huart;
+  ShellLastRx = HAL_GetTick();   /* awake for a first session after reset */
+  Shell_Start();
+  Log_Write(SHELL_PROMPT, sizeof(SHELL_PROMPT) - 1);
+  Log_Flush();
+}
+
+/**
+  * @brief  Process what was received since the last call; run from the
+  *         main loop.
+  * @retval None
+  */
+void Shell_Poll(void)
+{
+  uint32_t head;
+
+  if (ShellUart == NULL)
+  {
+    return;
+  }
+  ShellInput = 0;
+  if (ShellUart->RxState == HAL_UART_STATE_READY)
+  {
+    Shell_Start();                /* stopped by a reception error */
+  }
+
+  head = SHELL_RX_SIZE - __HAL_DMA_GET_COUNTER(ShellUart->hdmarx);
+  if (head >= SHELL_RX_SIZE)
+  {
+    head = 0;
+  }
+  while (ShellRxTail != head)
+  {
+    Shell_Char((char)ShellRx[ShellRxTail]);
+    ShellRxTail = (ShellRxTail + 1) % SHELL_RX_SIZE;
+  }
+  Log_Flush();
+}
+
+/**
+  * @brief  Tell whether input arrived since the last Shell_Poll().
+  * @retval 1 if Shell_Poll() has something to do, else 0
+  */
+uint32_t Shell_HasInput(void)
+{
+  return ShellInput;
+}
+
+/**
+  * @brief  Tell whether the MCU may enter Stop 2, and arm the RX wake-up
+  *         if so.
+  * @retval 0 while the shell was used in the last SHELL_AWAKE_MS, else 1
+  */
+uint32_t Shell_IsIdle(void)
+{
+  if (ShellUart == NULL)
+  {
+    return 1;
+  }
+  if (ShellInput || ((HAL_GetTick() - ShellLastRx) < SHELL_AWAKE_MS))
+  {
+    return 0;
+  }
+  __HAL_GPIO_EXTI_CLEAR_IT(SHELL_WAKE_PIN);
+  EXTI->IMR1 |= SHELL_WAKE_PIN;
+  return 1;
+}
+
+/**
+  * @brief  RX edge while idle: stay awake for the session that starts.
+  * @note   Called from HAL_GPIO_EXTI_Callback() for SHELL_WAKE_PIN.
+  * @retval None
+  */
+void Shell_Wake(void)
+{
+  EXTI->IMR1 &= ~SHELL_WAKE_PIN;   /* not an interrupt per received bit */
+  ShellLastRx = HAL_GetTick();
+}
+
+/**
+  * @brief  Reception event: idle line, half or whole buffer filled.
+  * @param  huart: UART handle
+  * @param  Size: DMA position in the buffer
+  * @retval None
+  */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+  (void)Size;                     /* Shell_Poll() reads the DMA counter */
+  if (huart == ShellUart)
+  {
+    ShellInput = 1;
+    ShellLastRx = HAL_GetTick();
+  }
+}
@@ -0,0 +1,124 @@
+/**
+  ******************************************************************************
+  * @file    signal_features.c
+  * @brief   Signal features of 3-axis sensor windows, computed with CMSIS-DSP.
+  * @attention
+  * The band RMS values come from the Hann-windowed real FFT of each axis:
+  * twice the power of the bins in a band over N^2, corrected for the power
+  * lost to the window, so that the squares of all bands add up to about the
+  * sum of the squared per-axis RMS. DC and Nyquist bins are left out.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "signal_features.h"
+
+/* Private define ------------------------------------------------------------*/
+#define FEATURES_HANN_POWER      0.375f  /* mean of the squared Hann window */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Set up an empty window.
+  * @param  pWin: window state
+  * @param  SampleRate: sample rate of the input, Hz
+  * @retval 0, or -1 if FEATURES_WINDOW is not an FFT length CMSIS-DSP supports
+  */
+int32_t Features_Init(Features_Window_t *pWin, float32_t SampleRate)
+{
+  uint32_t i;
+
+  if (arm_rfft_fast_init_f32(&pWin->Fft, FEATURES_WINDOW) != ARM_MATH_SUCCESS)
+  {
+    return -1;
+  }
+  for (i = 0; i < FEATURES_WINDOW; i++)
+  {
+    pWin->Hann[i] = 0.5f - 0.5f * arm_cos_f32(2.0f * PI * i / FEATURES_WINDOW);
+  }
+  pWin->SampleRate = SampleRate;
+  pWin->Fill = 0;
+  return 0;
+}
+
+/**
+  * @brief  Collect samples until the window is full.
+  * @param  pWin: window state
+  * @param  pXYZ: interleaved X, Y, Z samples
+  * @param  Samples: number of X, Y, Z triplets in pXYZ
+  * @retval Triplets taken; fewer than Samples once the window is full, in
+  *         which case Features_Compute() empties it for the rest
+  */
+uint32_t Features_Add(Features_Window_t *pWin, const int16_t *pXYZ, uint32_t Samples)
+{
+  uint32_t n = FEATURES_WINDOW - pWin->Fill;
+  uint32_t i;
+
+  if (n > Samples)
+  {
+    n = Samples;
+  }
+  for (i = 0; i < n; i++, pXYZ += FEATURES_AXES)
+  {
+    pWin->Samples[0][pWin->Fill + i] = pXYZ[0];
+    pWin->Samples[1][pWin->Fill + i] = pXYZ[1];
+    pWin->Samples[2][pWin->Fill + i] = pXYZ[2];
+  }
+  pWin->Fill += n;
+  return n;
+}
+
+/**
+  * @brief  Reduce a full window to its features, and empty it.
+  * @param  pWin: window state
+  * @param  pFeatures: features of the window
+  * @retval 1 if the window was full and pFeatures is set, 0 otherwise
+  */
+int32_t Features_Compute(Features_Window_t *pWin, Features_t *pFeatures)
+{
+  const uint32_t bins = FEATURES_WINDOW / 2 - 1;   /* bins 1 .. N/2-1 */
+  float32_t power[FEATURES_BANDS];
+  float32_t mean, max, min;
+  uint32_t axis, band, i, index;
+
+  if (pWin->Fill < FEATURES_WINDOW)
+  {
+    return 0;
+  }
+  memset(power, 0, sizeof(power));
+
+  for (axis = 0; axis < FEATURES_AXES; axis++)
+  {
+    float32_t *x = pWin->Samples[axis];
+
+    /* Time domain, about the mean: gravity or the earth field is not vibration */
+    arm_mean_f32(x, FEATURES_WINDOW, &mean);
+    arm_offset_f32(x, -mean, x, FEATURES_WINDOW);
+    arm_rms_f32(x, FEATURES_WINDOW, &pFeatures->Rms[axis]);
+    arm_max_f32(x, FEATURES_WINDOW, &max, &index);
+    arm_min_f32(x, FEATURES_WINDOW, &min, &index);
+    pFeatures->Peak[axis] = (max >= -min) ? max : -min;
+    pFeatures->Crest[axis] = (pFeatures->Rms[axis] > 0.0f) ?
+                             pFeatures->Peak[axis] / pFeatures->Rms[axis] : 0.0f;
+
+    /* Frequency domain: the FFT output is packed as DC, Nyquist, then the
+       complex bins, and is squared in place */
+    arm_mult_f32(x, pWin->Hann, x, FEATURES_WINDOW);
+    arm_rfft_fast_f32(&pWin->Fft, x, pWin->Spectrum, 0);
+    arm_cmplx_mag_squared_f32(&pWin->Spectrum[2], pWin->Spectrum, bins);
+    for (i = 0; i < bins; i++)
+    {
+      power[i * FEATURES_BANDS / bins] += pWin->Spectrum[i];
+    }
+  }
+
+  for (band = 0; band < FEATURES_BANDS; band++)
+  {
+    arm_sqrt_f32(2.0f * power[band] / ((float32_t)FEATURES_WINDOW * FEATURES_WINDOW * FEATURES_HANN_POWER),
+                 &pFeatures->Band[band]);
+  }
+  pFeatures->BandWidth = pWin->SampleRate / 2.0f / FEATURES_BANDS;
+
+  pWin->Fill = 0;
+  return 1;
+}
@@ -0,0 +1,408 @@
+/**
+  ******************************************************************************
+  * @file    stats.c
+  * @brief   Run-time statistics of the Wi-Fi and MQTT layers.
+  * @attention
+  * AT round trips are timed with the DWT cycle counter, since most of them
+  * take a few ms; the CPU busy-waits on the SPI meanwhile, so the counter
+  * runs. Publish to acknowledgement times are in HAL_GetTick() ms: the
+  * packet identifier of each QoS 1 or 2 PUBLISH sent is kept with its time
+  * in StatsPending until the PUBACK or PUBCOMP with that identifier is read.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "stm32l4xx_hal.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "logging.h"
+
+/* Private define ------------------------------------------------------------*/
+/* QoS 1 and 2 PUBLISHes timed at once; a new one replaces the oldest */
+#define STATS_PENDING            4
+
+#define MQTT_PUBLISH             3
+#define MQTT_PUBACK              4
+#define MQTT_PUBCOMP             7
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  uint16_t Id;                   /* packet identifier, 0 if free */
+  uint32_t Sent;                 /* HAL_GetTick() */
+} Stats_Pending_t;
+
+/* Exported variables --------------------------------------------------------*/
+Stats_t Stats;
+
+/* Private variables ---------------------------------------------------------*/
+static Stats_Pending_t StatsPending[STATS_PENDING];
+static uint32_t StatsPendingNext;
+static uint32_t StatsAtStart;
+static Stats_AtCommand_t *StatsAtSlot;
+static uint32_t StatsCyclesPerUnit = 1;
+
+static const char *const StatsMqttNames[16] = {
+  "?", "CONNECT", "CONNACK", "PUBLISH", "PUBACK", "PUBREC", "PUBREL", "PUBCOMP",
+  "SUBSCRIBE", "SUBACK", "UNSUBSCRIBE", "UNSUBACK", "PINGREQ", "PINGRESP", "DISCONNECT", "?"
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static Stats_AtCommand_t *Stats_AtSlot(const uint8_t *pCmd);
+static uint32_t Stats_Trim(const uint32_t *pValues, uint32_t Count);
+static uint32_t Stats_Histogram(const Stats_Histogram_t *pHistogram, uint32_t *pValues);
+static uint32_t Stats_Percentile(const Stats_Histogram_t *pHistogram, uint32_t Percent);
+static void Stats_PrintPackets(const char *pName, const uint32_t *pCounts);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Find or take the slot of an AT command.
+  * @param  pCmd: command, e.g. "S3=12\r"
+  * @retval Its slot; the last one, kept for "other" from the start, for the
+  *         commands that found no room
+  */
+static Stats_AtCommand_t *Stats_AtSlot(const uint8_t *pCmd)
+{
+  uint16_t code = (uint16_t)(pCmd[0] << 8);
+  uint32_t i;
+
+  /* "R0\r" is R0, "Z\r" only Z */
+  if (((pCmd[1] >= '0') && (pCmd[1] <= '9')) || ((pCmd[1] >= 'A') && (pCmd[1] <= 'Z')) ||
+      ((pCmd[1] >= 'a') && (pCmd[1] <= 'z')) || (pCmd[1] == '?'))
+  {
+    code |= pCmd[1];
+  }
+  for (i = 0; i < Stats.AtTypes; i++)
+  {
+    if (Stats.At[i].Code == code)
+    {
+      return &Stats.At[i];
+    }
+  }
+  if (Stats.AtTypes < STATS_AT_TYPES - 1)
+  {
+    Stats.At[Stats.AtTypes].Code = code;
+    return &Stats.At[Stats.AtTypes++];
+  }
+  Stats.AtTypes = STATS_AT_TYPES;          /* "other", code 0 since Stats_Init() */
+  return &Stats.At[STATS_AT_TYPES - 1];
+}
+
+/**
+  * @brief  Number of values up to the last non-zero one.
+  * @param  pValues: values
+  * @param  Count: number of values
+  * @retval Count without the trailing zeros
+  */
+static uint32_t Stats_Trim(const uint32_t *pValues, uint32_t Count)
+{
+  while ((Count > 0) && (pValues[Count - 1] == 0))
+  {
+    Count--;
+  }
+  return Count;
+}
+
+/**
+  * @brief  Lay out a histogram as in the payload: the maximum, then the
+  *         buckets up to the last non-empty one.
+  * @param  pHistogram: histogram
+  * @param  pValues: room for 1 + STATS_BUCKETS values
+  * @retval Number of values
+  */
+static uint32_t Stats_Histogram(const Stats_Histogram_t *pHistogram, uint32_t *pValues)
+{
+  pValues[0] = pHistogram->Max;
+  memcpy(&pValues[1], pHistogram->Count, sizeof(pHistogram->Count));
+  return Stats_Trim(pValues, 1 + STATS_BUCKETS);
+}
+
+/**
+  * @brief  Bound of a percentile, to the resolution of the buckets.
+  * @param  pHistogram: histogram
+  * @param  Percent: 1 to 100
+  * @retval The percentile is below this value; the maximum if it falls in
+  *         the last bucket, 0 if nothing was counted
+  */
+static uint32_t Stats_Percentile(const Stats_Histogram_t *pHistogram, uint32_t Percent)
+{
+  uint32_t total = 0, seen = 0;
+  uint32_t k;
+
+  for (k = 0; k < STATS_BUCKETS; k++)
+  {
+    total += pHistogram->Count[k];
+  }
+  if (total == 0)
+  {
+    return 0;
+  }
+  for (k = 0; k < STATS_BUCKETS - 1; k++)
+  {
+    seen += pHistogram->Count[k];
+    if ((uint64_t)seen * 100U >= (uint64_t)total * Percent)
+    {
+      return 1UL << k;
+    }
+  }
+  return pHistogram->Max;
+}
+
+/**
+  * @brief  Print the non-zero packet counts.
+  * @param  pName: line header
+  * @param  pCounts: counts by packet type
+  * @retval None
+  */
+static void Stats_PrintPackets(const char *pName, const uint32_t *pCounts)
+{
+  uint32_t type;
+
+  printf("%s", pName);
+  for (type = 0; type < 16; type++)
+  {
+    if (pCounts[type] != 0)
+    {
+      printf(" %s %lu", StatsMqttNames[type], (unsigned long)pCounts[type]);
+    }
+  }
+  printf("\n");
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Clear the statistics and start the cycle counter, once the
+  *         system clock is set.
+  * @retval None
+  */
+void Stats_Init(void)
+{
+  memset(&Stats, 0, sizeof(Stats));
+  memset(StatsPending, 0, sizeof(StatsPending));
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  StatsCyclesPerUnit = SystemCoreClock / 1000000U * STATS_AT_UNIT_US;
+  if (StatsCyclesPerUnit == 0)
+  {
+    StatsCyclesPerUnit = 1;
+  }
+}
+
+/**
+  * @brief  Count a value in a histogram.
+  * @param  pHistogram: histogram
+  * @param  Value: value, in the unit of the histogram
+  * @retval None
+  */
+void Stats_Record(Stats_Histogram_t *pHistogram, uint32_t Value)
+{
+  uint32_t bucket = 32U - __CLZ(Value);   /* 0 for 0, k from 2^(k-1) to 2^k - 1 */
+
+  if (bucket >= STATS_BUCKETS)
+  {
+    bucket = STATS_BUCKETS - 1;
+  }
+  pHistogram->Count[bucket]++;
+  if (Value > pHistogram->Max)
+  {
+    pHistogram->Max = Value;
+  }
+}
+
+/**
+  * @brief  An AT command is about to be sent.
+  * @param  pCmd: command; the response may then overwrite it
+  * @retval None
+  */
+void Stats_AtBegin(const uint8_t *pCmd)
+{
+  StatsAtSlot = Stats_AtSlot(pCmd);
+  StatsAtStart = DWT->CYCCNT;
+}
+
+/**
+  * @brief  The response of the command given to Stats_AtBegin() was read.
+  * @param  Length: response length, 0 or negative if none came
+  * @retval None
+  */
+void Stats_AtEnd(int32_t Length)
+{
+  uint32_t units = (DWT->CYCCNT - StatsAtStart) / StatsCyclesPerUnit;
+
+  if (StatsAtSlot == NULL)
+  {
+    return;
+  }
+  if (Length <= 0)
+  {
+    StatsAtSlot->Errors++;
+    return;
+  }
+  Stats_Record(&StatsAtSlot->Latency, units);
+  if ((uint32_t)Length > Stats.AtResponseMax)
+  {
+    Stats.AtResponseMax = (uint32_t)Length;
+  }
+}
+
+/**
+  * @brief  Count an MQTT packet, and time the acknowledgement of a PUBLISH.
+  * @param  Received: 0 for a packet sent, 1 for a packet read
+  * @param  pPacket: packet, from the fixed header; a PUBLISH sent may lack
+  *         its payload
+  * @retval None
+  */
+void Stats_MqttPacket(uint8_t Received, const uint8_t *pPacket)
+{
+  uint32_t type = pPacket[0] >> 4;
+  uint32_t length = 0, shift = 0, n = 1;
+  const uint8_t *p;
+  uint16_t id;
+  uint8_t byte;
+  uint32_t i;
+
+  do
+  {
+    byte = pPacket[n++];
+    length |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while ((byte & 0x80) && (n < 5));
+  length += n;
+  p = &pPacket[n];                /* variable header */
+
+  if (!Received)
+  {
+    Stats.MqttTx[type]++;
+    if (length > Stats.MqttTxMax)
+    {
+      Stats.MqttTxMax = length;
+    }
+    if ((type == MQTT_PUBLISH) && (pPacket[0] & 0x06))
+    {
+      /* Topic name, then the packet identifier of a QoS 1 or 2 PUBLISH */
+      i = (p[0] << 8) | p[1];
+      StatsPending[StatsPendingNext].Id = (uint16_t)((p[2 + i] << 8) | p[3 + i]);
+      StatsPending[StatsPendingNext].Sent = HAL_GetTick();
+      StatsPendingNext = (StatsPendingNext + 1) % STATS_PENDING;
+    }
+    return;
+  }
+
+  Stats.MqttRx[type]++;
+  if (length > Stats.MqttRxMax)
+  {
+    Stats.MqttRxMax = length;
+  }
+  if ((type == MQTT_PUBACK) || (type == MQTT_PUBCOMP))
+  {
+    id = (uint16_t)((p[0] << 8) | p[1]);
+    for (i = 0; (i < STATS_PENDING) && (StatsPending[i].Id != id); i++)
+    {
+    }
+    if ((i < STATS_PENDING) && (id != 0))
+    {
+      Stats_Record(&Stats.PublishAck, HAL_GetTick() - StatsPending[i].Sent);
+      StatsPending[i].Id = 0;
+    }
+    else
+    {
+      Stats.UnmatchedAcks++;
+    }
+  }
+}
+
+/**
+  * @brief  Encode the statistics as a CBOR map (keys in stats.h).
+  * @param  pBuffer: payload buffer
+  * @param  Size: size of pBuffer
+  * @retval Payload length, or -1 if the counters did not fit; AT commands
+  *         that do not fit after them are left out
+  */
+int32_t Stats_Encode(uint8_t *pBuffer, uint32_t Size)
+{
+  Telemetry_Encoder_t enc;
+  Log_Stats_t log;
+  uint32_t values[3 + STATS_BUCKETS];
+  uint32_t i;
+
+  Log_GetStats(&log);
+  Telemetry_Begin(&enc, pBuffer, Size);
+  Telemetry_AddInt(&enc, STATS_UPTIME, HAL_GetTick() / 1000);
+  Telemetry_AddInt(&enc, STATS_CONNECTS, (int32_t)Stats.Connects);
+
+  values[0] = Stats.SpiTxBytes;
+  values[1] = Stats.SpiRxBytes;
+  values[2] = Stats.SpiIrqs;
+  values[3] = Stats.DataReadyIrqs;
+  Telemetry_AddArray(&enc, STATS_SPI, values, Stats_Trim(values, 4));
+  Telemetry_AddArray(&enc, STATS_MQTT_TX, Stats.MqttTx, Stats_Trim(Stats.MqttTx, 16));
+  Telemetry_AddArray(&enc, STATS_MQTT_RX, Stats.MqttRx, Stats_Trim(Stats.MqttRx, 16));
+  Telemetry_AddArray(&enc, STATS_PUBLISH_ACK, values, Stats_Histogram(&Stats.PublishAck, values));
+
+  values[0] = log.HighWater;
+  values[1] = Stats.MqttTxMax;
+  values[2] = Stats.MqttRxMax;
+  values[3] = Stats.AtResponseMax;
+  Telemetry_AddArray(&enc, STATS_HIGH_WATER, values, Stats_Trim(values, 4));
+
+  values[0] = Stats.SocketErrors;
+  values[1] = Stats.UnmatchedAcks;
+  Telemetry_AddArray(&enc, STATS_ERRORS, values, Stats_Trim(values, 2));
+
+  for (i = 0; (i < Stats.AtTypes) && !enc.Overflow; i++)
+  {
+    values[0] = Stats.At[i].Code;
+    values[1] = Stats.At[i].Errors;
+    Telemetry_AddArray(&enc, STATS_AT + i, values,
+                       2 + Stats_Histogram(&Stats.At[i].Latency, &values[2]));
+    if (enc.Overflow)
+    {
+      enc.Overflow = 0;            /* dropped whole; the rest is kept */
+      break;
+    }
+  }
+  return Telemetry_End(&enc);
+}
+
+/**
+  * @brief  Print the statistics on the console.
+  * @retval None
+  */
+void Stats_Print(void)
+{
+  const Stats_Histogram_t *h = &Stats.PublishAck;
+  uint32_t i;
+
+  printf("connects  %lu\n", (unsigned long)Stats.Connects);
+  printf("spi       %lu bytes out, %lu in, %lu SPI IRQs, %lu data-ready IRQs\n",
+         (unsigned long)Stats.SpiTxBytes, (unsigned long)Stats.SpiRxBytes,
+         (unsigned long)Stats.SpiIrqs, (unsigned long)Stats.DataReadyIrqs);
+  Stats_PrintPackets("mqtt out ", Stats.MqttTx);
+  Stats_PrintPackets("mqtt in  ", Stats.MqttRx);
+  printf("ack       p50 < %lu ms, p90 < %lu ms, max %lu ms, %lu unmatched\n",
+         (unsigned long)Stats_Percentile(h, 50), (unsigned long)Stats_Percentile(h, 90),
+         (unsigned long)h->Max, (unsigned long)Stats.UnmatchedAcks);
+  printf("largest   %lu bytes MQTT out, %lu in, %lu AT response\n",
+         (unsigned long)Stats.MqttTxMax, (unsigned long)Stats.MqttRxMax,
+         (unsigned long)Stats.AtResponseMax);
+  printf("socket    %lu selection failures\n", (unsigned long)Stats.SocketErrors);
+  for (i = 0; i < Stats.AtTypes; i++)
+  {
+    const Stats_AtCommand_t *at = &Stats.At[i];
+    uint32_t count = 0, k;
+
+    for (k = 0; k < STATS_BUCKETS; k++)
+    {
+      count += at->Latency.Count[k];
+    }
+    printf("at %c%c     %lu, p50 < %lu us, p90 < %lu us, max %lu us, %lu errors\n",
+           (at->Code != 0) ? (char)(at->Code >> 8) : '*', (at->Code & 0xFF) ? (char)at->Code : ' ',
+           (unsigned long)count,
+           (unsigned long)(Stats_Percentile(&at->Latency, 50) * STATS_AT_UNIT_US),
+           (unsigned long)(Stats_Percentile(&at->Latency, 90) * STATS_AT_UNIT_US),
+           (unsigned long)(at->Latency.Max * STATS_AT_UNIT_US), (unsigned long)at->Errors);
+  }
+}
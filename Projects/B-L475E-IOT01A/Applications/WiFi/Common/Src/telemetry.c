@@ -0,0 +1,459 @@
+/**
+  ******************************************************************************
+  * @file    telemetry.c
+  * @brief   Compact CBOR encoding of sensor readings for MQTT publishes.
+  * @attention
+  * Only the subset the backend decoder needs is produced: one definite-length
+  * map with unsigned integer keys and integer values, or arrays of integers
+  * for a batch, each in its shortest form. The map header is patched in by
+  * Telemetry_End() once the number of fields is known.
+  *
+  * A batch keeps its samples raw and only tracks the size they will take
+  * once delta encoded, so that adding a sample is a copy and a few compares;
+  * the encoding is done once per PUBLISH.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "telemetry.h"
+
+/* Private define ------------------------------------------------------------*/
+#define CBOR_UINT                0x00
+#define CBOR_NEGINT              0x20
+#define CBOR_ARRAY               0x80
+#define CBOR_MAP                 0xA0
+
+/* Private variables ---------------------------------------------------------*/
+static const Telemetry_Field_t Telemetry_Schema[] = {
+  { TELEMETRY_UPTIME,      1,   "uptime" },
+  { TELEMETRY_TEMPERATURE, 100, "temperature" },
+  { TELEMETRY_HUMIDITY,    10,  "humidity" },
+  { TELEMETRY_PRESSURE,    10,  "pressure" },
+  { TELEMETRY_ACC_X,       1,   "acc_x" },
+  { TELEMETRY_ACC_Y,       1,   "acc_y" },
+  { TELEMETRY_ACC_Z,       1,   "acc_z" },
+  { TELEMETRY_MAG_X,       1,   "mag_x" },
+  { TELEMETRY_MAG_Y,       1,   "mag_y" },
+  { TELEMETRY_MAG_Z,       1,   "mag_z" },
+  { TELEMETRY_TIME,        1,   "time_ms" },
+  { TELEMETRY_RMS_X,       10,  "rms_x" },
+  { TELEMETRY_RMS_Y,       10,  "rms_y" },
+  { TELEMETRY_RMS_Z,       10,  "rms_z" },
+  { TELEMETRY_PEAK_X,      1,   "peak_x" },
+  { TELEMETRY_PEAK_Y,      1,   "peak_y" },
+  { TELEMETRY_PEAK_Z,      1,   "peak_z" },
+  { TELEMETRY_CREST_X,     100, "crest_x" },
+  { TELEMETRY_CREST_Y,     100, "crest_y" },
+  { TELEMETRY_CREST_Z,     100, "crest_z" },
+  { TELEMETRY_BAND_0,      10,  "band0" },
+  { TELEMETRY_BAND_0 + 1,  10,  "band1" },
+  { TELEMETRY_BAND_0 + 2,  10,  "band2" },
+  { TELEMETRY_BAND_0 + 3,  10,  "band3" },
+  { TELEMETRY_BAND_0 + 4,  10,  "band4" },
+  { TELEMETRY_BAND_0 + 5,  10,  "band5" },
+  { TELEMETRY_BAND_0 + 6,  10,  "band6" },
+  { TELEMETRY_BAND_7,      10,  "band7" },
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t Telemetry_HeadSize(uint32_t value);
+static uint32_t Telemetry_IntSize(int32_t value);
+static void Telemetry_PutHead(Telemetry_Encoder_t *pEnc, uint8_t major, uint32_t value);
+static void Telemetry_PutInt(Telemetry_Encoder_t *pEnc, int32_t value);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Size of a CBOR item head in its shortest form.
+  * @param  value: argument of the head
+  * @retval 1, 2, 3 or 5 bytes
+  */
+static uint32_t Telemetry_HeadSize(uint32_t value)
+{
+  return (value < 24) ? 1 : (value <= 0xFF) ? 2 : (value <= 0xFFFF) ? 3 : 5;
+}
+
+/**
+  * @brief  Size of a CBOR integer.
+  * @param  value: integer
+  * @retval 1, 2, 3 or 5 bytes
+  */
+static uint32_t Telemetry_IntSize(int32_t value)
+{
+  return Telemetry_HeadSize((value >= 0) ? (uint32_t)value : (uint32_t)(-1 - value));
+}
+
+/**
+  * @brief  Append a CBOR item head in its shortest form.
+  * @param  pEnc: encoder
+  * @param  major: CBOR major type, in the top three bits
+  * @param  value: argument of the head
+  * @retval None
+  */
+static void Telemetry_PutHead(Telemetry_Encoder_t *pEnc, uint8_t major, uint32_t value)
+{
+  uint8_t head[5];
+  uint32_t len;
+
+  if (value < 24)
+  {
+    head[0] = major | (uint8_t)value;
+    len = 1;
+  }
+  else if (value <= 0xFF)
+  {
+    head[0] = major | 24;
+    head[1] = (uint8_t)value;
+    len = 2;
+  }
+  else if (value <= 0xFFFF)
+  {
+    head[0] = major | 25;
+    head[1] = (uint8_t)(value >> 8);
+    head[2] = (uint8_t)value;
+    len = 3;
+  }
+  else
+  {
+    head[0] = major | 26;
+    head[1] = (uint8_t)(value >> 24);
+    head[2] = (uint8_t)(value >> 16);
+    head[3] = (uint8_t)(value >> 8);
+    head[4] = (uint8_t)value;
+    len = 5;
+  }
+
+  if (pEnc->Length + len > pEnc->Size)
+  {
+    pEnc->Overflow = 1;
+    return;
+  }
+  memcpy(&pEnc->Buffer[pEnc->Length], head, len);
+  pEnc->Length += len;
+}
+
+/**
+  * @brief  Append a CBOR integer.
+  * @param  pEnc: encoder
+  * @param  value: integer
+  * @retval None
+  */
+static void Telemetry_PutInt(Telemetry_Encoder_t *pEnc, int32_t value)
+{
+  if (value >= 0)
+  {
+    Telemetry_PutHead(pEnc, CBOR_UINT, (uint32_t)value);
+  }
+  else
+  {
+    Telemetry_PutHead(pEnc, CBOR_NEGINT, (uint32_t)(-1 - value));
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Look up a key in the schema.
+  * @param  Key: TELEMETRY_UPTIME ...
+  * @retval The field, or NULL for an unknown key
+  */
+const Telemetry_Field_t *Telemetry_FindField(uint8_t Key)
+{
+  uint32_t i;
+
+  for (i = 0; i < sizeof(Telemetry_Schema) / sizeof(Telemetry_Schema[0]); i++)
+  {
+    if (Telemetry_Schema[i].Key == Key)
+    {
+      return &Telemetry_Schema[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Scale a reading to the fixed-point units of the schema.
+  * @param  Key: TELEMETRY_UPTIME ...
+  * @param  Reading: value in the units of the BSP, e.g. degC
+  * @retval Rounded scaled value; the reading itself for an unknown key
+  */
+int32_t Telemetry_Scale(uint8_t Key, float Reading)
+{
+  const Telemetry_Field_t *field = Telemetry_FindField(Key);
+  float scaled = (field != NULL) ? Reading * field->Scale : Reading;
+
+  return (int32_t)(scaled >= 0.0f ? scaled + 0.5f : scaled - 0.5f);
+}
+
+/**
+  * @brief  Start a payload in a caller buffer.
+  * @param  pEnc: encoder
+  * @param  pBuffer: payload buffer
+  * @param  Size: size of pBuffer; at least 1 for the map header
+  * @retval None
+  */
+void Telemetry_Begin(Telemetry_Encoder_t *pEnc, uint8_t *pBuffer, uint32_t Size)
+{
+  pEnc->Buffer = pBuffer;
+  pEnc->Size = Size;
+  pEnc->Length = 1;              /* map header, written by Telemetry_End() */
+  pEnc->Count = 0;
+  pEnc->Overflow = (Size < 1);
+}
+
+/**
+  * @brief  Add a field whose value is already in the units of the schema.
+  * @param  pEnc: encoder
+  * @param  Key: TELEMETRY_UPTIME ...
+  * @param  Value: scaled value
+  * @retval None
+  */
+void Telemetry_AddInt(Telemetry_Encoder_t *pEnc, uint8_t Key, int32_t Value)
+{
+  uint32_t length = pEnc->Length;
+
+  if (pEnc->Overflow || (pEnc->Count == TELEMETRY_MAX_FIELDS))
+  {
+    pEnc->Overflow = 1;
+    return;
+  }
+
+  Telemetry_PutHead(pEnc, CBOR_UINT, Key);
+  Telemetry_PutInt(pEnc, Value);
+
+  if (pEnc->Overflow)
+  {
+    pEnc->Length = length;       /* drop the partial field */
+  }
+  else
+  {
+    pEnc->Count++;
+  }
+}
+
+/**
+  * @brief  Add a reading, scaled and rounded to an integer by the schema.
+  * @param  pEnc: encoder
+  * @param  Key: TELEMETRY_UPTIME ...
+  * @param  Reading: value in the units of the BSP, e.g. degC
+  * @retval None
+  */
+void Telemetry_AddReading(Telemetry_Encoder_t *pEnc, uint8_t Key, float Reading)
+{
+  if (Telemetry_FindField(Key) == NULL)
+  {
+    pEnc->Overflow = 1;
+    return;
+  }
+  Telemetry_AddInt(pEnc, Key, Telemetry_Scale(Key, Reading));
+}
+
+/**
+  * @brief  Add a field holding an array of counters.
+  * @param  pEnc: encoder
+  * @param  Key: map key
+  * @param  pValues: unsigned values
+  * @param  Count: number of values
+  * @retval None
+  */
+void Telemetry_AddArray(Telemetry_Encoder_t *pEnc, uint8_t Key, const uint32_t *pValues, uint32_t Count)
+{
+  uint32_t length = pEnc->Length;
+  uint32_t i;
+
+  if (pEnc->Overflow || (pEnc->Count == TELEMETRY_MAX_FIELDS))
+  {
+    pEnc->Overflow = 1;
+    return;
+  }
+
+  Telemetry_PutHead(pEnc, CBOR_UINT, Key);
+  Telemetry_PutHead(pEnc, CBOR_ARRAY, Count);
+  for (i = 0; i < Count; i++)
+  {
+    Telemetry_PutHead(pEnc, CBOR_UINT, pValues[i]);
+  }
+
+  if (pEnc->Overflow)
+  {
+    pEnc->Length = length;       /* drop the partial field */
+  }
+  else
+  {
+    pEnc->Count++;
+  }
+}
+
+/**
+  * @brief  Finish a payload.
+  * @param  pEnc: encoder
+  * @retval Payload length, or -1 if a field did not fit or was unknown
+  */
+int32_t Telemetry_End(Telemetry_Encoder_t *pEnc)
+{
+  if (pEnc->Overflow)
+  {
+    return -1;
+  }
+  pEnc->Buffer[0] = CBOR_MAP | pEnc->Count;
+  return (int32_t)pEnc->Length;
+}
+
+/**
+  * @brief  Set up an empty batch over caller storage.
+  * @param  pBatch: batch
+  * @param  pKeys: column keys, kept by reference
+  * @param  Columns: number of keys, at most TELEMETRY_MAX_FIELDS - 1
+  * @param  pValues: room for MaxRows * Columns scaled values
+  * @param  pTimes: room for MaxRows sample times
+  * @param  MaxRows: samples held at most
+  * @param  MaxBytes: payload size bound, at least TELEMETRY_BATCH_ROW_MAX(Columns)
+  *         plus the map and array heads
+  * @param  MaxAge: ms a sample may wait for its PUBLISH
+  * @retval None
+  */
+void Telemetry_BatchInit(Telemetry_Batch_t *pBatch, const uint8_t *pKeys, uint8_t Columns,
+                         int32_t *pValues, uint32_t *pTimes, uint16_t MaxRows,
+                         uint32_t MaxBytes, uint32_t MaxAge)
+{
+  pBatch->Keys = pKeys;
+  pBatch->Columns = Columns;
+  pBatch->MaxRows = MaxRows;
+  pBatch->Values = pValues;
+  pBatch->Times = pTimes;
+  pBatch->MaxBytes = MaxBytes;
+  pBatch->MaxAge = MaxAge;
+  pBatch->Rows = 0;
+  pBatch->ItemBytes = 0;
+}
+
+/**
+  * @brief  Add a sample to a batch.
+  * @param  pBatch: batch
+  * @param  Time: sample time, ms
+  * @param  pValues: one scaled value per column, see Telemetry_Scale()
+  * @retval 0, or -1 if the batch is due and must be encoded first
+  */
+int32_t Telemetry_BatchAdd(Telemetry_Batch_t *pBatch, uint32_t Time, const int32_t *pValues)
+{
+  int32_t *row = &pBatch->Values[pBatch->Rows * pBatch->Columns];
+  uint32_t i;
+
+  if (Telemetry_BatchTimeLeft(pBatch, Time) == 0)
+  {
+    return -1;
+  }
+
+  if (pBatch->Rows == 0)
+  {
+    for (i = 0; i < pBatch->Columns; i++)
+    {
+      row[i] = pValues[i];
+      pBatch->ItemBytes += Telemetry_IntSize(pValues[i]);
+    }
+    pBatch->ItemBytes += Telemetry_HeadSize(Time);
+  }
+  else
+  {
+    const int32_t *last = row - pBatch->Columns;
+
+    for (i = 0; i < pBatch->Columns; i++)
+    {
+      row[i] = pValues[i];
+      /* Wrapping differences: the decoder adds them back modulo 2^32 */
+      pBatch->ItemBytes += Telemetry_IntSize((int32_t)((uint32_t)pValues[i] - (uint32_t)last[i]));
+    }
+    pBatch->ItemBytes += Telemetry_IntSize((int32_t)(Time - pBatch->Times[pBatch->Rows - 1]));
+  }
+  pBatch->Times[pBatch->Rows++] = Time;
+  return 0;
+}
+
+/**
+  * @brief  Size the samples held will take once encoded.
+  * @param  pBatch: batch
+  * @retval Payload bytes; 0 for an empty batch
+  */
+uint32_t Telemetry_BatchSize(const Telemetry_Batch_t *pBatch)
+{
+  uint32_t size = 1 + Telemetry_HeadSize(TELEMETRY_TIME);
+  uint32_t i;
+
+  if (pBatch->Rows == 0)
+  {
+    return 0;
+  }
+  for (i = 0; i < pBatch->Columns; i++)
+  {
+    size += Telemetry_HeadSize(pBatch->Keys[i]);
+  }
+  return size + (pBatch->Columns + 1U) * Telemetry_HeadSize(pBatch->Rows) + pBatch->ItemBytes;
+}
+
+/**
+  * @brief  Time until a batch must be encoded and published.
+  * @param  pBatch: batch
+  * @param  Now: current time, ms
+  * @retval ms left; 0 once the oldest sample reached MaxAge or the next
+  *         sample may not fit in MaxRows or MaxBytes; MaxAge when empty
+  */
+uint32_t Telemetry_BatchTimeLeft(const Telemetry_Batch_t *pBatch, uint32_t Now)
+{
+  uint32_t age;
+
+  if (pBatch->Rows == 0)
+  {
+    return pBatch->MaxAge;
+  }
+  age = Now - pBatch->Times[0];
+  if ((pBatch->Rows == pBatch->MaxRows) || (age >= pBatch->MaxAge) ||
+      (Telemetry_BatchSize(pBatch) + TELEMETRY_BATCH_ROW_MAX(pBatch->Columns) > pBatch->MaxBytes))
+  {
+    return 0;
+  }
+  return pBatch->MaxAge - age;
+}
+
+/**
+  * @brief  Encode the samples held column by column, and empty the batch.
+  * @param  pBatch: batch
+  * @param  pBuffer: payload buffer
+  * @param  Size: size of pBuffer; MaxBytes is always enough
+  * @retval Payload length, 0 for an empty batch, or -1 if it did not fit
+  */
+int32_t Telemetry_BatchEncode(Telemetry_Batch_t *pBatch, uint8_t *pBuffer, uint32_t Size)
+{
+  Telemetry_Encoder_t enc;
+  uint32_t col, row;
+
+  if (pBatch->Rows == 0)
+  {
+    return 0;
+  }
+
+  Telemetry_Begin(&enc, pBuffer, Size);
+  Telemetry_PutHead(&enc, CBOR_UINT, TELEMETRY_TIME);
+  Telemetry_PutHead(&enc, CBOR_ARRAY, pBatch->Rows);
+  Telemetry_PutHead(&enc, CBOR_UINT, pBatch->Times[0]);
+  for (row = 1; row < pBatch->Rows; row++)
+  {
+    Telemetry_PutInt(&enc, (int32_t)(pBatch->Times[row] - pBatch->Times[row - 1]));
+  }
+  for (col = 0; col < pBatch->Columns; col++)
+  {
+    const int32_t *v = &pBatch->Values[col];
+
+    Telemetry_PutHead(&enc, CBOR_UINT, pBatch->Keys[col]);
+    Telemetry_PutHead(&enc, CBOR_ARRAY, pBatch->Rows);
+    for (row = 0; row < pBatch->Rows; row++)
+    {
+      Telemetry_PutInt(&enc, (row == 0) ? v[0] :
+                             (int32_t)((uint32_t)v[row * pBatch->Columns] -
+                                       (uint32_t)v[(row - 1) * pBatch->Columns]));
+    }
+  }
+  enc.Count = pBatch->Columns + 1;
+
+  pBatch->Rows = 0;
+  pBatch->ItemBytes = 0;
+  return Telemetry_End(&enc);
+}
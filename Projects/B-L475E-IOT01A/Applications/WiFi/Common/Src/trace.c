@@ -0,0 +1,165 @@
+/**
+  ******************************************************************************
+  * @file    trace.c
+  * @brief   Binary trace of MQTT packets and ES-WiFi AT commands in a RAM ring.
+  * @attention
+  * Records are written with interrupts masked, so they can come from any
+  * task; the copy is bounded by the snaplen passed by the caller.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32l4xx_hal.h"
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TRACE_ALIGN(n)           (((n) + 3U) & ~3U)
+#define TRACE_DUMP_LINE          32
+
+/* Private variables ---------------------------------------------------------*/
+Trace_Ring_t Trace_Ring;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Trace_Write(uint32_t offset, const void *pdata, uint32_t len);
+static void Trace_Read(uint32_t offset, void *pdata, uint32_t len);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Copy bytes into the ring, wrapping around the end of Data.
+  * @param  offset: offset in Data, below Size
+  * @param  pdata: bytes to copy
+  * @param  len: number of bytes, at most Size
+  * @retval None
+  */
+static void Trace_Write(uint32_t offset, const void *pdata, uint32_t len)
+{
+  uint32_t first = Trace_Ring.Size - offset;
+
+  if (first > len)
+  {
+    first = len;
+  }
+  memcpy(&Trace_Ring.Data[offset], pdata, first);
+  memcpy(&Trace_Ring.Data[0], (const uint8_t *)pdata + first, len - first);
+}
+
+/**
+  * @brief  Copy bytes out of the ring, wrapping around the end of Data.
+  * @param  offset: offset in Data, below Size
+  * @param  pdata: destination
+  * @param  len: number of bytes, at most Size
+  * @retval None
+  */
+static void Trace_Read(uint32_t offset, void *pdata, uint32_t len)
+{
+  uint32_t first = Trace_Ring.Size - offset;
+
+  if (first > len)
+  {
+    first = len;
+  }
+  memcpy(pdata, &Trace_Ring.Data[offset], first);
+  memcpy((uint8_t *)pdata + first, &Trace_Ring.Data[0], len - first);
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Empty the ring.
+  * @retval None
+  */
+void Trace_Init(void)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  Trace_Ring.Magic = TRACE_MAGIC;
+  Trace_Ring.Size = sizeof(Trace_Ring.Data);
+  Trace_Ring.Head = 0;
+  Trace_Ring.Tail = 0;
+  Trace_Ring.Used = 0;
+  Trace_Ring.Dropped = 0;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Append a record, overwriting the oldest ones if the ring is full.
+  * @param  Type: TRACE_MQTT_TX, TRACE_MQTT_RX, TRACE_AT_CMD or TRACE_AT_RESP
+  * @param  Channel: socket number
+  * @param  pdata: packet bytes
+  * @param  Length: packet length; only the snaplen for Type is kept
+  * @retval None
+  */
+void Trace_Record(uint8_t Type, uint8_t Channel, const uint8_t *pdata, uint32_t Length)
+{
+  Trace_RecordHeader_t hdr;
+  Trace_RecordHeader_t old;
+  uint32_t snaplen = (Type <= TRACE_MQTT_RX) ? TRACE_MQTT_SNAPLEN : TRACE_AT_SNAPLEN;
+  uint32_t need;
+  uint32_t primask;
+
+  if (Trace_Ring.Magic != TRACE_MAGIC)
+  {
+    return;
+  }
+
+  hdr.Timestamp = HAL_GetTick();
+  hdr.Length = (Length > 0xFFFF) ? 0xFFFF : (uint16_t)Length;
+  hdr.Captured = (uint16_t)((Length > snaplen) ? snaplen : Length);
+  hdr.Type = Type;
+  hdr.Channel = Channel;
+  hdr.Reserved = 0;
+  need = sizeof(hdr) + TRACE_ALIGN(hdr.Captured);
+  if (need > Trace_Ring.Size)
+  {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  while (Trace_Ring.Size - Trace_Ring.Used < need)
+  {
+    uint32_t size;
+
+    Trace_Read(Trace_Ring.Tail, &old, sizeof(old));
+    size = sizeof(old) + TRACE_ALIGN(old.Captured);
+    Trace_Ring.Tail = (Trace_Ring.Tail + size) % Trace_Ring.Size;
+    Trace_Ring.Used -= size;
+    Trace_Ring.Dropped++;
+  }
+
+  Trace_Write(Trace_Ring.Head, &hdr, sizeof(hdr));
+  Trace_Write((Trace_Ring.Head + sizeof(hdr)) % Trace_Ring.Size, pdata, hdr.Captured);
+  Trace_Ring.Head = (Trace_Ring.Head + need) % Trace_Ring.Size;
+  Trace_Ring.Used += need;
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Print the ring as hex lines between BEGIN and END markers, for
+  *         Tools/trace2pcap to read from a terminal log. Recording is paused
+  *         meanwhile, so the dump is consistent.
+  * @retval None
+  */
+void Trace_Dump(void)
+{
+  const uint8_t *p = (const uint8_t *)&Trace_Ring;
+  uint32_t magic = Trace_Ring.Magic;
+  uint32_t i;
+
+  Trace_Ring.Magic = 0;   /* stops Trace_Record() */
+  printf("-----BEGIN TRACE-----\n");
+  for (i = 0; i < sizeof(Trace_Ring); i++)
+  {
+    printf("%02x", (i < sizeof(magic)) ? ((const uint8_t *)&magic)[i] : p[i]);
+    if ((i % TRACE_DUMP_LINE) == TRACE_DUMP_LINE - 1)
+    {
+      printf("\n");
+    }
+  }
+  printf("\n-----END TRACE-----\n");
+  Trace_Ring.Magic = magic;
+}
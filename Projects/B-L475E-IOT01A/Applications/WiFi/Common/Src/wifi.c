@@ -285,7 +285,7 @@ WIFI_Status_t WIFI_GetHostAddress(const char *location, uint8_t *ipaddr, uint8_t
 /**
   * @brief  Configure and start a client connection
   * @param  socket : socket
-  * @param  type : Connection type TCP/UDP
+  * @param  type : Connection type TCP/UDP/TCP over TLS
   * @param  name : name of the connection
   * @param  ipaddr : IP address of the remote host
   * @param  port : Remote port
@@ -301,7 +301,18 @@ WIFI_Status_t WIFI_OpenClientConnection(uint32_t socket, WIFI_Protocol_t type, c
   conn.Number = (uint8_t)socket;
   conn.RemotePort = port;
   conn.LocalPort = local_port;
-  conn.Type = (type == WIFI_TCP_PROTOCOL)? ES_WIFI_TCP_CONNECTION : ES_WIFI_UDP_CONNECTION;
+  switch (type)
+  {
+    case WIFI_TCP_PROTOCOL:
+      conn.Type = ES_WIFI_TCP_CONNECTION;
+      break;
+    case WIFI_TCP_SSL_PROTOCOL:
+      conn.Type = ES_WIFI_TCP_SSL_CONNECTION;
+      break;
+    default:
+      conn.Type = ES_WIFI_UDP_CONNECTION;
+      break;
+  }
   conn.RemoteIP[0] = ipaddr[0];
   conn.RemoteIP[1] = ipaddr[1];
   conn.RemoteIP[2] = ipaddr[2];
@@ -483,6 +494,33 @@ WIFI_Status_t WIFI_SendDataTo(uint32_t socket, const uint8_t *pdata, uint16_t Re
   return ret;
 }
 
+/**
+  * @brief  Send a burst of datagrams to one remote host
+  * @param  socket : socket
+  * @param  pdata : array of pointers to the datagrams to be sent
+  * @param  Reqlen : array of datagram lengths
+  * @param  Count : number of datagrams
+  * @param  SentCount : (OUT) number of datagrams actually sent
+  * @param  Timeout : Socket write timeout (ms)
+  * @param  ipaddr : (IN) 4-byte array containing the IP address of the remote host
+  * @param  port : (IN) port number of the remote host
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_SendDataToMany(uint32_t socket, const uint8_t *const pdata[], const uint16_t Reqlen[],
+                                  uint16_t Count, uint16_t *SentCount, uint32_t Timeout,
+                                  const uint8_t *ipaddr, uint16_t port)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if (ES_WIFI_SendDataToMany(&EsWifiObj, (uint8_t)socket, pdata, Reqlen, Count, SentCount, Timeout,
+                             ipaddr, port) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+
+  return ret;
+}
+
 /**
   * @brief  Receive Data from a socket
   * @param  socket : socket
@@ -651,3 +689,48 @@ WIFI_Status_t WIFI_GetModuleName(char *ModuleName, uint8_t ModuleNameLen)
 
   return ret;
 }
+
+/**
+  * @brief  Write a TLS credential set to the module's flash.
+  *         Only needed once per device: the set survives resets and power cycles,
+  *         and is then chosen with WIFI_SelectTLSCredentials().
+  * @param  credset : credential set number
+  * @param  ca : root CA certificate, PEM
+  * @param  ca_len : length of the CA certificate
+  * @param  cert : device certificate, PEM
+  * @param  cert_len : length of the device certificate
+  * @param  key : device private key, PEM
+  * @param  key_len : length of the device private key
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_StoreTLSCredentials(uint8_t credset, const uint8_t *ca, uint16_t ca_len,
+                                       const uint8_t *cert, uint16_t cert_len,
+                                       const uint8_t *key, uint16_t key_len)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if (ES_WIFI_StoreCreds(&EsWifiObj, ES_WIFI_FUNCTION_TLS, credset, (uint8_t *)ca, ca_len,
+                         (uint8_t *)cert, cert_len, (uint8_t *)key, key_len) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  Use a TLS credential set already stored in the module for the next TLS connections
+  * @param  credset : credential set number
+  * @retval Operation status
+  */
+WIFI_Status_t WIFI_SelectTLSCredentials(uint8_t credset)
+{
+  WIFI_Status_t ret = WIFI_STATUS_ERROR;
+
+  if (ES_WIFI_SelectCreds(&EsWifiObj, ES_WIFI_FUNCTION_TLS, credset) == ES_WIFI_STATUS_OK)
+  {
+    ret = WIFI_STATUS_OK;
+  }
+
+  return ret;
+}
@@ -0,0 +1,352 @@
+/**
+  ******************************************************************************
+  * @file    logdecode.c
+  * @brief   Host tool: format the deferred log records (logging.h) of a
+  *          console capture, with the strings of the firmware ELF.
+  * @attention
+  * The console carries text and, from a USE_LOG_DEFER build, binary records
+  * holding a format string address and its arguments. Text is copied as is;
+  * each record is printed as the line Log_Printf() would have written,
+  * "<tick> <level> <text>". The format, and the %s arguments pointing to
+  * flash, are read from the allocated sections of the ELF (the .axf of the
+  * same build); %s arguments pointing to RAM use the copy in the record.
+  *
+  * The capture is a file or, without one, stdin, e.g. a live port:
+  *   stty -F /dev/ttyACM0 115200 raw && ./logdecode Project.axf < /dev/ttyACM0
+  *
+  * Build: gcc -I../Inc -o logdecode logdecode.c
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Record layout, as in logging.h, which needs the HAL to be included */
+#define LOG_DEFER_MARKER         0xFF
+#define LOG_DEFER_MAX_ARGS       6
+#define LOG_DEFER_HEADER_SIZE    11
+
+#define SHT_NOBITS               8
+#define SHF_ALLOC                2
+#define MAX_TEXT                 1024
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t *elf;
+static size_t elf_size;
+static int column;                      /* characters since the last newline */
+
+static const char level_tag[] = "-EWID";
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t get16(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+  * @brief  Load a 32-bit little-endian ELF file.
+  * @param  path: file name
+  * @retval 0 on success, -1 on error (reported)
+  */
+static int load_elf(const char *path)
+{
+  FILE *f = fopen(path, "rb");
+  long size;
+
+  if (f == NULL)
+  {
+    perror(path);
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  elf = malloc(size > 0 ? size : 1);
+  elf_size = (elf != NULL) ? fread(elf, 1, size, f) : 0;
+  fclose(f);
+
+  if ((elf_size < 52) || (memcmp(elf, "\177ELF", 4) != 0) || (elf[4] != 1) || (elf[5] != 1))
+  {
+    fprintf(stderr, "%s: not a 32-bit little-endian ELF file\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Find a string of the firmware image.
+  * @param  address: target address
+  * @retval The NUL-terminated string, or NULL if not in an allocated
+  *         section of the ELF
+  */
+static const char *elf_string(uint32_t address)
+{
+  uint32_t shoff = get32(&elf[32]);
+  uint32_t shentsize = get16(&elf[46]);
+  uint32_t shnum = get16(&elf[48]);
+  uint32_t i;
+
+  for (i = 0; i < shnum; i++)
+  {
+    const uint8_t *sh = &elf[shoff + i * shentsize];
+    uint32_t addr, offset, size;
+
+    if ((uint64_t)shoff + (uint64_t)(i + 1) * shentsize > elf_size)
+    {
+      break;
+    }
+    addr = get32(&sh[12]);
+    offset = get32(&sh[16]);
+    size = get32(&sh[20]);
+    if (!(get32(&sh[8]) & SHF_ALLOC) || (get32(&sh[4]) == SHT_NOBITS) ||
+        (address - addr >= size) || ((uint64_t)offset + size > elf_size))
+    {
+      continue;
+    }
+    if (memchr(&elf[offset + (address - addr)], '\0', size - (address - addr)) != NULL)
+    {
+      return (const char *)&elf[offset + (address - addr)];
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Format a record the way printf() would have on the device.
+  * @param  out: text, NUL-terminated
+  * @param  size: size of out
+  * @param  format: printf() format
+  * @param  args: arguments
+  * @param  count: number of arguments
+  * @param  strings: copy of the string of each argument pointing to RAM,
+  *         NULL for the others
+  * @retval None
+  */
+static void format_record(char *out, size_t size, const char *format,
+                          const uint32_t *args, uint32_t count, char *const *strings)
+{
+  size_t len = 0;
+  uint32_t n = 0;
+
+  while ((*format != '\0') && (len < size - 1))
+  {
+    char spec[32];
+    size_t k = 0;
+    int star = 0;
+    int length = 0;
+    uint32_t value;
+    const char *s;
+    char conv;
+
+    if (*format != '%')
+    {
+      out[len++] = *format++;
+      continue;
+    }
+    if (format[1] == '%')
+    {
+      out[len++] = '%';
+      format += 2;
+      continue;
+    }
+
+    /* %[flags][width][.precision][length]conversion */
+    spec[k++] = *format++;
+    while ((strchr("-+ #0*.0123456789", *format) != NULL) && (*format != '\0') && (k < sizeof(spec) - 4))
+    {
+      star += (*format == '*');
+      spec[k++] = *format++;
+    }
+    while ((strchr("hlzjt", *format) != NULL) && (*format != '\0'))
+    {
+      length = (*format == 'h') ? length - 1 : length + 1;
+      format++;
+    }
+    conv = *format;
+    if (conv == '\0')
+    {
+      break;
+    }
+    format++;
+
+    if ((star > 0) || (length > 1) || (strchr("diouxXcsp", conv) == NULL) || (n >= count))
+    {
+      /* *, 64-bit, floating point or missing argument: not in the record */
+      len += snprintf(&out[len], size - len, "<%%%c?>", conv);
+      n = count;
+      continue;
+    }
+    value = args[n];
+    spec[k] = '\0';
+
+    switch (conv)
+    {
+      case 'd':
+      case 'i':
+        strcat(spec, "ld");
+        len += snprintf(&out[len], size - len, spec,
+                        (long)((length == -2) ? (int8_t)value : (length == -1) ? (int16_t)value : (int32_t)value));
+        break;
+      case 'o':
+      case 'u':
+      case 'x':
+      case 'X':
+        strcat(spec, "l");
+        spec[k + 1] = conv;
+        spec[k + 2] = '\0';
+        len += snprintf(&out[len], size - len, spec,
+                        (unsigned long)((length == -2) ? (uint8_t)value : (length == -1) ? (uint16_t)value : value));
+        break;
+      case 'c':
+        spec[k] = 'c';
+        spec[k + 1] = '\0';
+        len += snprintf(&out[len], size - len, spec, (int)(uint8_t)value);
+        break;
+      case 'p':
+        len += snprintf(&out[len], size - len, "0x%08lx", (unsigned long)value);
+        break;
+      default:                          /* 's' */
+        s = (strings[n] != NULL) ? strings[n] : elf_string(value);
+        if (s == NULL)
+        {
+          len += snprintf(&out[len], size - len, "<0x%08lx>", (unsigned long)value);
+          break;
+        }
+        spec[k] = 's';
+        spec[k + 1] = '\0';
+        len += snprintf(&out[len], size - len, spec, s);
+        break;
+    }
+    n++;
+  }
+
+  if (len > size - 1)
+  {
+    len = size - 1;
+  }
+  out[len] = '\0';
+}
+
+/**
+  * @brief  Read and print one record, the marker already read.
+  * @param  in: capture
+  * @retval 0 on success, -1 if the record is malformed or truncated
+  */
+static int decode_record(FILE *in)
+{
+  uint8_t header[LOG_DEFER_HEADER_SIZE - 1];
+  uint8_t raw[4 * LOG_DEFER_MAX_ARGS];
+  uint32_t args[LOG_DEFER_MAX_ARGS];
+  char copies[LOG_DEFER_MAX_ARGS][256];
+  char *strings[LOG_DEFER_MAX_ARGS];
+  char text[MAX_TEXT];
+  const char *format;
+  uint32_t level, count, mask, i;
+
+  if (fread(header, 1, sizeof(header), in) != sizeof(header))
+  {
+    return -1;
+  }
+  level = header[0] >> 4;
+  count = header[0] & 0x0F;
+  mask = header[1];
+  if ((level == 0) || (level >= sizeof(level_tag) - 1) || (count > LOG_DEFER_MAX_ARGS) ||
+      (mask >> count) != 0 || (fread(raw, 4, count, in) != count))
+  {
+    return -1;
+  }
+  for (i = 0; i < count; i++)
+  {
+    int len;
+
+    args[i] = get32(&raw[4 * i]);
+    strings[i] = NULL;
+    if (mask & (1U << i))
+    {
+      if (((len = fgetc(in)) == EOF) || (fread(copies[i], 1, len, in) != (size_t)len))
+      {
+        return -1;
+      }
+      copies[i][len] = '\0';
+      strings[i] = copies[i];
+    }
+  }
+
+  format = elf_string(get32(&header[6]));
+  if (format != NULL)
+  {
+    format_record(text, sizeof(text), format, args, count, strings);
+  }
+  else
+  {
+    int len = snprintf(text, sizeof(text), "<format 0x%08lx not in the ELF>",
+                       (unsigned long)get32(&header[6]));
+
+    for (i = 0; i < count; i++)
+    {
+      len += snprintf(&text[len], sizeof(text) - len, " 0x%08lx", (unsigned long)args[i]);
+    }
+    strcat(text, "\n");
+  }
+
+  /* A record queued while printf() had half a line out starts its own */
+  if (column != 0)
+  {
+    putchar('\n');
+  }
+  printf("%lu %c %s", (unsigned long)get32(&header[2]), level_tag[level], text);
+  column = (text[0] != '\0') && (text[strlen(text) - 1] != '\n');
+  fflush(stdout);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  FILE *in = stdin;
+  int errors = 0;
+  int c;
+
+  if ((argc < 2) || (argc > 3))
+  {
+    fprintf(stderr, "usage: logdecode <firmware ELF> [capture]\n");
+    return 2;
+  }
+  if (load_elf(argv[1]) != 0)
+  {
+    return 1;
+  }
+  if ((argc == 3) && ((in = fopen(argv[2], "rb")) == NULL))
+  {
+    perror(argv[2]);
+    return 1;
+  }
+
+  while ((c = fgetc(in)) != EOF)
+  {
+    if (c != LOG_DEFER_MARKER)
+    {
+      putchar(c);
+      column = (c == '\n') ? 0 : column + 1;
+      if (c == '\n')
+      {
+        fflush(stdout);
+      }
+      continue;
+    }
+    if (decode_record(in) != 0)
+    {
+      fprintf(stderr, "malformed record\n");
+      errors++;
+    }
+  }
+  return errors ? 1 : 0;
+}
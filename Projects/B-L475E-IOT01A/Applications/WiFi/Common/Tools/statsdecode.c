@@ -0,0 +1,346 @@
+/**
+  ******************************************************************************
+  * @file    statsdecode.c
+  * @brief   Host tool: decode statistics payloads (stats.h) into JSON.
+  * @attention
+  * Reads one payload per line as hex, which is what mosquitto_sub prints
+  * with -F %x, and writes one JSON object per payload, e.g.
+  *   mosquitto_sub -h test.mosquitto.org -t B-L475E-IOT01A1_Client/stats -F %x | ./statsdecode
+  * With -b the arguments are binary files holding one payload each.
+  *
+  * Counters indexed by MQTT packet type are printed by type name, the AT
+  * command slots by command, and each histogram as its maximum and its
+  * non-empty buckets, labelled with their range in us or ms: "2048-4095"
+  * is the bucket of the values from 2048 to 4095, and the last bucket,
+  * open-ended, has no upper bound.
+  *
+  * Build: gcc -I../Inc -o statsdecode statsdecode.c
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "stats.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MAX_PAYLOAD              4096
+#define MAX_KEYS                 32
+#define MAX_ITEMS                (3 + STATS_BUCKETS)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  int      present;
+  int      array;                /* 0 for a single value */
+  uint32_t count;
+  uint64_t items[MAX_ITEMS];     /* missing trailing items are 0 */
+} field_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const char *const mqtt_names[16] = {
+  "type0", "CONNECT", "CONNACK", "PUBLISH", "PUBACK", "PUBREC", "PUBREL", "PUBCOMP",
+  "SUBSCRIBE", "SUBACK", "UNSUBSCRIBE", "UNSUBACK", "PINGREQ", "PINGRESP", "DISCONNECT", "type15"
+};
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Read a CBOR head with an unsigned argument.
+  * @param  p: payload, advanced past the head
+  * @param  end: end of the payload
+  * @param  major: set to the major type, in the top three bits
+  * @param  value: set to the argument
+  * @retval 0 on success, -1 if truncated or indefinite
+  */
+static int get_head(const uint8_t **p, const uint8_t *end, uint8_t *major, uint64_t *value)
+{
+  uint8_t info;
+  int n, i;
+
+  if (*p >= end)
+  {
+    return -1;
+  }
+  *major = **p & 0xE0;
+  info = **p & 0x1F;
+  (*p)++;
+
+  if (info < 24)
+  {
+    *value = info;
+    return 0;
+  }
+  if (info > 27)
+  {
+    return -1;
+  }
+  n = 1 << (info - 24);
+  if (end - *p < n)
+  {
+    return -1;
+  }
+  *value = 0;
+  for (i = 0; i < n; i++)
+  {
+    *value = (*value << 8) | *(*p)++;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Print named counters as a JSON object member.
+  * @param  name: member name
+  * @param  f: array field
+  * @param  names: name of each item
+  * @param  count: number of names
+  * @param  all: 1 to print the zero items too
+  * @retval None
+  */
+static void put_counters(const char *name, const field_t *f, const char *const *names, uint32_t count, int all)
+{
+  const char *sep = "";
+  uint32_t i;
+
+  printf(",\"%s\":{", name);
+  for (i = 0; i < count; i++)
+  {
+    if (all || (f->items[i] != 0))
+    {
+      printf("%s\"%s\":%llu", sep, names[i], (unsigned long long)f->items[i]);
+      sep = ",";
+    }
+  }
+  printf("}");
+}
+
+/**
+  * @brief  Print a histogram laid out as [max, buckets...].
+  * @param  items: the max, then STATS_BUCKETS counts
+  * @param  unit: value of one histogram unit, in the printed unit
+  * @retval None
+  */
+static void put_histogram(const uint64_t *items, uint32_t unit)
+{
+  const char *sep = "";
+  uint64_t total = 0;
+  uint32_t k;
+
+  for (k = 0; k < STATS_BUCKETS; k++)
+  {
+    total += items[1 + k];
+  }
+  printf("{\"count\":%llu,\"max\":%llu,\"buckets\":{", (unsigned long long)total,
+         (unsigned long long)(items[0] * unit));
+  for (k = 0; k < STATS_BUCKETS; k++)
+  {
+    unsigned long long low = (k == 0) ? 0 : ((unsigned long long)unit << (k - 1));
+    unsigned long long high = (k == 0) ? 0 : ((unsigned long long)unit << k) - 1;
+
+    if (items[1 + k] == 0)
+    {
+      continue;
+    }
+    if (k == STATS_BUCKETS - 1)
+    {
+      printf("%s\"%llu-\":", sep, low);
+    }
+    else if (low == high)
+    {
+      printf("%s\"%llu\":", sep, low);
+    }
+    else
+    {
+      printf("%s\"%llu-%llu\":", sep, low, high);
+    }
+    printf("%llu", (unsigned long long)items[1 + k]);
+    sep = ",";
+  }
+  printf("}}");
+}
+
+/**
+  * @brief  Print one payload as a JSON object.
+  * @retval 0 on success, -1 if the payload is not a statistics map
+  */
+static int decode(const uint8_t *payload, size_t len)
+{
+  static const char *const spi_names[] = { "tx_bytes", "rx_bytes", "spi_irqs", "ready_irqs" };
+  static const char *const water_names[] = { "log", "mqtt_tx", "mqtt_rx", "at_response" };
+  static const char *const error_names[] = { "socket", "unmatched_acks" };
+  field_t fields[MAX_KEYS];
+  const uint8_t *p = payload, *end = payload + len;
+  uint64_t count, key, items, v;
+  uint32_t i, j;
+  const char *sep = "";
+  uint8_t major;
+
+  memset(fields, 0, sizeof(fields));
+  if ((get_head(&p, end, &major, &count) != 0) || (major != 0xA0))
+  {
+    return -1;
+  }
+  for (i = 0; i < count; i++)
+  {
+    field_t *f;
+
+    if ((get_head(&p, end, &major, &key) != 0) || (major != 0x00) || (key >= MAX_KEYS) || (p >= end))
+    {
+      return -1;
+    }
+    f = &fields[key];
+    f->present = 1;
+    items = 1;
+    if ((*p & 0xE0) == 0x80)
+    {
+      if ((get_head(&p, end, &major, &items) != 0) || (items > MAX_ITEMS))
+      {
+        return -1;
+      }
+      f->array = 1;
+    }
+    f->count = (uint32_t)items;
+    for (j = 0; j < items; j++)
+    {
+      if ((get_head(&p, end, &major, &v) != 0) || (major != 0x00))
+      {
+        return -1;
+      }
+      f->items[j] = v;
+    }
+  }
+
+  printf("{\"uptime\":%llu,\"connects\":%llu", (unsigned long long)fields[STATS_UPTIME].items[0],
+         (unsigned long long)fields[STATS_CONNECTS].items[0]);
+  put_counters("spi", &fields[STATS_SPI], spi_names, 4, 1);
+  put_counters("mqtt_tx", &fields[STATS_MQTT_TX], mqtt_names, 16, 0);
+  put_counters("mqtt_rx", &fields[STATS_MQTT_RX], mqtt_names, 16, 0);
+  printf(",\"publish_ack_ms\":");
+  put_histogram(fields[STATS_PUBLISH_ACK].items, 1);
+  put_counters("high_water", &fields[STATS_HIGH_WATER], water_names, 4, 1);
+  put_counters("errors", &fields[STATS_ERRORS], error_names, 2, 1);
+
+  printf(",\"at\":{");
+  for (key = STATS_AT; key < MAX_KEYS; key++)
+  {
+    const field_t *f = &fields[key];
+    uint32_t code = (uint32_t)f->items[0];
+
+    if (!f->present)
+    {
+      continue;
+    }
+    if (code == 0)
+    {
+      printf("%s\"other\":", sep);
+    }
+    else if ((code & 0xFF) == 0)
+    {
+      printf("%s\"%c\":", sep, (char)(code >> 8));
+    }
+    else
+    {
+      printf("%s\"%c%c\":", sep, (char)(code >> 8), (char)code);
+    }
+    printf("{\"errors\":%llu,\"latency_us\":", (unsigned long long)f->items[1]);
+    put_histogram(&f->items[2], STATS_AT_UNIT_US);
+    printf("}");
+    sep = ",";
+  }
+  printf("}}\n");
+
+  if (p != end)
+  {
+    fprintf(stderr, "%u trailing bytes ignored\n", (unsigned)(end - p));
+  }
+  return 0;
+}
+
+/**
+  * @brief  Convert a hex line to bytes, ignoring whitespace.
+  * @retval Number of bytes, or -1 on a character that is not hex
+  */
+static long from_hex(const char *line, uint8_t *out, size_t size)
+{
+  size_t n = 0;
+  int nibble = -1;
+
+  for (; *line != '\0'; line++)
+  {
+    int v;
+
+    if (isspace((unsigned char)*line))
+    {
+      continue;
+    }
+    if (!isxdigit((unsigned char)*line) || (n == size))
+    {
+      return -1;
+    }
+    v = isdigit((unsigned char)*line) ? *line - '0' : (tolower((unsigned char)*line) - 'a' + 10);
+    if (nibble < 0)
+    {
+      nibble = v;
+    }
+    else
+    {
+      out[n++] = (uint8_t)((nibble << 4) | v);
+      nibble = -1;
+    }
+  }
+  return (nibble < 0) ? (long)n : -1;
+}
+
+int main(int argc, char **argv)
+{
+  static uint8_t payload[MAX_PAYLOAD];
+  static char line[2 * MAX_PAYLOAD + 16];
+  int errors = 0;
+  int i;
+
+  if ((argc > 1) && (strcmp(argv[1], "-b") == 0))
+  {
+    for (i = 2; i < argc; i++)
+    {
+      FILE *f = fopen(argv[i], "rb");
+      size_t len;
+
+      if (f == NULL)
+      {
+        perror(argv[i]);
+        errors++;
+        continue;
+      }
+      len = fread(payload, 1, sizeof(payload), f);
+      fclose(f);
+      if (decode(payload, len) != 0)
+      {
+        fprintf(stderr, "%s: not a statistics payload\n", argv[i]);
+        errors++;
+      }
+    }
+    return errors ? 1 : 0;
+  }
+  if (argc > 1)
+  {
+    fprintf(stderr, "usage: statsdecode < hex lines\n       statsdecode -b <payload file>...\n");
+    return 2;
+  }
+
+  while (fgets(line, sizeof(line), stdin) != NULL)
+  {
+    long len = from_hex(line, payload, sizeof(payload));
+
+    if (len == 0)
+    {
+      continue;
+    }
+    if ((len < 0) || (decode(payload, (size_t)len) != 0))
+    {
+      fprintf(stderr, "not a statistics payload: %s", line);
+      errors++;
+    }
+    fflush(stdout);
+  }
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,266 @@
+/**
+  ******************************************************************************
+  * @file    teledecode.c
+  * @brief   Host tool: decode telemetry payloads (telemetry.h) into JSON.
+  * @attention
+  * Reads one payload per line as hex, which is what mosquitto_sub prints
+  * with -F %x, and writes one JSON object per payload with the schema
+  * names and the readings scaled back, e.g.
+  *   mosquitto_sub -h test.mosquitto.org -t test/env -F %x | ./teledecode
+  * prints {"temperature":23.45,"humidity":41.2,"pressure":1013.2}.
+  * A batch payload prints one object per sample, with its time_ms.
+  * With -b the arguments are binary files holding one payload each.
+  * Keys missing from the schema are printed as "key<n>" with the raw value.
+  *
+  * Build: gcc -I../Inc -o teledecode teledecode.c ../Src/telemetry.c
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "telemetry.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MAX_PAYLOAD              4096
+#define MAX_JSON                 (64 * TELEMETRY_MAX_FIELDS)
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Read a CBOR integer head.
+  * @param  p: payload, advanced past the item
+  * @param  end: end of the payload
+  * @param  major: set to the major type, in the top three bits
+  * @param  value: set to the argument
+  * @retval 0 on success, -1 if truncated or not a plain integer argument
+  */
+static int get_head(const uint8_t **p, const uint8_t *end, uint8_t *major, int64_t *value)
+{
+  uint8_t info;
+  int n, i;
+
+  if (*p >= end)
+  {
+    return -1;
+  }
+  *major = **p & 0xE0;
+  info = **p & 0x1F;
+  (*p)++;
+
+  if (info < 24)
+  {
+    *value = info;
+    return 0;
+  }
+  if (info > 27)
+  {
+    return -1;                   /* indefinite length or reserved */
+  }
+  n = 1 << (info - 24);
+  if (end - *p < n)
+  {
+    return -1;
+  }
+  *value = 0;
+  for (i = 0; i < n; i++)
+  {
+    *value = (*value << 8) | *(*p)++;
+  }
+  return (*value < 0) ? -1 : 0;  /* 64-bit arguments beyond int64_t */
+}
+
+/**
+  * @brief  Format one field as "name":value.
+  * @retval Characters written
+  */
+static int put_field(char *out, uint8_t key, int64_t value)
+{
+  const Telemetry_Field_t *field = Telemetry_FindField(key);
+  int decimals = 0;
+  unsigned scale;
+
+  if (field == NULL)
+  {
+    return sprintf(out, "\"key%d\":%lld", key, (long long)value);
+  }
+  if (field->Scale == 1)
+  {
+    return sprintf(out, "\"%s\":%lld", field->Name, (long long)value);
+  }
+  for (scale = field->Scale; scale > 1; scale /= 10)
+  {
+    decimals++;
+  }
+  return sprintf(out, "\"%s\":%.*f", field->Name, decimals, (double)value / field->Scale);
+}
+
+/**
+  * @brief  Print one payload as JSON: one object, or one per sample for a
+  *         batch, with the delta-encoded columns added back up.
+  * @retval 0 on success, -1 if the payload is not a telemetry map
+  */
+static int decode(const uint8_t *payload, size_t len)
+{
+  static int64_t values[MAX_PAYLOAD];
+  static char json[MAX_JSON];
+  uint8_t keys[TELEMETRY_MAX_FIELDS];
+  int64_t *column[TELEMETRY_MAX_FIELDS];
+  int64_t rows[TELEMETRY_MAX_FIELDS];   /* -1 for a single value */
+  const uint8_t *p = payload, *end = payload + len;
+  size_t used = 0, n;
+  int64_t count, key, samples = -1, row, i;
+  uint8_t major;
+
+  if ((get_head(&p, end, &major, &count) != 0) || (major != 0xA0) || (count > TELEMETRY_MAX_FIELDS))
+  {
+    return -1;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    int64_t items = 1, j;
+
+    if ((get_head(&p, end, &major, &key) != 0) || (major != 0x00) || (key > 0xFF) ||
+        (p >= end))
+    {
+      return -1;
+    }
+    keys[i] = (uint8_t)key;
+    rows[i] = -1;
+    if ((*p & 0xE0) == 0x80)
+    {
+      if ((get_head(&p, end, &major, &items) != 0) || (items > (int64_t)(len - used)) ||
+          ((samples >= 0) && (items != samples)))
+      {
+        return -1;                 /* every column of a batch has one item per sample */
+      }
+      samples = rows[i] = items;
+    }
+    column[i] = &values[used];
+    for (j = 0; j < items; j++)
+    {
+      int64_t v;
+
+      if ((get_head(&p, end, &major, &v) != 0) || ((major != 0x00) && (major != 0x20)))
+      {
+        return -1;
+      }
+      v = (major == 0x20) ? -1 - v : v;
+      if ((rows[i] >= 0) && (j > 0))
+      {
+        /* Differences wrap like the encoder's: times as uint32_t, values as int32_t */
+        v = (keys[i] == TELEMETRY_TIME) ? (int64_t)(uint32_t)(column[i][j - 1] + v) :
+                                          (int64_t)(int32_t)(uint32_t)(column[i][j - 1] + v);
+      }
+      values[used++] = v;
+    }
+  }
+
+  for (row = 0; row < ((samples < 0) ? 1 : samples); row++)
+  {
+    n = sprintf(json, "{");
+    for (i = 0; i < count; i++)
+    {
+      n += put_field(json + n, keys[i], column[i][(rows[i] < 0) ? 0 : row]);
+      n += sprintf(json + n, (i + 1 < count) ? "," : "");
+    }
+    printf("%s}\n", json);
+  }
+
+  if (p != end)
+  {
+    fprintf(stderr, "%u trailing bytes ignored\n", (unsigned)(end - p));
+  }
+  return 0;
+}
+
+/**
+  * @brief  Convert a hex line to bytes, ignoring whitespace.
+  * @retval Number of bytes, or -1 on a character that is not hex
+  */
+static long from_hex(const char *line, uint8_t *out, size_t size)
+{
+  size_t n = 0;
+  int nibble = -1;
+
+  for (; *line != '\0'; line++)
+  {
+    int v;
+
+    if (isspace((unsigned char)*line))
+    {
+      continue;
+    }
+    if (!isxdigit((unsigned char)*line) || (n == size))
+    {
+      return -1;
+    }
+    v = isdigit((unsigned char)*line) ? *line - '0' : (tolower((unsigned char)*line) - 'a' + 10);
+    if (nibble < 0)
+    {
+      nibble = v;
+    }
+    else
+    {
+      out[n++] = (uint8_t)((nibble << 4) | v);
+      nibble = -1;
+    }
+  }
+  return (nibble < 0) ? (long)n : -1;
+}
+
+int main(int argc, char **argv)
+{
+  static uint8_t payload[MAX_PAYLOAD];
+  static char line[2 * MAX_PAYLOAD + 16];
+  int errors = 0;
+  int i;
+
+  if ((argc > 1) && (strcmp(argv[1], "-b") == 0))
+  {
+    for (i = 2; i < argc; i++)
+    {
+      FILE *f = fopen(argv[i], "rb");
+      size_t len;
+
+      if (f == NULL)
+      {
+        perror(argv[i]);
+        errors++;
+        continue;
+      }
+      len = fread(payload, 1, sizeof(payload), f);
+      fclose(f);
+      if (decode(payload, len) != 0)
+      {
+        fprintf(stderr, "%s: not a telemetry payload\n", argv[i]);
+        errors++;
+      }
+    }
+    return errors ? 1 : 0;
+  }
+  if (argc > 1)
+  {
+    fprintf(stderr, "usage: teledecode < hex lines\n       teledecode -b <payload file>...\n");
+    return 2;
+  }
+
+  while (fgets(line, sizeof(line), stdin) != NULL)
+  {
+    long len = from_hex(line, payload, sizeof(payload));
+
+    if (len == 0)
+    {
+      continue;
+    }
+    if ((len < 0) || (decode(payload, (size_t)len) != 0))
+    {
+      fprintf(stderr, "not a telemetry payload: %s", line);
+      errors++;
+    }
+    fflush(stdout);
+  }
+  return errors ? 1 : 0;
+}
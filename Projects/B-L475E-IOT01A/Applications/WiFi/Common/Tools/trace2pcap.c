@@ -0,0 +1,314 @@
+/**
+  ******************************************************************************
+  * @file    trace2pcap.c
+  * @brief   Host tool: convert a trace ring dump (trace.h) into a pcap file.
+  * @attention
+  * Input is either the hex block printed by Trace_Dump(), anywhere in a
+  * terminal log, or the Trace_Ring variable saved by the debugger as binary,
+  * e.g. in gdb: dump binary value trace.bin Trace_Ring
+  *
+  * The output uses raw IPv4 frames (LINKTYPE_RAW) so that Wireshark applies
+  * its own dissectors:
+  *  - MQTT records become TCP segments between the board (10.0.0.2, port
+  *    49152 + socket) and the broker (10.0.0.1, port 1883), with sequence
+  *    numbers following the traced bytes, so the MQTT dissector reassembles
+  *    packets split across reads. Bytes beyond the snaplen are accounted as
+  *    missing. TLS builds trace MQTT before encryption, so it is always 1883.
+  *  - AT records become UDP datagrams between the board and the module
+  *    (10.0.0.3, port 2000 + socket), shown as text in the packet bytes.
+  * With -t the records are also listed on stdout.
+  *
+  * Build: gcc -I../Inc -o trace2pcap trace2pcap.c
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "trace.h"
+
+/* Private define ------------------------------------------------------------*/
+#define LINKTYPE_RAW             101
+#define RING_HEADER_SIZE         24      /* Trace_Ring_t fields before Data */
+#define BOARD_ADDR               0x0A000002UL
+#define BROKER_ADDR              0x0A000001UL
+#define MODULE_ADDR              0x0A000003UL
+#define BOARD_PORT_BASE          49152
+#define MQTT_PORT                1883
+#define AT_PORT_BASE             2000
+#define MAX_FRAME                (20 + 20 + 65535)
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t tcp_seq[256][2];        /* next sequence number per socket, per direction */
+static uint8_t  frame[MAX_FRAME];
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t get32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put16be(uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+static void put32be(uint8_t *p, uint32_t v)
+{
+  put16be(p, v >> 16);
+  put16be(p + 2, v);
+}
+
+static void write32(FILE *f, uint32_t v)
+{
+  fwrite(&v, 4, 1, f);   /* pcap headers are in host byte order */
+}
+
+/**
+  * @brief  Read the whole input and return the ring image: the file itself
+  *         if it starts with TRACE_MAGIC, else the hex between the markers.
+  */
+static uint8_t *load_ring(const char *name, size_t *len)
+{
+  FILE *f = fopen(name, "rb");
+  uint8_t *buf = NULL;
+  uint8_t *out;
+  size_t size = 0, n;
+  const char *p, *end;
+  int hi = -1;
+
+  if (f == NULL)
+  {
+    perror(name);
+    return NULL;
+  }
+  for (;;)
+  {
+    buf = realloc(buf, size + 65536 + 1);
+    n = fread(buf + size, 1, 65536, f);
+    size += n;
+    if (n == 0)
+    {
+      break;
+    }
+  }
+  fclose(f);
+  buf[size] = '\0';
+
+  if ((size >= 4) && (get32(buf) == TRACE_MAGIC))
+  {
+    *len = size;
+    return buf;
+  }
+
+  p = strstr((char *)buf, "-----BEGIN TRACE-----");
+  end = p ? strstr(p, "-----END TRACE-----") : NULL;
+  if (end == NULL)
+  {
+    fprintf(stderr, "%s: no trace found\n", name);
+    free(buf);
+    return NULL;
+  }
+  p += strlen("-----BEGIN TRACE-----");
+  out = malloc((end - p) / 2 + 1);
+  *len = 0;
+  for (; p < end; p++)
+  {
+    int v;
+
+    if (!isxdigit((unsigned char)*p))
+    {
+      continue;
+    }
+    v = isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10);
+    if (hi < 0)
+    {
+      hi = v;
+    }
+    else
+    {
+      out[(*len)++] = (uint8_t)((hi << 4) | v);
+      hi = -1;
+    }
+  }
+  free(buf);
+  return out;
+}
+
+static uint16_t ip_checksum(const uint8_t *p, int len)
+{
+  uint32_t sum = 0;
+  int i;
+
+  for (i = 0; i < len; i += 2)
+  {
+    sum += (p[i] << 8) | p[i + 1];
+  }
+  while (sum >> 16)
+  {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return (uint16_t)~sum;
+}
+
+/**
+  * @brief  Build the IPv4 frame for one record; return its length.
+  */
+static int build_frame(const Trace_RecordHeader_t *hdr, const uint8_t *data)
+{
+  int tx = (hdr->Type == TRACE_MQTT_TX) || (hdr->Type == TRACE_AT_CMD);
+  int tcp = (hdr->Type == TRACE_MQTT_TX) || (hdr->Type == TRACE_MQTT_RX);
+  uint32_t peer = tcp ? BROKER_ADDR : MODULE_ADDR;
+  uint32_t board_port = BOARD_PORT_BASE + hdr->Channel;
+  uint32_t peer_port = tcp ? MQTT_PORT : AT_PORT_BASE + hdr->Channel;
+  int l4 = tcp ? 20 : 8;
+  int len = 20 + l4 + hdr->Captured;
+  int orig_len = 20 + l4 + hdr->Length;   /* the headers describe the untruncated packet */
+
+  memset(frame, 0, 20 + l4);
+  frame[0] = 0x45;
+  put16be(&frame[2], orig_len);
+  frame[8] = 64;
+  frame[9] = tcp ? 6 : 17;
+  put32be(&frame[12], tx ? BOARD_ADDR : peer);
+  put32be(&frame[16], tx ? peer : BOARD_ADDR);
+  put16be(&frame[10], ip_checksum(frame, 20));
+
+  put16be(&frame[20], tx ? board_port : peer_port);
+  put16be(&frame[22], tx ? peer_port : board_port);
+  if (tcp)
+  {
+    uint32_t *seq = tcp_seq[hdr->Channel];
+
+    put32be(&frame[24], seq[!tx]);
+    put32be(&frame[28], seq[tx]);
+    frame[32] = 5 << 4;
+    frame[33] = 0x18;                   /* PSH, ACK */
+    put16be(&frame[34], 0xFFFF);
+    seq[!tx] += hdr->Length;
+  }
+  else
+  {
+    put16be(&frame[24], 8 + hdr->Length);
+  }
+  memcpy(&frame[20 + l4], data, hdr->Captured);
+  return len;
+}
+
+static void print_record(const Trace_RecordHeader_t *hdr, const uint8_t *data)
+{
+  static const char *names[] = { "MQTT>", "MQTT<", "AT>", "AT<" };
+  int i;
+
+  printf("%10.3f %-5s %3u %5u ", hdr->Timestamp / 1000.0,
+         (hdr->Type < 4) ? names[hdr->Type] : "?", hdr->Channel, hdr->Length);
+  for (i = 0; i < hdr->Captured; i++)
+  {
+    if (hdr->Type >= TRACE_AT_CMD)
+    {
+      putchar(isprint(data[i]) ? data[i] : '.');
+    }
+    else
+    {
+      printf("%02x", data[i]);
+    }
+  }
+  printf("%s\n", (hdr->Captured < hdr->Length) ? "..." : "");
+}
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  int text = 0;
+  uint8_t *ring;
+  const uint8_t *ringdata;
+  size_t len;
+  uint32_t size, tail, used, dropped, off, records = 0;
+  FILE *out;
+
+  if ((argc > 1) && (strcmp(argv[1], "-t") == 0))
+  {
+    text = 1;
+    argc--;
+    argv++;
+  }
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: trace2pcap [-t] <dump (hex log or binary)> <out.pcap>\n");
+    return 2;
+  }
+
+  ring = load_ring(argv[1], &len);
+  if (ring == NULL)
+  {
+    return 1;
+  }
+  size = get32(ring + 4);
+  tail = get32(ring + 12);
+  used = get32(ring + 16);
+  dropped = get32(ring + 20);
+  if ((len < RING_HEADER_SIZE) || (get32(ring) != TRACE_MAGIC) || (size > len - RING_HEADER_SIZE) ||
+      (tail >= size) || (used > size))
+  {
+    fprintf(stderr, "%s: not a trace ring, or truncated\n", argv[1]);
+    return 1;
+  }
+  ringdata = ring + RING_HEADER_SIZE;
+
+  out = fopen(argv[2], "wb");
+  if (out == NULL)
+  {
+    perror(argv[2]);
+    return 1;
+  }
+  write32(out, 0xA1B2C3D4);
+  fwrite("\x02\x00\x04\x00", 4, 1, out);   /* version 2.4, little endian */
+  write32(out, 0);
+  write32(out, 0);
+  write32(out, 65535);
+  write32(out, LINKTYPE_RAW);
+
+  for (off = 0; off < used; )
+  {
+    Trace_RecordHeader_t hdr;
+    uint8_t data[65536];
+    uint32_t i, n;
+
+    for (i = 0; i < sizeof(hdr); i++)
+    {
+      ((uint8_t *)&hdr)[i] = ringdata[(tail + off + i) % size];
+    }
+    n = sizeof(hdr) + ((hdr.Captured + 3U) & ~3U);
+    if (off + n > used)
+    {
+      fprintf(stderr, "record at %u runs past the end of the trace\n", (unsigned)off);
+      break;
+    }
+    for (i = 0; i < hdr.Captured; i++)
+    {
+      data[i] = ringdata[(tail + off + sizeof(hdr) + i) % size];
+    }
+    off += n;
+    records++;
+
+    if (text)
+    {
+      print_record(&hdr, data);
+    }
+    n = build_frame(&hdr, data);
+    write32(out, hdr.Timestamp / 1000);
+    write32(out, (hdr.Timestamp % 1000) * 1000);
+    write32(out, n);
+    write32(out, n + (hdr.Length - hdr.Captured));
+    fwrite(frame, 1, n, out);
+  }
+  fclose(out);
+
+  fprintf(stderr, "%u records written to %s, %u older records were overwritten on the board\n",
+          (unsigned)records, argv[2], (unsigned)dropped);
+  free(ring);
+  return 0;
+}
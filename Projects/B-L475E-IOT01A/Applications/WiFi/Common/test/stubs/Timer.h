@@ -0,0 +1,3 @@
+/* The port header is TImer.h; Timer.c includes it as Timer.h, which only a
+ * case-insensitive file system finds */
+#include "TImer.h"
@@ -0,0 +1,293 @@
+/*******************************************************************************
+ * Host stand-in for the STM32L4 HAL: only the types, constants and calls the
+ * Common modules under test use.  Register access and interrupt state are
+ * plain variables, and each test program defines the HAL functions it needs
+ * to observe.
+ *******************************************************************************/
+
+#ifndef STM32L4XX_HAL_H
+#define STM32L4XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+	HAL_OK = 0,
+	HAL_ERROR = 1,
+	HAL_BUSY = 2,
+	HAL_TIMEOUT = 3
+} HAL_StatusTypeDef;
+
+/* Core: the active exception number and the interrupt mask, set by the tests */
+extern uint32_t stub_ipsr;
+extern uint32_t stub_primask;
+static inline uint32_t __get_IPSR(void) { return stub_ipsr; }
+static inline uint32_t __get_PRIMASK(void) { return stub_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { stub_primask = primask; }
+static inline void __disable_irq(void) { stub_primask = 1; }
+#define __DMB()
+
+/* SysTick and the SCB interrupt control register, set by the tests */
+typedef struct
+{
+	volatile uint32_t CTRL;
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+	volatile uint32_t CALIB;
+} SysTick_Type;
+typedef struct
+{
+	volatile uint32_t CPUID;
+	volatile uint32_t ICSR;
+} SCB_Type;
+extern SysTick_Type stub_systick;
+extern SCB_Type stub_scb;
+#define SysTick (&stub_systick)
+#define SCB (&stub_scb)
+#define SCB_ICSR_PENDSTSET_Msk (1UL << 26)
+
+/* Cycle counter and core clock, set by the tests */
+typedef struct
+{
+	volatile uint32_t CTRL;
+	volatile uint32_t CYCCNT;
+} DWT_Type;
+typedef struct
+{
+	volatile uint32_t DEMCR;
+} CoreDebug_Type;
+extern DWT_Type stub_dwt;
+extern CoreDebug_Type stub_coredebug;
+extern uint32_t SystemCoreClock;
+#define DWT (&stub_dwt)
+#define CoreDebug (&stub_coredebug)
+#define DWT_CTRL_CYCCNTENA_Msk 1UL
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+static inline uint32_t __CLZ(uint32_t value) { return (value == 0) ? 32 : (uint32_t)__builtin_clz(value); }
+
+#define SRAM1_BASE 0x20000000UL
+#define SRAM1_SIZE_MAX 0x00018000UL
+#define SRAM2_BASE 0x10000000UL
+#define SRAM2_SIZE 0x00008000UL
+
+typedef int IRQn_Type;
+#define EXTI4_IRQn 10
+#define DMA1_Channel4_IRQn 14
+#define DMA1_Channel5_IRQn 15
+#define I2C2_EV_IRQn 33
+#define I2C2_ER_IRQn 34
+#define USART1_IRQn 37
+#define EXTI15_10_IRQn 40
+#define DMA2_Channel6_IRQn 68
+static inline void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t pre, uint32_t sub) { (void)irq; (void)pre; (void)sub; }
+static inline void HAL_NVIC_EnableIRQ(IRQn_Type irq) { (void)irq; }
+static inline void HAL_NVIC_DisableIRQ(IRQn_Type irq) { (void)irq; }
+static inline void HAL_NVIC_ClearPendingIRQ(IRQn_Type irq) { (void)irq; }
+
+uint32_t HAL_GetTick(void);
+static inline void HAL_Delay(uint32_t delay) { (void)delay; }
+
+/* Clocks and resets */
+#define __HAL_RCC_DMA1_CLK_ENABLE()
+#define __HAL_RCC_GPIOB_CLK_ENABLE()
+#define __HAL_RCC_GPIOB_CLK_DISABLE()
+#define __HAL_RCC_GPIOC_CLK_ENABLE()
+#define __HAL_RCC_GPIOD_CLK_ENABLE()
+#define __HAL_RCC_GPIOE_CLK_ENABLE()
+#define __HAL_RCC_I2C2_CLK_ENABLE()
+#define __HAL_RCC_I2C2_CLK_DISABLE()
+#define __HAL_RCC_I2C2_FORCE_RESET()
+#define __HAL_RCC_I2C2_RELEASE_RESET()
+#define __HAL_RCC_USART1_CLK_ENABLE()
+#define __HAL_RCC_USART1_CLK_DISABLE()
+
+/* GPIO: ports are addresses only, never dereferenced */
+typedef struct
+{
+	uint32_t MODER;
+} GPIO_TypeDef;
+
+typedef struct
+{
+	uint32_t Pin;
+	uint32_t Mode;
+	uint32_t Pull;
+	uint32_t Speed;
+	uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+typedef enum
+{
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIOB ((GPIO_TypeDef*)0x48000400)
+#define GPIOC ((GPIO_TypeDef*)0x48000800)
+#define GPIOD ((GPIO_TypeDef*)0x48000C00)
+#define GPIOE ((GPIO_TypeDef*)0x48001000)
+#define GPIO_PIN_2 0x0004
+#define GPIO_PIN_4 0x0010
+#define GPIO_PIN_6 0x0040
+#define GPIO_PIN_7 0x0080
+#define GPIO_PIN_10 0x0400
+#define GPIO_PIN_11 0x0800
+#define GPIO_PIN_13 0x2000
+#define GPIO_PIN_14 0x4000
+#define GPIO_MODE_INPUT 0x00
+#define GPIO_MODE_OUTPUT_PP 0x01
+#define GPIO_MODE_AF_PP 0x02
+#define GPIO_MODE_AF_OD 0x12
+#define GPIO_MODE_IT_RISING 0x10110000
+#define GPIO_MODE_IT_FALLING 0x10210000
+#define GPIO_NOPULL 0
+#define GPIO_PULLUP 1
+#define GPIO_SPEED_FREQ_LOW 0
+#define GPIO_SPEED_FREQ_HIGH 2
+#define GPIO_SPEED_FREQ_VERY_HIGH 3
+#define GPIO_AF4_I2C2 4
+#define GPIO_AF7_USART1 7
+static inline void HAL_GPIO_Init(GPIO_TypeDef* port, GPIO_InitTypeDef* init) { (void)port; (void)init; }
+static inline void HAL_GPIO_DeInit(GPIO_TypeDef* port, uint32_t pin) { (void)port; (void)pin; }
+static inline GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* port, uint16_t pin) { (void)port; (void)pin; return GPIO_PIN_RESET; }
+static inline void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint16_t pin, GPIO_PinState state) { (void)port; (void)pin; (void)state; }
+static inline void HAL_GPIO_TogglePin(GPIO_TypeDef* port, uint16_t pin) { (void)port; (void)pin; }
+
+/* DMA */
+typedef struct
+{
+	uint32_t Request;
+	uint32_t Direction;
+	uint32_t PeriphInc;
+	uint32_t MemInc;
+	uint32_t PeriphDataAlignment;
+	uint32_t MemDataAlignment;
+	uint32_t Mode;
+	uint32_t Priority;
+} DMA_InitTypeDef;
+
+typedef struct
+{
+	void* Instance;
+	DMA_InitTypeDef Init;
+} DMA_HandleTypeDef;
+
+#define DMA1_Channel4 ((void*)0x40020044)
+#define DMA1_Channel5 ((void*)0x40020058)
+#define DMA2_Channel6 ((void*)0x40020468)
+#define DMA_REQUEST_2 2
+#define DMA_REQUEST_3 3
+#define DMA_PERIPH_TO_MEMORY 0
+#define DMA_MEMORY_TO_PERIPH 0x10
+#define DMA_PINC_DISABLE 0
+#define DMA_MINC_ENABLE 0x80
+#define DMA_PDATAALIGN_BYTE 0
+#define DMA_MDATAALIGN_BYTE 0
+#define DMA_NORMAL 0
+#define DMA_PRIORITY_LOW 0
+#define __HAL_RCC_DMA2_CLK_ENABLE()
+#define __HAL_LINKDMA(handle, field, dma) ((handle)->field = &(dma))
+static inline HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma) { (void)hdma; return HAL_OK; }
+static inline HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef* hdma) { (void)hdma; return HAL_OK; }
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef* hdma);
+
+/* UART */
+typedef struct
+{
+	uint32_t CR1;
+} USART_TypeDef;
+
+#define USART1 ((USART_TypeDef*)0x40013800)
+#define HAL_UART_STATE_READY 0x20
+typedef struct
+{
+	DMA_HandleTypeDef* hdmatx;
+	uint32_t gState;
+	USART_TypeDef* Instance;
+} UART_HandleTypeDef;
+
+static inline HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef* huart) { (void)huart; return HAL_OK; }
+static inline HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef* huart) { (void)huart; return HAL_OK; }
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart);
+
+/* I2C: the transfers are defined by the test of the sensor bus */
+typedef struct
+{
+	uint32_t Timing;
+	uint32_t OwnAddress1;
+	uint32_t AddressingMode;
+	uint32_t DualAddressMode;
+	uint32_t OwnAddress2;
+	uint32_t GeneralCallMode;
+	uint32_t NoStretchMode;
+} I2C_InitTypeDef;
+
+typedef struct
+{
+	void* Instance;
+	I2C_InitTypeDef Init;
+	DMA_HandleTypeDef* hdmatx;
+	DMA_HandleTypeDef* hdmarx;
+} I2C_HandleTypeDef;
+
+#define I2C2 ((void*)0x40005800)
+#define I2C_ADDRESSINGMODE_7BIT 1
+#define I2C_DUALADDRESS_DISABLE 0
+#define I2C_GENERALCALL_DISABLE 0
+#define I2C_NOSTRETCH_DISABLE 0
+#define I2C_ANALOGFILTER_ENABLE 0
+#define I2C_MEMADD_SIZE_8BIT 1
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef* hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef* hi2c);
+static inline HAL_StatusTypeDef HAL_I2CEx_ConfigAnalogFilter(I2C_HandleTypeDef* hi2c, uint32_t filter) { (void)hi2c; (void)filter; return HAL_OK; }
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint32_t Trials, uint32_t Timeout);
+static inline HAL_StatusTypeDef HAL_I2C_Master_Transmit(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint8_t* pData,
+		uint16_t Size, uint32_t Timeout) { (void)hi2c; (void)DevAddress; (void)pData; (void)Size; (void)Timeout; return HAL_ERROR; }
+static inline HAL_StatusTypeDef HAL_I2C_Master_Receive(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint8_t* pData,
+		uint16_t Size, uint32_t Timeout) { (void)hi2c; (void)DevAddress; (void)pData; (void)Size; (void)Timeout; return HAL_ERROR; }
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef* hi2c);
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef* hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef* hi2c);
+
+/* Flash: 1 MB in two banks of 2 KB pages, as on the STM32L475VG */
+typedef struct
+{
+	uint32_t TypeErase;
+	uint32_t Banks;
+	uint32_t Page;
+	uint32_t NbPages;
+} FLASH_EraseInitTypeDef;
+
+#define FLASH_BASE 0x08000000UL
+#define FLASH_BANK_SIZE 0x00080000UL
+#define FLASH_PAGE_SIZE 0x00000800UL
+#define FLASH_BANK_1 1
+#define FLASH_BANK_2 2
+#define FLASH_TYPEERASE_PAGES 0
+#define FLASH_TYPEPROGRAM_DOUBLEWORD 0
+#define FLASH_FLAG_ALL_ERRORS 0xC3FA
+#define __HAL_FLASH_CLEAR_FLAG(flag) ((void)(flag))
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* PageError);
+
+#endif /* STM32L4XX_HAL_H */
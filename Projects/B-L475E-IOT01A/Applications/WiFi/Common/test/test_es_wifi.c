@@ -0,0 +1,239 @@
+/*******************************************************************************
+ * Host tests of the socket and destination cache of the ES-WiFi driver
+ * (es_wifi.c), with the SPI transport replaced by a fake module that records
+ * the AT commands it is sent and answers OK, ERROR or a failed send.
+ *******************************************************************************/
+
+
+#include "es_wifi.h"
+#include "logging.h"
+#include "testutil.h"
+
+uint32_t stub_ipsr;
+uint32_t stub_primask;
+
+static ES_WIFIObject_t wifi;
+
+/* Commands the fake module received since the last clearSent(), '\r' dropped */
+static char sent[512];
+
+/* Reply to the next command that reads one */
+#define REPLY_OK     "\r\nOK\r\n> "
+#define REPLY_ERROR  "\r\nERROR\r\n> "
+#define REPLY_FAILED "\r\n-1\r\nOK\r\n> "
+static const char* next_reply;
+static int resets;
+
+
+uint32_t HAL_GetTick(void)
+{
+	return 0;
+}
+
+
+void Log_Printf(uint8_t Level, const char *format, ...)
+{
+}
+
+
+static int8_t ioInit(uint16_t mode)
+{
+	if (mode == ES_WIFI_RESET)
+		++resets;
+	return 1;
+}
+
+
+static int8_t ioDeInit(void)
+{
+	return 0;
+}
+
+
+static void ioDelay(uint32_t ms)
+{
+}
+
+
+static int16_t ioSend(const uint8_t *cmd, uint16_t len, uint32_t timeout)
+{
+	size_t used = strlen(sent);
+	uint16_t i;
+
+	if (used > 0 && used < sizeof(sent) - 1)
+		sent[used++] = ' ';
+	for (i = 0; i < len && used < sizeof(sent) - 1; i++)
+	{
+		if (cmd[i] != '\r')
+			sent[used++] = cmd[i];
+	}
+	sent[used] = '\0';
+	return len;
+}
+
+
+static int16_t ioReceive(uint8_t *data, uint16_t len, uint32_t timeout)
+{
+	const char* reply = next_reply ? next_reply : REPLY_OK;
+
+	next_reply = NULL;
+	strcpy((char*)data, reply);
+	return strlen(reply);
+}
+
+
+static void clearSent(void)
+{
+	sent[0] = '\0';
+}
+
+
+static void wifiOpen(void)
+{
+	memset(&wifi, 0, sizeof(wifi));
+	ES_WIFI_RegisterBusIO(&wifi, ioInit, ioDeInit, ioDelay, ioSend, ioReceive);
+	wifi.Timeout = ES_WIFI_TIMEOUT;
+	ES_WIFI_HardResetModule(&wifi);
+	clearSent();
+}
+
+
+static ES_WIFI_Status_t sendTo(uint8_t socket, const char* data, uint32_t timeout, const uint8_t* ip, uint16_t port)
+{
+	uint16_t sentlen = 0;
+
+	clearSent();
+	return ES_WIFI_SendDataTo(&wifi, socket, (const uint8_t*)data, strlen(data), &sentlen, timeout, ip, port);
+}
+
+
+int test1(struct Options options)
+{
+	const uint8_t gateway[4] = {10, 0, 0, 2};
+	const uint8_t other[4] = {10, 0, 0, 3};
+	ES_WIFI_Status_t rc;
+
+	fprintf(xml, "<testcase classname=\"test_es_wifi\" name=\"datagram settings cached\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - only the socket settings that changed are sent before a datagram");
+
+	wifiOpen();
+	rc = sendTo(1, "ping", 100, gateway, 1884);
+	assert("first datagram sends all settings", rc == ES_WIFI_STATUS_OK &&
+			strcmp(sent, "P0=1 P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0, "sent %s\n", sent);
+	rc = sendTo(1, "pong", 100, gateway, 1884);
+	assert("same peer sends the datagram only", rc == ES_WIFI_STATUS_OK &&
+			strcmp(sent, "S3=0004 pong") == 0, "sent %s\n", sent);
+
+	rc = sendTo(1, "ping", 100, other, 1884);
+	assert("new address keeps the port", strcmp(sent, "P3=10.0.0.3 S3=0004 ping") == 0, "sent %s\n", sent);
+	rc = sendTo(1, "ping", 100, other, 1885);
+	assert("new port sets both", strcmp(sent, "P4=1885 P3=10.0.0.3 S3=0004 ping") == 0, "sent %s\n", sent);
+	rc = sendTo(1, "ping", 200, other, 1885);
+	assert("new write timeout", strcmp(sent, "S2=200 S3=0004 ping") == 0, "sent %s\n", sent);
+	rc = sendTo(1, "ping", 0, other, 1885);
+	assert("no timeout is the non-blocking timeout", strcmp(sent, "S2=1 S3=0004 ping") == 0, "sent %s\n", sent);
+
+	/* S2 may be global in the module firmware: another socket's value is not trusted */
+	rc = sendTo(2, "ping", 100, gateway, 1884);
+	assert("other socket selected and set up", strcmp(sent, "P0=2 P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0,
+			"sent %s\n", sent);
+	rc = sendTo(1, "ping", 1, other, 1885);
+	assert("back to the first socket, S2 sent again", rc == ES_WIFI_STATUS_OK &&
+			strcmp(sent, "P0=1 S2=1 S3=0004 ping") == 0, "sent %s\n", sent);
+	sendTo(1, "ping", 100, other, 1885);
+	rc = sendTo(2, "ping", 100, gateway, 1884);
+	assert("same S2 on the module and the socket", strcmp(sent, "P0=2 S3=0004 ping") == 0, "sent %s\n", sent);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	const uint8_t gateway[4] = {10, 0, 0, 2};
+	ES_WIFI_Conn_t conn;
+	ES_WIFI_Status_t rc;
+	uint16_t sentlen = 0;
+
+	fprintf(xml, "<testcase classname=\"test_es_wifi\" name=\"cache invalidated\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - the cache is dropped when the module state is not known");
+
+	wifiOpen();
+	sendTo(1, "ping", 100, gateway, 1884);
+	sendTo(2, "ping", 100, gateway, 1884);
+
+	/* Restarting a socket drops its own settings, not the other socket's */
+	memset(&conn, 0, sizeof(conn));
+	conn.Type = ES_WIFI_UDP_CONNECTION;
+	conn.Number = 1;
+	conn.LocalPort = 4000;
+	clearSent();
+	rc = ES_WIFI_StartClientConnection(&wifi, &conn);
+	assert("socket started", rc == ES_WIFI_STATUS_OK && strcmp(sent, "P0=1 P1=1 P2=4000 P6=1") == 0, "sent %s\n", sent);
+	sendTo(1, "ping", 100, gateway, 1884);
+	assert("started socket set up again", strcmp(sent, "P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0, "sent %s\n", sent);
+	sendTo(2, "ping", 100, gateway, 1884);
+	assert("other socket still cached", strcmp(sent, "P0=2 S3=0004 ping") == 0, "sent %s\n", sent);
+
+	clearSent();
+	rc = ES_WIFI_StopClientConnection(&wifi, &conn);
+	assert("socket stopped", rc == ES_WIFI_STATUS_OK && strcmp(sent, "P0=1 P6=0") == 0, "sent %s\n", sent);
+	sendTo(1, "ping", 100, gateway, 1884);
+	assert("stopped socket set up again", strcmp(sent, "P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0, "sent %s\n", sent);
+
+	/* A datagram the module refused: nothing it was told is trusted any more */
+	next_reply = REPLY_FAILED;
+	rc = sendTo(1, "ping", 100, gateway, 1884);
+	assert("failed send reported", rc == ES_WIFI_STATUS_ERROR, "rc %d\n", rc);
+	sendTo(1, "ping", 100, gateway, 1884);
+	assert("all set up after a failed send", strcmp(sent, "P0=1 P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0,
+			"sent %s\n", sent);
+	sendTo(2, "ping", 100, gateway, 1884);
+	assert("other socket dropped too", strcmp(sent, "P0=2 P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0,
+			"sent %s\n", sent);
+
+	/* A command that failed part way through the setup */
+	next_reply = REPLY_ERROR;
+	rc = sendTo(1, "ping", 100, gateway, 1884);
+	assert("failed selection stops the send", rc != ES_WIFI_STATUS_OK && strcmp(sent, "P0=1") == 0, "sent %s\n", sent);
+	sendTo(1, "ping", 100, gateway, 1884);
+	assert("all set up after a failed command", strcmp(sent, "P0=1 P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0,
+			"sent %s\n", sent);
+
+	/* Stream sends share the selection and S2 */
+	clearSent();
+	rc = ES_WIFI_SendData(&wifi, 1, (const uint8_t*)"tcp!", 4, &sentlen, 100);
+	assert("stream send uses the cache", rc == ES_WIFI_STATUS_OK && strcmp(sent, "S3=0004 tcp!") == 0, "sent %s\n", sent);
+
+	/* Resets */
+	clearSent();
+	rc = ES_WIFI_ResetModule(&wifi);
+	sendTo(1, "ping", 100, gateway, 1884);
+	assert("all set up after a soft reset", strcmp(sent, "P0=1 P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0,
+			"sent %s\n", sent);
+	resets = 0;
+	ES_WIFI_HardResetModule(&wifi);
+	sendTo(1, "ping", 100, gateway, 1884);
+	assert("all set up after a hard reset", resets == 1 &&
+			strcmp(sent, "P0=1 P4=1884 P3=10.0.0.2 S2=100 S3=0004 ping") == 0, "sent %s\n", sent);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2};
+
+	return run_tests(argc, argv, "test_es_wifi", tests, ARRAY_SIZE(tests));
+}
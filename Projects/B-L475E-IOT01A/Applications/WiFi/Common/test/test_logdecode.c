@@ -0,0 +1,313 @@
+/*******************************************************************************
+ * Host tests of Tools/logdecode.c: the lookup of strings in the allocated
+ * sections of an ELF, the printf() conversions of a deferred log record, and
+ * a capture of text and records decoded end to end.  The tool is included
+ * with its main() renamed; the ELF is a small image built by the test.
+ *******************************************************************************/
+
+
+#define main logdecode_main
+#include "../Tools/logdecode.c"
+#undef main
+#include "testutil.h"
+#include <unistd.h>
+
+static const char* elf_name = "test_logdecode.elf";
+static const char* capture_name = "test_logdecode.cap";
+static const char* output_name = "test_logdecode.out";
+
+/* Sections of the test image */
+#define RODATA_ADDR     0x08010000
+#define RODATA_OFFSET   64
+#define RODATA_SIZE     128
+#define NONUL_ADDR      0x08030000
+#define NONUL_OFFSET    (RODATA_OFFSET + RODATA_SIZE)
+#define COMMENT_ADDR    0x08020000
+#define BSS_ADDR        0x20000000
+#define SHDR_OFFSET     (NONUL_OFFSET + 4)
+#define SHDR_COUNT      5
+
+/* Strings of .rodata, at their offset in the section */
+#define FORMAT_CONNECT  0
+#define FORMAT_64BIT    32
+#define STRING_BROKER   48
+#define STRING_COMMENT  64
+static const char* rodata_strings[] = {
+	"%s connected to %s port %hu\n",
+	"%lld oops %d\n",
+	"broker.local",
+	"not allocated",
+};
+
+static uint8_t image[SHDR_OFFSET + SHDR_COUNT * 40];
+
+/* Output of the tool */
+static char decoded[1024];
+
+
+static void put16(uint8_t* p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+
+static void put32(uint8_t* p, uint32_t v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+
+static void section(int index, uint32_t type, uint32_t flags, uint32_t addr, uint32_t offset, uint32_t size)
+{
+	uint8_t* sh = &image[SHDR_OFFSET + index * 40];
+
+	put32(&sh[4], type);
+	put32(&sh[8], flags);
+	put32(&sh[12], addr);
+	put32(&sh[16], offset);
+	put32(&sh[20], size);
+}
+
+
+/* Writes an ELF with .rodata, a .bss over the same bytes, a section that is
+ * not allocated and one whose bytes have no NUL, and loads it */
+static int makeElf(void)
+{
+	FILE* f;
+	int i;
+
+	memset(image, 0, sizeof(image));
+	memcpy(image, "\177ELF", 4);
+	image[4] = 1;                                 /* 32-bit */
+	image[5] = 1;                                 /* little-endian */
+	put32(&image[32], SHDR_OFFSET);
+	put16(&image[46], 40);
+	put16(&image[48], SHDR_COUNT);
+	for (i = 0; i < 4; i++)
+		strcpy((char*)&image[RODATA_OFFSET + 16 * ((i == 0) ? 0 : i + 1)], rodata_strings[i]);
+	memcpy(&image[NONUL_OFFSET], "abcd", 4);
+
+	section(1, 1, SHF_ALLOC, RODATA_ADDR, RODATA_OFFSET, STRING_COMMENT);
+	section(2, SHT_NOBITS, SHF_ALLOC | 1, BSS_ADDR, RODATA_OFFSET, RODATA_SIZE);
+	section(3, 1, 0, COMMENT_ADDR, RODATA_OFFSET + STRING_COMMENT, RODATA_SIZE - STRING_COMMENT);
+	section(4, 1, SHF_ALLOC, NONUL_ADDR, NONUL_OFFSET, 4);
+
+	if ((f = fopen(elf_name, "wb")) == NULL)
+		return -1;
+	fwrite(image, 1, sizeof(image), f);
+	fclose(f);
+	free(elf);
+	return load_elf(elf_name);
+}
+
+
+/* Appends a record to the capture; strings holds the copy of each argument in mask */
+static void putRecord(FILE* f, uint8_t level, uint32_t tick, uint32_t format,
+		uint32_t count, const uint32_t* args, uint8_t mask, const char* const* strings)
+{
+	uint8_t header[LOG_DEFER_HEADER_SIZE];
+	uint8_t arg[4];
+	uint32_t i;
+
+	header[0] = LOG_DEFER_MARKER;
+	header[1] = (level << 4) | count;
+	header[2] = mask;
+	put32(&header[3], tick);
+	put32(&header[7], format);
+	fwrite(header, 1, sizeof(header), f);
+	for (i = 0; i < count && args != NULL; i++)
+	{
+		put32(arg, args[i]);
+		fwrite(arg, 1, 4, f);
+	}
+	for (i = 0; i < count && strings != NULL; i++)
+	{
+		if (mask & (1U << i))
+		{
+			fputc(strlen(strings[i]), f);
+			fputs(strings[i], f);
+		}
+	}
+}
+
+
+/* Runs the tool on the capture, its stdout going to the output file */
+static int runTool(void)
+{
+	char* argv[] = {"logdecode", (char*)elf_name, (char*)capture_name, NULL};
+	FILE* f = fopen(output_name, "w");
+	size_t len = 0;
+	int saved, rc;
+
+	fflush(stdout);
+	saved = dup(fileno(stdout));
+	dup2(fileno(f), fileno(stdout));
+	column = 0;
+	rc = logdecode_main(3, argv);
+	fflush(stdout);
+	dup2(saved, fileno(stdout));
+	close(saved);
+	fclose(f);
+
+	if ((f = fopen(output_name, "r")) != NULL)
+	{
+		len = fread(decoded, 1, sizeof(decoded) - 1, f);
+		fclose(f);
+	}
+	decoded[len] = '\0';
+	return rc;
+}
+
+
+int test1(struct Options options)
+{
+	const char* s;
+
+	fprintf(xml, "<testcase classname=\"test_logdecode\" name=\"ELF strings\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - strings found in the allocated sections of the ELF only");
+
+	assert("test ELF loaded", makeElf() == 0, "%s\n", elf_name);
+	s = elf_string(RODATA_ADDR + FORMAT_CONNECT);
+	assert("string at the start of a section", s != NULL && strcmp(s, rodata_strings[0]) == 0, "found %s\n", s);
+	s = elf_string(RODATA_ADDR + STRING_BROKER + 7);
+	assert("address inside a string", s != NULL && strcmp(s, "local") == 0, "found %s\n", s);
+	s = elf_string(RODATA_ADDR + STRING_COMMENT);
+	assert("end of the section", s == NULL, "found %s\n", s);
+	s = elf_string(RODATA_ADDR - 1);
+	assert("before the section", s == NULL, "found %s\n", s);
+	s = elf_string(BSS_ADDR);
+	assert("NOBITS section has no bytes in the file", s == NULL, "found %s\n", s);
+	s = elf_string(COMMENT_ADDR);
+	assert("section not allocated", s == NULL, "found %s\n", s);
+	s = elf_string(NONUL_ADDR);
+	assert("string without a NUL in its section", s == NULL, "found %s\n", s);
+	s = elf_string(0x20001000);
+	assert("address of no section", s == NULL, "found %s\n", s);
+
+	/* Section headers past the end of a truncated file are not read */
+	put16(&elf[48], 1000);
+	s = elf_string(RODATA_ADDR + STRING_BROKER);
+	assert("truncated section table", s != NULL && strcmp(s, "broker.local") == 0, "found %s\n", s);
+	put16(&elf[48], SHDR_COUNT);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	char* none[LOG_DEFER_MAX_ARGS] = {NULL};
+	char ram[] = "ram";
+	char* copies[3] = {ram, NULL, NULL};
+	char out[128];
+	char small[8];
+
+	fprintf(xml, "<testcase classname=\"test_logdecode\" name=\"conversions\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - the printf() conversions of a record formatted as on the device");
+
+	makeElf();
+	format_record(out, sizeof(out), "%hhd %hhu %hd %hu|", (uint32_t[]){0xFF, 0x1FF, 0x18000, 0x12345}, 4, none);
+	assert("char and short arguments cast down", strcmp(out, "-1 255 -32768 9029|") == 0, "out %s\n", out);
+	format_record(out, sizeof(out), "%lu %ld %d %i", (uint32_t[]){0xFFFFFFFF, 0xFFFFFFFF, 0x80000000, 12}, 4, none);
+	assert("32-bit arguments", strcmp(out, "4294967295 -1 -2147483648 12") == 0, "out %s\n", out);
+	format_record(out, sizeof(out), "%08x|%-4d|%+d|%X|%o|%c|%p|100%%",
+			(uint32_t[]){0xBEEF, 7, 7, 0xAB, 8, 'A' | 0x100, 0x20000010}, 7, none);
+	assert("flags, width and other conversions", strcmp(out, "0000beef|7   |+7|AB|10|A|0x20000010|100%") == 0,
+			"out %s\n", out);
+
+	format_record(out, sizeof(out), "%s and %s and %.3s!",
+			(uint32_t[]){BSS_ADDR + 0x100, RODATA_ADDR + STRING_BROKER, RODATA_ADDR + STRING_BROKER}, 3, copies);
+	assert("%s from the copy or from the ELF", strcmp(out, "ram and broker.local and bro!") == 0, "out %s\n", out);
+	format_record(out, sizeof(out), "%s!", (uint32_t[]){BSS_ADDR + 0x200}, 1, none);
+	assert("%s without a copy or a string in the ELF", strcmp(out, "<0x20000200>!") == 0, "out %s\n", out);
+
+	format_record(out, sizeof(out), "%lld %d", (uint32_t[]){1, 2, 3}, 3, none);
+	assert("64-bit argument rejected, the others no longer known", strcmp(out, "<%d?> <%d?>") == 0, "out %s\n", out);
+	format_record(out, sizeof(out), "%u %f %u", (uint32_t[]){1, 2, 3}, 3, none);
+	assert("floating point rejected", strcmp(out, "1 <%f?> <%u?>") == 0, "out %s\n", out);
+	format_record(out, sizeof(out), "%*d|%.*s", (uint32_t[]){4, 5}, 2, none);
+	assert("width from an argument rejected", strcmp(out, "<%d?>|<%s?>") == 0, "out %s\n", out);
+	format_record(out, sizeof(out), "%d %d", (uint32_t[]){5}, 1, none);
+	assert("missing argument", strcmp(out, "5 <%d?>") == 0, "out %s\n", out);
+	format_record(out, sizeof(out), "end %", (uint32_t[]){5}, 1, none);
+	assert("conversion cut by the end of the format", strcmp(out, "end ") == 0, "out %s\n", out);
+
+	format_record(small, sizeof(small), "%s", (uint32_t[]){RODATA_ADDR + STRING_BROKER}, 1, none);
+	assert("output cut at its size", strcmp(small, "broker.") == 0, "out %s\n", small);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test3(struct Options options)
+{
+	const char* copies[] = {"wifi", NULL, NULL};
+	const char* expected =
+		"boot\n"
+		"1000 I wifi connected to broker.local port 1883\n"
+		"> \n"
+		"2000 E <%d?> oops <%d?>\n"
+		"3000 W <format 0x08040000 not in the ELF> 0x00000001 0x00000002\n"
+		"done\n";
+	FILE* f;
+	int rc;
+
+	fprintf(xml, "<testcase classname=\"test_logdecode\" name=\"capture\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 3 - a console capture of text and records decoded");
+
+	makeElf();
+	f = fopen(capture_name, "wb");
+	fputs("boot\n", f);
+	putRecord(f, 3, 1000, RODATA_ADDR + FORMAT_CONNECT, 3,
+			(uint32_t[]){BSS_ADDR + 0x40, RODATA_ADDR + STRING_BROKER, 0x10000 + 1883}, 0x01, copies);
+	fputs("> ", f);
+	putRecord(f, 1, 2000, RODATA_ADDR + FORMAT_64BIT, 3, (uint32_t[]){1, 0, 2}, 0, NULL);
+	putRecord(f, 2, 3000, 0x08040000, 2, (uint32_t[]){1, 2}, 0, NULL);
+	fputs("done\n", f);
+	fclose(f);
+	rc = runTool();
+	assert("capture decoded", rc == 0, "rc %d\n", rc);
+	assert("text kept, records as lines of their own", strcmp(decoded, expected) == 0, "output\n%s", decoded);
+
+	/* Level 0, a mask bit past the count, more than LOG_DEFER_MAX_ARGS, and a truncated record */
+	f = fopen(capture_name, "wb");
+	fputs("ok\n", f);
+	putRecord(f, 0, 1, RODATA_ADDR, 0, NULL, 0, NULL);
+	putRecord(f, 3, 1, RODATA_ADDR, 0, NULL, 0x01, NULL);
+	putRecord(f, 3, 1, RODATA_ADDR, LOG_DEFER_MAX_ARGS + 1, NULL, 0, NULL);
+	putRecord(f, 3, 4000, RODATA_ADDR + FORMAT_CONNECT, 3,
+			(uint32_t[]){BSS_ADDR + 0x40, RODATA_ADDR + STRING_BROKER, 1883}, 0x01, copies);
+	fflush(f);
+	rc = ftruncate(fileno(f), 3 + 4 * LOG_DEFER_HEADER_SIZE + 4 + 3);
+	fclose(f);
+	rc = runTool();
+	assert("malformed records reported", rc == 1, "rc %d\n", rc);
+	assert("nothing printed for them", strcmp(decoded, "ok\n") == 0, "output\n%s", decoded);
+
+	MyLog(LOGA_INFO, "TEST3: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2, test3};
+
+	return run_tests(argc, argv, "test_logdecode", tests, ARRAY_SIZE(tests));
+}
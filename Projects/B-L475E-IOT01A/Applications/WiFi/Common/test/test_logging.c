@@ -0,0 +1,469 @@
+/*******************************************************************************
+ * Host tests of the console ring (logging.c), with the UART DMA replaced by a
+ * fake that completes when the test says so.  logging.c is included rather
+ * than linked so that the tests can start its free-running indices anywhere.
+ *******************************************************************************/
+
+
+#include "../Src/logging.c"
+#include "testutil.h"
+#include <sys/mman.h>
+
+uint32_t stub_ipsr;
+uint32_t stub_primask;
+
+static UART_HandleTypeDef uart = {NULL, HAL_UART_STATE_READY};
+static uint8_t* sending;
+static uint16_t sending_len;
+static int uart_sync;          /* complete each transfer as soon as it starts */
+static int chunks_outside;     /* transfers reaching past the end of the ring */
+static char sent[200000];
+static uint32_t sent_len;
+
+
+uint32_t HAL_GetTick(void)
+{
+	return 42;
+}
+
+
+void uartComplete(void)
+{
+	if (sending == NULL)
+		return;
+	memcpy(&sent[sent_len], sending, sending_len);
+	sent_len += sending_len;
+	sending = NULL;
+	stub_ipsr = 16 + USART1_IRQn;
+	HAL_UART_TxCpltCallback(&uart);
+	stub_ipsr = 0;
+}
+
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size)
+{
+	if (sending != NULL)
+		return HAL_BUSY;
+	if (pData < LogBuffer || pData + Size > LogBuffer + LOG_BUFFER_SIZE || Size == 0)
+		++chunks_outside;
+	sending = pData;
+	sending_len = Size;
+	if (uart_sync)
+		uartComplete();
+	return HAL_OK;
+}
+
+
+void uartDrain(void)
+{
+	while (sending != NULL || !Log_IsIdle())
+		uartComplete();
+}
+
+
+/* Empties the ring with its head and tail at index, and attaches the UART. */
+void resetLog(uint32_t index)
+{
+	LogHead = LogTail = index;
+	LogSending = 0;
+	LogRunLevel = LOG_LEVEL;
+	LogBlocking = 0;
+	LogLineLen = 0;
+	memset(&LogStats, 0, sizeof(LogStats));
+	sending = NULL;
+	uart_sync = 0;
+	chunks_outside = 0;
+	sent_len = 0;
+	Log_Init(&uart);
+}
+
+
+/* Prints 500 lines of 20 to 40 bytes through Log_Putc(), with the UART
+ * finishing a transfer every third line, and returns the bytes printed. */
+uint32_t printLines(char* expected)
+{
+	uint32_t len = 0;
+	int i, k, n;
+
+	for (i = 0; i < 500; ++i)
+	{
+		char line[64];
+
+		n = sprintf(line, "line %d %.*s\n", i, i % 21, "....................");
+		for (k = 0; k < n; ++k)
+			Log_Putc(line[k]);
+		memcpy(&expected[len], line, n);
+		len += n;
+		if (i % 3 == 0)
+			uartComplete();
+	}
+	uartDrain();
+	return len;
+}
+
+
+int test1(struct Options options)
+{
+	static char expected[sizeof(sent)];
+	Log_Stats_t stats;
+	uint32_t len = 0;
+
+	fprintf(xml, "<testcase classname=\"test_logging\" name=\"ring\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - text through the ring arrives byte-exact");
+
+	resetLog(0);
+	len = printLines(expected);
+	Log_GetStats(&stats);
+	assert("nothing dropped", stats.Dropped == 0 && stats.DroppedIsr == 0, "dropped %u\n", stats.Dropped);
+	assert("everything written", stats.Written == len, "written %u\n", stats.Written);
+	assert1("everything sent", sent_len == len, "sent %u, expected %u\n", sent_len, len);
+	assert("sent in order", memcmp(sent, expected, len) == 0, "length %u\n", len);
+	assert("transfers stay inside the ring", chunks_outside == 0, "%d outside\n", chunks_outside);
+	assert("high water inside the ring", stats.HighWater > 0 && stats.HighWater <= LOG_BUFFER_SIZE,
+			"high water %u\n", stats.HighWater);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	static char expected[sizeof(sent)];
+	Log_Stats_t stats;
+	uint32_t len = 0;
+
+	fprintf(xml, "<testcase classname=\"test_logging\" name=\"index wrap\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - ring indices wrapping at 2^32");
+
+	/* Off the ring alignment, so that a line straddles both wraps */
+	resetLog(0xFFFFFFFF - 3 * LOG_BUFFER_SIZE + 5);
+	len = printLines(expected);
+	Log_GetStats(&stats);
+	assert("indices wrapped", LogHead < len && LogHead == LogTail, "head %u\n", LogHead);
+	assert("nothing dropped", stats.Dropped == 0, "dropped %u\n", stats.Dropped);
+	assert1("everything sent", sent_len == len, "sent %u, expected %u\n", sent_len, len);
+	assert("sent in order", memcmp(sent, expected, len) == 0, "length %u\n", len);
+	assert("transfers stay inside the ring", chunks_outside == 0, "%d outside\n", chunks_outside);
+	assert("high water inside the ring", stats.HighWater <= LOG_BUFFER_SIZE, "high water %u\n", stats.HighWater);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test3(struct Options options)
+{
+	static char big[LOG_BUFFER_SIZE + 1];
+	Log_Stats_t stats;
+	uint32_t attempted = 0, i = 0;
+	int last = -1, next = 0, n = 0;
+	char* p = NULL;
+
+	fprintf(xml, "<testcase classname=\"test_logging\" name=\"overflow\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 3 - a full ring drops whole messages");
+
+	resetLog(0x7FFFFF00);
+	for (i = 0; i < 200; ++i)
+	{
+		attempted += snprintf(NULL, 0, "42 I overflow %u\n", i);
+		LOG_INFO("overflow %u\n", i);
+	}
+	Log_GetStats(&stats);
+	assert1("written and dropped add up", stats.Written + stats.Dropped == attempted,
+			"written %u, dropped %u\n", stats.Written, stats.Dropped);
+	assert("ring filled", stats.Dropped > 0 && stats.HighWater > LOG_BUFFER_SIZE - 20 &&
+			stats.HighWater <= LOG_BUFFER_SIZE, "high water %u\n", stats.HighWater);
+
+	uartDrain();
+	assert("only what was written is sent", sent_len == stats.Written, "sent %u\n", sent_len);
+	sent[sent_len] = '\0';
+	for (p = sent; *p != '\0'; p += n)
+	{
+		n = 0;
+		if (sscanf(p, "42 I overflow %d\n%n", &next, &n) != 1 || n == 0 || next <= last)
+			break;
+		last = next;
+	}
+	assert("sent text is whole messages, in order", *p == '\0', "stopped at offset %d\n", (int)(p - sent));
+	assert("the first messages kept", last >= 0 && strncmp(sent, "42 I overflow 0\n", 16) == 0, "last %d\n", last);
+
+	LOG_INFO("after\n");
+	uartDrain();
+	assert("ring usable after the overflow", sent_len == stats.Written + 11 &&
+			memcmp(&sent[stats.Written], "42 I after\n", 11) == 0, "sent %u\n", sent_len);
+
+	memset(big, 'x', sizeof(big));
+	i = Log_Write(big, sizeof(big));
+	Log_GetStats(&stats);
+	assert("text larger than the ring dropped", i == 0 && LogHead == LogTail, "rc was %u\n", i);
+
+	MyLog(LOGA_INFO, "TEST3: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test4(struct Options options)
+{
+	static char dump[10 * 1000];
+	Log_Stats_t stats;
+	uint32_t rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test_logging\" name=\"counters\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 4 - interrupts, levels, errors and blocking writes");
+
+	resetLog(0);
+	stub_ipsr = 16 + 3;
+	rc = Log_Write("isr\n", 4);
+	stub_ipsr = 0;
+	Log_GetStats(&stats);
+	assert("text from an interrupt dropped", rc == 0 && stats.DroppedIsr == 4 && LogHead == 0, "rc was %u\n", rc);
+
+	LOG_DEBUG("compiled out\n");
+	Log_GetStats(&stats);
+	assert("debug above LOG_LEVEL compiled out", stats.Skipped == 0 && LogHead == 0, "skipped %u\n", stats.Skipped);
+	Log_SetLevel(LOG_LEVEL_ERROR);
+	LOG_WARN("skipped\n");
+	LOG_INFO("skipped\n");
+	LOG_ERROR("kept\n");
+	Log_GetStats(&stats);
+	assert("messages above the run-time level skipped", stats.Skipped == 2, "skipped %u\n", stats.Skipped);
+	uartDrain();
+	assert("error prefix", sent_len == 10 && memcmp(sent, "42 E kept\n", 10) == 0, "sent %u\n", sent_len);
+
+	sent_len = 0;
+	Log_SetLevel(LOG_LEVEL_INFO);
+	LOG_INFO("lost\n");
+	LOG_INFO("next\n");
+	sending = NULL;            /* the HAL aborts the transfer before the callback */
+	HAL_UART_ErrorCallback(&uart);
+	Log_GetStats(&stats);
+	assert("chunk given up on a UART error", stats.Dropped == 10, "dropped %u\n", stats.Dropped);
+	uartDrain();
+	assert("next chunk sent after the error", sent_len == 10 && memcmp(sent, "42 I next\n", 10) == 0,
+			"sent %u\n", sent_len);
+
+	resetLog(0);
+	uart_sync = 1;
+	Log_SetBlocking(1);
+	memset(dump, 'd', sizeof(dump));
+	for (rc = 0; rc < 10; ++rc)
+		Log_Write(&dump[rc * 1000], 1000);
+	uartDrain();
+	Log_GetStats(&stats);
+	assert("blocking writes wait for room", stats.Dropped == 0 && sent_len == sizeof(dump),
+			"dropped %u\n", stats.Dropped);
+	stub_primask = 1;
+	Log_Write(dump, LOG_BUFFER_SIZE);
+	Log_Write(dump, LOG_BUFFER_SIZE);
+	stub_primask = 0;
+	Log_GetStats(&stats);
+	assert("no waiting with interrupts masked", stats.Dropped == LOG_BUFFER_SIZE, "dropped %u\n", stats.Dropped);
+	Log_SetBlocking(0);
+
+	MyLog(LOGA_INFO, "TEST4: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test5(struct Options options)
+{
+	static char expected[LOG_BUFFER_SIZE * 2];
+	char line[64];
+	Log_Stats_t stats;
+	uint32_t attempted = 0, i = 0;
+	int last = -1, next = 0, n = 0, k = 0;
+	char* p = NULL;
+
+	fprintf(xml, "<testcase classname=\"test_logging\" name=\"printf lines\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 5 - printf() output queued a line at a time");
+
+	resetLog(0);
+	for (p = "prompt> "; *p != '\0'; ++p)
+		Log_Putc(*p);
+	assert("line held until its end", LogHead == 0, "head %u\n", LogHead);
+	Log_Flush();
+	uartDrain();
+	assert("flushed without its end", sent_len == 8 && memcmp(sent, "prompt> ", 8) == 0, "sent %u\n", sent_len);
+
+	sent_len = 0;
+	for (p = "x = "; *p != '\0'; ++p)
+		Log_Putc(*p);
+	LOG_INFO("between\n");
+	Log_Putc('1');
+	Log_Putc('\n');
+	uartDrain();
+	assert("order kept with other messages", sent_len == 19 && memcmp(sent, "x = 42 I between\n1\n", 19) == 0,
+			"sent %u\n", sent_len);
+
+	sent_len = 0;
+	stub_ipsr = 16 + 3;
+	Log_Putc('!');
+	stub_ipsr = 0;
+	Log_GetStats(&stats);
+	assert("character from an interrupt dropped", stats.DroppedIsr == 1 && LogLineLen == 0, "dropped %u\n", stats.DroppedIsr);
+
+	/* Longer than the line buffer: queued in pieces, nothing lost */
+	memset(expected, 'L', 3 * LOG_LINE_SIZE);
+	expected[3 * LOG_LINE_SIZE] = '\n';
+	for (i = 0; i <= 3 * LOG_LINE_SIZE; ++i)
+		Log_Putc(expected[i]);
+	uartDrain();
+	assert("long line sent whole", sent_len == 3 * LOG_LINE_SIZE + 1 && memcmp(sent, expected, sent_len) == 0,
+			"sent %u\n", sent_len);
+
+	/* The UART is stalled: lines stop fitting, and are dropped whole */
+	resetLog(0x7FFFFF00);
+	for (i = 0; i < 200; ++i)
+	{
+		n = sprintf(line, "putc %u %.*s\n", i, (int)(1 + i % 20), "....................");
+		for (k = 0; k < n; ++k)
+			Log_Putc(line[k]);
+		attempted += n;
+	}
+	Log_GetStats(&stats);
+	assert1("written and dropped add up", stats.Written + stats.Dropped == attempted,
+			"written %u, dropped %u\n", stats.Written, stats.Dropped);
+	assert("ring filled", stats.Dropped > 0, "dropped %u\n", stats.Dropped);
+	uartDrain();
+	sent[sent_len] = '\0';
+	for (p = sent; *p != '\0'; p += n)
+	{
+		n = 0;
+		if (sscanf(p, "putc %d %*[.]%n", &next, &n) != 1 || n == 0 || p[n] != '\n' || next <= last)
+			break;
+		n++;
+		last = next;
+	}
+	assert("sent text is whole lines, in order", *p == '\0', "stopped at offset %d\n", (int)(p - sent));
+	assert("the first lines kept", last > 0 && strncmp(sent, "putc 0 .\n", 9) == 0, "last %d\n", last);
+
+	MyLog(LOGA_INFO, "TEST5: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+/* Maps host memory at the address of an SRAM, so that Log_Defer() can copy
+ * the strings of arguments pointing there. */
+static char* mapSram(uint32_t base, uint32_t size)
+{
+	void* p = mmap((void*)(uintptr_t)base, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+	return (p == (void*)(uintptr_t)base) ? p : NULL;
+}
+
+
+int test6(struct Options options)
+{
+	static const char format[] = "at %s %d %s %u\n";
+	const uint8_t* r = (const uint8_t*)sent;
+	char* sram1 = mapSram(SRAM1_BASE, SRAM1_SIZE_MAX);
+	char* sram2 = mapSram(SRAM2_BASE, SRAM2_SIZE);
+	uint32_t address = (uint32_t)(uintptr_t)format;
+	uint32_t flash = 0x08012345;
+	uint32_t resp = SRAM1_BASE + 0x100;
+	uint32_t last = SRAM1_BASE + SRAM1_SIZE_MAX - 5;
+	uint32_t cmd = SRAM2_BASE + 0x40;
+	uint32_t value = 0;
+	Log_Stats_t stats;
+
+	fprintf(xml, "<testcase classname=\"test_logging\" name=\"deferred records\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 6 - deferred record layout and the copies of strings in RAM");
+
+	assert("SRAM mapped at its target address", sram1 != NULL && sram2 != NULL, "%s\n", "mmap failed");
+	if (sram1 == NULL || sram2 == NULL)
+		goto exit;
+	memset(&sram1[0x100], 'r', 40);
+	sram1[0x100 + 40] = '\0';
+	memcpy(&sram1[SRAM1_SIZE_MAX - 5], "tail!", 5);      /* no NUL before the end of SRAM1 */
+	strcpy(&sram2[0x40], "P0=1");
+
+	resetLog(0);
+	Log_Defer(LOG_LEVEL_WARN, 4, format, resp, -2, flash, 7u);
+	uartDrain();
+	assert("header", sent_len > LOG_DEFER_HEADER_SIZE && r[0] == LOG_DEFER_MARKER &&
+			r[1] == ((LOG_LEVEL_WARN << 4) | 4) && r[2] == 0x01, "sent %u\n", sent_len);
+	memcpy(&value, &r[3], 4);
+	assert("tick", value == 42, "tick %u\n", value);
+	memcpy(&value, &r[7], 4);
+	assert("format address", value == address, "address %x\n", value);
+	r += LOG_DEFER_HEADER_SIZE;
+	memcpy(&value, &r[4], 4);
+	assert("arguments as 32-bit words", memcmp(&r[0], &resp, 4) == 0 && value == (uint32_t)-2 &&
+			memcmp(&r[8], &flash, 4) == 0 && r[12] == 7 && r[13] == 0, "argument 1 %x\n", value);
+	r += 16;
+	assert("RAM string cut at LOG_DEFER_STRING_SIZE", r[0] == LOG_DEFER_STRING_SIZE &&
+			memcmp(&r[1], &sram1[0x100], LOG_DEFER_STRING_SIZE) == 0, "length %u\n", r[0]);
+	r += 1 + LOG_DEFER_STRING_SIZE;
+	assert("flash string not copied", r == (const uint8_t*)&sent[sent_len], "%d bytes more\n",
+			(int)((const uint8_t*)&sent[sent_len] - r));
+
+	sent_len = 0;
+	r = (const uint8_t*)sent;
+	Log_Defer(LOG_LEVEL_ERROR, 3, "%s %s %s\n", last, cmd, SRAM2_BASE + SRAM2_SIZE);
+	uartDrain();
+	assert("mask of the RAM arguments", r[1] == ((LOG_LEVEL_ERROR << 4) | 3) && r[2] == 0x03, "mask %x\n", r[2]);
+	r += LOG_DEFER_HEADER_SIZE + 12;
+	assert("copy stops at the end of SRAM1", r[0] == 5 && memcmp(&r[1], "tail!", 5) == 0, "length %u\n", r[0]);
+	r += 6;
+	assert("SRAM2 string copied to its NUL", r[0] == 4 && memcmp(&r[1], "P0=1", 4) == 0, "length %u\n", r[0]);
+	r += 5;
+	assert("nothing past the copies", r == (const uint8_t*)&sent[sent_len], "%d bytes more\n",
+			(int)((const uint8_t*)&sent[sent_len] - r));
+
+	sent_len = 0;
+	Log_Defer(LOG_LEVEL_INFO, 0, "no arguments\n");
+	uartDrain();
+	assert("record without arguments", sent_len == LOG_DEFER_HEADER_SIZE && sent[2] == 0, "sent %u\n", sent_len);
+
+	sent_len = 0;
+	Log_SetLevel(LOG_LEVEL_WARN);
+	Log_Defer(LOG_LEVEL_INFO, 0, "skipped\n");
+	Log_SetLevel(LOG_LEVEL_INFO);
+	Log_Defer(LOG_LEVEL_INFO, LOG_DEFER_MAX_ARGS + 1, "too many %d %d %d %d %d %d %d\n", 1, 2, 3, 4, 5, 6, 7);
+	uartDrain();
+	Log_GetStats(&stats);
+	assert("records above the level or with too many arguments skipped", sent_len == 0 && stats.Skipped == 2,
+			"skipped %u\n", stats.Skipped);
+	assert("argument count macro", LOG_DEFER_NARGS("f") == 0 && LOG_DEFER_NARGS("f", 1, 2, 3) == 3 &&
+			LOG_DEFER_NARGS("f", 1, 2, 3, 4, 5, 6) == 6, "%d\n", LOG_DEFER_NARGS("f", 1));
+
+	munmap(sram1, SRAM1_SIZE_MAX);
+	munmap(sram2, SRAM2_SIZE);
+exit:
+	MyLog(LOGA_INFO, "TEST6: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2, test3, test4, test5, test6};
+
+	return run_tests(argc, argv, "test_logging", tests, ARRAY_SIZE(tests));
+}
@@ -0,0 +1,117 @@
+/*******************************************************************************
+ * Host tests of the report-by-exception channels (report.c).
+ *******************************************************************************/
+
+
+#include "report.h"
+#include "telemetry.h"
+#include "testutil.h"
+
+
+int test1(struct Options options)
+{
+	Report_Channel_t temperature, pressure;
+	int temperature_reports = 0, pressure_reports = 0;
+	uint32_t t = 0;
+
+	fprintf(xml, "<testcase classname=\"test_report\" name=\"drift\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - two hours of slowly drifting readings");
+
+	/* 0.2 degC or 0.05 %, at most every 10 s, and at least every hour */
+	Report_Init(&temperature, TELEMETRY_TEMPERATURE, 20, 0, 10000, 3600000);
+	Report_Init(&pressure, TELEMETRY_PRESSURE, 0, 5, 10000, 3600000);
+	for (t = 0; t < 7200000; t += 5000)
+	{
+		int32_t temperature_value = 2000 + (int32_t)((t / 1000) % 600) / 100;   /* 20.00 to 20.05 degC */
+		int32_t pressure_value = 10130 + (int32_t)(t / 600000);                 /* +0.1 hPa every 10 min */
+
+		if (Report_IsDue(&temperature, t, temperature_value))
+		{
+			Report_Commit(&temperature, t, temperature_value);
+			++temperature_reports;
+		}
+		if (Report_IsDue(&pressure, t, pressure_value))
+		{
+			Report_Commit(&pressure, t, pressure_value);
+			++pressure_reports;
+		}
+	}
+	assert("temperature reported at start and after MaxInterval", temperature_reports == 2,
+			"reports were %d\n", temperature_reports);
+	assert("pressure reported at start and after MaxInterval", pressure_reports == 2,
+			"reports were %d\n", pressure_reports);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	Report_Channel_t channel;
+	uint32_t rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test_report\" name=\"deadbands\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - deadbands and intervals");
+
+	Report_Init(&channel, TELEMETRY_TEMPERATURE, 20, 0, 10000, 60000);
+	rc = Report_IsDue(&channel, 123456, -4000);
+	assert("first reading reported", rc == 1, "rc was %u\n", rc);
+	Report_Commit(&channel, 1000, 2000);
+	rc = Report_IsDue(&channel, 2000, 3000);
+	assert("large change held back until MinInterval", rc == 0, "rc was %u\n", rc);
+	rc = Report_IsDue(&channel, 11000, 2019);
+	assert("change inside the deadband not reported", rc == 0, "rc was %u\n", rc);
+	rc = Report_IsDue(&channel, 11000, 1980);
+	assert("change of the deadband reported", rc == 1, "rc was %u\n", rc);
+	rc = Report_IsDue(&channel, 61000, 2000);
+	assert("unchanged value reported after MaxInterval", rc == 1, "rc was %u\n", rc);
+	rc = Report_IsDue(&channel, 61000, 1980);
+	assert("reading stays due until committed", rc == 1, "rc was %u\n", rc);
+
+	Report_Commit(&channel, 0xFFFFF000, 2000);
+	rc = Report_IsDue(&channel, 0x1000, 2000);
+	assert("tick wrap is not MaxInterval", rc == 0, "rc was %u\n", rc);
+	rc = Report_IsDue(&channel, 0x1000 + 10000, 2020);
+	assert("tick wrap counts MinInterval", rc == 1, "rc was %u\n", rc);
+
+	Report_Init(&channel, TELEMETRY_PRESSURE, 0, 100, 0, 0);
+	Report_Commit(&channel, 0, -10000);
+	rc = Report_IsDue(&channel, 0x7FFFFFFF, -10099);
+	assert("change under 1 % not reported, and no MaxInterval", rc == 0, "rc was %u\n", rc);
+	rc = Report_IsDue(&channel, 1, -9900);
+	assert("change of 1 % reported", rc == 1, "rc was %u\n", rc);
+
+	Report_Init(&channel, TELEMETRY_PRESSURE, 0, 5, 0, 0);
+	Report_Commit(&channel, 0, 0);
+	rc = Report_IsDue(&channel, 1, 0);
+	assert("relative deadband about zero, same value", rc == 0, "rc was %u\n", rc);
+	rc = Report_IsDue(&channel, 1, 1);
+	assert("relative deadband about zero, any change", rc == 1, "rc was %u\n", rc);
+
+	Report_Init(&channel, TELEMETRY_UPTIME, 0, 0, 0, 0);
+	Report_Commit(&channel, 0, 7);
+	rc = Report_IsDue(&channel, 1, 7);
+	assert("no deadband, same value", rc == 0, "rc was %u\n", rc);
+	rc = Report_IsDue(&channel, 1, 8);
+	assert("no deadband, any change", rc == 1, "rc was %u\n", rc);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2};
+
+	return run_tests(argc, argv, "test_report", tests, ARRAY_SIZE(tests));
+}
@@ -0,0 +1,372 @@
+/*******************************************************************************
+ * Host tests of the sensor bus queue (SENSOR_IO_Submit() in the B-L475E-IOT01
+ * BSP), with I2C2 and its DMA replaced by a fake bus that completes, fails or
+ * loses a transfer when the test says so.
+ *******************************************************************************/
+
+
+#include "stm32l475e_iot01.h"
+#include "testutil.h"
+
+/* LINK operations, declared by the sensor drivers */
+void     SENSOR_IO_Init(void);
+uint8_t  SENSOR_IO_Read(uint8_t Addr, uint8_t Reg);
+HAL_StatusTypeDef SENSOR_IO_IsDeviceReady(uint16_t DevAddress, uint32_t Trials);
+
+uint32_t stub_ipsr;
+uint32_t stub_primask;
+
+static uint32_t now;
+
+/* The transfer on the fake bus */
+static I2C_HandleTypeDef* bus_handle;
+static uint8_t* bus_buffer;
+static uint16_t bus_size;
+static int bus_read;
+static int bus_busy;
+static HAL_StatusTypeDef bus_start_status = HAL_OK;   /* returned by the next start */
+
+static int started_it, started_dma, blocking, inits, deinits, aborts;
+
+/* Callbacks in the order they ran */
+static SENSOR_IO_TransactionTypeDef* done[32];
+static HAL_StatusTypeDef done_status[32];
+static int done_count;
+static uint32_t done_primask;
+static SENSOR_IO_TransactionTypeDef* resubmit;   /* submitted again by the next callback */
+
+
+uint32_t HAL_GetTick(void)
+{
+	return ++now;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef* hi2c)
+{
+	++inits;
+	bus_busy = 0;
+	return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef* hi2c)
+{
+	++deinits;
+	bus_busy = 0;
+	return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef* hdma)
+{
+	++aborts;
+	return HAL_OK;
+}
+
+
+static HAL_StatusTypeDef busStart(I2C_HandleTypeDef* hi2c, uint8_t* pData, uint16_t Size, int read)
+{
+	HAL_StatusTypeDef rc = bus_start_status;
+
+	bus_start_status = HAL_OK;
+	if (bus_busy)
+		return HAL_BUSY;
+	if (rc != HAL_OK)
+		return rc;
+	bus_handle = hi2c;
+	bus_buffer = pData;
+	bus_size = Size;
+	bus_read = read;
+	bus_busy = 1;
+	return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size)
+{
+	++started_it;
+	return busStart(hi2c, pData, Size, 1);
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size)
+{
+	++started_it;
+	return busStart(hi2c, pData, Size, 0);
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read_DMA(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size)
+{
+	++started_dma;
+	return busStart(hi2c, pData, Size, 1);
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write_DMA(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size)
+{
+	++started_dma;
+	return busStart(hi2c, pData, Size, 0);
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+	++blocking;
+	if (bus_busy)
+		return HAL_BUSY;
+	memset(pData, 0x5A, Size);
+	return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint16_t MemAddress, uint16_t MemAddSize,
+		uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+	++blocking;
+	return bus_busy ? HAL_BUSY : HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint32_t Trials, uint32_t Timeout)
+{
+	++blocking;
+	return bus_busy ? HAL_BUSY : HAL_OK;
+}
+
+
+/* Ends the transfer on the bus from its interrupt: HAL_OK completes it, and
+ * HAL_ERROR fails it as on a NACK or bus error. */
+void busComplete(HAL_StatusTypeDef status)
+{
+	int read = bus_read;
+
+	if (!bus_busy)
+		return;
+	if (read && status == HAL_OK)
+		memset(bus_buffer, 0xA5, bus_size);
+	bus_busy = 0;
+	stub_ipsr = 16 + I2C2_EV_IRQn;
+	if (status != HAL_OK)
+		HAL_I2C_ErrorCallback(bus_handle);
+	else if (read)
+		HAL_I2C_MemRxCpltCallback(bus_handle);
+	else
+		HAL_I2C_MemTxCpltCallback(bus_handle);
+	stub_ipsr = 0;
+}
+
+
+void transactionDone(SENSOR_IO_TransactionTypeDef* transaction, HAL_StatusTypeDef status)
+{
+	done[done_count] = transaction;
+	done_status[done_count++] = status;
+	done_primask = stub_primask;
+	if (resubmit != NULL)
+	{
+		SENSOR_IO_TransactionTypeDef* again = resubmit;
+
+		resubmit = NULL;
+		SENSOR_IO_Submit(again);
+	}
+}
+
+
+void setTransaction(SENSOR_IO_TransactionTypeDef* transaction, uint8_t direction, uint8_t* buffer, uint16_t length)
+{
+	memset(transaction, 0, sizeof(*transaction));
+	transaction->Addr = 0xD4;
+	transaction->Reg = 0x28;
+	transaction->Direction = direction;
+	transaction->Buffer = buffer;
+	transaction->Length = length;
+	transaction->Callback = transactionDone;
+}
+
+
+void resetBus(void)
+{
+	while (!SENSOR_IO_IsIdle())
+		busComplete(HAL_OK);
+	bus_busy = 0;
+	bus_start_status = HAL_OK;
+	started_it = started_dma = blocking = inits = deinits = aborts = 0;
+	done_count = 0;
+	resubmit = NULL;
+}
+
+
+int test1(struct Options options)
+{
+	SENSOR_IO_TransactionTypeDef t[SENSOR_IO_QUEUE_SIZE + 1];
+	uint8_t status = 0, xyz[6], ctrl[2] = {0x60, 0x04};
+	HAL_StatusTypeDef rc = HAL_OK;
+	int i;
+
+	fprintf(xml, "<testcase classname=\"test_sensor_io\" name=\"queue\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - transactions run one after the other");
+
+	SENSOR_IO_Init();
+	resetBus();
+	setTransaction(&t[0], SENSOR_IO_READ, &status, 1);
+	setTransaction(&t[1], SENSOR_IO_READ, xyz, sizeof(xyz));
+	setTransaction(&t[2], SENSOR_IO_WRITE, ctrl, sizeof(ctrl));
+	for (i = 0; i < 3; ++i)
+	{
+		rc = SENSOR_IO_Submit(&t[i]);
+		assert("good rc from SENSOR_IO_Submit", rc == HAL_OK, "rc was %d\n", rc);
+	}
+	assert("interrupts unmasked again", stub_primask == 0, "primask was %u\n", stub_primask);
+	assert("first transaction on the bus", bus_busy && bus_buffer == &status && started_it == 1 && started_dma == 0,
+			"started %d\n", started_it);
+	assert("queue not idle", SENSOR_IO_IsIdle() == 0, "done %d\n", done_count);
+
+	busComplete(HAL_OK);
+	assert("first reported", done_count == 1 && done[0] == &t[0] && done_status[0] == HAL_OK && status == 0xA5,
+			"done %d\n", done_count);
+	assert("next started before the callback, by DMA from 4 bytes", bus_busy && bus_buffer == xyz && started_dma == 1,
+			"started %d\n", started_dma);
+	busComplete(HAL_OK);
+	busComplete(HAL_OK);
+	assert("all reported in order", done_count == 3 && done[1] == &t[1] && done[2] == &t[2] &&
+			done_status[1] == HAL_OK && done_status[2] == HAL_OK, "done %d\n", done_count);
+	assert("queue idle", SENSOR_IO_IsIdle() == 1 && !bus_busy, "done %d\n", done_count);
+
+	resetBus();
+	for (i = 0; i < SENSOR_IO_QUEUE_SIZE; ++i)
+	{
+		setTransaction(&t[i], SENSOR_IO_READ, &status, 1);
+		SENSOR_IO_Submit(&t[i]);
+	}
+	setTransaction(&t[i], SENSOR_IO_READ, &status, 1);
+	rc = SENSOR_IO_Submit(&t[i]);
+	assert("full queue refuses", rc == HAL_BUSY, "rc was %d\n", rc);
+	resubmit = &t[i];
+	for (i = 0; i <= SENSOR_IO_QUEUE_SIZE; ++i)
+		busComplete(HAL_OK);
+	assert("callback submits again", done_count == SENSOR_IO_QUEUE_SIZE + 1 && done[SENSOR_IO_QUEUE_SIZE] == &t[SENSOR_IO_QUEUE_SIZE],
+			"done %d\n", done_count);
+	assert("queue idle", SENSOR_IO_IsIdle() == 1, "done %d\n", done_count);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	SENSOR_IO_TransactionTypeDef t[3];
+	uint8_t a = 0, b = 0, c = 0;
+
+	fprintf(xml, "<testcase classname=\"test_sensor_io\" name=\"error recovery\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - failed transfers are reported and the queue goes on");
+
+	resetBus();
+	setTransaction(&t[0], SENSOR_IO_READ, &a, 1);
+	setTransaction(&t[1], SENSOR_IO_READ, &b, 1);
+	setTransaction(&t[2], SENSOR_IO_READ, &c, 1);
+	SENSOR_IO_Submit(&t[0]);
+	SENSOR_IO_Submit(&t[1]);
+
+	busComplete(HAL_ERROR);
+	assert("error reported", done_count == 1 && done[0] == &t[0] && done_status[0] == HAL_ERROR, "done %d\n", done_count);
+	assert("bus re-initialized", deinits == 1 && inits == 1, "inits %d\n", inits);
+	assert("next started after the error", bus_busy && bus_buffer == &b, "done %d\n", done_count);
+	busComplete(HAL_OK);
+	assert("next completes", done_count == 2 && done_status[1] == HAL_OK && b == 0xA5, "done %d\n", done_count);
+
+	/* The bus refuses to start: reported at once, and the queue goes on */
+	done_count = 0;
+	bus_start_status = HAL_ERROR;
+	SENSOR_IO_Submit(&t[1]);
+	SENSOR_IO_Submit(&t[2]);
+	assert("transfer not started reported", done_count == 1 && done[0] == &t[1] && done_status[0] == HAL_ERROR,
+			"done %d\n", done_count);
+	assert("reported with interrupts masked", done_primask == 1 && stub_primask == 0, "primask was %u\n", done_primask);
+	assert("following transfer started", bus_busy && bus_buffer == &c, "done %d\n", done_count);
+	busComplete(HAL_OK);
+	assert("queue idle", SENSOR_IO_IsIdle() == 1 && done_count == 2 && done_status[1] == HAL_OK, "done %d\n", done_count);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test3(struct Options options)
+{
+	SENSOR_IO_TransactionTypeDef t[3];
+	uint8_t a = 0, b[6], c = 0, value = 0;
+	uint32_t start = 0;
+	HAL_StatusTypeDef rc = HAL_OK;
+
+	fprintf(xml, "<testcase classname=\"test_sensor_io\" name=\"timeout\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 3 - a lost completion is flushed by the blocking calls");
+
+	resetBus();
+	setTransaction(&t[0], SENSOR_IO_READ, &a, 1);
+	setTransaction(&t[1], SENSOR_IO_READ, b, sizeof(b));
+	setTransaction(&t[2], SENSOR_IO_READ, &c, 1);
+	SENSOR_IO_Submit(&t[0]);
+	SENSOR_IO_Submit(&t[1]);
+
+	/* The completion of t[0] never comes */
+	resubmit = &t[2];
+	start = now;
+	value = SENSOR_IO_Read(0xBE, 0x0F);
+	assert("waited 1 s", now - start >= 1000 && now - start < 1100, "waited %u\n", now - start);
+	assert("nothing read on the stuck bus", value == 0 && blocking == 0, "blocking %d\n", blocking);
+	assert("transfer stopped", aborts == 2 && deinits == 1 && inits == 1, "aborts %d\n", aborts);
+	assert("queued transactions reported as timed out", done_count == 2 && done[0] == &t[0] && done[1] == &t[1] &&
+			done_status[0] == HAL_TIMEOUT && done_status[1] == HAL_TIMEOUT, "done %d\n", done_count);
+	assert("flushed with interrupts masked", done_primask == 1 && stub_primask == 0, "primask was %u\n", done_primask);
+	assert("transaction submitted by a callback started", bus_busy && bus_buffer == &c && !SENSOR_IO_IsIdle(),
+			"done %d\n", done_count);
+
+	busComplete(HAL_OK);
+	assert("queue usable after the flush", done_count == 3 && done[2] == &t[2] && done_status[2] == HAL_OK &&
+			SENSOR_IO_IsIdle(), "done %d\n", done_count);
+
+	/* A completion arriving after the flush is ignored */
+	bus_busy = 1;
+	busComplete(HAL_OK);
+	assert("late completion ignored", done_count == 3 && SENSOR_IO_IsIdle(), "done %d\n", done_count);
+
+	value = SENSOR_IO_Read(0xBE, 0x0F);
+	assert("blocking read on the idle bus", value == 0x5A && blocking == 1, "value was %02x\n", value);
+
+	SENSOR_IO_Submit(&t[0]);
+	rc = SENSOR_IO_IsDeviceReady(0xBE, 3);
+	assert("device check times out too", rc == HAL_TIMEOUT && blocking == 1 && done_count == 4 &&
+			done_status[3] == HAL_TIMEOUT, "rc was %d\n", rc);
+	rc = SENSOR_IO_IsDeviceReady(0xBE, 3);
+	assert("device check on the idle bus", rc == HAL_OK && blocking == 2, "rc was %d\n", rc);
+
+	MyLog(LOGA_INFO, "TEST3: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2, test3};
+
+	return run_tests(argc, argv, "test_sensor_io", tests, ARRAY_SIZE(tests));
+}
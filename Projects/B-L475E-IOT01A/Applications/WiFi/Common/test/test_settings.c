@@ -0,0 +1,195 @@
+/*******************************************************************************
+ * Host tests of the settings page (settings.c).  The flash page is a host page
+ * mapped at SETTINGS_FLASH_ADDRESS and programmed by a fake HAL.  settings.c
+ * is included rather than linked to reach its CRC.
+ *******************************************************************************/
+
+
+#include <sys/mman.h>
+#include "../Src/settings.c"
+#include "testutil.h"
+
+static uint8_t* flash;
+static int flash_locked = 1;
+static int flash_fail;         /* make the next program call fail */
+static FLASH_EraseInitTypeDef erased;
+
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+	flash_locked = 0;
+	return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+	flash_locked = 1;
+	return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	uint8_t* p = flash + (Address - SETTINGS_FLASH_ADDRESS);
+
+	if (flash_locked || flash_fail || Address % 8 != 0 || Address - SETTINGS_FLASH_ADDRESS >= FLASH_PAGE_SIZE)
+		return HAL_ERROR;
+	/* Flash only clears bits; a double word is written once after an erase */
+	if (*(uint64_t*)p != ~(uint64_t)0)
+		return HAL_ERROR;
+	memcpy(p, &Data, 8);
+	return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* PageError)
+{
+	if (flash_locked)
+		return HAL_ERROR;
+	erased = *pEraseInit;
+	memset(flash, 0xFF, FLASH_PAGE_SIZE);
+	*PageError = 0xFFFFFFFF;
+	return HAL_OK;
+}
+
+
+/* Table-driven CRC-32, an implementation independent of settings.c */
+uint32_t referenceCrc(const uint8_t* p, uint32_t len)
+{
+	static uint32_t table[256];
+	uint32_t crc = 0xFFFFFFFF, i, bit;
+
+	if (table[1] == 0)
+	{
+		for (i = 0; i < 256; ++i)
+		{
+			uint32_t c = i;
+
+			for (bit = 0; bit < 8; ++bit)
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+	for (i = 0; i < len; ++i)
+		crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+
+void fillSettings(Settings_t* settings)
+{
+	memset(settings, 0, sizeof(Settings_t));
+	strcpy(settings->Ssid, "test-ssid");
+	strcpy(settings->Password, "secret");
+	strcpy(settings->BrokerHost, "test.mosquitto.org");
+	settings->BrokerPort = 1883;
+	settings->LogLevel = 3;
+	settings->PublishIntervalMs = 5000;
+}
+
+
+int test1(struct Options options)
+{
+	uint8_t buf[offsetof(Settings_t, Crc)];
+	uint32_t crc = 0;
+	unsigned int i;
+
+	fprintf(xml, "<testcase classname=\"test_settings\" name=\"crc\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - CRC-32 of the settings");
+
+	crc = referenceCrc((const uint8_t*)"123456789", 9);
+	assert("reference CRC-32 check value", crc == 0xCBF43926, "crc was %08x\n", crc);
+
+	assert("layout as on the target", offsetof(Settings_t, Crc) == 180, "offset was %u\n", (unsigned)offsetof(Settings_t, Crc));
+	for (i = 0; i < sizeof(buf); ++i)
+		buf[i] = (uint8_t)i;
+	crc = Settings_Crc((const Settings_t*)buf);
+	/* zlib.crc32(bytes(range(180))) */
+	assert("CRC-32 of the bytes before Crc", crc == 0xA1756E44, "crc was %08x\n", crc);
+
+	for (i = 0; i < sizeof(buf); ++i)
+		buf[i] = (uint8_t)(i * 37 + 11);
+	crc = Settings_Crc((const Settings_t*)buf);
+	assert("same as the reference", crc == referenceCrc(buf, sizeof(buf)), "crc was %08x\n", crc);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	Settings_t settings, loaded;
+	const Settings_t* stored = (const Settings_t*)flash;
+	int32_t rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test_settings\" name=\"save and load\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - settings saved to and loaded from flash");
+
+	memset(flash, 0xFF, FLASH_PAGE_SIZE);
+	assert("erased flash holds no settings", Settings_IsStored() == 0, "flash %02x\n", flash[0]);
+	memset(&loaded, 0x5A, sizeof(loaded));
+	rc = Settings_Load(&loaded);
+	assert("nothing loaded from erased flash", rc == -1 && loaded.BrokerPort == 0x5A5A, "rc was %d\n", rc);
+
+	fillSettings(&settings);
+	rc = Settings_Save(&settings);
+	assert("good rc from Settings_Save", rc == 0 && flash_locked, "rc was %d\n", rc);
+	assert("header filled in", settings.Magic == SETTINGS_MAGIC && settings.Version == SETTINGS_VERSION &&
+			settings.Size == sizeof(Settings_t), "magic was %08x\n", settings.Magic);
+	assert("CRC of the fields stored after them", stored->Crc == referenceCrc(flash, offsetof(Settings_t, Crc)),
+			"crc was %08x\n", stored->Crc);
+	assert("page of the second bank erased", erased.TypeErase == FLASH_TYPEERASE_PAGES && erased.Banks == FLASH_BANK_2 &&
+			erased.Page == 254 && erased.NbPages == 1, "page was %u\n", erased.Page);
+
+	rc = Settings_Load(&loaded);
+	assert("settings loaded", rc == 0 && memcmp(&loaded, &settings, sizeof(Settings_t)) == 0, "rc was %d\n", rc);
+
+	flash[offsetof(Settings_t, BrokerHost)] ^= 0x01;
+	memset(&loaded, 0x5A, sizeof(loaded));
+	rc = Settings_Load(&loaded);
+	assert("flipped bit detected", rc == -1 && Settings_IsStored() == 0 && loaded.BrokerPort == 0x5A5A, "rc was %d\n", rc);
+
+	rc = Settings_Save(&settings);
+	assert("saved again over the bad copy", rc == 0 && Settings_IsStored() == 1, "rc was %d\n", rc);
+	((Settings_t*)flash)->Version = SETTINGS_VERSION + 1;
+	((Settings_t*)flash)->Crc = referenceCrc(flash, offsetof(Settings_t, Crc));
+	assert("other layout version refused", Settings_IsStored() == 0, "version %u\n", stored->Version);
+
+	flash_fail = 1;
+	rc = Settings_Save(&settings);
+	flash_fail = 0;
+	assert("failed programming reported", rc == -1 && Settings_IsStored() == 0 && flash_locked, "rc was %d\n", rc);
+
+	rc = Settings_Save(&settings);
+	assert("good rc from Settings_Save", rc == 0, "rc was %d\n", rc);
+	rc = Settings_Erase();
+	assert("erased", rc == 0 && Settings_IsStored() == 0 && flash_locked, "rc was %d\n", rc);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2};
+
+	flash = mmap((void*)SETTINGS_FLASH_ADDRESS, FLASH_PAGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (flash != (uint8_t*)SETTINGS_FLASH_ADDRESS)
+	{
+		printf("Cannot map the settings page at %08lx\n", SETTINGS_FLASH_ADDRESS);
+		return 1;
+	}
+	return run_tests(argc, argv, "test_settings", tests, ARRAY_SIZE(tests));
+}
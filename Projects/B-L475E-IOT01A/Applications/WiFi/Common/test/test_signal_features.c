@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * Host tests of the signal features (signal_features.c), linked with the
+ * CMSIS-DSP C sources instead of the prebuilt Cortex-M4 library.
+ *******************************************************************************/
+
+
+#include <math.h>
+#include "signal_features.h"
+#include "testutil.h"
+
+#define SAMPLE_RATE 416.0f
+
+static Features_Window_t window;
+
+
+/* Fills one window from tones: X 100 at 50 Hz on an offset of 500, Y 30 at
+ * 180 Hz and Z a constant 1000, added in bursts of 100 samples as the FIFO does. */
+int computeTones(Features_t* features)
+{
+	int16_t xyz[3 * 100];
+	uint32_t k = 0, i, n, used;
+	int computed = 0;
+
+	while (!computed)
+	{
+		const int16_t* p = xyz;
+
+		for (i = 0; i < 100; ++i, ++k)
+		{
+			xyz[3 * i] = (int16_t)lrintf(500 + 100 * sinf(2 * PI * 50 * k / SAMPLE_RATE));
+			xyz[3 * i + 1] = (int16_t)lrintf(30 * sinf(2 * PI * 180 * k / SAMPLE_RATE));
+			xyz[3 * i + 2] = 1000;
+		}
+		for (n = 100; n > 0; n -= used, p += 3 * used)
+		{
+			used = Features_Add(&window, p, n);
+			if (Features_Compute(&window, features))
+				computed = 1;
+		}
+	}
+	return computed;
+}
+
+
+int test1(struct Options options)
+{
+	Features_t features;
+	float32_t total = 0.0f, expected = 0.0f;
+	int band;
+
+	fprintf(xml, "<testcase classname=\"test_signal_features\" name=\"tones\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - features of 50 Hz and 180 Hz tones");
+
+	assert("good rc from Features_Init", Features_Init(&window, SAMPLE_RATE) == 0, "window %d\n", FEATURES_WINDOW);
+	computeTones(&features);
+
+	assert("X RMS about the mean", fabsf(features.Rms[0] - 70.71f) < 0.5f, "rms was %f\n", features.Rms[0]);
+	assert("X peak about the mean", fabsf(features.Peak[0] - 100.0f) < 1.0f, "peak was %f\n", features.Peak[0]);
+	assert("X crest of a sine", fabsf(features.Crest[0] - 1.414f) < 0.02f, "crest was %f\n", features.Crest[0]);
+	assert("Y RMS", fabsf(features.Rms[1] - 21.21f) < 0.5f, "rms was %f\n", features.Rms[1]);
+	assert("Y peak", fabsf(features.Peak[1] - 30.0f) < 1.0f, "peak was %f\n", features.Peak[1]);
+	assert("Z without vibration", features.Rms[2] == 0.0f && features.Peak[2] == 0.0f && features.Crest[2] == 0.0f,
+			"rms was %f\n", features.Rms[2]);
+
+	assert("band width", features.BandWidth == SAMPLE_RATE / 2 / FEATURES_BANDS, "width was %f\n", features.BandWidth);
+	assert("50 Hz in band 1", fabsf(features.Band[1] - features.Rms[0]) < 0.05f * features.Rms[0],
+			"band was %f\n", features.Band[1]);
+	assert("180 Hz in band 6", fabsf(features.Band[6] - features.Rms[1]) < 0.05f * features.Rms[1],
+			"band was %f\n", features.Band[6]);
+	for (band = 0; band < FEATURES_BANDS; ++band)
+	{
+		total += features.Band[band] * features.Band[band];
+		if (band != 1 && band != 6)
+			assert("no energy in the other bands", features.Band[band] < 1.0f, "band was %f\n", features.Band[band]);
+	}
+	expected = features.Rms[0] * features.Rms[0] + features.Rms[1] * features.Rms[1];
+	assert1("bands add up to the total AC power", fabsf(total - expected) < 0.05f * expected,
+			"total was %f, expected %f\n", total, expected);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	Features_t features;
+	int16_t xyz[3 * FEATURES_WINDOW];
+	uint32_t used = 0;
+	int32_t rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test_signal_features\" name=\"window\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - collecting samples into windows");
+
+	memset(xyz, 0, sizeof(xyz));
+	Features_Init(&window, SAMPLE_RATE);
+	rc = Features_Compute(&window, &features);
+	assert("empty window not computed", rc == 0, "rc was %d\n", rc);
+
+	used = Features_Add(&window, xyz, FEATURES_WINDOW - 10);
+	assert("all samples taken", used == FEATURES_WINDOW - 10, "used was %u\n", used);
+	rc = Features_Compute(&window, &features);
+	assert("partial window not computed", rc == 0 && window.Fill == FEATURES_WINDOW - 10, "rc was %d\n", rc);
+
+	used = Features_Add(&window, xyz, 25);
+	assert("samples past the window left", used == 10, "used was %u\n", used);
+	used = Features_Add(&window, xyz, 25);
+	assert("full window takes nothing", used == 0, "used was %u\n", used);
+	rc = Features_Compute(&window, &features);
+	assert("full window computed and emptied", rc == 1 && window.Fill == 0, "rc was %d\n", rc);
+	assert("silent window", features.Rms[0] == 0.0f && features.Crest[0] == 0.0f && features.Band[0] == 0.0f,
+			"rms was %f\n", features.Rms[0]);
+
+	used = Features_Add(&window, xyz, 15);
+	assert("samples taken into the next window", used == 15 && window.Fill == 15, "used was %u\n", used);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2};
+
+	return run_tests(argc, argv, "test_signal_features", tests, ARRAY_SIZE(tests));
+}
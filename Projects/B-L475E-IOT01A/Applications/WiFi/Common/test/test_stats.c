@@ -0,0 +1,436 @@
+/*******************************************************************************
+ * Host tests of the run-time statistics (stats.c): the histogram buckets, the
+ * AT command slots, the timing of MQTT acknowledgements and the CBOR payload,
+ * checked against Tools/statsdecode.c.  Both are included rather than
+ * linked, the tool with its main() renamed; the cycle counter is a variable.
+ *******************************************************************************/
+
+
+#include "../Src/stats.c"
+#define main statsdecode_main
+#include "../Tools/statsdecode.c"
+#undef main
+#include "testutil.h"
+#include <unistd.h>
+
+uint32_t stub_ipsr;
+uint32_t stub_primask;
+DWT_Type stub_dwt;
+CoreDebug_Type stub_coredebug;
+uint32_t SystemCoreClock = 80000000;
+
+static uint32_t now;
+static uint32_t log_high_water;
+
+static const char* payload_name = "test_stats.bin";
+static const char* json_name = "test_stats.json";
+
+/* Output of the tool */
+static char json[4096];
+
+
+uint32_t HAL_GetTick(void)
+{
+	return now;
+}
+
+
+void Log_GetStats(Log_Stats_t* pStats)
+{
+	memset(pStats, 0, sizeof(*pStats));
+	pStats->HighWater = log_high_water;
+}
+
+
+/* Times an AT command of the given number of STATS_AT_UNIT_US, 0 or less being no response */
+static void atCommand(const char* cmd, uint32_t units, int32_t length)
+{
+	DWT->CYCCNT = 1000;
+	Stats_AtBegin((const uint8_t*)cmd);
+	DWT->CYCCNT = 1000 + units * (SystemCoreClock / 1000000U * STATS_AT_UNIT_US);
+	Stats_AtEnd(length);
+}
+
+
+/* Sends a PUBLISH with a topic of topiclen bytes and a payload of paylen bytes */
+static void publish(uint8_t qos, uint16_t id, uint32_t topiclen, uint32_t paylen)
+{
+	uint8_t packet[512];
+	uint32_t remaining = 2 + topiclen + ((qos > 0) ? 2 : 0) + paylen;
+	uint32_t n = 0;
+
+	memset(packet, 'x', sizeof(packet));
+	packet[n++] = 0x30 | (qos << 1);
+	do
+	{
+		packet[n++] = (remaining & 0x7F) | ((remaining > 0x7F) ? 0x80 : 0);
+		remaining >>= 7;
+	} while (remaining > 0);
+	packet[n++] = topiclen >> 8;
+	packet[n++] = topiclen;
+	n += topiclen;
+	if (qos > 0)
+	{
+		packet[n++] = id >> 8;
+		packet[n++] = id;
+	}
+	Stats_MqttPacket(0, packet);
+}
+
+
+static void ack(uint8_t type, uint16_t id)
+{
+	uint8_t packet[4] = {type << 4, 2, id >> 8, id};
+
+	Stats_MqttPacket(1, packet);
+}
+
+
+/* Walks a payload as statsdecode does; returns the number of AT keys, -1 if not a valid map of length len */
+static int checkMap(const uint8_t* payload, size_t len)
+{
+	const uint8_t* p = payload;
+	const uint8_t* end = payload + len;
+	uint64_t count, key, items, v, i, j;
+	int at = 0;
+	uint8_t major;
+
+	if (get_head(&p, end, &major, &count) != 0 || major != 0xA0)
+		return -1;
+	for (i = 0; i < count; i++)
+	{
+		if (get_head(&p, end, &major, &key) != 0 || major != 0x00 || key != ((key < STATS_AT) ? key : STATS_AT + at) ||
+				p >= end)
+			return -1;
+		items = 1;
+		if ((*p & 0xE0) == 0x80 && get_head(&p, end, &major, &items) != 0)
+			return -1;
+		for (j = 0; j < items; j++)
+		{
+			if (get_head(&p, end, &major, &v) != 0 || major != 0x00)
+				return -1;
+		}
+		at += (key >= STATS_AT);
+	}
+	return (p == end) ? at : -1;
+}
+
+
+/* Runs the tool on the payload, its stdout going to the JSON file */
+static int runTool(const uint8_t* payload, size_t len)
+{
+	char* argv[] = {"statsdecode", "-b", (char*)payload_name, NULL};
+	FILE* f = fopen(payload_name, "wb");
+	int saved, rc;
+
+	fwrite(payload, 1, len, f);
+	fclose(f);
+	f = fopen(json_name, "w");
+	fflush(stdout);
+	saved = dup(fileno(stdout));
+	dup2(fileno(f), fileno(stdout));
+	rc = statsdecode_main(3, argv);
+	fflush(stdout);
+	dup2(saved, fileno(stdout));
+	close(saved);
+	fclose(f);
+
+	len = 0;
+	if ((f = fopen(json_name, "r")) != NULL)
+	{
+		len = fread(json, 1, sizeof(json) - 1, f);
+		fclose(f);
+	}
+	json[len] = '\0';
+	return rc;
+}
+
+
+int test1(struct Options options)
+{
+	Stats_Histogram_t h;
+	uint32_t k;
+	int ok = 1;
+
+	fprintf(xml, "<testcase classname=\"test_stats\" name=\"histogram buckets\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - values counted in their power-of-two bucket");
+
+	memset(&h, 0, sizeof(h));
+	Stats_Record(&h, 0);
+	assert("zero in bucket 0", h.Count[0] == 1 && h.Max == 0, "count %u\n", h.Count[0]);
+	Stats_Record(&h, 1);
+	assert("one in bucket 1", h.Count[1] == 1 && h.Max == 1, "count %u\n", h.Count[1]);
+
+	/* 2^k - 1 is the top of bucket k, 2^k the bottom of bucket k + 1 */
+	for (k = 1; k < STATS_BUCKETS - 1; k++)
+	{
+		memset(&h, 0, sizeof(h));
+		Stats_Record(&h, (1U << k) - 1);
+		Stats_Record(&h, 1U << k);
+		ok = ok && h.Count[k] == 1 && h.Count[k + 1] == 1 && h.Max == (1U << k);
+	}
+	assert("bucket bounds", ok, "k %u\n", k);
+
+	memset(&h, 0, sizeof(h));
+	Stats_Record(&h, 1U << (STATS_BUCKETS - 1));
+	Stats_Record(&h, 1U << STATS_BUCKETS);
+	Stats_Record(&h, 0xFFFFFFFF);
+	assert("larger values saturate into the last bucket", h.Count[STATS_BUCKETS - 1] == 3 &&
+			h.Count[STATS_BUCKETS - 2] == 0, "count %u\n", h.Count[STATS_BUCKETS - 1]);
+	assert("max kept", h.Max == 0xFFFFFFFF, "max %u\n", h.Max);
+	Stats_Record(&h, 5);
+	assert("max not lowered", h.Max == 0xFFFFFFFF && h.Count[3] == 1, "max %u\n", h.Max);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	char cmd[8];
+	uint32_t i;
+	int ok = 1;
+
+	fprintf(xml, "<testcase classname=\"test_stats\" name=\"AT command slots\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - AT commands timed per command, the last slot shared");
+
+	Stats_Init();
+	atCommand("S3=0004\r", 20, 10);
+	atCommand("S3=0010\r", 40, 30);
+	atCommand("Z\r", 1, 0);
+	atCommand("R0\r", 1, 0);
+	assert("commands told apart by two characters", Stats.AtTypes == 3 && Stats.At[0].Code == ('S' << 8 | '3') &&
+			Stats.At[1].Code == ('Z' << 8) && Stats.At[2].Code == ('R' << 8 | '0'), "types %u\n", Stats.AtTypes);
+	assert("round trips in STATS_AT_UNIT_US", Stats.At[0].Latency.Count[5] == 1 && Stats.At[0].Latency.Count[6] == 1 &&
+			Stats.At[0].Latency.Max == 40, "max %u\n", Stats.At[0].Latency.Max);
+	assert("no response counted as an error", Stats.At[1].Errors == 1 && Stats.At[1].Latency.Count[1] == 0,
+			"errors %u\n", Stats.At[1].Errors);
+	assert("longest response", Stats.AtResponseMax == 30, "max %u\n", Stats.AtResponseMax);
+
+	/* Slots 0 to STATS_AT_TYPES - 2 are named; the last one is "other" as soon as it is used */
+	Stats_Init();
+	for (i = 0; i < STATS_AT_TYPES - 1; i++)
+	{
+		sprintf(cmd, "C%c\r", 'A' + i);
+		atCommand(cmd, 1, 4);
+	}
+	assert("named slots taken", Stats.AtTypes == STATS_AT_TYPES - 1, "types %u\n", Stats.AtTypes);
+	atCommand("X1\r", 2, 4);
+	assert("next command counted as other", Stats.AtTypes == STATS_AT_TYPES &&
+			Stats.At[STATS_AT_TYPES - 1].Code == 0 && Stats.At[STATS_AT_TYPES - 1].Latency.Count[2] == 1,
+			"code %x\n", Stats.At[STATS_AT_TYPES - 1].Code);
+	atCommand("X2\r", 4, 4);
+	atCommand("X1\r", 2, 4);
+	assert("other commands share the slot", Stats.AtTypes == STATS_AT_TYPES &&
+			Stats.At[STATS_AT_TYPES - 1].Code == 0 && Stats.At[STATS_AT_TYPES - 1].Latency.Count[2] == 2 &&
+			Stats.At[STATS_AT_TYPES - 1].Latency.Count[3] == 1, "code %x\n", Stats.At[STATS_AT_TYPES - 1].Code);
+	for (i = 0; i < STATS_AT_TYPES - 1; i++)
+	{
+		sprintf(cmd, "C%c\r", 'A' + i);
+		atCommand(cmd, 1, 4);
+		ok = ok && Stats.At[i].Code == ('C' << 8 | ('A' + i)) && Stats.At[i].Latency.Count[1] == 2;
+	}
+	assert("named commands keep their slot", ok && Stats.At[STATS_AT_TYPES - 1].Latency.Count[1] == 0, "i %u\n", i);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test3(struct Options options)
+{
+	uint32_t i;
+
+	fprintf(xml, "<testcase classname=\"test_stats\" name=\"MQTT packets\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 3 - packets counted, PUBLISH to acknowledgement timed");
+
+	Stats_Init();
+	now = 1000;
+	publish(1, 0x1234, 5, 10);
+	now = 1250;
+	ack(MQTT_PUBACK, 0x1234);
+	assert("QoS 1 PUBLISH timed to its PUBACK", Stats.PublishAck.Count[8] == 1 && Stats.PublishAck.Max == 250 &&
+			Stats.UnmatchedAcks == 0, "max %u\n", Stats.PublishAck.Max);
+	assert("packets counted by type", Stats.MqttTx[MQTT_PUBLISH] == 1 && Stats.MqttRx[MQTT_PUBACK] == 1,
+			"tx %u\n", Stats.MqttTx[MQTT_PUBLISH]);
+	assert("longest packets", Stats.MqttTxMax == 2 + 2 + 5 + 2 + 10 && Stats.MqttRxMax == 4, "tx %u\n", Stats.MqttTxMax);
+	ack(MQTT_PUBACK, 0x1234);
+	assert("second ack unmatched", Stats.UnmatchedAcks == 1 && Stats.PublishAck.Count[8] == 1,
+			"unmatched %u\n", Stats.UnmatchedAcks);
+
+	/* The identifier follows a topic and a remaining length of more than one byte */
+	now = 2000;
+	publish(1, 0x0A0B, 300, 100);
+	assert("two-byte remaining length", Stats.MqttTxMax == 3 + 2 + 300 + 2 + 100, "tx %u\n", Stats.MqttTxMax);
+	now = 2003;
+	ack(MQTT_PUBACK, 0x0A0B);
+	assert("identifier found past a long topic", Stats.PublishAck.Count[2] == 1 && Stats.UnmatchedAcks == 1,
+			"unmatched %u\n", Stats.UnmatchedAcks);
+
+	publish(2, 7, 3, 0);
+	now = 2010;
+	ack(MQTT_PUBCOMP, 7);
+	assert("QoS 2 PUBLISH timed to its PUBCOMP", Stats.PublishAck.Count[3] == 1 && Stats.MqttRx[MQTT_PUBCOMP] == 1,
+			"count %u\n", Stats.PublishAck.Count[3]);
+
+	publish(0, 0, 3, 4);
+	ack(MQTT_PUBACK, 0);
+	assert("QoS 0 PUBLISH not timed, identifier 0 never matched", Stats.UnmatchedAcks == 2 &&
+			Stats.MqttTx[MQTT_PUBLISH] == 4, "unmatched %u\n", Stats.UnmatchedAcks);
+	ack(MQTT_PUBACK, 99);
+	assert("ack of no PUBLISH", Stats.UnmatchedAcks == 3, "unmatched %u\n", Stats.UnmatchedAcks);
+
+	/* STATS_PENDING at once: a new one replaces the oldest */
+	for (i = 1; i <= STATS_PENDING + 1; i++)
+		publish(1, 100 + i, 4, 0);
+	ack(MQTT_PUBACK, 101);
+	ack(MQTT_PUBACK, 100 + STATS_PENDING + 1);
+	ack(MQTT_PUBACK, 102);
+	assert("oldest replaced", Stats.UnmatchedAcks == 4 && Stats.PublishAck.Count[0] == 2,
+			"unmatched %u\n", Stats.UnmatchedAcks);
+
+	MyLog(LOGA_INFO, "TEST3: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test4(struct Options options)
+{
+	uint8_t buffer[1024];
+	int32_t full, rc;
+	uint32_t size, i;
+	int at, valid = 1, dropped = 0, guarded = 1, last_at = STATS_AT_TYPES;
+	uint32_t smallest = 0;
+
+	fprintf(xml, "<testcase classname=\"test_stats\" name=\"payload overflow\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 4 - AT commands that do not fit are left out of a valid map");
+
+	Stats_Init();
+	now = 3600000;
+	Stats.SpiTxBytes = 100000;
+	Stats.MqttTx[MQTT_PUBLISH] = 70000;
+	Stats_Record(&Stats.PublishAck, 300);
+	for (i = 0; i < STATS_AT_TYPES + 2; i++)
+	{
+		char cmd[8];
+
+		sprintf(cmd, "D%c\r", 'A' + i);
+		atCommand(cmd, 1U << i, 200);
+	}
+	full = Stats_Encode(buffer, sizeof(buffer));
+	at = checkMap(buffer, full);
+	assert("all AT commands fit a large buffer", full > 0 && at == STATS_AT_TYPES, "at %d\n", at);
+
+	for (size = full; size > 0; size--)
+	{
+		memset(buffer, 0xEE, sizeof(buffer));
+		rc = Stats_Encode(buffer, size);
+		guarded = guarded && buffer[size] == 0xEE;
+		if (rc < 0)
+			continue;
+		at = checkMap(buffer, rc);
+		valid = valid && rc <= (int32_t)size && at >= 0 && at <= last_at;
+		dropped = dropped || (at < STATS_AT_TYPES);
+		last_at = at;
+		smallest = size;
+	}
+	assert("every payload a valid map", valid, "size %u\n", size);
+	assert("AT commands dropped whole", dropped && last_at == 0, "at %d\n", last_at);
+	assert("nothing written past the buffer", guarded, "size %u\n", size);
+	assert("counters that do not fit are an error", smallest > 1 && Stats_Encode(buffer, smallest - 1) == -1,
+			"smallest %u\n", smallest);
+
+	MyLog(LOGA_INFO, "TEST4: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test5(struct Options options)
+{
+	const char* counters =
+		"{\"uptime\":125,\"connects\":2,"
+		"\"spi\":{\"tx_bytes\":100,\"rx_bytes\":200,\"spi_irqs\":3,\"ready_irqs\":0},"
+		"\"mqtt_tx\":{\"CONNECT\":1,\"PUBLISH\":5},\"mqtt_rx\":{\"CONNACK\":1,\"PUBACK\":5},"
+		"\"publish_ack_ms\":{\"count\":4,\"max\":3,\"buckets\":{\"0\":1,\"1\":1,\"2-3\":2}},"
+		"\"high_water\":{\"log\":512,\"mqtt_tx\":60,\"mqtt_rx\":0,\"at_response\":10},"
+		"\"errors\":{\"socket\":0,\"unmatched_acks\":1},"
+		"\"at\":{\"S3\":{\"errors\":0,\"latency_us\":{\"count\":1,\"max\":1280,\"buckets\":{\"1024-2047\":1}}},"
+		"\"Z\":{\"errors\":1,\"latency_us\":{\"count\":0,\"max\":0,\"buckets\":{}}},";
+	char expected[2048];
+	uint8_t buffer[512];
+	int32_t len;
+	uint32_t i;
+	int rc;
+
+	fprintf(xml, "<testcase classname=\"test_stats\" name=\"decoded payload\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 5 - a payload decoded to JSON by statsdecode");
+
+	Stats_Init();
+	now = 125999;
+	log_high_water = 512;
+	Stats.Connects = 2;
+	Stats.SpiTxBytes = 100;
+	Stats.SpiRxBytes = 200;
+	Stats.SpiIrqs = 3;
+	Stats.MqttTx[1] = 1;
+	Stats.MqttTx[MQTT_PUBLISH] = 5;
+	Stats.MqttRx[2] = 1;
+	Stats.MqttRx[MQTT_PUBACK] = 5;
+	Stats.MqttTxMax = 60;
+	Stats.UnmatchedAcks = 1;
+	Stats_Record(&Stats.PublishAck, 0);
+	Stats_Record(&Stats.PublishAck, 1);
+	Stats_Record(&Stats.PublishAck, 2);
+	Stats_Record(&Stats.PublishAck, 3);
+	atCommand("S3=0004\r", 20, 10);
+	atCommand("Z\r", 1, 0);
+	strcpy(expected, counters);
+	for (i = 0; i < STATS_AT_TYPES - 3; i++)
+	{
+		char cmd[8];
+
+		sprintf(cmd, "E%c\r", 'A' + i);
+		Stats_AtSlot((const uint8_t*)cmd);
+		sprintf(&expected[strlen(expected)], "\"E%c\":{\"errors\":0,\"latency_us\":{\"count\":0,\"max\":0,\"buckets\":{}}},",
+				'A' + i);
+	}
+	atCommand("X1\r", 1024, 4);
+	strcat(expected, "\"other\":{\"errors\":0,\"latency_us\":{\"count\":1,\"max\":65536,\"buckets\":{\"65536-131071\":1}}}}}\n");
+
+	len = Stats_Encode(buffer, sizeof(buffer));
+	rc = runTool(buffer, len);
+	assert("payload decoded", len > 0 && rc == 0, "rc %d\n", rc);
+	assert("JSON of the payload", strcmp(json, expected) == 0, "json\n%s", json);
+
+	MyLog(LOGA_INFO, "TEST5: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2, test3, test4, test5};
+
+	return run_tests(argc, argv, "test_stats", tests, ARRAY_SIZE(tests));
+}
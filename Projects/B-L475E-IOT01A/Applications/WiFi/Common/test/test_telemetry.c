@@ -0,0 +1,248 @@
+/*******************************************************************************
+ * Host tests of the telemetry CBOR encoder and batches (telemetry.c).
+ *******************************************************************************/
+
+
+#include "telemetry.h"
+#include "testutil.h"
+
+
+int checkBytes(const uint8_t* buf, int len, const char* hex)
+{
+	int i;
+
+	if ((int)strlen(hex) != 2 * len)
+		return 0;
+	for (i = 0; i < len; ++i)
+	{
+		unsigned int byte = 0;
+
+		sscanf(&hex[2 * i], "%2x", &byte);
+		if (buf[i] != byte)
+			return 0;
+	}
+	return 1;
+}
+
+
+int test1(struct Options options)
+{
+	Telemetry_Encoder_t enc;
+	uint8_t buf[64];
+	int32_t rc = 0;
+
+	fprintf(xml, "<testcase classname=\"test_telemetry\" name=\"encode\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - encoding of readings in their shortest form");
+
+	Telemetry_Begin(&enc, buf, sizeof(buf));
+	Telemetry_AddReading(&enc, TELEMETRY_TEMPERATURE, 23.456f);
+	Telemetry_AddReading(&enc, TELEMETRY_HUMIDITY, 41.23f);
+	Telemetry_AddReading(&enc, TELEMETRY_PRESSURE, 1013.24f);
+	Telemetry_AddInt(&enc, TELEMETRY_ACC_X, -1000);
+	Telemetry_AddInt(&enc, TELEMETRY_UPTIME, 70000);
+	Telemetry_AddInt(&enc, 42, -5);
+	rc = Telemetry_End(&enc);
+	assert("good rc from Telemetry_End", rc == 26, "rc was %d\n", rc);
+	/* {1: 2346, 2: 412, 3: 10132, 4: -1000, 0: 70000, 42: -5} */
+	assert("payload is the shortest CBOR map", checkBytes(buf, rc, "a60119092a0219019c03192794043903e7001a00011170182a24"),
+			"first byte was %02x\n", buf[0]);
+
+	rc = Telemetry_Scale(TELEMETRY_TEMPERATURE, -0.125f);
+	assert("negative readings round away from zero", rc == -13, "rc was %d\n", rc);
+	rc = Telemetry_Scale(99, 2.5f);
+	assert("unknown keys are not scaled", rc == 3, "rc was %d\n", rc);
+
+	Telemetry_Begin(&enc, buf, sizeof(buf));
+	rc = Telemetry_End(&enc);
+	assert("empty payload is an empty map", rc == 1 && buf[0] == 0xa0, "rc was %d\n", rc);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	Telemetry_Encoder_t enc;
+	uint8_t buf[80];
+	uint32_t counters[3] = {1, 300, 70000};
+	int32_t rc = 0;
+	int i;
+
+	fprintf(xml, "<testcase classname=\"test_telemetry\" name=\"overflow\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - payloads that do not fit");
+
+	Telemetry_Begin(&enc, buf, 5);
+	Telemetry_AddInt(&enc, TELEMETRY_TEMPERATURE, 2345);
+	Telemetry_AddInt(&enc, TELEMETRY_HUMIDITY, 412);
+	assert("partial field dropped", enc.Length == 5 && enc.Count == 1, "length was %u\n", enc.Length);
+	rc = Telemetry_End(&enc);
+	assert("overflow reported by Telemetry_End", rc == -1, "rc was %d\n", rc);
+
+	Telemetry_Begin(&enc, buf, sizeof(buf));
+	Telemetry_AddReading(&enc, 99, 1.0f);
+	rc = Telemetry_End(&enc);
+	assert("unknown reading refused", rc == -1, "rc was %d\n", rc);
+
+	Telemetry_Begin(&enc, buf, sizeof(buf));
+	for (i = 0; i < TELEMETRY_MAX_FIELDS; ++i)
+		Telemetry_AddInt(&enc, (uint8_t)i, i);
+	rc = Telemetry_End(&enc);
+	assert("TELEMETRY_MAX_FIELDS fit a one byte map header", rc > 0 && buf[0] == (0xa0 | TELEMETRY_MAX_FIELDS),
+			"rc was %d\n", rc);
+	Telemetry_AddInt(&enc, TELEMETRY_MAX_FIELDS, 0);
+	rc = Telemetry_End(&enc);
+	assert("one field more refused", rc == -1, "rc was %d\n", rc);
+
+	Telemetry_Begin(&enc, buf, sizeof(buf));
+	Telemetry_AddArray(&enc, 30, counters, 3);
+	rc = Telemetry_End(&enc);
+	/* {30: [1, 300, 70000]} */
+	assert("array of counters", checkBytes(buf, rc, "a1181e830119012c1a00011170"), "rc was %d\n", rc);
+
+	Telemetry_Begin(&enc, buf, 8);
+	Telemetry_AddArray(&enc, 30, counters, 3);
+	assert("partial array dropped", enc.Length == 1 && enc.Count == 0, "length was %u\n", enc.Length);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test3(struct Options options)
+{
+	static const uint8_t keys[2] = {TELEMETRY_TEMPERATURE, TELEMETRY_HUMIDITY};
+	int32_t values[4 * 2];
+	uint32_t times[4];
+	int32_t samples[3][2] = {{2000, 400}, {2010, 399}, {2010, 401}};
+	Telemetry_Batch_t batch;
+	uint8_t buf[64];
+	uint32_t size = 0;
+	int32_t rc = 0;
+	int i;
+
+	fprintf(xml, "<testcase classname=\"test_telemetry\" name=\"batch encode\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 3 - columnar delta encoding of a batch");
+
+	Telemetry_BatchInit(&batch, keys, 2, values, times, 4, sizeof(buf), 60000);
+	rc = Telemetry_BatchEncode(&batch, buf, sizeof(buf));
+	assert("empty batch encodes to nothing", rc == 0, "rc was %d\n", rc);
+	assert("empty batch has no size", Telemetry_BatchSize(&batch) == 0, "size was %u\n", Telemetry_BatchSize(&batch));
+
+	for (i = 0; i < 3; ++i)
+	{
+		rc = Telemetry_BatchAdd(&batch, 1000 * (i + 1), samples[i]);
+		assert("good rc from Telemetry_BatchAdd", rc == 0, "rc was %d\n", rc);
+	}
+	size = Telemetry_BatchSize(&batch);
+	rc = Telemetry_BatchEncode(&batch, buf, sizeof(buf));
+	assert1("size tracked while adding is the encoded size", rc == (int32_t)size, "rc was %d, size %u\n", rc, size);
+	/* {10: [1000, 1000, 1000], 1: [2000, 10, 0], 2: [400, -1, 2]} */
+	assert("payload holds the first value and the differences",
+			checkBytes(buf, rc, "a30a831903e81903e81903e801831907d00a0002831901902002"), "rc was %d\n", rc);
+	assert("batch emptied by the encoding", batch.Rows == 0 && Telemetry_BatchSize(&batch) == 0,
+			"rows were %u\n", batch.Rows);
+
+	Telemetry_BatchAdd(&batch, 0xFFFFFC18, samples[0]);
+	Telemetry_BatchAdd(&batch, 1000, samples[1]);
+	size = Telemetry_BatchSize(&batch);
+	rc = Telemetry_BatchEncode(&batch, buf, sizeof(buf));
+	/* {10: [4294966296, 2000], ...}: the tick wraps between the samples */
+	assert("sample times wrap", rc == (int32_t)size && checkBytes(buf, 8, "a30a821afffffc18"), "rc was %d\n", rc);
+	assert("wrapped difference is small", buf[8] == 0x19 && buf[9] == 0x07 && buf[10] == 0xd0, "byte was %02x\n", buf[8]);
+
+	Telemetry_BatchAdd(&batch, 1000, samples[0]);
+	Telemetry_BatchAdd(&batch, 2000, samples[1]);
+	rc = Telemetry_BatchEncode(&batch, buf, 10);
+	assert("buffer smaller than the batch refused", rc == -1, "rc was %d\n", rc);
+
+	MyLog(LOGA_INFO, "TEST3: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test4(struct Options options)
+{
+	static const uint8_t keys[3] = {TELEMETRY_MAG_X, TELEMETRY_MAG_Y, TELEMETRY_MAG_Z};
+	static int32_t values[128 * 3];
+	static uint32_t times[128];
+	int32_t sample[3] = {0, 0, 0};
+	Telemetry_Batch_t batch;
+	uint8_t buf[256];
+	uint32_t t = 0, left = 0, size = 0;
+	int32_t rc = 0;
+	int i;
+
+	fprintf(xml, "<testcase classname=\"test_telemetry\" name=\"batch flush\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 4 - batches due by age, rows and bytes");
+
+	Telemetry_BatchInit(&batch, keys, 3, values, times, 128, sizeof(buf), 10000);
+	left = Telemetry_BatchTimeLeft(&batch, 123);
+	assert("empty batch waits MaxAge", left == 10000, "left was %u\n", left);
+	Telemetry_BatchAdd(&batch, 5000, sample);
+	left = Telemetry_BatchTimeLeft(&batch, 9000);
+	assert("time left counts from the oldest sample", left == 6000, "left was %u\n", left);
+	left = Telemetry_BatchTimeLeft(&batch, 15000);
+	assert("due at MaxAge", left == 0, "left was %u\n", left);
+	rc = Telemetry_BatchAdd(&batch, 15000, sample);
+	assert("sample refused once due", rc == -1 && batch.Rows == 1, "rc was %d\n", rc);
+	Telemetry_BatchEncode(&batch, buf, sizeof(buf));
+
+	Telemetry_BatchInit(&batch, keys, 3, values, times, 4, sizeof(buf), 10000);
+	for (i = 0; i < 4; ++i)
+		Telemetry_BatchAdd(&batch, i, sample);
+	left = Telemetry_BatchTimeLeft(&batch, 4);
+	assert("due at MaxRows", left == 0, "left was %u\n", left);
+	rc = Telemetry_BatchAdd(&batch, 4, sample);
+	assert("sample refused at MaxRows", rc == -1 && batch.Rows == 4, "rc was %d\n", rc);
+	Telemetry_BatchEncode(&batch, buf, sizeof(buf));
+
+	/* Noisy readings: every difference takes 3 bytes */
+	Telemetry_BatchInit(&batch, keys, 3, values, times, 128, sizeof(buf), 600000);
+	srand(1);
+	for (i = 0; i < 1000; ++i)
+	{
+		sample[0] = (rand() % 2000) - 1000;
+		sample[1] = (rand() % 2000) - 1000;
+		sample[2] = (rand() % 70000) - 35000;
+		if (Telemetry_BatchAdd(&batch, t, sample) != 0)
+		{
+			size = Telemetry_BatchSize(&batch);
+			rc = Telemetry_BatchEncode(&batch, buf, sizeof(buf));
+			assert1("due batch fits MaxBytes", rc > 0 && rc == (int32_t)size && size <= sizeof(buf),
+					"rc was %d, size %u\n", rc, size);
+			assert("due batch is not much smaller than MaxBytes", size + TELEMETRY_BATCH_ROW_MAX(3) > sizeof(buf),
+					"size was %u\n", size);
+			rc = Telemetry_BatchAdd(&batch, t, sample);
+			assert("sample accepted after the encoding", rc == 0, "rc was %d\n", rc);
+		}
+		t += 1000 + (rand() % 3);
+	}
+
+	MyLog(LOGA_INFO, "TEST4: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2, test3, test4};
+
+	return run_tests(argc, argv, "test_telemetry", tests, ARRAY_SIZE(tests));
+}
@@ -0,0 +1,153 @@
+/*******************************************************************************
+ * Host tests of the monotonic Timer port (MQTTClient-C/src/Timer.c), with the
+ * HAL tick, SysTick and the SysTick pending bit set by the tests.
+ *******************************************************************************/
+
+
+#include "Timer.h"
+#include "testutil.h"
+
+SysTick_Type stub_systick;
+SCB_Type stub_scb;
+
+static uint32_t tick;
+
+
+uint32_t HAL_GetTick(void)
+{
+	return tick;
+}
+
+
+/* Moves the HAL tick to now and runs the tick interrupt */
+void tickTo(uint32_t now)
+{
+	tick = now;
+	TimerIncTick();
+}
+
+
+int test1(struct Options options)
+{
+	Timer timer;
+	uint64_t ms = 0;
+	int left = 0;
+
+	fprintf(xml, "<testcase classname=\"test_timer\" name=\"64-bit tick\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - the millisecond tick extended past the HAL tick wrap");
+
+	tickTo(0xFFFFFF00);
+	ms = TimerGetTickMS();
+	assert("tick before the wrap", ms == 0xFFFFFF00ULL, "ms was %llx\n", (unsigned long long)ms);
+	TimerCountdownMS(&timer, 0x200);
+	assert("countdown running", !TimerIsExpired(&timer) && TimerLeftMS(&timer) == 0x200, "left %d\n", TimerLeftMS(&timer));
+
+	tickTo(0x00000010);
+	ms = TimerGetTickMS();
+	assert("tick carried into the high word", ms == 0x100000010ULL, "ms was %llx\n", (unsigned long long)ms);
+	left = TimerLeftMS(&timer);
+	assert("countdown runs across the wrap", !TimerIsExpired(&timer) && left == 0x200 - 0x110, "left %d\n", left);
+	tickTo(0x000000FF);
+	assert("not yet expired", !TimerIsExpired(&timer) && TimerLeftMS(&timer) == 1, "left %d\n", TimerLeftMS(&timer));
+	tickTo(0x00000100);
+	assert("expired on time", TimerIsExpired(&timer) && TimerLeftMS(&timer) == 0, "left %d\n", TimerLeftMS(&timer));
+
+	/* After Stop 2 the HAL tick jumps forward by the time asleep, here past the next wrap */
+	tickTo(0xFFFFFFF0);
+	tickTo(0x00000200);
+	ms = TimerGetTickMS();
+	assert("jump across the wrap counted", ms == 0x200000200ULL, "ms was %llx\n", (unsigned long long)ms);
+
+	TimerCountdown(&timer, 3000000);
+	left = TimerLeftMS(&timer);
+	assert("time left saturated", left == 0x7FFFFFFF && !TimerIsExpired(&timer), "left %d\n", left);
+	TimerCountdownMS(&timer, 0);
+	assert("zero countdown expired", TimerIsExpired(&timer), "left %d\n", TimerLeftMS(&timer));
+	TimerInit(&timer);
+	assert("no countdown set is expired", TimerIsExpired(&timer), "left %d\n", TimerLeftMS(&timer));
+	assert("no timer is expired", TimerIsExpired(NULL) && TimerLeftMS(NULL) == 0, "left %d\n", TimerLeftMS(NULL));
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	uint64_t us = 0, last = 0, base = 0;
+	uint32_t val = 0;
+	int monotonic = 1;
+
+	fprintf(xml, "<testcase classname=\"test_timer\" name=\"microseconds\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - microseconds from SysTick, with a reload pending");
+
+	/* 80 MHz: 80000 SysTick clocks a millisecond, counting down */
+	tickTo(0);
+	tickTo(1000);
+	base = (TimerGetTickMS() - 1000) * 1000;   /* the high word test 1 left */
+	SysTick->LOAD = 79999;
+	SysTick->VAL = 79999;
+	SCB->ICSR = 0;
+	us = TimerGetTickUS() - base;
+	assert("start of the millisecond", us == 1000000, "us was %llu\n", (unsigned long long)us);
+	SysTick->VAL = 40000;
+	us = TimerGetTickUS() - base;
+	assert("half way through", us == 1000499, "us was %llu\n", (unsigned long long)us);
+
+	/* Interrupts masked: the counter reloads but the tick interrupt cannot run */
+	SysTick->VAL = 79900;
+	SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+	us = TimerGetTickUS() - base;
+	assert("pending reload counted", us == 1001001, "us was %llu\n", (unsigned long long)us);
+
+	/* Pending, but the reload came after VAL was read: VAL is still from the old millisecond */
+	SysTick->VAL = 100;
+	us = TimerGetTickUS() - base;
+	assert("reload after the read not counted", us == 1000998, "us was %llu\n", (unsigned long long)us);
+
+	/* Across a reload with the tick interrupt held off for up to half a millisecond */
+	SCB->ICSR = 0;
+	last = 0;
+	for (val = 79999; val >= 8000; val -= 8000)
+	{
+		SysTick->VAL = val;
+		us = TimerGetTickUS() - base;
+		monotonic = monotonic && us > last;
+		last = us;
+	}
+	SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+	for (val = 79999; val > 40000; val -= 8000)
+	{
+		SysTick->VAL = val;
+		us = TimerGetTickUS() - base;
+		monotonic = monotonic && us > last;
+		last = us;
+	}
+	assert("last reading of the held-off millisecond", last == 1001400, "us was %llu\n", (unsigned long long)last);
+	SCB->ICSR = 0;
+	tickTo(1001);
+	SysTick->VAL = 39999;
+	us = TimerGetTickUS() - base;
+	monotonic = monotonic && us > last;
+	assert("time goes forward", monotonic, "us was %llu\n", (unsigned long long)us);
+	assert("tick interrupt ran", us == 1001500, "us was %llu\n", (unsigned long long)us);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2};
+
+	return run_tests(argc, argv, "test_timer", tests, ARRAY_SIZE(tests));
+}
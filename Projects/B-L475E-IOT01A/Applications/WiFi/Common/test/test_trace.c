@@ -0,0 +1,297 @@
+/*******************************************************************************
+ * Host tests of the trace ring (trace.c) and of the pcap it becomes with
+ * Tools/trace2pcap.c, from both the binary ring image and the hex dump.  Both
+ * are included rather than linked, the tool with its main() renamed, and the
+ * ring is made small so that the tests can wrap it.
+ *******************************************************************************/
+
+
+#define TRACE_BUFFER_SIZE 512
+
+#include "../Src/trace.c"
+#define main trace2pcap_main
+#include "../Tools/trace2pcap.c"
+#undef main
+#include "testutil.h"
+#include <unistd.h>
+
+uint32_t stub_ipsr;
+uint32_t stub_primask;
+
+static uint32_t now;
+
+static const char* bin_name = "test_trace.bin";
+static const char* dump_name = "test_trace.log";
+static const char* pcap_name = "test_trace.pcap";
+
+/* The pcap the tool wrote */
+static uint8_t pcap[65536];
+static size_t pcap_len;
+
+
+uint32_t HAL_GetTick(void)
+{
+	return now;
+}
+
+
+/* Reads the record at offset off from Tail, as the tool does; returns its size in the ring */
+static uint32_t readRecord(uint32_t off, Trace_RecordHeader_t* hdr, uint8_t* data)
+{
+	uint32_t i;
+
+	for (i = 0; i < sizeof(*hdr); i++)
+		((uint8_t*)hdr)[i] = Trace_Ring.Data[(Trace_Ring.Tail + off + i) % Trace_Ring.Size];
+	for (i = 0; i < hdr->Captured; i++)
+		data[i] = Trace_Ring.Data[(Trace_Ring.Tail + off + sizeof(*hdr) + i) % Trace_Ring.Size];
+	return sizeof(*hdr) + ((hdr->Captured + 3U) & ~3U);
+}
+
+
+/* Records len bytes all equal to fill */
+static void record(uint8_t type, uint8_t channel, uint8_t fill, uint32_t len)
+{
+	uint8_t data[300];
+
+	memset(data, fill, sizeof(data));
+	Trace_Record(type, channel, data, len);
+}
+
+
+static int runTool(const char* input)
+{
+	char* argv[] = {"trace2pcap", (char*)input, (char*)pcap_name, NULL};
+	FILE* f;
+	int rc;
+
+	memset(tcp_seq, 0, sizeof(tcp_seq));
+	rc = trace2pcap_main(3, argv);
+	pcap_len = 0;
+	if ((f = fopen(pcap_name, "rb")) != NULL)
+	{
+		pcap_len = fread(pcap, 1, sizeof(pcap), f);
+		fclose(f);
+	}
+	return rc;
+}
+
+
+/* Runs Trace_Dump() with stdout going to the dump file, around a line of other console output */
+static void dumpToFile(void)
+{
+	FILE* f = fopen(dump_name, "w");
+	int saved;
+
+	fflush(stdout);
+	saved = dup(fileno(stdout));
+	dup2(fileno(f), fileno(stdout));
+	printf("main: unrelated console line\n");
+	Trace_Dump();
+	fflush(stdout);
+	dup2(saved, fileno(stdout));
+	close(saved);
+	fclose(f);
+}
+
+
+static uint32_t get16be(const uint8_t* p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+
+static uint32_t get32be(const uint8_t* p)
+{
+	return (get16be(p) << 16) | get16be(p + 2);
+}
+
+
+int test1(struct Options options)
+{
+	Trace_RecordHeader_t hdr;
+	uint8_t data[300];
+	uint32_t off, n, i, last;
+	int ok;
+
+	fprintf(xml, "<testcase classname=\"test_trace\" name=\"ring\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 1 - records appended, truncated to the snaplen and overwritten oldest first");
+
+	record(TRACE_MQTT_TX, 0, 1, 10);
+	assert("nothing recorded before Trace_Init", Trace_Ring.Used == 0, "used %u\n", Trace_Ring.Used);
+
+	Trace_Init();
+	now = 1000;
+	stub_primask = 0;
+	record(TRACE_MQTT_TX, 1, 0x30, 10);
+	assert("interrupts unmasked again", stub_primask == 0, "primask %u\n", stub_primask);
+	assert("header and padded bytes", Trace_Ring.Used == 24 && Trace_Ring.Head == 24, "used %u\n", Trace_Ring.Used);
+	stub_primask = 1;
+	record(TRACE_AT_CMD, 1, 'A', 100);
+	assert("interrupts left masked", stub_primask == 1, "primask %u\n", stub_primask);
+	stub_primask = 0;
+	n = readRecord(24, &hdr, data);
+	assert("AT record cut at the AT snaplen", n == 12 + TRACE_AT_SNAPLEN && hdr.Length == 100 &&
+			hdr.Captured == TRACE_AT_SNAPLEN && hdr.Type == TRACE_AT_CMD && hdr.Channel == 1 && hdr.Timestamp == 1000,
+			"captured %u\n", hdr.Captured);
+	record(TRACE_MQTT_RX, 1, 0x31, 300);
+	n = readRecord(24 + 12 + TRACE_AT_SNAPLEN, &hdr, data);
+	assert("MQTT record cut at the MQTT snaplen", hdr.Length == 300 && hdr.Captured == TRACE_MQTT_SNAPLEN &&
+			data[TRACE_MQTT_SNAPLEN - 1] == 0x31, "captured %u\n", hdr.Captured);
+	assert("nothing dropped yet", Trace_Ring.Dropped == 0 &&
+			Trace_Ring.Used == 24 + 12 + TRACE_AT_SNAPLEN + 12 + TRACE_MQTT_SNAPLEN, "used %u\n", Trace_Ring.Used);
+
+	/* 100-byte records, 112 bytes each in the ring: the oldest go, and records wrap around the end of Data */
+	for (i = 0; i < 10; i++)
+	{
+		now = 2000 + i;
+		record(TRACE_MQTT_TX, 2, (uint8_t)i, 100);
+	}
+	assert1("oldest records dropped", Trace_Ring.Dropped == 3 + 6 && Trace_Ring.Used == 4 * 112,
+			"dropped %u, used %u\n", Trace_Ring.Dropped, Trace_Ring.Used);
+	assert1("head follows the tail", (Trace_Ring.Tail + Trace_Ring.Used) % Trace_Ring.Size == Trace_Ring.Head,
+			"tail %u head %u\n", Trace_Ring.Tail, Trace_Ring.Head);
+	ok = 1;
+	last = 0;
+	for (off = 0, i = 6; off < Trace_Ring.Used; i++)
+	{
+		off += readRecord(off, &hdr, data);
+		ok = ok && hdr.Timestamp == 2000 + i && hdr.Captured == 100 && data[0] == i && data[99] == i;
+		last = i;
+	}
+	assert("the newest records kept in order", ok && last == 9, "last %u\n", last);
+
+	/* A record that could never fit is skipped, and leaves the ring alone */
+	Trace_Init();
+	record(TRACE_MQTT_TX, 0, 0, 10);
+	Trace_Ring.Size = 64;
+	record(TRACE_MQTT_TX, 0, 0, 100);
+	Trace_Ring.Size = sizeof(Trace_Ring.Data);
+	assert("record larger than the ring skipped", Trace_Ring.Used == 24 && Trace_Ring.Dropped == 0,
+			"used %u\n", Trace_Ring.Used);
+
+	MyLog(LOGA_INFO, "TEST1: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int test2(struct Options options)
+{
+	static uint8_t from_bin[65536];
+	size_t from_bin_len;
+	const uint8_t* p;
+	uint32_t seq_tx, seq_rx;
+	FILE* f;
+	int rc;
+
+	fprintf(xml, "<testcase classname=\"test_trace\" name=\"pcap\"");
+	global_start_time = start_clock();
+	failures = 0;
+	MyLog(LOGA_INFO, "Starting test 2 - trace2pcap frames from the ring image and from the console dump");
+
+	/* Wrapped: the first records are gone, and one record straddles the end of Data */
+	Trace_Init();
+	record(TRACE_MQTT_TX, 1, 0xEE, 300);
+	now = 12345;
+	record(TRACE_MQTT_TX, 1, 0x10, 100);
+	now = 12400;
+	record(TRACE_MQTT_RX, 1, 0x20, 4);
+	record(TRACE_AT_CMD, 1, 'P', 5);
+	record(TRACE_MQTT_TX, 1, 0x30, 90);
+	assert("the ring wrapped", Trace_Ring.Dropped == 1 && Trace_Ring.Head < Trace_Ring.Tail,
+			"dropped %u\n", Trace_Ring.Dropped);
+
+	f = fopen(bin_name, "wb");
+	fwrite(&Trace_Ring, sizeof(Trace_Ring), 1, f);
+	fclose(f);
+	rc = runTool(bin_name);
+	assert("binary image converted", rc == 0 && pcap_len > 24, "rc %d\n", rc);
+
+	p = pcap;
+	assert("pcap header", get32(p) == 0xA1B2C3D4 && get32(p + 20) == LINKTYPE_RAW, "link %u\n", get32(p + 20));
+	p += 24;
+	assert("timestamp in seconds and microseconds", get32(p) == 12 && get32(p + 4) == 345000, "ts %u\n", get32(p));
+	assert("frame lengths", get32(p + 8) == 40 + 100 && get32(p + 12) == 40 + 100, "len %u\n", get32(p + 8));
+	p += 16;
+	assert("IPv4 TCP, board to broker", p[0] == 0x45 && p[9] == 6 && get32be(p + 12) == BOARD_ADDR &&
+			get32be(p + 16) == BROKER_ADDR && get16be(p + 2) == 140, "proto %u\n", p[9]);
+	assert("IP checksum", ip_checksum(p, 20) == 0, "sum %x\n", ip_checksum(p, 20));
+	assert("TCP ports", get16be(p + 20) == BOARD_PORT_BASE + 1 && get16be(p + 22) == MQTT_PORT,
+			"port %u\n", get16be(p + 20));
+	seq_tx = get32be(p + 24);
+	seq_rx = get32be(p + 28);
+	assert("payload", p[40] == 0x10 && p[139] == 0x10, "byte %x\n", p[40]);
+	p += 140;
+
+	assert("broker to board", get32(p + 4) == 400000 && get32(p + 8) == 44, "len %u\n", get32(p + 8));
+	p += 16;
+	assert("received TCP segment", get32be(p + 12) == BROKER_ADDR && get16be(p + 20) == MQTT_PORT &&
+			get32be(p + 24) == seq_rx && get32be(p + 28) == seq_tx + 100 && p[40] == 0x20, "seq %u\n", get32be(p + 24));
+	p += 44;
+
+	assert("AT frame length", get32(p + 8) == 28 + 5, "len %u\n", get32(p + 8));
+	p += 16;
+	assert("AT command as UDP to the module", p[9] == 17 && get32be(p + 16) == MODULE_ADDR &&
+			get16be(p + 22) == AT_PORT_BASE + 1 && get16be(p + 24) == 8 + 5 && p[28] == 'P', "proto %u\n", p[9]);
+	p += 28 + 5;
+
+	p += 16;
+	assert("sequence numbers follow the sent bytes", get32be(p + 24) == seq_tx + 100 &&
+			get32be(p + 28) == seq_rx + 4 && p[40] == 0x30 && p[129] == 0x30, "seq %u\n", get32be(p + 24));
+	p += 130;
+	assert("four records", p == pcap + pcap_len, "%d bytes left\n", (int)(pcap + pcap_len - p));
+
+	/* The hex block Trace_Dump() prints, found among other console lines */
+	memcpy(from_bin, pcap, pcap_len);
+	from_bin_len = pcap_len;
+	dumpToFile();
+	rc = runTool(dump_name);
+	assert("console dump gives the same pcap", rc == 0 && pcap_len == from_bin_len &&
+			memcmp(pcap, from_bin, pcap_len) == 0, "%d bytes\n", (int)pcap_len);
+	assert("recording resumed after the dump", Trace_Ring.Magic == TRACE_MAGIC, "magic %x\n", Trace_Ring.Magic);
+
+	/* Truncated at the snaplen: captured and original lengths differ */
+	Trace_Init();
+	record(TRACE_MQTT_RX, 0, 0x40, 300);
+	f = fopen(bin_name, "wb");
+	fwrite(&Trace_Ring, sizeof(Trace_Ring), 1, f);
+	fclose(f);
+	rc = runTool(bin_name);
+	p = pcap + 24;
+	assert("snaplen kept, original length reported", rc == 0 && get32(p + 8) == 40 + TRACE_MQTT_SNAPLEN &&
+			get32(p + 12) == 40 + 300 && get16be(p + 16 + 2) == 40 + 300, "len %u\n", get32(p + 8));
+
+	/* Inputs that are not a ring */
+	Trace_Ring.Tail = Trace_Ring.Size;
+	f = fopen(bin_name, "wb");
+	fwrite(&Trace_Ring, sizeof(Trace_Ring), 1, f);
+	fclose(f);
+	Trace_Init();
+	rc = runTool(bin_name);
+	assert("corrupt ring refused", rc == 1, "rc %d\n", rc);
+	f = fopen(dump_name, "w");
+	fprintf(f, "no trace in this log\n");
+	fclose(f);
+	rc = runTool(dump_name);
+	assert("log without a dump refused", rc == 1, "rc %d\n", rc);
+
+	remove(bin_name);
+	remove(dump_name);
+	remove(pcap_name);
+
+	MyLog(LOGA_INFO, "TEST2: test %s. %d tests run, %d failures.",
+			(failures == 0) ? "passed" : "failed", tests, failures);
+	write_test_result();
+	return failures;
+}
+
+
+int main(int argc, char** argv)
+{
+ 	int (*tests[])(struct Options) = {NULL, test1, test2};
+
+	return run_tests(argc, argv, "test_trace", tests, ARRAY_SIZE(tests));
+}
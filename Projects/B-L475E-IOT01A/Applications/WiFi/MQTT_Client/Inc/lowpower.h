@@ -0,0 +1,40 @@
+/**
+  ******************************************************************************
+  * @file    Wifi/MQTT_Client/Inc/lowpower.h
+  * @brief   Tickless Stop 2 idle between MQTT activities.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LOWPOWER_H
+#define __LOWPOWER_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32l4xx_hal.h"
+#include "es_wifi_conf.h"
+#include "Timer.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Shorter idle periods are spent in Sleep mode: Stop 2 entry and the PLL
+   relock on exit cost more than they save. */
+#define LOWPOWER_MIN_SLEEP_MS          5
+
+/* LPTIM1 runs at 1 kHz from LSI, so one sleep is bounded by its 16-bit counter. */
+#define LOWPOWER_MAX_SLEEP_MS          65000
+
+/* Exported variables --------------------------------------------------------*/
+extern LPTIM_HandleTypeDef hlptim1;
+
+/* Exported functions ------------------------------------------------------- */
+void     LowPower_Init(void);
+uint32_t LowPower_NextDeadlineMS(Timer* const* timers, int count);
+uint32_t LowPower_Sleep(uint32_t ms, int (*pending)(void));
+
+#ifdef WIFI_USE_CMSIS_OS
+/* FreeRTOS tickless idle: in FreeRTOSConfig.h set
+     #define configUSE_TICKLESS_IDLE  2
+     #define portSUPPRESS_TICKS_AND_SLEEP(x)  LowPower_SuppressTicksAndSleep(x) */
+void     LowPower_SuppressTicksAndSleep(uint32_t expected_idle_ticks);
+#endif
+
+#endif /* __LOWPOWER_H */
@@ -30,6 +30,7 @@
 #include "stm32l475e_iot01_hsensor.h"
 #include "stm32l475e_iot01_tsensor.h"
 #include "stm32l475e_iot01_magneto.h"
+#include "stm32l475e_iot01_env.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -92,5 +93,6 @@
 /* Exported functions ------------------------------------------------------- */
 extern  SPI_HandleTypeDef hspi;
 void SPI3_IRQHandler(void);
+void SystemClock_Config(void);
 
 #endif /* __MAIN_H */
\ No newline at end of file
@@ -0,0 +1,30 @@
+/**
+  ******************************************************************************
+  * @file    Wifi/MQTT_Client/Inc/mqtt_client_conf.h
+  * @brief   MQTT client configuration of this application.
+  * @attention
+  * Included first by MQTTClientConfig.h, as the project defines
+  * MQTTCLIENT_CONFIG_HEADER to this file; what is not set here keeps the
+  * default of MQTTClientConfig.h.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MQTT_CLIENT_CONF_H
+#define __MQTT_CLIENT_CONF_H
+
+#if defined(USE_STATS)
+/* MQTT_PACKET_SENT / MQTT_PACKET_RECEIVED count the packets */
+#include "stats.h"
+#endif
+
+/* Room for the largest payload main.c publishes in one PUBLISH: a telemetry
+   batch of MAG_MAX_BYTES, or the statistics of STATS_PAYLOAD_SIZE. main.c
+   checks it at compile time. */
+#if defined(USE_TELEMETRY_BATCH)
+#define MQTT_SENDBUF_SIZE        576
+#elif defined(USE_STATS)
+#define MQTT_SENDBUF_SIZE        512
+#endif
+
+#endif /* __MQTT_CLIENT_CONF_H */
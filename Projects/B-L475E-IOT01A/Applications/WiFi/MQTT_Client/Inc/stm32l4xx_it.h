@@ -41,6 +41,20 @@ void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
 void EXTI1_IRQHandler(void);
+#if defined(USE_TRACE) || defined(USE_VIBRATION)
+void EXTI15_10_IRQHandler(void);
+#endif
+void I2C2_EV_IRQHandler(void);
+void I2C2_ER_IRQHandler(void);
+void DMA1_Channel4_IRQHandler(void);
+void DMA1_Channel5_IRQHandler(void);
+void USART1_IRQHandler(void);
+void DMA2_Channel6_IRQHandler(void);
+#if defined(USE_SHELL)
+void DMA2_Channel7_IRQHandler(void);
+void EXTI9_5_IRQHandler(void);
+#endif
+void LPTIM1_IRQHandler(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,236 @@
+/**
+  ******************************************************************************
+  * @file    Wifi/MQTT_Client/src/lowpower.c
+  * @brief   Tickless Stop 2 idle between MQTT activities.
+  * @attention
+  * The MCU is put in Stop 2 until the next application deadline (publish,
+  * keepalive, sensor sample). LPTIM1, clocked from LSI, is the wake-up source
+  * and measures the time actually slept so that the HAL tick, and with it the
+  * MQTT client Timers, stay consistent across the sleep. Any other enabled
+  * interrupt (ES-WiFi data ready, user button) ends the sleep early.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "lowpower.h"
+#include "logging.h"
+#if defined(USE_SHELL)
+#include "shell.h"
+#endif
+
+/* Private defines -----------------------------------------------------------*/
+/* LSI / 32 gives a 1 ms LPTIM count */
+#define LOWPOWER_LPTIM_PRESCALER       LPTIM_PRESCALER_DIV32
+#define LOWPOWER_LPTIM_PERIOD          0xFFFF
+
+/* The shell keeps the MCU out of Stop 2 while in use, and its input ends the
+   sleep so that the main loop runs the command */
+#if defined(USE_SHELL)
+#define LOWPOWER_SHELL_BUSY()          (!Shell_IsIdle())
+#define LOWPOWER_SHELL_INPUT()         Shell_HasInput()
+#else
+#define LOWPOWER_SHELL_BUSY()          0
+#define LOWPOWER_SHELL_INPUT()         0
+#endif
+
+#define LOWPOWER_PENDING(pending)      (((pending) != NULL) && (pending)())
+
+/* Private variables ---------------------------------------------------------*/
+LPTIM_HandleTypeDef hlptim1;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t LowPower_EnterStop2(uint32_t ms);
+static uint32_t LowPower_ReadCounter(void);
+
+/*------------------------------------------------------------------------------
+  LowPower_Init() - Start LSI and configure LPTIM1 as the Stop 2 wake-up timer.
+------------------------------------------------------------------------------*/
+void LowPower_Init(void)
+{
+    RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+    RCC_PeriphCLKInitTypeDef PeriphClkInit = {0};
+
+    /* LSI keeps running in Stop 2 */
+    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_LSI;
+    RCC_OscInitStruct.LSIState = RCC_LSI_ON;
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+    if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK) {
+        while(1);
+    }
+
+    PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_LPTIM1;
+    PeriphClkInit.Lptim1ClockSelection = RCC_LPTIM1CLKSOURCE_LSI;
+    if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK) {
+        while(1);
+    }
+
+    hlptim1.Instance = LPTIM1;
+    hlptim1.Init.Clock.Source = LPTIM_CLOCKSOURCE_APBCLOCK_LPOSC;
+    hlptim1.Init.Clock.Prescaler = LOWPOWER_LPTIM_PRESCALER;
+    hlptim1.Init.Trigger.Source = LPTIM_TRIGSOURCE_SOFTWARE;
+    hlptim1.Init.OutputPolarity = LPTIM_OUTPUTPOLARITY_HIGH;
+    hlptim1.Init.UpdateMode = LPTIM_UPDATE_IMMEDIATE;
+    hlptim1.Init.CounterSource = LPTIM_COUNTERSOURCE_INTERNAL;
+    hlptim1.Init.Input1Source = LPTIM_INPUT1SOURCE_GPIO;
+    hlptim1.Init.Input2Source = LPTIM_INPUT2SOURCE_GPIO;
+    if (HAL_LPTIM_Init(&hlptim1) != HAL_OK) {
+        while(1);
+    }
+
+    /* Wake up on MSI so that SystemClock_Config() only has to relock the PLL */
+    HAL_RCCEx_WakeUpStopCLKConfig(RCC_STOP_WAKEUPCLOCK_MSI);
+}
+
+/*------------------------------------------------------------------------------
+  HAL_LPTIM_MspInit() - LPTIM1 clock and interrupt.
+------------------------------------------------------------------------------*/
+void HAL_LPTIM_MspInit(LPTIM_HandleTypeDef *hlptim)
+{
+    if (hlptim->Instance == LPTIM1) {
+        __HAL_RCC_LPTIM1_CLK_ENABLE();
+        HAL_NVIC_SetPriority(LPTIM1_IRQn, 0x0F, 0);
+        HAL_NVIC_EnableIRQ(LPTIM1_IRQn);
+    }
+}
+
+/*------------------------------------------------------------------------------
+  LowPower_NextDeadlineMS() - Milliseconds until the first of the given Timers
+  expires. NULL entries are skipped; 0 means something is already due.
+------------------------------------------------------------------------------*/
+uint32_t LowPower_NextDeadlineMS(Timer* const* timers, int count)
+{
+    uint32_t next = LOWPOWER_MAX_SLEEP_MS;
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        if (timers[i] != NULL) {
+            uint32_t left = (uint32_t)TimerLeftMS(timers[i]);
+            if (left < next)
+                next = left;
+        }
+    }
+    return next;
+}
+
+/*------------------------------------------------------------------------------
+  LowPower_Sleep() - Idle for up to ms milliseconds, or until pending(), if
+  not NULL, returns non-zero: it tells whether an interrupt has left work for
+  the caller. Returns the time actually slept, which is shorter when another
+  interrupt woke the MCU. Periods below LOWPOWER_MIN_SLEEP_MS are spent in
+  Sleep mode with SysTick running, and so is the time until queued sensor bus
+  transfers and console output are done, and while the shell is in use: I2C2,
+  the USART and the DMA do not run in Stop 2.
+------------------------------------------------------------------------------*/
+uint32_t LowPower_Sleep(uint32_t ms, int (*pending)(void))
+{
+    uint32_t start = HAL_GetTick();
+    uint32_t slept;
+
+    if (ms == 0)
+        return 0;
+
+    if (!SENSOR_IO_IsIdle() || !Log_IsIdle() || LOWPOWER_SHELL_BUSY()) {
+        while ((!SENSOR_IO_IsIdle() || !Log_IsIdle() || LOWPOWER_SHELL_BUSY()) &&
+               !LOWPOWER_SHELL_INPUT() && !LOWPOWER_PENDING(pending) && (HAL_GetTick() - start) < ms)
+            __WFI();
+        return HAL_GetTick() - start;
+    }
+
+    if (ms < LOWPOWER_MIN_SLEEP_MS) {
+        while (!LOWPOWER_PENDING(pending) && (HAL_GetTick() - start) < ms)
+            __WFI();
+        return HAL_GetTick() - start;
+    }
+
+    if (ms > LOWPOWER_MAX_SLEEP_MS)
+        ms = LOWPOWER_MAX_SLEEP_MS;
+
+    /* An interrupt that came after the caller last looked has run by now and
+       is seen here; one that comes later stays pending and ends the WFI at
+       once. Checking before masking would lose a level-triggered source such
+       as the LSM6DSL INT1, whose edge does not come again until serviced. */
+    __disable_irq();
+    if (LOWPOWER_PENDING(pending)) {
+        __enable_irq();
+        return 0;
+    }
+    slept = LowPower_EnterStop2(ms);
+    __enable_irq();
+
+    return slept;
+}
+
+#ifdef WIFI_USE_CMSIS_OS
+/*------------------------------------------------------------------------------
+  LowPower_SuppressTicksAndSleep() - portSUPPRESS_TICKS_AND_SLEEP() hook.
+  Assumes configTICK_RATE_HZ is 1000 so that one RTOS tick is one HAL tick.
+------------------------------------------------------------------------------*/
+void LowPower_SuppressTicksAndSleep(uint32_t expected_idle_ticks)
+{
+    uint32_t slept;
+
+    if (expected_idle_ticks * portTICK_PERIOD_MS < LOWPOWER_MIN_SLEEP_MS)
+        return;
+
+    __disable_irq();
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+        __enable_irq();
+        return;
+    }
+
+    slept = LowPower_EnterStop2(expected_idle_ticks * portTICK_PERIOD_MS);
+    vTaskStepTick(slept / portTICK_PERIOD_MS);
+    __enable_irq();
+}
+#endif
+
+/*------------------------------------------------------------------------------
+  LowPower_EnterStop2() - Stop 2 for up to ms milliseconds. Called with
+  interrupts masked: a pending interrupt still wakes the core, but its handler
+  only runs once the clocks and the tick have been restored.
+------------------------------------------------------------------------------*/
+static uint32_t LowPower_EnterStop2(uint32_t ms)
+{
+    uint32_t slept;
+
+    if (HAL_LPTIM_TimeOut_Start_IT(&hlptim1, LOWPOWER_LPTIM_PERIOD, ms) != HAL_OK)
+        return 0;
+
+    HAL_SuspendTick();
+    HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+
+    /* Back on MSI: read the elapsed time before anything else */
+    slept = LowPower_ReadCounter();
+    if (__HAL_LPTIM_GET_FLAG(&hlptim1, LPTIM_FLAG_CMPM)) {
+        __HAL_LPTIM_CLEAR_FLAG(&hlptim1, LPTIM_FLAG_CMPM);
+        slept = ms;
+    }
+    HAL_LPTIM_TimeOut_Stop_IT(&hlptim1);
+    HAL_NVIC_ClearPendingIRQ(LPTIM1_IRQn);
+
+    SystemClock_Config();
+
+    /* Move the HAL tick forward by the time spent in Stop 2 and let the 64-bit
+       Timer base see a possible wrap before SysTick resumes */
+    uwTick += slept;
+    TimerIncTick();
+    HAL_ResumeTick();
+
+    return slept;
+}
+
+/*------------------------------------------------------------------------------
+  LowPower_ReadCounter() - LPTIM1 counter, read until two reads agree since the
+  counter is clocked asynchronously to the APB.
+------------------------------------------------------------------------------*/
+static uint32_t LowPower_ReadCounter(void)
+{
+    uint32_t cnt;
+
+    do {
+        cnt = HAL_LPTIM_ReadCounter(&hlptim1);
+    } while (cnt != HAL_LPTIM_ReadCounter(&hlptim1));
+
+    return cnt;
+}
@@ -12,6 +12,12 @@
 #include "main.h"
 #include "Timer.h"           // Timer implementation
 #include "MQTTInterface.h"   // MQTT network interface (defines Network and wrappers)
+#include "lowpower.h"        // Stop 2 idle between MQTT activities
+#include "telemetry.h"       // compact CBOR sensor payloads
+#include "report.h"          // report by exception
+#include "logging.h"         // console through a UART DMA ring
+#include "settings.h"        // run-time configuration saved in flash
+#include "stats.h"           // run-time statistics, counted with USE_STATS
 
 /* Undefine SUCCESS to avoid conflicts with the MQTT client's enum definition */
 #ifdef SUCCESS
@@ -20,18 +26,132 @@
 
 #include "MQTTClient.h"      // Paho Embedded MQTT Client
 
+#if defined(STACKTRACE_PROFILE)
+#include "StackTrace.h"      // MQTTPacket codec profile
+#endif
+
+#if defined(USE_MQTTSN)
+#include "MQTTSNClient.h"    // MQTT-SN over UDP, through a gateway
+#endif
+
+#if defined(USE_TRACE)
+#include "trace.h"           // MQTT packet and AT command trace ring
+#endif
+
+#if defined(USE_VIBRATION_FEATURES)
+#include "signal_features.h" // CMSIS-DSP features of the vibration windows
+#endif
+
+#if defined(USE_SHELL)
+#include "shell.h"           // console commands, received by UART DMA
+#endif
+
 /* Private defines -----------------------------------------------------------*/
+/* Defaults of the run-time settings (settings.h); with USE_SHELL defined
+   they can be changed from the console and saved to flash */
 #define SSID                "YOUR_WIFI_SSID"
 #define PASSWORD            "YOUR_WIFI_PASSWORD"
 
 /* Mosquitto broker settings */
 #define MQTT_BROKER_HOST    "test.mosquitto.org"
+#if defined(USE_MQTT_TLS)
+/* MQTT over TLS: the module does the handshake with credential set
+   MQTT_TLS_CREDSET, written once to its flash by a build with
+   MQTT_TLS_PROVISION defined and only selected by later builds */
+#define MQTT_BROKER_PORT    8883
+#define MQTT_BROKER_PROTO   WIFI_TCP_SSL_PROTOCOL
+#define MQTT_BROKER_TRANSPORT "TLS"
+#define MQTT_TLS_CREDSET    0
+#else
 #define MQTT_BROKER_PORT    1883
+#define MQTT_BROKER_PROTO   WIFI_TCP_PROTOCOL
+#define MQTT_BROKER_TRANSPORT "TCP"
+#endif
+
+#define MQTT_CLIENT_ID      "B-L475E-IOT01A1_Client"
+
+#define PUBLISH_INTERVAL_MS 2000   // test message period
+#define RECONNECT_INTERVAL_MS 10000 // wait between broker reconnect attempts
+
+#if defined(STACKTRACE_PROFILE)
+#define PROFILE_INTERVAL_MS 60000  // codec profile report period
+#define PROFILE_TOPIC       "test/$SYS/mqttpacket"
+#endif
+
+#if defined(USE_MQTTSN)
+/* Gateway settings: the gateway maps MQTTSN_TOPIC_ID to a topic name, e.g.
+   gateway --predefined 1=sensors/temp (MQTTSNClient/samples/linux) */
+#define MQTTSN_GATEWAY_HOST "192.168.1.10"
+#define MQTTSN_GATEWAY_PORT 10000
+#define MQTTSN_TOPIC_ID     1
+#define MQTTSN_INTERVAL_MS  60000  // temperature report period
+#endif
 
-#define MQTT_BUFFER_SIZE    256
+#if defined(USE_VIBRATION)
+/* Accelerometer batches from the LSM6DSL FIFO, drained on its watermark interrupt */
+#define VIBRATION_ODR       LSM6DSL_ODR_416Hz
+#define VIBRATION_WATERMARK 104    // samples per batch: 250 ms at 416 Hz
+#endif
+
+#if defined(USE_VIBRATION_FEATURES)
+#if !defined(USE_VIBRATION)
+#error "USE_VIBRATION_FEATURES needs USE_VIBRATION"
+#endif
+/* One feature vector per FEATURES_WINDOW samples instead of the raw data */
+#define VIBRATION_RATE_HZ   416.0f
+#define VIBRATION_TOPIC     "test/vibration"
+#define VIBRATION_PENDING   2      // windows reduced while draining, published after
+#endif
+
+#if defined(USE_ENV_SENSORS)
+/* Temperature, humidity and pressure, read over the queued sensor bus */
+#define ENV_TOPIC           "test/env"
+#endif
+
+#if defined(USE_TELEMETRY_BATCH)
+/* Sensor groups sampled at their own rate; each is published as one
+   delta-encoded batch once it reaches its byte or age bound */
+#define TELEMETRY_TOPIC     "test/telemetry"
+#define BATCH_MAX_ROWS      64
+#define BATCH_MAX_COLUMNS   3
+#define ENV_SAMPLE_MS       10000  // temperature, humidity, pressure
+#define ENV_MAX_BYTES       256
+#define ENV_MAX_AGE_MS      600000
+#define MAG_SAMPLE_MS       1000   // magnetometer
+#define MAG_MAX_BYTES       512
+#define MAG_MAX_AGE_MS      60000
+#endif
+
+#if defined(USE_REPORT_BY_EXCEPTION)
+/* Environmental readings are only published when they change */
+#define REPORT_TOPIC        "test/report"
+#define REPORT_SAMPLE_MS    5000     // sensor read period
+#define REPORT_MIN_MS       10000    // at most one report per channel this often
+#define REPORT_MAX_MS       3600000  // unchanged values are sent again hourly
+#define REPORT_HEARTBEAT_MS 300000   // uptime-only publish when nothing changed
+#endif
+
+#if defined(USE_STATS)
+/* Counters and latency histograms of each layer (stats.h), as CBOR under the
+   client ID, decoded by Common/Tools/statsdecode */
+#define STATS_TOPIC         MQTT_CLIENT_ID "/stats"
+#define STATS_INTERVAL_MS   60000
+#define STATS_PAYLOAD_SIZE  384    // fits MQTT_SENDBUF_SIZE of mqtt_client_conf.h, checked below
+#endif
 
 #define TERMINAL_USE
 
+#if defined(USE_SHELL)
+#if !defined(TERMINAL_USE)
+#error "USE_SHELL needs TERMINAL_USE"
+#endif
+/* Publish benchmark started from the shell */
+#define BENCH_TOPIC         "test/bench"
+#define BENCH_COUNT         100
+#define BENCH_MAX_COUNT     10000
+#define BENCH_SIZE          64
+#endif
+
 #ifdef TERMINAL_USE
   #define LOG(a) printf a
 #else
@@ -43,12 +163,21 @@
 extern UART_HandleTypeDef hDiscoUart;
 #endif
 
-/* MQTT communication buffers */
-unsigned char mqtt_sendbuf[MQTT_BUFFER_SIZE];
-unsigned char mqtt_readbuf[MQTT_BUFFER_SIZE];
+/* MQTT communication buffers, sized in MQTTClientConfig.h */
+unsigned char mqtt_sendbuf[MQTT_SENDBUF_SIZE];
+unsigned char mqtt_readbuf[MQTT_READBUF_SIZE];
 
-/* Private function prototypes -----------------------------------------------*/
-static void SystemClock_Config(void);
+/* Bytes of a PUBLISH besides its payload: fixed header, remaining length
+   (2 bytes up to 16 KB), topic name and packet id. A payload the send buffer
+   cannot hold fails MQTTPublish() and closes the session. */
+#define PUBLISH_OVERHEAD(topic)  (1 + 2 + 2 + (sizeof(topic) - 1) + 2)
+#if defined(USE_TELEMETRY_BATCH)
+typedef char telemetry_batch_fits[(MAG_MAX_BYTES + PUBLISH_OVERHEAD(TELEMETRY_TOPIC) <= MQTT_SENDBUF_SIZE &&
+                                   ENV_MAX_BYTES + PUBLISH_OVERHEAD(TELEMETRY_TOPIC) <= MQTT_SENDBUF_SIZE) ? 1 : -1];
+#endif
+#if defined(USE_STATS)
+typedef char stats_payload_fits[(STATS_PAYLOAD_SIZE + PUBLISH_OVERHEAD(STATS_TOPIC) <= MQTT_SENDBUF_SIZE) ? 1 : -1];
+#endif
 
 /* Include Wi-Fi driver headers */
 #include "wifi.h"
@@ -57,6 +186,77 @@ static void SystemClock_Config(void);
 /* Global variable for IP address */
 uint8_t IP_Addr[4];
 
+/* Run-time configuration: the defaults above or the copy saved in flash */
+static Settings_t settings;
+
+/* Test topic publishes, for the shell stats */
+static uint32_t publish_count = 0;
+static uint32_t publish_failures = 0;
+
+#if defined(USE_SHELL)
+/* Set once the client exists; the stats and bench commands use it */
+static MQTTClient *shell_client = NULL;
+#endif
+
+#if defined(USE_TRACE)
+/* Set by the user button; the main loop then prints the trace ring */
+static volatile int trace_dump_requested = 0;
+#endif
+
+#if defined(USE_VIBRATION)
+/* Set by the LSM6DSL FIFO watermark interrupt (INT1) */
+static volatile int vibration_batch_ready = 0;
+/* Room for two batches, in case the main loop was held up */
+static int16_t vibration_buf[2 * VIBRATION_WATERMARK * 3];
+static uint32_t vibration_samples = 0;
+static uint32_t vibration_overruns = 0;
+#endif
+
+#if defined(USE_VIBRATION_FEATURES)
+static Features_Window_t vibration_window;
+/* Features of the windows filled by the last FIFO drain, not yet published */
+static Features_t vibration_pending[VIBRATION_PENDING];
+static uint32_t vibration_pending_count = 0;
+#endif
+
+#if defined(USE_ENV_SENSORS)
+/* Filled in by the sensor bus completion; published by the main loop */
+static volatile int env_ready = 0;
+static ENV_DataTypeDef env_data;
+#endif
+
+#if defined(USE_TELEMETRY_BATCH)
+typedef struct {
+    uint32_t sample_ms;
+    void (*sample)(int32_t *values);   // one scaled value per column
+    Timer sample_timer;
+    Timer flush_timer;                 // expires when the batch is due
+    Telemetry_Batch_t batch;
+    int32_t values[BATCH_MAX_ROWS * BATCH_MAX_COLUMNS];
+    uint32_t times[BATCH_MAX_ROWS];
+} telemetry_group_t;
+
+static const uint8_t env_keys[] = { TELEMETRY_TEMPERATURE, TELEMETRY_HUMIDITY, TELEMETRY_PRESSURE };
+static const uint8_t mag_keys[] = { TELEMETRY_MAG_X, TELEMETRY_MAG_Y, TELEMETRY_MAG_Z };
+static telemetry_group_t env_group, mag_group;
+static uint8_t batch_payload[MAG_MAX_BYTES > ENV_MAX_BYTES ? MAG_MAX_BYTES : ENV_MAX_BYTES];
+#endif
+
+#if defined(USE_REPORT_BY_EXCEPTION)
+static Report_Channel_t report_channels[3];
+static uint32_t report_last_publish;
+#endif
+
+#if defined(USE_MQTT_TLS) && defined(MQTT_TLS_PROVISION)
+/* PEM credentials, e.g. mosquitto.org.crt as the CA for test.mosquitto.org.
+   The device certificate and key are only sent to a broker that asks for them.
+   Nothing is written to the module until all three are PEM. */
+#define TLS_PEM_BEGIN "-----BEGIN "
+static const char tls_ca[]   = "YOUR_ROOT_CA_PEM";
+static const char tls_cert[] = "YOUR_DEVICE_CERTIFICATE_PEM";
+static const char tls_key[]  = "YOUR_DEVICE_KEY_PEM";
+#endif
+
 /*------------------------------------------------------------------------------
   wifi_connect() - Connect to Wi-Fi using the ES-WiFi APIs.
 ------------------------------------------------------------------------------*/
@@ -82,8 +282,8 @@ int wifi_connect(void)
     }
     
     /* Connect to the Access Point */
-    LOG(("\nConnecting to %s , %s\n", SSID, PASSWORD));
-    if (WIFI_Connect(SSID, PASSWORD, WIFI_ECN_WPA2_PSK) != WIFI_STATUS_OK) {
+    LOG(("\nConnecting to %s , %s\n", settings.Ssid, settings.Password));
+    if (WIFI_Connect(settings.Ssid, settings.Password, WIFI_ECN_WPA2_PSK) != WIFI_STATUS_OK) {
         LOG(("ERROR: ES-WiFi module NOT connected.\n"));
         return -1;
     }
@@ -102,8 +302,9 @@ int wifi_connect(void)
 
 /*------------------------------------------------------------------------------
   SystemClock_Config() - Configure the system clock.
+  Also called by the low-power module to restore the PLL after Stop 2.
 ------------------------------------------------------------------------------*/
-static void SystemClock_Config(void)
+void SystemClock_Config(void)
 {
     RCC_ClkInitTypeDef RCC_ClkInitStruct;
     RCC_OscInitTypeDef RCC_OscInitStruct;
@@ -136,6 +337,521 @@ static void SystemClock_Config(void)
     }
 }
 
+/*------------------------------------------------------------------------------
+  broker_connect() - Open the broker socket on socket 0 and send CONNECT.
+  Opening the socket is where the module does the TCP and, with USE_MQTT_TLS,
+  the TLS handshake.  Its time is printed with the running minimum and maximum
+  so that plain and TLS connects, at boot and on reconnect, can be compared.
+------------------------------------------------------------------------------*/
+static int broker_connect(MQTTClient* client, const uint8_t* brokerIP, MQTTPacket_connectData* connectData)
+{
+    static uint32_t connects = 0, min_ms = UINT32_MAX, max_ms = 0;
+    uint32_t start = HAL_GetTick();
+    uint32_t elapsed;
+    int rc;
+
+    if (WIFI_OpenClientConnection(0, MQTT_BROKER_PROTO, "MQTT", brokerIP, settings.BrokerPort, 0) != WIFI_STATUS_OK) {
+        LOG_ERROR("Failed to open client connection to broker\n");
+        return FAILURE;
+    }
+    elapsed = HAL_GetTick() - start;
+    connects++;
+    STATS_INC(Connects);
+    if (elapsed < min_ms)
+        min_ms = elapsed;
+    if (elapsed > max_ms)
+        max_ms = elapsed;
+    LOG_INFO(MQTT_BROKER_TRANSPORT " connection to MQTT broker established in %lu ms (min %lu, max %lu, %lu connects)\n",
+             (unsigned long)elapsed, (unsigned long)min_ms, (unsigned long)max_ms, (unsigned long)connects);
+
+    rc = MQTTConnect(client, connectData);
+    if (rc != MQTT_SUCCESS) {
+        LOG_ERROR("MQTT connect failed with return code %d\n", rc);
+        WIFI_CloseClientConnection(0);
+    } else {
+        LOG_INFO("MQTT connected successfully\n");
+    }
+    return rc;
+}
+
+#if defined(USE_MQTTSN)
+/*------------------------------------------------------------------------------
+  mqttsn_run() - Report the temperature as MQTT-SN QoS -1 publishes.
+  QoS -1 needs neither a connection nor a registration: each report is one
+  datagram to the gateway, and the board sleeps in Stop 2 in between.
+------------------------------------------------------------------------------*/
+static void mqttsn_run(void)
+{
+    static unsigned char sn_sendbuf[64];
+    static unsigned char sn_readbuf[64];
+    MQTTSNNetwork network;
+    MQTTSNClient client;
+    MQTTSN_topicid topic;
+    MQTTSNMessage message;
+    Timer report_timer;
+    float temperature;
+
+    if (WIFI_GetHostAddress(MQTTSN_GATEWAY_HOST, network.gateway, sizeof(network.gateway)) != WIFI_STATUS_OK) {
+        printf("Failed to resolve gateway hostname: %s\n", MQTTSN_GATEWAY_HOST);
+        while (1);
+    }
+    /* UDP on socket 1, addressed to the gateway; socket 0 stays for MQTT over TCP */
+    if (WIFI_OpenClientConnection(1, WIFI_UDP_PROTOCOL, "MQTTSN", network.gateway, MQTTSN_GATEWAY_PORT, 0) != WIFI_STATUS_OK) {
+        printf("Failed to open UDP connection to gateway\n");
+        while (1);
+    }
+    network.socket = 1;
+    network.port = MQTTSN_GATEWAY_PORT;
+    network.mqttsnread = mqttsn_network_read;
+    network.mqttsnwrite = mqttsn_network_write;
+    MQTTSNClientInit(&client, &network, 3000, sn_sendbuf, sizeof(sn_sendbuf), sn_readbuf, sizeof(sn_readbuf));
+
+    topic.type = MQTTSN_TOPIC_TYPE_PREDEFINED;
+    topic.data.id = MQTTSN_TOPIC_ID;
+    message.qos = -1;
+    message.retained = 0;
+    message.dup = 0;
+    message.payload = &temperature;
+    message.payloadlen = sizeof(temperature);   // 4 byte float, little endian
+
+    TimerInit(&report_timer);
+    while (1) {
+        Timer* const deadlines[] = { &report_timer };
+
+        if (TimerIsExpired(&report_timer)) {
+            TimerCountdownMS(&report_timer, MQTTSN_INTERVAL_MS);
+            temperature = BSP_TSENSOR_ReadTemp();
+            if (MQTTSNPublish(&client, topic, &message) != MQTTSN_SUCCESS) {
+                printf("MQTT-SN publish failed\n");
+            }
+        }
+        LowPower_Sleep(LowPower_NextDeadlineMS(deadlines, 1), NULL);
+    }
+}
+#endif
+
+#if defined(USE_ENV_SENSORS)
+/*------------------------------------------------------------------------------
+  env_callback() - Environmental reading done (interrupt context).
+------------------------------------------------------------------------------*/
+static void env_callback(const ENV_DataTypeDef *data, ENV_StatusTypeDef status)
+{
+    if (status == ENV_OK) {
+        env_data = *data;
+        env_ready = 1;
+    }
+}
+#endif
+
+#if defined(USE_TELEMETRY_BATCH)
+/*------------------------------------------------------------------------------
+  env_sample(), mag_sample() - Read one sample of a sensor group.
+------------------------------------------------------------------------------*/
+static void env_sample(int32_t *values)
+{
+    values[0] = Telemetry_Scale(TELEMETRY_TEMPERATURE, BSP_TSENSOR_ReadTemp());
+    values[1] = Telemetry_Scale(TELEMETRY_HUMIDITY, BSP_HSENSOR_ReadHumidity());
+    values[2] = Telemetry_Scale(TELEMETRY_PRESSURE, BSP_PSENSOR_ReadPressure());
+}
+
+static void mag_sample(int32_t *values)
+{
+    int16_t xyz[3];
+
+    BSP_MAGNETO_GetXYZ(xyz);
+    values[0] = xyz[0];
+    values[1] = xyz[1];
+    values[2] = xyz[2];
+}
+
+/*------------------------------------------------------------------------------
+  telemetry_group_init() - Set up a sensor group; its first sample is due now.
+------------------------------------------------------------------------------*/
+static void telemetry_group_init(telemetry_group_t *group, const uint8_t *keys, uint8_t columns,
+                                 void (*sample)(int32_t *), uint32_t sample_ms,
+                                 uint32_t max_bytes, uint32_t max_age_ms)
+{
+    group->sample = sample;
+    group->sample_ms = sample_ms;
+    TimerInit(&group->sample_timer);
+    TimerCountdownMS(&group->flush_timer, max_age_ms);
+    Telemetry_BatchInit(&group->batch, keys, columns, group->values, group->times,
+                        BATCH_MAX_ROWS, max_bytes, max_age_ms);
+}
+
+/*------------------------------------------------------------------------------
+  telemetry_group_run() - Take a sample when due, and publish the batch once
+  it is full or its oldest sample reached the maximum age. A batch that
+  cannot be published is dropped: the next one starts fresh.
+------------------------------------------------------------------------------*/
+static void telemetry_group_run(MQTTClient *client, telemetry_group_t *group)
+{
+    int32_t values[BATCH_MAX_COLUMNS];
+    int added = 1;
+
+    if (TimerIsExpired(&group->sample_timer)) {
+        TimerCountdownMS(&group->sample_timer, group->sample_ms);
+        group->sample(values);
+        added = (Telemetry_BatchAdd(&group->batch, HAL_GetTick(), values) == 0);
+    }
+
+    if (Telemetry_BatchTimeLeft(&group->batch, HAL_GetTick()) == 0) {
+        MQTTMessage message;
+        int32_t len = Telemetry_BatchEncode(&group->batch, batch_payload, sizeof(batch_payload));
+
+        message.payload = batch_payload;
+        message.payloadlen = (len > 0) ? (size_t)len : 0;
+        message.qos = QOS0;
+        message.retained = 0;
+        if (len < 0 || !MQTTIsConnected(client) ||
+            MQTTPublish(client, TELEMETRY_TOPIC, &message) != MQTT_SUCCESS)
+            LOG_WARN("Telemetry batch of %ld bytes dropped\n", (long)len);
+        if (!added)
+            Telemetry_BatchAdd(&group->batch, HAL_GetTick(), values);
+    }
+    TimerCountdownMS(&group->flush_timer, Telemetry_BatchTimeLeft(&group->batch, HAL_GetTick()));
+}
+#endif
+
+#if defined(USE_VIBRATION)
+/*------------------------------------------------------------------------------
+  vibration_drain() - Read the accelerometer FIFO until it is empty. With
+  USE_VIBRATION_FEATURES the samples go into the feature window, and each full
+  window is reduced to features kept for vibration_publish(), so that nothing
+  waits on the network while the FIFO fills. Returns 0 if samples were left
+  in the FIFO because VIBRATION_PENDING windows already wait to be published.
+------------------------------------------------------------------------------*/
+static int vibration_drain(void)
+{
+    uint16_t n;
+#if defined(USE_VIBRATION_FEATURES)
+    uint32_t room;
+
+    while (1) {
+        if (vibration_window.Fill == FEATURES_WINDOW) {
+            if (vibration_pending_count == VIBRATION_PENDING)
+                return 0;
+            Features_Compute(&vibration_window, &vibration_pending[vibration_pending_count++]);
+        }
+        /* No more than the window takes, so that no sample read is dropped */
+        room = FEATURES_WINDOW - vibration_window.Fill;
+        n = BSP_ACCELERO_FIFO_GetXYZ(vibration_buf, (room < 2 * VIBRATION_WATERMARK) ? room : 2 * VIBRATION_WATERMARK);
+        if (n == 0)
+            break;
+        vibration_samples += n;
+        Features_Add(&vibration_window, vibration_buf, n);
+    }
+#else
+    while ((n = BSP_ACCELERO_FIFO_GetXYZ(vibration_buf, 2 * VIBRATION_WATERMARK)) > 0)
+        vibration_samples += n;
+#endif
+    return 1;
+}
+#endif
+
+#if defined(USE_VIBRATION_FEATURES)
+/*------------------------------------------------------------------------------
+  vibration_publish() - Publish the features vibration_drain() computed.
+------------------------------------------------------------------------------*/
+static void vibration_publish(MQTTClient *client)
+{
+    uint32_t k;
+
+    for (k = 0; k < vibration_pending_count; k++) {
+        const Features_t *features = &vibration_pending[k];
+
+        if (MQTTIsConnected(client)) {
+            uint8_t payload[128];
+            Telemetry_Encoder_t enc;
+            MQTTMessage message;
+            int32_t len;
+            int i;
+
+            Telemetry_Begin(&enc, payload, sizeof(payload));
+            for (i = 0; i < FEATURES_AXES; i++) {
+                Telemetry_AddReading(&enc, TELEMETRY_RMS_X + i, features->Rms[i]);
+                Telemetry_AddReading(&enc, TELEMETRY_PEAK_X + i, features->Peak[i]);
+                Telemetry_AddReading(&enc, TELEMETRY_CREST_X + i, features->Crest[i]);
+            }
+            for (i = 0; i < FEATURES_BANDS; i++)
+                Telemetry_AddReading(&enc, TELEMETRY_BAND_0 + i, features->Band[i]);
+            len = Telemetry_End(&enc);
+            message.payload = payload;
+            message.payloadlen = len;
+            message.qos = QOS0;
+            message.retained = 0;
+            if (len < 0)
+                LOG_WARN("Vibration features do not fit in %u bytes\n", (unsigned)sizeof(payload));
+            else if (MQTTPublish(client, VIBRATION_TOPIC, &message) != MQTT_SUCCESS)
+                LOG_WARN("Vibration features publish failed\n");
+        }
+    }
+    vibration_pending_count = 0;
+}
+#endif
+
+#if defined(USE_REPORT_BY_EXCEPTION)
+/*------------------------------------------------------------------------------
+  report_run() - Read the environmental sensors and publish the channels that
+  moved out of their deadband, or only the uptime as a heartbeat. Nothing is
+  encoded or sent when no channel is due.
+------------------------------------------------------------------------------*/
+static void report_run(MQTTClient *client)
+{
+    uint32_t now = HAL_GetTick();
+    uint32_t due = 0;
+    int32_t values[3];
+    uint8_t payload[32];
+    Telemetry_Encoder_t enc;
+    MQTTMessage message;
+    int32_t len;
+    int i;
+
+    values[0] = Telemetry_Scale(TELEMETRY_TEMPERATURE, BSP_TSENSOR_ReadTemp());
+    values[1] = Telemetry_Scale(TELEMETRY_HUMIDITY, BSP_HSENSOR_ReadHumidity());
+    values[2] = Telemetry_Scale(TELEMETRY_PRESSURE, BSP_PSENSOR_ReadPressure());
+    for (i = 0; i < 3; i++) {
+        if (Report_IsDue(&report_channels[i], now, values[i]))
+            due |= 1U << i;
+    }
+    if ((due == 0 && now - report_last_publish < REPORT_HEARTBEAT_MS) || !MQTTIsConnected(client))
+        return;
+
+    Telemetry_Begin(&enc, payload, sizeof(payload));
+    Telemetry_AddInt(&enc, TELEMETRY_UPTIME, now / 1000);
+    for (i = 0; i < 3; i++) {
+        if (due & (1U << i))
+            Telemetry_AddInt(&enc, report_channels[i].Key, values[i]);
+    }
+    len = Telemetry_End(&enc);
+    if (len < 0) {
+        LOG_WARN("Report does not fit in %u bytes\n", (unsigned)sizeof(payload));
+        return;
+    }
+    message.payload = payload;
+    message.payloadlen = len;
+    message.qos = QOS0;
+    message.retained = 0;
+    if (MQTTPublish(client, REPORT_TOPIC, &message) != MQTT_SUCCESS) {
+        LOG_WARN("Report publish failed\n");
+        return;
+    }
+
+    report_last_publish = now;
+    for (i = 0; i < 3; i++) {
+        if (due & (1U << i))
+            Report_Commit(&report_channels[i], now, values[i]);
+    }
+}
+#endif
+
+#if defined(USE_STATS)
+/*------------------------------------------------------------------------------
+  stats_publish() - Publish the statistics at QoS 1, so that each period also
+  times a PUBLISH to PUBACK round trip. MQTTClient_poll() reads the PUBACK:
+  the main loop does not wait for it.
+------------------------------------------------------------------------------*/
+static void stats_publish(MQTTClient *client)
+{
+    static uint8_t payload[STATS_PAYLOAD_SIZE];
+    int32_t len = Stats_Encode(payload, sizeof(payload));
+    MQTTMessage message;
+
+    if (len < 0) {
+        LOG_WARN("Statistics do not fit in %u bytes\n", (unsigned)sizeof(payload));
+        return;
+    }
+    message.payload = payload;
+    message.payloadlen = len;
+    message.qos = QOS1;
+    message.retained = 0;
+    if (MQTTPublishNB(client, STATS_TOPIC, &message, NULL, NULL) != MQTT_SUCCESS)
+        LOG_WARN("Statistics publish failed\n");
+}
+#endif
+
+/*------------------------------------------------------------------------------
+  settings_init() - Start from the built-in defaults, replaced by the copy
+  saved from the shell if there is one.
+------------------------------------------------------------------------------*/
+static void settings_init(void)
+{
+    strncpy(settings.Ssid, SSID, sizeof(settings.Ssid) - 1);
+    strncpy(settings.Password, PASSWORD, sizeof(settings.Password) - 1);
+    strncpy(settings.BrokerHost, MQTT_BROKER_HOST, sizeof(settings.BrokerHost) - 1);
+    settings.BrokerPort = MQTT_BROKER_PORT;
+    settings.PublishIntervalMs = PUBLISH_INTERVAL_MS;
+    settings.LogLevel = LOG_LEVEL;
+#if defined(USE_SHELL)
+    if (Settings_Load(&settings) == 0)
+        printf("Settings loaded from flash\n");
+#endif
+    Log_SetLevel(settings.LogLevel);
+}
+
+/*------------------------------------------------------------------------------
+  halt() - Stop after a start-up error. The shell keeps running so that
+  settings that may fix it can be set, saved, and the board rebooted.
+------------------------------------------------------------------------------*/
+static void halt(void)
+{
+    while (1) {
+#if defined(USE_SHELL)
+        Shell_Poll();
+#endif
+    }
+}
+
+/*------------------------------------------------------------------------------
+  work_pending() - Whether an interrupt has set a flag the main loop has not
+  handled yet. LowPower_Sleep() calls it with interrupts masked, just before
+  Stop 2, so that a flag set after the loop went past its check is not slept on.
+------------------------------------------------------------------------------*/
+static int work_pending(void)
+{
+    int pending = 0;
+
+#if defined(USE_ENV_SENSORS)
+    pending |= env_ready;
+#endif
+#if defined(USE_VIBRATION)
+    pending |= vibration_batch_ready;
+#endif
+#if defined(USE_TRACE)
+    pending |= trace_dump_requested;
+#endif
+    return pending;
+}
+
+#if defined(USE_SHELL)
+/*------------------------------------------------------------------------------
+  Shell commands. Settings used to connect apply after save and reboot; the
+  publish interval and the log level apply at once.
+------------------------------------------------------------------------------*/
+static void cmd_show(int argc, char *argv[])
+{
+    printf("ssid      %s\n", settings.Ssid);
+    printf("password  %s\n", settings.Password[0] ? "(set)" : "(none)");
+    printf("host      %s\n", settings.BrokerHost);
+    printf("port      %u\n", (unsigned)settings.BrokerPort);
+    printf("interval  %lu ms\n", (unsigned long)settings.PublishIntervalMs);
+    printf("loglevel  %u\n", (unsigned)settings.LogLevel);
+    printf("flash     %s\n", Settings_IsStored() ? "saved copy" : "none, built-in defaults");
+}
+
+static void cmd_set(int argc, char *argv[])
+{
+    const char *value = (argc > 2) ? argv[2] : "";
+    unsigned long n = strtoul(value, NULL, 10);
+
+    if (argc < 3) {
+        argc = 0;
+    } else if (strcmp(argv[1], "ssid") == 0 && strlen(value) < sizeof(settings.Ssid)) {
+        strcpy(settings.Ssid, value);
+    } else if (strcmp(argv[1], "password") == 0 && strlen(value) < sizeof(settings.Password)) {
+        strcpy(settings.Password, value);
+    } else if (strcmp(argv[1], "host") == 0 && strlen(value) < sizeof(settings.BrokerHost)) {
+        strcpy(settings.BrokerHost, value);
+    } else if (strcmp(argv[1], "port") == 0 && n > 0 && n <= 65535) {
+        settings.BrokerPort = (uint16_t)n;
+    } else if (strcmp(argv[1], "interval") == 0 && n >= 100) {
+        settings.PublishIntervalMs = n;          // from the next publish
+    } else if (strcmp(argv[1], "loglevel") == 0 && n <= LOG_LEVEL_DEBUG) {
+        settings.LogLevel = (uint8_t)n;
+        Log_SetLevel(settings.LogLevel);
+    } else {
+        argc = 0;
+    }
+    if (argc == 0)
+        printf("usage: set ssid|password|host|port|interval|loglevel <value>\n");
+}
+
+static void cmd_save(int argc, char *argv[])
+{
+    printf(Settings_Save(&settings) == 0 ? "Saved\n" : "Flash write failed\n");
+}
+
+static void cmd_erase(int argc, char *argv[])
+{
+    printf(Settings_Erase() == 0 ? "Erased, defaults apply after reboot\n" : "Flash erase failed\n");
+}
+
+static void cmd_reboot(int argc, char *argv[])
+{
+    printf("Rebooting\n");
+    while (!Log_IsIdle())
+        ;
+    NVIC_SystemReset();
+}
+
+static void cmd_stats(int argc, char *argv[])
+{
+    Log_Stats_t log;
+
+    Log_GetStats(&log);
+    printf("uptime    %lu s\n", (unsigned long)(HAL_GetTick() / 1000));
+    printf("mqtt      %s, %lu publishes, %lu failed\n",
+           (shell_client != NULL && MQTTIsConnected(shell_client)) ? "connected" : "not connected",
+           (unsigned long)publish_count, (unsigned long)publish_failures);
+    printf("log       %lu bytes, %lu dropped, %lu from interrupts, %lu skipped, %lu queued at most\n",
+           (unsigned long)log.Written, (unsigned long)log.Dropped,
+           (unsigned long)log.DroppedIsr, (unsigned long)log.Skipped, (unsigned long)log.HighWater);
+#if defined(USE_VIBRATION)
+    printf("vibration %lu samples, %lu FIFO overruns\n",
+           (unsigned long)vibration_samples, (unsigned long)vibration_overruns);
+#endif
+#if defined(USE_STATS)
+    Stats_Print();
+#endif
+}
+
+/* Back-to-back QoS 0 publishes: the AT command and SPI cost per message */
+static void cmd_bench(int argc, char *argv[])
+{
+    static char payload[MQTT_SENDBUF_SIZE - 32];   // room for the PUBLISH header and topic
+    unsigned long count = (argc > 1) ? strtoul(argv[1], NULL, 10) : BENCH_COUNT;
+    unsigned long size = (argc > 2) ? strtoul(argv[2], NULL, 10) : BENCH_SIZE;
+    unsigned long failed = 0, elapsed, i;
+    MQTTMessage message;
+    uint32_t start;
+
+    if (shell_client == NULL || !MQTTIsConnected(shell_client)) {
+        printf("Not connected to the broker\n");
+        return;
+    }
+    if (count == 0 || count > BENCH_MAX_COUNT || size > sizeof(payload)) {
+        printf("usage: bench [count <= %u] [size <= %u]\n", BENCH_MAX_COUNT, (unsigned)sizeof(payload));
+        return;
+    }
+
+    memset(payload, 'x', size);
+    message.payload = payload;
+    message.payloadlen = size;
+    message.qos = QOS0;
+    message.retained = 0;
+    start = HAL_GetTick();
+    for (i = 0; i < count; i++) {
+        if (MQTTPublish(shell_client, BENCH_TOPIC, &message) != MQTT_SUCCESS)
+            failed++;
+    }
+    elapsed = HAL_GetTick() - start;
+    if (elapsed == 0)
+        elapsed = 1;
+    printf("%lu publishes of %lu bytes in %lu ms, %lu failed: %lu msg/s, %lu bytes/s\n",
+           count, size, elapsed, failed, count * 1000 / elapsed, count * size * 1000 / elapsed);
+}
+
+static const Shell_Command_t shell_commands[] = {
+    { "show",   "                print the settings", cmd_show },
+    { "set",    "<name> <value>  ssid, password, host, port, interval (ms) or loglevel (0-4)", cmd_set },
+    { "save",   "                write the settings to flash", cmd_save },
+    { "erase",  "                erase the saved settings", cmd_erase },
+    { "reboot", "                restart, e.g. to connect with new settings", cmd_reboot },
+    { "stats",  "                print live counters", cmd_stats },
+    { "bench",  "[count] [size]  publish back to back to " BENCH_TOPIC, cmd_bench },
+};
+#endif
+
 /*------------------------------------------------------------------------------
   main() - Entry point.
 ------------------------------------------------------------------------------*/
@@ -145,6 +861,14 @@ int main(void)
     SystemClock_Config();
     BSP_LED_Init(LED2);
     BSP_TSENSOR_Init();
+    LowPower_Init();
+#if defined(USE_STATS)
+    Stats_Init();
+#endif
+#if defined(USE_TRACE)
+    Trace_Init();
+    BSP_PB_Init(BUTTON_USER, BUTTON_MODE_EXTI);   // press to dump the trace
+#endif
 
 #if defined (TERMINAL_USE)
     /* Initialize UART for debugging */
@@ -159,30 +883,100 @@ int main(void)
     hDiscoUart.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
     hDiscoUart.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
     BSP_COM_Init(COM1, &hDiscoUart);
+    Log_Init(&hDiscoUart);
     printf("****** MQTT Mosquitto Broker Demo ******\n\n");
 #endif
+    settings_init();
+#if defined(USE_SHELL)
+    Shell_Init(&hDiscoUart, shell_commands, sizeof(shell_commands) / sizeof(shell_commands[0]));
+#endif
+
+#if defined(USE_ENV_SENSORS)
+    if (BSP_ENV_Init() != ENV_OK) {
+        printf("Environmental sensor init failed\n");
+        halt();
+    }
+#endif
+
+#if defined(USE_TELEMETRY_BATCH)
+    if (BSP_HSENSOR_Init() != HSENSOR_OK || BSP_PSENSOR_Init() != PSENSOR_OK ||
+        BSP_MAGNETO_Init() != MAGNETO_OK) {
+        printf("Telemetry sensor init failed\n");
+        halt();
+    }
+    telemetry_group_init(&env_group, env_keys, 3, env_sample, ENV_SAMPLE_MS,
+                         ENV_MAX_BYTES, ENV_MAX_AGE_MS);
+    telemetry_group_init(&mag_group, mag_keys, 3, mag_sample, MAG_SAMPLE_MS,
+                         MAG_MAX_BYTES, MAG_MAX_AGE_MS);
+#endif
+
+#if defined(USE_REPORT_BY_EXCEPTION)
+    if (BSP_HSENSOR_Init() != HSENSOR_OK || BSP_PSENSOR_Init() != PSENSOR_OK) {
+        printf("Report sensor init failed\n");
+        halt();
+    }
+    /* 0.2 degC, 1 %rH and 0.05 % of the pressure, about 0.5 hPa */
+    Report_Init(&report_channels[0], TELEMETRY_TEMPERATURE, 20, 0, REPORT_MIN_MS, REPORT_MAX_MS);
+    Report_Init(&report_channels[1], TELEMETRY_HUMIDITY, 10, 0, REPORT_MIN_MS, REPORT_MAX_MS);
+    Report_Init(&report_channels[2], TELEMETRY_PRESSURE, 0, 5, REPORT_MIN_MS, REPORT_MAX_MS);
+#endif
+
+#if defined(USE_VIBRATION)
+    /* The LSM6DSL batches the samples; the MCU only wakes once per watermark */
+    if (BSP_ACCELERO_Init() != ACCELERO_OK ||
+        BSP_ACCELERO_FIFO_Init(VIBRATION_ODR, VIBRATION_WATERMARK) != ACCELERO_OK) {
+        printf("Accelerometer FIFO init failed\n");
+        halt();
+    }
+#endif
+#if defined(USE_VIBRATION_FEATURES)
+    if (Features_Init(&vibration_window, VIBRATION_RATE_HZ) != 0) {
+        printf("Unsupported FEATURES_WINDOW %d\n", FEATURES_WINDOW);
+        halt();
+    }
+#endif
 
     /* Connect to Wi-Fi */
     if (wifi_connect() != 0) {
         printf("Wi-Fi connection failed!\n");
-        while (1);
+        halt();
     }
     printf("Wi-Fi connected successfully.\n");
 
+#if defined(USE_MQTTSN)
+    mqttsn_run();
+#endif
+
     /* Resolve the MQTT broker hostname to an IP address */
     uint8_t brokerIP[4];
-    if (WIFI_GetHostAddress(MQTT_BROKER_HOST, brokerIP, sizeof(brokerIP)) != WIFI_STATUS_OK) {
-        printf("Failed to resolve broker hostname: %s\n", MQTT_BROKER_HOST);
-        while (1);
+    if (WIFI_GetHostAddress(settings.BrokerHost, brokerIP, sizeof(brokerIP)) != WIFI_STATUS_OK) {
+        printf("Failed to resolve broker hostname: %s\n", settings.BrokerHost);
+        halt();
     }
     printf("Broker IP: %d.%d.%d.%d\n", brokerIP[0], brokerIP[1], brokerIP[2], brokerIP[3]);
 
-    /* Open a TCP client connection to the MQTT broker using socket 0 */
-    if (WIFI_OpenClientConnection(0, WIFI_TCP_PROTOCOL, "MQTT", brokerIP, MQTT_BROKER_PORT, 0) != WIFI_STATUS_OK) {
-        printf("Failed to open client connection to broker\n");
-        while (1);
+#if defined(USE_MQTT_TLS)
+    /* Writing the credentials costs flash cycles on the module: do it once */
+#if defined(MQTT_TLS_PROVISION)
+    if (strncmp(tls_ca, TLS_PEM_BEGIN, strlen(TLS_PEM_BEGIN)) != 0 ||
+        strncmp(tls_cert, TLS_PEM_BEGIN, strlen(TLS_PEM_BEGIN)) != 0 ||
+        strncmp(tls_key, TLS_PEM_BEGIN, strlen(TLS_PEM_BEGIN)) != 0) {
+        printf("TLS credentials in main.c are not PEM, not stored\n");
+        halt();
+    }
+    if (WIFI_StoreTLSCredentials(MQTT_TLS_CREDSET, (const uint8_t*)tls_ca, sizeof(tls_ca) - 1,
+                                 (const uint8_t*)tls_cert, sizeof(tls_cert) - 1,
+                                 (const uint8_t*)tls_key, sizeof(tls_key) - 1) != WIFI_STATUS_OK) {
+        printf("Failed to store TLS credentials\n");
+        halt();
     }
-    printf("TCP client connection to MQTT broker established\n");
+    printf("TLS credentials stored in set %d\n", MQTT_TLS_CREDSET);
+#endif
+    if (WIFI_SelectTLSCredentials(MQTT_TLS_CREDSET) != WIFI_STATUS_OK) {
+        printf("Failed to select TLS credentials\n");
+        halt();
+    }
+#endif
 
     /* Set up the MQTT network interface */
     Network network;
@@ -194,45 +988,203 @@ int main(void)
     MQTTClient client;
     MQTTClientInit(&client, &network, 3000, mqtt_sendbuf, sizeof(mqtt_sendbuf),
                    mqtt_readbuf, sizeof(mqtt_readbuf));
+#if defined(USE_SHELL)
+    shell_client = &client;
+#endif
 
     /* Set up MQTT connection parameters */
     MQTTPacket_connectData connectData = MQTTPacket_connectData_initializer;
     connectData.MQTTVersion = 4;     // Protocol level 4 for MQTT 3.1.1
-    connectData.clientID.cstring = "B-L475E-IOT01A1_Client";
+    connectData.clientID.cstring = MQTT_CLIENT_ID;
     connectData.cleansession = 1;
     connectData.keepAliveInterval = 60;
 
-    int rc = MQTTConnect(&client, &connectData);
-    if (rc != MQTT_SUCCESS) {
-        printf("MQTT connect failed with return code %d\n", rc);
-        while (1);
+    /* Connect over socket 0; if this fails the main loop retries */
+    int rc = broker_connect(&client, brokerIP, &connectData);
+
+    /* The test topic is serialized once; each publish only adds the payload */
+    MQTTPublishHandle test_topic;
+    if (MQTTPreparePublish(&test_topic, "test/topic", QOS0, 0) != MQTT_SUCCESS) {
+        printf("Test topic longer than MQTT_PREPARED_TOPIC_MAX\n");
+        halt();
     }
-    printf("MQTT connected successfully\n");
 
-    /* Main loop: process incoming MQTT messages and maintain the connection */
+    /* Main loop: publish periodically, process incoming MQTT messages, and
+       sleep in Stop 2 until the next publish or keepalive deadline */
+    Timer publish_timer;
+    TimerInit(&publish_timer);   // expired: publish straight away
+    Timer reconnect_timer;
+    TimerCountdownMS(&reconnect_timer, RECONNECT_INTERVAL_MS);
+#if defined(STACKTRACE_PROFILE)
+    Timer profile_timer;
+    TimerCountdownMS(&profile_timer, PROFILE_INTERVAL_MS);
+#endif
+#if defined(USE_REPORT_BY_EXCEPTION)
+    Timer report_timer;
+    TimerInit(&report_timer);    // expired: first readings are reported at once
+#endif
+#if defined(USE_STATS)
+    Timer stats_timer;
+    TimerCountdownMS(&stats_timer, STATS_INTERVAL_MS);
+#endif
+
     while (1) {
-			  /* Publish a test message */
-				MQTTMessage message;
-				char payload[] = "Hello from STM32 connecting to Mosquitto!";
-				message.payload = payload;
-				message.payloadlen = strlen(payload);
-				message.qos = QOS0;
-				message.retained = 0;
-
-				rc = MQTTPublish(&client, "test/topic", &message);
-				if (rc != MQTT_SUCCESS) {
-						printf("MQTT publish failed with return code %d\n", rc);
-				} else {
-						printf("MQTT publish succeeded\n");
-				}
-				HAL_Delay(1000);
-        MQTTYield(&client, 1000);
-        // Additional application logic can be added here.
+        /* A lost connection costs a new handshake, so the socket is only
+           reopened once the client has given up on it */
+        if (!MQTTIsConnected(&client) && TimerIsExpired(&reconnect_timer)) {
+            TimerCountdownMS(&reconnect_timer, RECONNECT_INTERVAL_MS);
+            WIFI_CloseClientConnection(0);
+            broker_connect(&client, brokerIP, &connectData);
+        }
+
+        if (MQTTIsConnected(&client) && TimerIsExpired(&publish_timer)) {
+            TimerCountdownMS(&publish_timer, settings.PublishIntervalMs);
+
+            /* Publish a test message */
+            char payload[] = "Hello from STM32 connecting to Mosquitto!";
+
+            rc = MQTTPublishPrepared(&client, &test_topic, payload, strlen(payload));
+            publish_count++;
+            if (rc != MQTT_SUCCESS) {
+                publish_failures++;
+                LOG_WARN("MQTT publish failed with return code %d\n", rc);
+            } else {
+                LOG_DEBUG("MQTT publish succeeded\n");
+            }
+#if defined(USE_VIBRATION)
+            LOG_INFO("Vibration: %lu samples, %lu FIFO overruns\n",
+                     (unsigned long)vibration_samples, (unsigned long)vibration_overruns);
+#endif
+#if defined(USE_ENV_SENSORS)
+            /* Published below once both sensors have been read */
+            BSP_ENV_Read_IT(env_callback);
+#endif
+        }
+
+#if defined(USE_ENV_SENSORS)
+        if (env_ready) {
+            uint8_t env_payload[24];
+            Telemetry_Encoder_t enc;
+            MQTTMessage message;
+            int32_t len;
+
+            /* Fixed-point CBOR (telemetry.h), decoded by Common/Tools/teledecode */
+            env_ready = 0;
+            Telemetry_Begin(&enc, env_payload, sizeof(env_payload));
+            Telemetry_AddInt(&enc, TELEMETRY_UPTIME, HAL_GetTick() / 1000);
+            Telemetry_AddReading(&enc, TELEMETRY_TEMPERATURE, env_data.Temperature);
+            Telemetry_AddReading(&enc, TELEMETRY_HUMIDITY, env_data.Humidity);
+            Telemetry_AddReading(&enc, TELEMETRY_PRESSURE, env_data.Pressure);
+            len = Telemetry_End(&enc);
+            message.payload = env_payload;
+            message.payloadlen = len;
+            message.qos = QOS0;
+            message.retained = 0;
+            if (len < 0)
+                LOG_WARN("Environmental reading does not fit in %u bytes\n", (unsigned)sizeof(env_payload));
+            else if (MQTTPublish(&client, ENV_TOPIC, &message) != MQTT_SUCCESS)
+                LOG_WARN("Environmental publish failed\n");
+        }
+#endif
+
+#if defined(STACKTRACE_PROFILE)
+        if (TimerIsExpired(&profile_timer)) {
+            static char profile[MQTT_SENDBUF_SIZE - 32];   // leave room for the PUBLISH header and topic
+            MQTTMessage message;
+
+            TimerCountdownMS(&profile_timer, PROFILE_INTERVAL_MS);
+            StackTrace_printProfile(stdout);
+            message.payload = profile;
+            message.payloadlen = StackTrace_formatProfile(profile, sizeof(profile));
+            message.qos = QOS0;
+            message.retained = 0;
+            MQTTPublish(&client, PROFILE_TOPIC, &message);
+        }
+#endif
+
+#if defined(USE_VIBRATION)
+        if (vibration_batch_ready) {
+            uint8_t status = 0;
+
+            vibration_batch_ready = 0;
+            BSP_ACCELERO_FIFO_GetLevel(&status);
+            if (status & LSM6DSL_FIFO_STATUS_OVER_RUN)
+                vibration_overruns++;
+
+            /* INT1 only rises again once the FIFO is back below the watermark:
+               drain it all before publishing, which may block on the network */
+            if (!vibration_drain())
+                vibration_batch_ready = 1;   // the rest once the features are out
+#if defined(USE_VIBRATION_FEATURES)
+            vibration_publish(&client);
+#endif
+        }
+#endif
+
+#if defined(USE_REPORT_BY_EXCEPTION)
+        if (TimerIsExpired(&report_timer)) {
+            TimerCountdownMS(&report_timer, REPORT_SAMPLE_MS);
+            report_run(&client);
+        }
+#endif
+
+#if defined(USE_TELEMETRY_BATCH)
+        telemetry_group_run(&client, &env_group);
+        telemetry_group_run(&client, &mag_group);
+#endif
+
+#if defined(USE_STATS)
+        if (MQTTIsConnected(&client) && TimerIsExpired(&stats_timer)) {
+            TimerCountdownMS(&stats_timer, STATS_INTERVAL_MS);
+            stats_publish(&client);
+        }
+#endif
+
+#if defined(USE_TRACE)
+        if (trace_dump_requested) {
+            trace_dump_requested = 0;
+            Log_SetBlocking(1);   // the dump is larger than the log ring
+            Trace_Dump();
+            Log_SetBlocking(0);
+        }
+#endif
+
+#if defined(USE_SHELL)
+        Shell_Poll();
+#endif
+
+        /* Process whatever the module has received, without waiting for more */
+        MQTTClient_poll(&client);
+        // Additional application logic can be added here, with its Timer
+        // added to the deadlines below.
+
+        /* The keepalive timers only matter once a keepalive interval is set */
+        Timer* const deadlines[] = {
+            &publish_timer,
+            client.keepAliveInterval ? &client.last_sent : NULL,
+            client.keepAliveInterval ? &client.last_received : NULL,
+            MQTTIsConnected(&client) ? NULL : &reconnect_timer,
+#if defined(STACKTRACE_PROFILE)
+            &profile_timer,
+#endif
+#if defined(USE_REPORT_BY_EXCEPTION)
+            &report_timer,
+#endif
+#if defined(USE_STATS)
+            MQTTIsConnected(&client) ? &stats_timer : NULL,
+#endif
+#if defined(USE_TELEMETRY_BATCH)
+            &env_group.sample_timer, &env_group.flush_timer,
+            &mag_group.sample_timer, &mag_group.flush_timer,
+#endif
+        };
+        LowPower_Sleep(LowPower_NextDeadlineMS(deadlines, sizeof(deadlines) / sizeof(deadlines[0])), work_pending);
     }
 }
 
 /*------------------------------------------------------------------------------
-  Retarget printf to USART for debugging (if TERMINAL_USE is defined)
+  Retarget printf to USART for debugging (if TERMINAL_USE is defined). The
+  characters are queued in the log ring and sent by DMA in the background.
 ------------------------------------------------------------------------------*/
 #if defined (TERMINAL_USE)
 #ifdef __GNUC__
@@ -241,8 +1193,7 @@ int __io_putchar(int ch)
 int fputc(int ch, FILE *f)
 #endif
 {
-    HAL_UART_Transmit(&hDiscoUart, (uint8_t *)&ch, 1, 0xFFFF);
-    return ch;
+    return Log_Putc(ch);
 }
 #endif
 
@@ -256,6 +1207,21 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
         case GPIO_PIN_1:
             SPI_WIFI_ISR();
             break;
+#if defined(USE_TRACE)
+        case USER_BUTTON_PIN:
+            trace_dump_requested = 1;
+            break;
+#endif
+#if defined(USE_VIBRATION)
+        case LSM6DSL_INT1_EXTI11_PIN:
+            vibration_batch_ready = 1;
+            break;
+#endif
+#if defined(USE_SHELL)
+        case SHELL_WAKE_PIN:
+            Shell_Wake();
+            break;
+#endif
         default:
             break;
     }
@@ -266,5 +1232,6 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 ------------------------------------------------------------------------------*/
 void SPI3_IRQHandler(void)
 {
+    STATS_INC(SpiIrqs);
     HAL_SPI_IRQHandler(&hspi);
 }
@@ -21,11 +21,19 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "stm32l4xx_it.h"
+#include "Timer.h"
+#include "lowpower.h"
+#if defined(USE_SHELL)
+#include "shell.h"
+#endif
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+extern I2C_HandleTypeDef hI2cHandler;
+extern UART_HandleTypeDef hDiscoUart;
+
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
 
@@ -129,6 +137,7 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
   HAL_IncTick();
+  TimerIncTick();
 }
 
 /******************************************************************************/
@@ -155,3 +164,114 @@ void EXTI1_IRQHandler(void)
  HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_1);
 }
 
+#if defined(USE_TRACE) || defined(USE_VIBRATION)
+/**
+  * @brief  This function handles external lines 10 to 15 interrupt request
+  *         (user button, LSM6DSL INT1).
+  * @param  None
+  * @retval None
+  */
+void EXTI15_10_IRQHandler(void)
+{
+#if defined(USE_TRACE)
+  HAL_GPIO_EXTI_IRQHandler(USER_BUTTON_PIN);
+#endif
+#if defined(USE_VIBRATION)
+  HAL_GPIO_EXTI_IRQHandler(LSM6DSL_INT1_EXTI11_PIN);
+#endif
+}
+#endif
+
+/**
+  * @brief  This function handles I2C2 event interrupt (sensor bus).
+  * @param  None
+  * @retval None
+  */
+void I2C2_EV_IRQHandler(void)
+{
+  HAL_I2C_EV_IRQHandler(&hI2cHandler);
+}
+
+/**
+  * @brief  This function handles I2C2 error interrupt (sensor bus).
+  * @param  None
+  * @retval None
+  */
+void I2C2_ER_IRQHandler(void)
+{
+  HAL_I2C_ER_IRQHandler(&hI2cHandler);
+}
+
+/**
+  * @brief  This function handles DMA1 channel 4 interrupt (I2C2 TX).
+  * @param  None
+  * @retval None
+  */
+void DMA1_Channel4_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(hI2cHandler.hdmatx);
+}
+
+/**
+  * @brief  This function handles DMA1 channel 5 interrupt (I2C2 RX).
+  * @param  None
+  * @retval None
+  */
+void DMA1_Channel5_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(hI2cHandler.hdmarx);
+}
+
+/**
+  * @brief  This function handles USART1 global interrupt (console).
+  * @param  None
+  * @retval None
+  */
+void USART1_IRQHandler(void)
+{
+  HAL_UART_IRQHandler(&hDiscoUart);
+}
+
+/**
+  * @brief  This function handles DMA2 channel 6 interrupt (USART1 TX).
+  * @param  None
+  * @retval None
+  */
+void DMA2_Channel6_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(hDiscoUart.hdmatx);
+}
+
+#if defined(USE_SHELL)
+/**
+  * @brief  This function handles DMA2 channel 7 interrupt (USART1 RX).
+  * @param  None
+  * @retval None
+  */
+void DMA2_Channel7_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(hDiscoUart.hdmarx);
+}
+
+/**
+  * @brief  This function handles external lines 5 to 9 interrupt request
+  *         (USART1 RX, Stop 2 wake-up of the shell).
+  * @param  None
+  * @retval None
+  */
+void EXTI9_5_IRQHandler(void)
+{
+  HAL_GPIO_EXTI_IRQHandler(SHELL_WAKE_PIN);
+}
+#endif
+
+/**
+  * @brief  This function handles LPTIM1 global interrupt (Stop 2 wake-up timer).
+  * @param  None
+  * @retval None
+  */
+void LPTIM1_IRQHandler(void)
+{
+  HAL_LPTIM_IRQHandler(&hlptim1);
+}
+